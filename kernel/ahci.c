@@ -0,0 +1,496 @@
+#include "ahci.h"
+#include "blk.h"
+#include "pci.h"
+#include "idt.h"
+#include "lapic.h"
+#include "ports.h"
+#include "string.h"
+#include "console.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+
+/* HBA registers */
+#define AHCI_CAP_SNCQ       (1u << 30)  // Native command queuing
+#define AHCI_CAP_NCS(cap)   ((((cap) >> 8) & 0x1F) + 1)
+#define AHCI_GHC_AE         (1u << 31)  // AHCI mode
+#define AHCI_GHC_IE         (1u << 1)
+#define AHCI_CAP2_BOH       (1u << 0)   // BIOS/OS handoff supported
+#define AHCI_BOHC_BOS       (1u << 0)
+#define AHCI_BOHC_OOS       (1u << 1)
+
+/* Port registers */
+#define PXCMD_ST            (1u << 0)
+#define PXCMD_FRE           (1u << 4)
+#define PXCMD_FR            (1u << 14)
+#define PXCMD_CR            (1u << 15)
+#define PXIS_DHRS           (1u << 0)   // D2H register FIS (non-queued completion)
+#define PXIS_PSS            (1u << 1)   // PIO setup FIS
+#define PXIS_SDBS           (1u << 3)   // Set device bits FIS (NCQ completion)
+#define PXIS_IFS            (1u << 27)
+#define PXIS_HBDS           (1u << 28)
+#define PXIS_HBFS           (1u << 29)
+#define PXIS_TFES           (1u << 30)
+#define PXIS_ERRORS         (PXIS_IFS | PXIS_HBDS | PXIS_HBFS | PXIS_TFES)
+#define PXTFD_BSY           0x80
+#define PXTFD_DRQ           0x08
+#define PXSSTS_DET_PRESENT  0x3
+#define PXSSTS_IPM_ACTIVE   0x1
+#define AHCI_SIG_ATA        0x00000101
+
+/* Commands */
+#define FIS_TYPE_REG_H2D    0x27
+#define ATA_CMD_IDENTIFY    0xEC
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_DEVICE_LBA      0x40
+
+#define AHCI_CMD_FIS_DWORDS 5           // H2D register FIS length
+#define AHCI_CMD_WRITE      (1 << 6)
+#define AHCI_PRDS           ((PMM_PAGE_SIZE - 128) / 16)   // One page per command table
+#define AHCI_PHYS_LIMIT     0x08000000  // Frames above 128MB are not identity-mapped
+#define AHCI_SPIN           1000000     // Register polls before giving up
+
+typedef volatile struct {
+    uint32_t clb, clbu, fb, fbu;
+    uint32_t is, ie, cmd, rsv0;
+    uint32_t tfd, sig, ssts, sctl, serr, sact, ci, sntf, fbs;
+    uint32_t rsv1[11];
+    uint32_t vendor[4];
+} ahci_port_regs_t;
+
+typedef volatile struct {
+    uint32_t cap, ghc, is, pi, vs;
+    uint32_t ccc_ctl, ccc_ports, em_loc, em_ctl, cap2, bohc;
+    uint8_t rsv[0x100 - 0x2C];
+    ahci_port_regs_t ports[32];
+} ahci_hba_t;
+
+typedef struct {
+    uint16_t flags;             // FIS length in dwords, write bit
+    uint16_t prdtl;             // PRD entries
+    volatile uint32_t prdbc;    // Bytes transferred
+    uint32_t ctba, ctbau;
+    uint32_t rsv[4];
+} ahci_cmd_header_t;
+
+typedef struct {
+    uint32_t dba, dbau, rsv;
+    uint32_t dbc;               // Byte count - 1 (bit 0 must be set: even counts)
+} ahci_prd_t;
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t rsv[48];
+    ahci_prd_t prdt[AHCI_PRDS];
+} ahci_cmd_table_t;
+
+// A request occupies one slot until all its commands are done; a request
+// larger than one command is issued again from the same slot
+typedef struct {
+    blk_request_t *req;
+    bio_t *bio;                 // Cursor: where the next command starts
+    uint32_t bio_off;
+    uint32_t done;              // Sectors of req finished
+    uint32_t sectors;           // Size of the command in flight
+} ahci_slot_t;
+
+typedef struct {
+    uint32_t index;             // Port number on the HBA
+    ahci_port_regs_t *regs;
+    ahci_cmd_header_t *cmd_list;
+    ahci_cmd_table_t *tables[32];
+    uint32_t slots;
+    int ncq;
+    uint32_t issued;            // Slots with a command at the drive
+    ahci_slot_t slot[32];
+    blk_device_t blk;
+    char name[8];
+} ahci_port_t;
+
+static ahci_hba_t *ahci_hba = 0;
+static ahci_port_t ahci_ports[AHCI_MAX_PORTS];
+static uint32_t ahci_nports = 0;
+
+static int ahci_wait_clear(volatile uint32_t *reg, uint32_t mask) {
+    for (uint32_t i = 0; i < AHCI_SPIN; i++) {
+        if (!(*reg & mask)) return 0;
+    }
+    return -1;
+}
+
+static void ahci_delay(uint32_t us) {
+    for (uint32_t i = 0; i < us; i++) inb(0x80);
+}
+
+static void ahci_port_stop(ahci_port_regs_t *regs) {
+    regs->cmd &= ~PXCMD_ST;
+    ahci_wait_clear(&regs->cmd, PXCMD_CR);
+    regs->cmd &= ~PXCMD_FRE;
+    ahci_wait_clear(&regs->cmd, PXCMD_FR);
+}
+
+static void ahci_port_start(ahci_port_regs_t *regs) {
+    ahci_wait_clear(&regs->cmd, PXCMD_CR);
+    regs->cmd |= PXCMD_FRE;
+    regs->cmd |= PXCMD_ST;
+}
+
+static void ahci_fis(uint8_t *fis, uint8_t cmd, uint32_t lba, uint16_t count, uint16_t features) {
+    memset(fis, 0, 20);
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;              // Command, not control
+    fis[2] = cmd;
+    fis[3] = (uint8_t)features;
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[7] = ATA_DEVICE_LBA;
+    fis[8] = (uint8_t)(lba >> 24);
+    fis[11] = (uint8_t)(features >> 8);
+    fis[12] = (uint8_t)count;
+    fis[13] = (uint8_t)(count >> 8);
+}
+
+// Describe 'sectors' sectors from the slot's cursor. Physically adjacent
+// pages share an entry. Returns the entry count, -1 if unusable.
+static int ahci_build_prdt(ahci_cmd_table_t *table, ahci_slot_t *s, uint32_t sectors) {
+    bio_t *bio = s->bio;
+    uint32_t off = s->bio_off;
+    int n = 0;
+    while (sectors > 0 && bio) {
+        uint32_t take = bio->count - off;
+        if (take > sectors) take = sectors;
+        uint8_t *buffer = bio->buffer + off * 512;
+        uint32_t bytes = take * 512;
+
+        while (bytes > 0) {
+            uint32_t phys = vmm_virt_to_phys(bio->pd, buffer);
+            if (!phys || (phys & 1)) return -1; // Unmapped, or not word-aligned
+
+            uint32_t len = PMM_PAGE_SIZE - (phys & (PMM_PAGE_SIZE - 1));
+            if (len > bytes) len = bytes;
+
+            ahci_prd_t *last = n ? &table->prdt[n - 1] : 0;
+            if (last && last->dba + last->dbc + 1 == phys) {
+                last->dbc += len;
+            } else {
+                if (n == AHCI_PRDS) return -1;
+                table->prdt[n].dba = phys;
+                table->prdt[n].dbau = 0;
+                table->prdt[n].rsv = 0;
+                table->prdt[n].dbc = len - 1;
+                n++;
+            }
+            buffer += len;
+            bytes -= len;
+        }
+        sectors -= take;
+        bio = bio->next;
+        off = 0;
+    }
+    return n;
+}
+
+// Put the next command of the slot's request on the wire
+static int ahci_issue(ahci_port_t *port, uint32_t tag) {
+    ahci_slot_t *s = &port->slot[tag];
+    blk_request_t *req = s->req;
+    uint32_t lba = req->lba + s->done;
+    uint32_t n = req->count - s->done;
+    if (n > AHCI_MAX_SECTORS) n = AHCI_MAX_SECTORS;
+
+    ahci_cmd_table_t *table = port->tables[tag];
+    int prds = ahci_build_prdt(table, s, n);
+    if (prds <= 0) return -1;
+
+    if (port->ncq) {
+        // Count goes in the features field, the tag in the count field
+        ahci_fis(table->cfis, req->write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA, lba, tag << 3, n);
+    } else {
+        ahci_fis(table->cfis, req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT, lba, n, 0);
+    }
+
+    ahci_cmd_header_t *h = &port->cmd_list[tag];
+    h->flags = AHCI_CMD_FIS_DWORDS | (req->write ? AHCI_CMD_WRITE : 0);
+    h->prdtl = (uint16_t)prds;
+    h->prdbc = 0;
+    h->ctba = (uint32_t)table;
+    h->ctbau = 0;
+
+    s->sectors = n;
+    port->issued |= 1u << tag;
+    if (port->ncq) port->regs->sact = 1u << tag;
+    port->regs->ci = 1u << tag;
+    return 0;
+}
+
+static void ahci_advance(ahci_slot_t *s, uint32_t sectors) {
+    s->done += sectors;
+    while (sectors > 0 && s->bio) {
+        uint32_t take = s->bio->count - s->bio_off;
+        if (take > sectors) take = sectors;
+        s->bio_off += take;
+        sectors -= take;
+        if (s->bio_off == s->bio->count) {
+            s->bio = s->bio->next;
+            s->bio_off = 0;
+        }
+    }
+}
+
+static void ahci_finish(ahci_port_t *port, uint32_t tag, int error) {
+    blk_request_t *req = port->slot[tag].req;
+    port->slot[tag].req = 0;
+    blk_end_request(&port->blk, req, error);
+}
+
+// A failed command aborts everything queued at the drive (NCQ) and halts
+// the port: restart it, resetting the link if the drive stays busy, and
+// fail every request it had.
+static void ahci_port_recover(ahci_port_t *port) {
+    ahci_port_regs_t *regs = port->regs;
+    regs->cmd &= ~PXCMD_ST;
+    ahci_wait_clear(&regs->cmd, PXCMD_CR);
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+
+    if (regs->tfd & (PXTFD_BSY | PXTFD_DRQ)) {
+        regs->sctl = (regs->sctl & ~0xF) | 1; // COMRESET
+        ahci_delay(1000);
+        regs->sctl &= ~0xF;
+        for (uint32_t i = 0; i < AHCI_SPIN && (regs->ssts & 0xF) != PXSSTS_DET_PRESENT; i++);
+        regs->serr = 0xFFFFFFFF;
+    }
+    regs->cmd |= PXCMD_ST;
+
+    uint32_t failed = port->issued;
+    port->issued = 0;
+    for (uint32_t tag = 0; tag < port->slots; tag++) {
+        if ((failed & (1u << tag)) && port->slot[tag].req) ahci_finish(port, tag, 1);
+    }
+}
+
+// Retire whatever the drive finished: CI (and SACT under NCQ) clears
+// per slot. Runs from the interrupt and from polling waiters.
+static void ahci_port_complete(ahci_port_t *port) {
+    ahci_port_regs_t *regs = port->regs;
+    uint32_t is = regs->is;
+    regs->is = is;
+    ahci_hba->is = 1u << port->index;
+
+    if (is & PXIS_ERRORS) {
+        serial_write("[AHCI] Command failed, restarting port.\n");
+        ahci_port_recover(port);
+        return;
+    }
+
+    uint32_t busy = regs->ci | (port->ncq ? regs->sact : 0);
+    uint32_t done = port->issued & ~busy;
+    for (uint32_t tag = 0; done; tag++) {
+        uint32_t bit = 1u << tag;
+        if (!(done & bit)) continue;
+        done &= ~bit;
+        port->issued &= ~bit;
+
+        ahci_slot_t *s = &port->slot[tag];
+        ahci_advance(s, s->sectors);
+        if (s->done < s->req->count) {
+            if (ahci_issue(port, tag) != 0) ahci_finish(port, tag, 1);
+        } else {
+            ahci_finish(port, tag, 0);
+        }
+    }
+}
+
+static void ahci_irq(registers_t *regs) {
+    (void)regs;
+    if (!ahci_hba) return;
+    uint32_t pending = ahci_hba->is;
+    for (uint32_t i = 0; i < ahci_nports; i++) {
+        if (pending & (1u << ahci_ports[i].index)) ahci_port_complete(&ahci_ports[i]);
+    }
+}
+
+static void ahci_poll(blk_device_t *dev) {
+    ahci_port_complete((ahci_port_t*)dev->driver_data);
+}
+
+static int ahci_start(blk_device_t *dev, blk_request_t *req) {
+    ahci_port_t *port = (ahci_port_t*)dev->driver_data;
+    uint32_t tag = 0;
+    while (tag < port->slots && port->slot[tag].req) tag++;
+    if (tag == port->slots) return 1; // Queue depth keeps us below this
+
+    ahci_slot_t *s = &port->slot[tag];
+    s->req = req;
+    s->bio = req->bio;
+    s->bio_off = 0;
+    s->done = 0;
+    if (ahci_issue(port, tag) != 0) {
+        s->req = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// --- Setup ---
+
+static void *ahci_alloc_page(void) {
+    void *page = pmm_alloc_block();
+    if (!page) return 0;
+    if ((uint32_t)page >= AHCI_PHYS_LIMIT) {
+        pmm_free_block(page);
+        return 0;
+    }
+    memset(page, 0, PMM_PAGE_SIZE);
+    return page;
+}
+
+// IDENTIFY DEVICE on slot 0, polled (interrupts are not enabled yet)
+static int ahci_identify(ahci_port_t *port, uint16_t *id) {
+    ahci_port_regs_t *regs = port->regs;
+    ahci_cmd_table_t *table = port->tables[0];
+    ahci_fis(table->cfis, ATA_CMD_IDENTIFY, 0, 0, 0);
+    table->cfis[7] = 0;
+    table->prdt[0].dba = (uint32_t)id;
+    table->prdt[0].dbau = 0;
+    table->prdt[0].dbc = 511;
+
+    ahci_cmd_header_t *h = &port->cmd_list[0];
+    h->flags = AHCI_CMD_FIS_DWORDS;
+    h->prdtl = 1;
+    h->prdbc = 0;
+    h->ctba = (uint32_t)table;
+    h->ctbau = 0;
+
+    if (ahci_wait_clear(&regs->tfd, PXTFD_BSY | PXTFD_DRQ) != 0) return -1;
+    regs->is = 0xFFFFFFFF;
+    regs->ci = 1;
+    for (uint32_t i = 0; i < AHCI_SPIN; i++) {
+        if (regs->is & PXIS_TFES) return -1;
+        if (!(regs->ci & 1)) return 0;
+    }
+    return -1;
+}
+
+static void ahci_port_init(uint32_t index) {
+    ahci_port_regs_t *regs = &ahci_hba->ports[index];
+    uint32_t ssts = regs->ssts;
+    if ((ssts & 0xF) != PXSSTS_DET_PRESENT || ((ssts >> 8) & 0xF) != PXSSTS_IPM_ACTIVE) return;
+    if (regs->sig != AHCI_SIG_ATA) return; // ATAPI, port multiplier, ...
+
+    ahci_port_t *port = &ahci_ports[ahci_nports];
+    memset(port, 0, sizeof(ahci_port_t));
+    port->index = index;
+    port->regs = regs;
+    port->slots = AHCI_CAP_NCS(ahci_hba->cap);
+
+    // Command list (1KB) and FIS receive area (256B) share a page
+    uint8_t *base = (uint8_t*)ahci_alloc_page();
+    if (!base) return;
+    for (uint32_t i = 0; i < port->slots; i++) {
+        port->tables[i] = (ahci_cmd_table_t*)ahci_alloc_page();
+        if (!port->tables[i]) {
+            port->slots = i;
+            break;
+        }
+    }
+    if (!port->slots) return;
+
+    ahci_port_stop(regs);
+    port->cmd_list = (ahci_cmd_header_t*)base;
+    regs->clb = (uint32_t)base;
+    regs->clbu = 0;
+    regs->fb = (uint32_t)base + 1024;
+    regs->fbu = 0;
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+    regs->ie = 0;
+    ahci_port_start(regs);
+
+    uint16_t *id = (uint16_t*)ahci_alloc_page();
+    if (!id) return;
+    if (ahci_identify(port, id) != 0 || !(id[83] & (1 << 10))) {
+        pmm_free_block(id);
+        ahci_port_stop(regs);
+        serial_write("[AHCI] Drive did not identify (or lacks LBA48), skipped.\n");
+        return;
+    }
+
+    // Queue depth: word 75 holds depth - 1; word 76 bit 8 is NCQ support
+    uint32_t depth = 1;
+    if ((ahci_hba->cap & AHCI_CAP_SNCQ) && (id[76] & (1 << 8))) {
+        depth = (id[75] & 0x1F) + 1;
+        if (depth > port->slots) depth = port->slots;
+        port->ncq = depth > 1;
+    }
+
+    port->name[0] = 's'; port->name[1] = 'a'; port->name[2] = 't'; port->name[3] = 'a';
+    port->name[4] = (char)('0' + ahci_nports);
+    port->blk.name = port->name;
+    port->blk.sectors = id[100] | ((uint32_t)id[101] << 16);
+    port->blk.max_sectors = AHCI_MAX_SECTORS;
+    port->blk.max_bios = AHCI_MAX_BIOS;
+    port->blk.depth = port->ncq ? depth : 1;
+    port->blk.start = ahci_start;
+    port->blk.poll = ahci_poll;
+    port->blk.driver_data = port;
+    pmm_free_block(id);
+
+    regs->is = 0xFFFFFFFF;
+    regs->ie = PXIS_DHRS | PXIS_PSS | PXIS_SDBS | PXIS_ERRORS;
+    ahci_nports++;
+    blk_register(&port->blk);
+    serial_write(port->ncq ? "[AHCI] SATA disk online (NCQ).\n" : "[AHCI] SATA disk online.\n");
+}
+
+static int ahci_probe(pci_device_t *dev, const pci_device_id_t *id) {
+    (void)id;
+    if (ahci_hba || dev->prog_if != 0x01) return -1; // One AHCI 1.0 controller
+    pci_bar_t *abar = &dev->bars[5];
+    if ((abar->flags & PCI_BAR_IO) || !abar->base) return -1;
+
+    pci_enable_device(dev, 1);
+    ahci_hba_t *hba = (ahci_hba_t*)vmm_map_mmio(abar->base, abar->size ? abar->size : sizeof(ahci_hba_t));
+    if (!hba) return -1;
+    ahci_hba = hba;
+
+    hba->ghc |= AHCI_GHC_AE;
+    if (hba->cap2 & AHCI_CAP2_BOH) {
+        // Ask the firmware to let go of the controller
+        hba->bohc |= AHCI_BOHC_OOS;
+        ahci_wait_clear(&hba->bohc, AHCI_BOHC_BOS);
+    }
+
+    uint32_t pi = hba->pi;
+    for (uint32_t i = 0; i < 32 && ahci_nports < AHCI_MAX_PORTS; i++) {
+        if (pi & (1u << i)) ahci_port_init(i);
+    }
+
+    // MSI straight to the local APIC, else the shared INTx line
+    uint32_t address;
+    uint16_t data;
+    if (dev->msi_cap && lapic_msi_route(ahci_irq, &address, &data) == 0 &&
+        pci_enable_msi(dev, address, data) == 0) {
+        serial_write("[AHCI] Using MSI.\n");
+    } else if (dev->irq_line < 16) {
+        irq_install_handler(dev->irq_line, ahci_irq);
+    }
+    hba->is = 0xFFFFFFFF;
+    hba->ghc |= AHCI_GHC_IE;
+    return 0;
+}
+
+static const pci_device_id_t ahci_pci_ids[] = {
+    { PCI_ANY_ID, PCI_ANY_ID, PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA },
+    { 0, 0, 0, 0 }
+};
+
+static pci_driver_t ahci_pci_driver = { "ahci", ahci_pci_ids, ahci_probe, 0 };
+
+void ahci_init(void) {
+    pci_register_driver(&ahci_pci_driver);
+}
@@ -1,87 +1,508 @@
 #include "ata.h"
 #include "ports.h"
+#include "pci.h"
+#include "idt.h"
+#include "blk.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
 
-/* Primary Bus Ports (Standard) */
-#define ATA_DATA        0x1F0
-#define ATA_ERROR       0x1F1
-#define ATA_SECTOR_CNT  0x1F2
-#define ATA_LBA_LO      0x1F3
-#define ATA_LBA_MID     0x1F4
-#define ATA_LBA_HI      0x1F5
-#define ATA_DRIVE_HEAD  0x1F6
-#define ATA_COMMAND     0x1F7
-#define ATA_STATUS      0x1F7
+/* Primary channel registers, relative to the bases found by ata_pci_probe() */
+#define ATA_DATA        (ata_io + 0)
+#define ATA_ERROR       (ata_io + 1)
+#define ATA_FEATURES    (ata_io + 1)
+#define ATA_SECTOR_CNT  (ata_io + 2)
+#define ATA_LBA_LO      (ata_io + 3)
+#define ATA_LBA_MID     (ata_io + 4)
+#define ATA_LBA_HI      (ata_io + 5)
+#define ATA_DRIVE_HEAD  (ata_io + 6)
+#define ATA_COMMAND     (ata_io + 7)
+#define ATA_STATUS      (ata_io + 7)
+#define ATA_ALT_STATUS  (ata_ctl)
+#define ATA_DEV_CONTROL (ata_ctl)       // Same port, written
+#define ATA_CTRL_NIEN   0x02            // Drive interrupts off
 #define ATA_STATUS_BSY  0x80
+#define ATA_STATUS_DF   0x20
 #define ATA_STATUS_DRQ  0x08
 #define ATA_STATUS_ERR  0x01
 
-#define ATA_CMD_READ_PIO    0x20
-#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_PIO        0x20
+#define ATA_CMD_READ_PIO_EXT    0x24
+#define ATA_CMD_READ_MULT_EXT   0x29
+#define ATA_CMD_WRITE_PIO       0x30
+#define ATA_CMD_WRITE_PIO_EXT   0x34
+#define ATA_CMD_WRITE_MULT_EXT  0x39
+#define ATA_CMD_READ_MULT       0xC4
+#define ATA_CMD_WRITE_MULT      0xC5
+#define ATA_CMD_SET_MULT        0xC6
+#define ATA_CMD_IDENTIFY        0xEC
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_SET_FEATURES    0xEF
+#define ATA_FEATURE_XFER_MODE   0x03
 
-void ata_init(void) {
-    // Basic identification could go here, but usually just ready to use
-}
+/* Bus Master IDE (primary channel registers, from PCI BAR4) */
+#define BM_COMMAND          0x00
+#define BM_STATUS           0x02
+#define BM_PRDT             0x04
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08        // Device to memory
+#define BM_STATUS_ERR       0x02
+#define BM_STATUS_IRQ       0x04
+
+#define ATA_PRD_ENTRIES     (PMM_PAGE_SIZE / 8)
+#define ATA_PRD_EOT         0x8000
+#define ATA_DMA_MIN_SECTORS 8           // Below this PIO is just as fast
+#define ATA_DMA_MAX_SECTORS 2048        // 1MB per command: 256 pages plus one per bio
+#define ATA_MAX_BIOS        128         // Keeps a full command within the PRD table
+#define ATA_PIO_BURST       64          // Sectors moved per PIO step (32KB)
+
+#define ATA_LBA28_LIMIT   0x10000000   // First sector LBA28 cannot address
+
+// Legacy compatibility-mode primary channel unless PCI says otherwise
+static uint16_t ata_io = 0x1F0;
+static uint16_t ata_ctl = 0x3F6;
+static uint8_t ata_irq_line = 14;
+static pci_device_t *ata_pci = 0;  // IDE controller, if one was found
+
+// Filled in by ata_init() from IDENTIFY DEVICE
+static int ata_probed = 0;
+static int ata_lba48 = 0;          // Drive takes the *_EXT commands
+static uint32_t ata_multiple = 1;  // Sectors per DRQ block under READ/WRITE MULTIPLE
+
+// Bus-master DMA. The PRD table lives in one identity-mapped page; entries
+// may not cross a 64KB boundary and a byte count of 0 means 64KB.
+typedef struct __attribute__((packed)) {
+    uint32_t addr;
+    uint16_t bytes;
+    uint16_t flags;
+} ata_prd_t;
+
+static uint16_t ata_bm_base = 0;           // 0 = no DMA, PIO only
+static ata_prd_t *ata_prdt = 0;
+
+// The block request being worked through, one command at a time. The
+// cursor (bio + sector within it) is where the next command starts.
+static blk_request_t *ata_req = 0;
+static bio_t *ata_bio = 0;
+static uint32_t ata_bio_off = 0;
+static uint32_t ata_req_done = 0;          // Sectors of ata_req finished
+static uint32_t ata_dma_sectors = 0;       // Size of the DMA command in flight, 0 = none
+static uint32_t ata_pio_left = 0;          // Sectors of the PIO command still to move
+
+static int ata_start(blk_device_t *dev, blk_request_t *req);
+static void ata_poll(blk_device_t *dev);
+
+static blk_device_t ata_blk = {
+    .name = "ata0",
+    .max_sectors = ATA_MAX_SECTORS_28,
+    .max_bios = ATA_MAX_BIOS,
+    .depth = 1,
+    .start = ata_start,
+    .poll = ata_poll,
+};
+static int ata_present = 0;                // IDENTIFY answered, ata_blk registered
 
 static void ata_wait_bsy(void) {
     while (inb(ATA_STATUS) & ATA_STATUS_BSY);
 }
 
-static void ata_wait_drq(void) {
-    while (!(inb(ATA_STATUS) & ATA_STATUS_DRQ));
+// Status is only meaningful ~400ns after a command or drive select
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) inb(ATA_ALT_STATUS);
 }
 
-int ata_read_sector(uint32_t lba, uint8_t *buffer) {
-    ata_wait_bsy();
-    
-    // Select Drive (Master) + LBA highest 4 bits
-    outb(ATA_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_ERROR, 0); // Null byte?
-    
-    outb(ATA_SECTOR_CNT, 1);
-    outb(ATA_LBA_LO, (uint8_t)(lba));
-    outb(ATA_LBA_MID, (uint8_t)(lba >> 8));
-    outb(ATA_LBA_HI, (uint8_t)(lba >> 16));
-    
-    outb(ATA_COMMAND, ATA_CMD_READ_PIO);
-    
-    // Polling wait
+// Wait for the drive to want data; non-zero on error
+static int ata_wait_drq(void) {
     uint8_t status = inb(ATA_STATUS);
-    while ((status & ATA_STATUS_BSY) && !(status & ATA_STATUS_DRQ) && !(status & ATA_STATUS_ERR)) {
-         status = inb(ATA_STATUS);
+    while ((status & ATA_STATUS_BSY) || !(status & (ATA_STATUS_DRQ | ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        status = inb(ATA_STATUS);
+    }
+    return (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) ? 1 : 0;
+}
+
+static void ata_next_command(void);
+
+// Step the cursor past 'sectors' sectors of the current request
+static void ata_advance(uint32_t sectors) {
+    ata_req_done += sectors;
+    while (sectors > 0 && ata_bio) {
+        uint32_t take = ata_bio->count - ata_bio_off;
+        if (take > sectors) take = sectors;
+        ata_bio_off += take;
+        sectors -= take;
+        if (ata_bio_off == ata_bio->count) {
+            ata_bio = ata_bio->next;
+            ata_bio_off = 0;
+        }
+    }
+}
+
+static void ata_finish(int error) {
+    blk_request_t *req = ata_req;
+    ata_req = 0;
+    blk_end_request(&ata_blk, req, error);
+}
+
+// Finish the DMA command in flight if the controller says it is done and
+// move on to the rest of the request. Runs from the IRQ and from waiters
+// polling in case it was not delivered.
+static void ata_dma_complete(void) {
+    if (!ata_dma_sectors) return;
+    uint8_t bm = inb(ata_bm_base + BM_STATUS);
+    if (!(bm & BM_STATUS_IRQ)) return;
+
+    outb(ata_bm_base + BM_COMMAND, 0);
+    uint8_t status = inb(ATA_STATUS); // Also acknowledges the drive
+    outb(ata_bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR); // Write-1-to-clear
+
+    uint32_t sectors = ata_dma_sectors;
+    ata_dma_sectors = 0;
+    if ((bm & BM_STATUS_ERR) || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        ata_finish(1);
+        return;
     }
-    
-    // Check error
-    if (status & ATA_STATUS_ERR) return 1;
-    
-    // Read 256 words (512 bytes)
-    insw(ATA_DATA, buffer, 256);
-    
+    ata_advance(sectors);
+    ata_next_command();
+}
+
+static void ata_irq(registers_t *regs) {
+    (void)regs;
+    if (ata_bm_base) ata_dma_complete();
+    else inb(ATA_STATUS);
+}
+
+static void ata_poll(blk_device_t *dev) {
+    (void)dev;
+    if (ata_pio_left) ata_next_command();
+    else if (ata_bm_base) ata_dma_complete();
+}
+
+// Pick up the IDE controller. A primary channel in native mode (prog-if
+// bit 0) has its command/control blocks in BAR0/BAR1 and uses the PCI
+// interrupt line; otherwise the legacy ports and IRQ14 stay in effect.
+static int ata_pci_probe(pci_device_t *dev, const pci_device_id_t *id) {
+    (void)id;
+    if (ata_pci) return -1;
+    if ((dev->prog_if & 0x01) && (dev->bars[0].flags & PCI_BAR_IO) && (dev->bars[1].flags & PCI_BAR_IO)) {
+        if (!dev->bars[0].base || !dev->bars[1].base || dev->irq_line >= 16) return -1;
+        ata_io = (uint16_t)dev->bars[0].base;
+        ata_ctl = (uint16_t)(dev->bars[1].base + 2);
+        ata_irq_line = dev->irq_line;
+    }
+    ata_pci = dev;
     return 0;
 }
 
-int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+static const pci_device_id_t ata_pci_ids[] = {
+    { PCI_ANY_ID, PCI_ANY_ID, PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE },
+    { 0, 0, 0, 0 }
+};
+
+static pci_driver_t ata_pci_driver = { "ata", ata_pci_ids, ata_pci_probe, 0 };
+
+// Needs the PCI IDE controller to be a bus master (prog-if bit 7) with
+// its bus-master registers in the I/O BAR4
+static void ata_dma_init(const uint16_t *id) {
+    if (!ata_pci || !(ata_pci->prog_if & 0x80)) return;
+    pci_bar_t *bar4 = &ata_pci->bars[4];
+    if (!(bar4->flags & PCI_BAR_IO) || !bar4->base) return;
+
+    ata_prdt = (ata_prd_t*)pmm_alloc_block();
+    if (!ata_prdt || (uint32_t)ata_prdt >= 0x08000000) return; // Must be identity-mapped
+
+    pci_enable_device(ata_pci, 1);
+    ata_bm_base = (uint16_t)bar4->base;
+
+    // Fastest Ultra DMA mode the drive offers (QEMU accepts any)
+    if (id[53] & (1 << 2)) {
+        uint8_t udma = id[88] & 0xFF;
+        int mode = -1;
+        for (int m = 0; m < 8; m++) if (udma & (1 << m)) mode = m;
+        if (mode >= 0) {
+            outb(ATA_DRIVE_HEAD, 0xE0);
+            outb(ATA_FEATURES, ATA_FEATURE_XFER_MODE);
+            outb(ATA_SECTOR_CNT, 0x40 | mode);
+            outb(ATA_COMMAND, ATA_CMD_SET_FEATURES);
+            ata_delay();
+            ata_wait_bsy();
+        }
+    }
+
+    outb(ata_bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+    irq_install_handler(ata_irq_line, ata_irq);
+}
+
+void ata_init(void) {
+    if (ata_probed) return;
+    ata_probed = 1;
+    pci_register_driver(&ata_pci_driver);
+
+    outb(ATA_DEV_CONTROL, ATA_CTRL_NIEN); // Polled until DMA sets up IRQ14
+    ata_wait_bsy();
+    outb(ATA_DRIVE_HEAD, 0xA0); // Master
+    ata_delay();
+    outb(ATA_SECTOR_CNT, 0);
+    outb(ATA_LBA_LO, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HI, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+
+    if (inb(ATA_STATUS) == 0) return; // No drive: keep the single-sector defaults
+    ata_wait_bsy();
+    if (inb(ATA_LBA_MID) || inb(ATA_LBA_HI)) return; // ATAPI/SATA signature, not ours
+    if (ata_wait_drq() != 0) return;
+
+    uint16_t id[256];
+    insw(ATA_DATA, id, 256);
+
+    ata_lba48 = (id[83] & (1 << 10)) ? 1 : 0;
+
+    // Largest DRQ block the drive supports for READ/WRITE MULTIPLE
+    uint32_t max_multiple = id[47] & 0xFF;
+    if (max_multiple > 1) {
+        outb(ATA_DRIVE_HEAD, 0xE0);
+        outb(ATA_SECTOR_CNT, (uint8_t)max_multiple);
+        outb(ATA_COMMAND, ATA_CMD_SET_MULT);
+        ata_delay();
+        ata_wait_bsy();
+        if (!(inb(ATA_STATUS) & ATA_STATUS_ERR)) ata_multiple = max_multiple;
+    }
+
+    if (id[49] & (1 << 8)) ata_dma_init(id);
+
+    // Capacity: words 60-61, or 100-103 for LBA48 (we address 32 bits)
+    ata_blk.sectors = ata_lba48 ? (id[100] | ((uint32_t)id[101] << 16)) : (id[60] | ((uint32_t)id[61] << 16));
+    if (ata_lba48) ata_blk.max_sectors = ata_bm_base ? ATA_DMA_MAX_SECTORS : ATA_MAX_SECTORS_48;
+    blk_register(&ata_blk);
+    ata_present = 1;
+}
+
+// Program the task file for one command of 'count' sectors. LBA48 is used
+// only when the range or length needs it: the 28-bit form is fewer port writes.
+static int ata_issue(uint32_t lba, uint32_t count, uint8_t cmd28, uint8_t cmd48) {
+    int ext = lba + count > ATA_LBA28_LIMIT || count > ATA_MAX_SECTORS_28;
+    if (ext && !ata_lba48) return 1;
+
     ata_wait_bsy();
-    
-    outb(ATA_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_SECTOR_CNT, 1);
+    if (ext) {
+        outb(ATA_DRIVE_HEAD, 0xE0);
+        // High-order bytes first, the register FIFOs hold both halves
+        outb(ATA_SECTOR_CNT, (uint8_t)(count >> 8));
+        outb(ATA_LBA_LO, (uint8_t)(lba >> 24));
+        outb(ATA_LBA_MID, 0);
+        outb(ATA_LBA_HI, 0);
+    } else {
+        // Select Drive (Master) + LBA highest 4 bits
+        outb(ATA_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F));
+    }
+    outb(ATA_SECTOR_CNT, (uint8_t)count); // 0 = 256 (65536 with LBA48)
     outb(ATA_LBA_LO, (uint8_t)(lba));
     outb(ATA_LBA_MID, (uint8_t)(lba >> 8));
     outb(ATA_LBA_HI, (uint8_t)(lba >> 16));
-    
-    outb(ATA_COMMAND, ATA_CMD_WRITE_PIO);
-    
-    // Wait for RDY
-    uint8_t status = inb(ATA_STATUS);
-    while ((status & ATA_STATUS_BSY) && !(status & ATA_STATUS_DRQ) && !(status & ATA_STATUS_ERR)) {
-         status = inb(ATA_STATUS);
+
+    outb(ATA_COMMAND, ext ? cmd48 : cmd28);
+    ata_delay();
+    return 0;
+}
+
+// Describe the next 'sectors' sectors of the request in the PRD table.
+// Physically adjacent pages share an entry up to the next 64KB boundary.
+static int ata_dma_build(uint32_t sectors) {
+    bio_t *bio = ata_bio;
+    uint32_t off = ata_bio_off;
+    uint32_t n = 0;
+    uint32_t run = 0; // Bytes in entry n-1
+    while (sectors > 0 && bio) {
+        uint32_t take = bio->count - off;
+        if (take > sectors) take = sectors;
+        uint8_t *buffer = bio->buffer + off * 512;
+        uint32_t bytes = take * 512;
+
+        while (bytes > 0) {
+            uint32_t phys = vmm_virt_to_phys(bio->pd, buffer);
+            if (!phys || (phys & 1)) return -1; // Unmapped, or not word-aligned
+
+            uint32_t len = PMM_PAGE_SIZE - (phys & (PMM_PAGE_SIZE - 1));
+            if (len > bytes) len = bytes;
+
+            if (n && ata_prdt[n - 1].addr + run == phys && (phys & 0xFFFF) != 0) {
+                run += len;
+            } else {
+                if (n == ATA_PRD_ENTRIES) return -1;
+                ata_prdt[n].addr = phys;
+                ata_prdt[n].flags = 0;
+                n++;
+                run = len;
+            }
+            ata_prdt[n - 1].bytes = (uint16_t)run; // 64KB wraps to 0 as intended
+
+            buffer += len;
+            bytes -= len;
+        }
+        sectors -= take;
+        bio = bio->next;
+        off = 0;
+    }
+    if (!n) return -1;
+    ata_prdt[n - 1].flags = ATA_PRD_EOT;
+    return 0;
+}
+
+// Start one DMA command; 1 if the buffers cannot be used (caller falls
+// back to PIO), otherwise completion arrives through ata_dma_complete()
+static int ata_dma_start(uint32_t lba, uint32_t count, int write) {
+    if (ata_dma_build(count) != 0) return 1;
+
+    outb(ata_bm_base + BM_COMMAND, 0);
+    outl(ata_bm_base + BM_PRDT, (uint32_t)ata_prdt);
+    outb(ata_bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+    outb(ATA_DEV_CONTROL, 0); // Completion comes in on the IRQ
+
+    int ret = write ? ata_issue(lba, count, ATA_CMD_WRITE_DMA, ATA_CMD_WRITE_DMA_EXT)
+                    : ata_issue(lba, count, ATA_CMD_READ_DMA, ATA_CMD_READ_DMA_EXT);
+    if (ret != 0) {
+        ata_finish(1);
+        return 0;
+    }
+    ata_dma_sectors = count;
+    outb(ata_bm_base + BM_COMMAND, BM_CMD_START | (write ? 0 : BM_CMD_READ));
+    return 0;
+}
+
+// Move one sector between the data port and the cursor's bio. Buffers
+// that are not contiguous in this address space bounce through the stack.
+static void ata_pio_sector(bio_t *bio, uint32_t off, int write) {
+    uint8_t *p = blk_bio_map(bio, off * 512, 512);
+    if (p) {
+        if (write) outsw(ATA_DATA, p, 256);
+        else insw(ATA_DATA, p, 256);
+        return;
+    }
+    uint8_t bounce[512];
+    if (write) {
+        blk_bio_copy(bio, off * 512, bounce, 512, 0);
+        outsw(ATA_DATA, bounce, 256);
+    } else {
+        insw(ATA_DATA, bounce, 256);
+        blk_bio_copy(bio, off * 512, bounce, 512, 1);
+    }
+}
+
+// PIO: each DRQ block is one status poll. A command is moved
+// ATA_PIO_BURST sectors at a time; the rest continues from ata_poll(), so
+// waiters get to let interrupts in between bursts.
+static int ata_pio_issue(uint32_t lba, uint32_t count, int write) {
+    outb(ATA_DEV_CONTROL, ATA_CTRL_NIEN); // Polled, keep the IRQ quiet
+
+    uint8_t cmd28, cmd48;
+    if (ata_multiple > 1) {
+        cmd28 = write ? ATA_CMD_WRITE_MULT : ATA_CMD_READ_MULT;
+        cmd48 = write ? ATA_CMD_WRITE_MULT_EXT : ATA_CMD_READ_MULT_EXT;
+    } else {
+        cmd28 = write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO;
+        cmd48 = write ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_READ_PIO_EXT;
     }
-    
-    if (status & ATA_STATUS_ERR) return 1;
-    
-    outsw(ATA_DATA, buffer, 256);
-    
+    if (ata_issue(lba, count, cmd28, cmd48) != 0) return 1;
+    ata_pio_left = count;
+    ata_blk.polled = 1;
+    return 0;
+}
+
+// Move up to a burst of the PIO command in flight. Non-zero on error.
+static int ata_pio_step(void) {
+    int write = ata_req->write;
+    uint32_t budget = ATA_PIO_BURST;
+    while (ata_pio_left > 0 && budget > 0) {
+        uint32_t block = ata_pio_left < ata_multiple ? ata_pio_left : ata_multiple;
+        if (ata_wait_drq() != 0) return 1;
+        for (uint32_t i = 0; i < block; i++) {
+            ata_pio_sector(ata_bio, ata_bio_off, write);
+            ata_advance(1);
+        }
+        ata_pio_left -= block;
+        budget = budget > block ? budget - block : 0;
+    }
+    if (ata_pio_left > 0) return 0;
+
+    ata_blk.polled = 0;
     // Flush / Sync wait
-    ata_wait_bsy();
-    
+    if (write) {
+        ata_wait_bsy();
+        if (inb(ATA_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) return 1;
+    }
     return 0;
 }
+
+// Issue the next command of the current request, or finish it. Large
+// requests go by DMA and continue from the IRQ; PIO continues from polls.
+static void ata_next_command(void) {
+    while (ata_req) {
+        if (ata_pio_left == 0) {
+            uint32_t lba = ata_req->lba + ata_req_done;
+            uint32_t left = ata_req->count - ata_req_done;
+            if (left == 0) {
+                ata_finish(0);
+                return;
+            }
+
+            if (ata_bm_base && ata_req->count >= ATA_DMA_MIN_SECTORS) {
+                uint32_t n = left < ATA_DMA_MAX_SECTORS ? left : ATA_DMA_MAX_SECTORS;
+                if (!ata_lba48 && n > ATA_MAX_SECTORS_28) n = ATA_MAX_SECTORS_28;
+                if (ata_dma_start(lba, n, ata_req->write) == 0) return;
+            }
+
+            uint32_t per_cmd = ata_lba48 ? ATA_MAX_SECTORS_48 : ATA_MAX_SECTORS_28;
+            uint32_t n = left < per_cmd ? left : per_cmd;
+            if (ata_pio_issue(lba, n, ata_req->write) != 0) {
+                ata_finish(1);
+                return;
+            }
+        }
+        if (ata_pio_step() != 0) {
+            ata_pio_left = 0;
+            ata_blk.polled = 0;
+            ata_finish(1);
+            return;
+        }
+        if (ata_pio_left > 0) return; // Next burst from ata_poll()
+    }
+}
+
+static int ata_start(blk_device_t *dev, blk_request_t *req) {
+    (void)dev;
+    if (ata_req) return 1; // depth is 1; cannot happen
+    ata_req = req;
+    ata_bio = req->bio;
+    ata_bio_off = 0;
+    ata_req_done = 0;
+    ata_next_command();
+    return 0;
+}
+
+// The calls below go through the block queue like everyone else's I/O.
+// The single-sector ones poll instead of sleeping: the buffer cache calls
+// them with its lock held.
+static int ata_transfer(uint32_t lba, uint32_t count, uint8_t *buffer, int write, int can_sleep) {
+    if (!ata_probed) ata_init();
+    if (!ata_present) return 1;
+    return blk_rw(&ata_blk, lba, count, buffer, write, can_sleep);
+}
+
+int ata_read_sectors(uint32_t lba, uint32_t count, uint8_t *buffer) {
+    return ata_transfer(lba, count, buffer, 0, 1);
+}
+
+int ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    return ata_transfer(lba, count, (uint8_t*)buffer, 1, 1);
+}
+
+int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+    return ata_transfer(lba, 1, buffer, 0, 0);
+}
+
+int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+    return ata_transfer(lba, 1, (uint8_t*)buffer, 1, 0);
+}
@@ -0,0 +1,412 @@
+#include "bcache.h"
+#include "blk.h"
+#include "memory.h"
+#include "string.h"
+#include "spinlock.h"
+#include "process.h"
+#include "pit.h"
+
+#define BCACHE_NO_LBA 0xFFFFFFFF
+
+// Single-sector disk I/O (fills, evictions) happens under the lock and
+// polls the block queue rather than sleeping. Spans and write-back batches
+// drop the lock around the disk and sleep until their bios complete.
+static buffer_head_t *buffers = NULL;
+static buffer_head_t *buckets[BCACHE_BUCKETS];
+static buffer_head_t *lru_head = NULL;   // Most recently used
+static buffer_head_t *lru_tail = NULL;
+static uint32_t dirty_count = 0;
+static lock_t bcache_lock;
+static int bcache_ready = 0;
+static uint32_t writeout_gen = 0;        // Bumped by every write to disk
+static blk_device_t *bcache_dev = NULL;
+
+typedef struct {
+    bio_t bios[BCACHE_BATCH];
+    buffer_head_t *bh[BCACHE_BATCH];
+    uint32_t seq[BCACHE_BATCH];
+} bcache_batch_t;
+
+// --- Disk ---
+
+static blk_device_t *bcache_disk(void) {
+    if (!bcache_dev) bcache_dev = blk_default();
+    return bcache_dev;
+}
+
+static int disk_rw(uint32_t lba, uint32_t count, uint8_t *buffer, int write, int can_sleep) {
+    return blk_rw(bcache_disk(), lba, count, buffer, write, can_sleep);
+}
+
+// Submit n prepared bios with the queue plugged, so neighbours merge and
+// go out in LBA order; then wait for all. Non-zero if any failed.
+static int disk_batch(bio_t *bios, uint32_t n) {
+    blk_device_t *dev = bcache_disk();
+    if (!dev) return -1;
+    blk_plug(dev);
+    for (uint32_t i = 0; i < n; i++) blk_submit(dev, &bios[i]);
+    blk_unplug(dev);
+
+    int ret = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (blk_wait(dev, &bios[i], 1) != 0) ret = -1;
+    }
+    return ret;
+}
+
+// --- Lists ---
+
+static void lru_unlink(buffer_head_t *bh) {
+    if (bh->lru_prev) bh->lru_prev->lru_next = bh->lru_next;
+    else lru_head = bh->lru_next;
+    if (bh->lru_next) bh->lru_next->lru_prev = bh->lru_prev;
+    else lru_tail = bh->lru_prev;
+    bh->lru_prev = bh->lru_next = NULL;
+}
+
+static void lru_push_front(buffer_head_t *bh) {
+    bh->lru_prev = NULL;
+    bh->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = bh;
+    lru_head = bh;
+    if (!lru_tail) lru_tail = bh;
+}
+
+static void hash_unlink(buffer_head_t *bh) {
+    buffer_head_t **link = &buckets[bh->lba % BCACHE_BUCKETS];
+    while (*link) {
+        if (*link == bh) {
+            *link = bh->hnext;
+            break;
+        }
+        link = &(*link)->hnext;
+    }
+    bh->hnext = NULL;
+    bh->lba = BCACHE_NO_LBA;
+    bh->valid = 0;
+}
+
+static buffer_head_t *bcache_find(uint32_t lba) {
+    buffer_head_t *bh = buckets[lba % BCACHE_BUCKETS];
+    while (bh && bh->lba != lba) bh = bh->hnext;
+    return bh;
+}
+
+void bcache_init(void) {
+    if (bcache_ready) return;
+
+    spinlock_init(bcache_lock);
+    buffers = (buffer_head_t*)memory_alloc(sizeof(buffer_head_t) * BCACHE_BUFFERS);
+    uint8_t *pool = (uint8_t*)memory_alloc(BCACHE_SECTOR_SIZE * BCACHE_BUFFERS);
+    if (!buffers || !pool) return; // Everything falls through to the disk
+
+    memset(buckets, 0, sizeof(buckets));
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        buffers[i].lba = BCACHE_NO_LBA;
+        buffers[i].data = pool + i * BCACHE_SECTOR_SIZE;
+        lru_push_front(&buffers[i]);
+    }
+    bcache_ready = 1;
+}
+
+// --- Core (lock held) ---
+
+static int bcache_writeout(buffer_head_t *bh) {
+    if (disk_rw(bh->lba, 1, bh->data, 1, 0) != 0) return -1;
+    writeout_gen++;
+    bh->dirty = 0;
+    dirty_count--;
+    return 0;
+}
+
+static void bcache_set_dirty(buffer_head_t *bh) {
+    bh->seq++;
+    if (bh->dirty) return;
+    bh->dirty = 1;
+    bh->dirty_tick = pit_get_ticks();
+    dirty_count++;
+}
+
+// Find or claim the buffer for 'lba'. With fill set, the sector is read in
+// when not already valid. NULL when every buffer is pinned or on I/O error.
+static buffer_head_t *bcache_getblk(uint32_t lba, int fill) {
+    buffer_head_t *bh = bcache_find(lba);
+    if (!bh) {
+        // Coldest unpinned buffer
+        bh = lru_tail;
+        while (bh && bh->refcount) bh = bh->lru_prev;
+        if (!bh) return NULL;
+        if (bh->dirty && bcache_writeout(bh) != 0) return NULL; // Keep the data rather than lose it
+        if (bh->lba != BCACHE_NO_LBA) hash_unlink(bh);
+
+        bh->lba = lba;
+        bh->hnext = buckets[lba % BCACHE_BUCKETS];
+        buckets[lba % BCACHE_BUCKETS] = bh;
+    }
+    lru_unlink(bh);
+    lru_push_front(bh);
+
+    if (fill && !bh->valid) {
+        if (disk_rw(lba, 1, bh->data, 0, 0) != 0) {
+            hash_unlink(bh);
+            return NULL;
+        }
+        bh->valid = 1;
+    }
+    return bh;
+}
+
+// --- Public API ---
+
+buffer_head_t *bcache_get(uint32_t lba) {
+    if (!bcache_ready) bcache_init();
+    if (!bcache_ready) return NULL;
+
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    buffer_head_t *bh = bcache_getblk(lba, 1);
+    if (bh) bh->refcount++;
+    spinlock_release_irqrestore(&bcache_lock, flags);
+    return bh;
+}
+
+void bcache_put(buffer_head_t *bh) {
+    if (!bh) return;
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    if (bh->refcount) bh->refcount--;
+    spinlock_release_irqrestore(&bcache_lock, flags);
+}
+
+void bcache_mark_dirty(buffer_head_t *bh) {
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    bcache_set_dirty(bh);
+    spinlock_release_irqrestore(&bcache_lock, flags);
+}
+
+int bcache_read(uint32_t lba, uint8_t *buffer) {
+    if (!bcache_ready) bcache_init();
+    if (!bcache_ready) return disk_rw(lba, 1, buffer, 0, 1);
+
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    int ret = 0;
+    buffer_head_t *bh = bcache_getblk(lba, 1);
+    if (bh) memcpy(buffer, bh->data, BCACHE_SECTOR_SIZE);
+    else ret = disk_rw(lba, 1, buffer, 0, 0);
+    spinlock_release_irqrestore(&bcache_lock, flags);
+    return ret;
+}
+
+int bcache_write(uint32_t lba, const uint8_t *buffer) {
+    if (!bcache_ready) bcache_init();
+    if (!bcache_ready) return disk_rw(lba, 1, (uint8_t*)buffer, 1, 1);
+
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    int ret = 0;
+    buffer_head_t *bh = bcache_getblk(lba, 0); // Whole sector is overwritten, no read needed
+    if (bh) {
+        memcpy(bh->data, buffer, BCACHE_SECTOR_SIZE);
+        bh->valid = 1;
+        bcache_set_dirty(bh);
+    } else {
+        ret = disk_rw(lba, 1, (uint8_t*)buffer, 1, 0);
+    }
+    spinlock_release_irqrestore(&bcache_lock, flags);
+    return ret;
+}
+
+// Span transfers do their disk I/O without the lock so the ATA driver can
+// sleep on a DMA completion. Cached copies are never older than the disk,
+// so they are laid over what a read brings in; a writeout that races the
+// read (its sector may be evicted before we look) makes us read again.
+
+static uint32_t bcache_count_cached(uint32_t lba, uint32_t count) {
+    uint32_t cached = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        buffer_head_t *bh = bcache_find(lba + i);
+        if (bh && bh->valid) cached++;
+    }
+    return cached;
+}
+
+static void bcache_overlay(uint32_t lba, uint32_t count, uint8_t *buffer) {
+    for (uint32_t i = 0; i < count; i++) {
+        buffer_head_t *bh = bcache_find(lba + i);
+        if (bh && bh->valid) memcpy(buffer + i * BCACHE_SECTOR_SIZE, bh->data, BCACHE_SECTOR_SIZE);
+    }
+}
+
+static int bcache_all_cached(const bcache_span_t *spans, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (bcache_count_cached(spans[i].lba, spans[i].count) != spans[i].count) return 0;
+    }
+    return 1;
+}
+
+int bcache_read_spans(const bcache_span_t *spans, uint32_t n) {
+    if (n > BCACHE_BATCH) {
+        if (bcache_read_spans(spans, BCACHE_BATCH) != 0) return -1;
+        return bcache_read_spans(spans + BCACHE_BATCH, n - BCACHE_BATCH);
+    }
+    bcache_batch_t *batch = (bcache_batch_t*)memory_alloc(sizeof(bcache_batch_t));
+    if (!batch) return -1;
+
+    int ret = 0;
+    while (1) {
+        uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+        uint32_t gen = writeout_gen;
+        if (bcache_ready && bcache_all_cached(spans, n)) {
+            for (uint32_t i = 0; i < n; i++) bcache_overlay(spans[i].lba, spans[i].count, spans[i].buffer);
+            spinlock_release_irqrestore(&bcache_lock, flags);
+            break;
+        }
+        spinlock_release_irqrestore(&bcache_lock, flags);
+
+        memset(batch->bios, 0, sizeof(batch->bios));
+        for (uint32_t i = 0; i < n; i++) {
+            batch->bios[i].lba = spans[i].lba;
+            batch->bios[i].count = spans[i].count;
+            batch->bios[i].buffer = spans[i].buffer;
+        }
+        if (disk_batch(batch->bios, n) != 0) {
+            ret = -1;
+            break;
+        }
+
+        flags = spinlock_acquire_irqsave(&bcache_lock);
+        int raced = writeout_gen != gen;
+        if (!raced && bcache_ready) {
+            for (uint32_t i = 0; i < n; i++) bcache_overlay(spans[i].lba, spans[i].count, spans[i].buffer);
+        }
+        spinlock_release_irqrestore(&bcache_lock, flags);
+        if (!raced) break;
+    }
+    memory_free(batch);
+    return ret;
+}
+
+int bcache_read_span(uint32_t lba, uint32_t count, uint8_t *buffer) {
+    bcache_span_t span = { lba, count, buffer };
+    return bcache_read_spans(&span, 1);
+}
+
+// Cached copies take the new data first (and stay dirty, so eviction
+// cannot drop it before the disk has it); they are marked clean once the
+// write lands, unless someone changed them meanwhile or an older
+// write-back of theirs is still queued (it may land after ours).
+int bcache_write_span(uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    if (!bcache_ready) return disk_rw(lba, count, (uint8_t*)buffer, 1, 1);
+
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        buffer_head_t *bh = bcache_find(lba + i);
+        if (!bh) continue;
+        memcpy(bh->data, buffer + i * BCACHE_SECTOR_SIZE, BCACHE_SECTOR_SIZE);
+        bh->valid = 1;
+        bcache_set_dirty(bh);
+    }
+    spinlock_release_irqrestore(&bcache_lock, flags);
+
+    int ret = disk_rw(lba, count, (uint8_t*)buffer, 1, 1);
+
+    flags = spinlock_acquire_irqsave(&bcache_lock);
+    if (ret == 0) writeout_gen++;
+    for (uint32_t i = 0; ret == 0 && i < count; i++) {
+        buffer_head_t *bh = bcache_find(lba + i);
+        if (bh && bh->dirty && !bh->writeback && memcmp(bh->data, buffer + i * BCACHE_SECTOR_SIZE, BCACHE_SECTOR_SIZE) == 0) {
+            bh->dirty = 0;
+            dirty_count--;
+        }
+    }
+    spinlock_release_irqrestore(&bcache_lock, flags);
+    return ret;
+}
+
+int bcache_read_bypass(uint32_t lba, uint8_t *buffer) {
+    return bcache_read_span(lba, 1, buffer);
+}
+
+int bcache_write_bypass(uint32_t lba, const uint8_t *buffer) {
+    return bcache_write_span(lba, 1, buffer);
+}
+
+// Write back dirty buffers at least 'age' ticks old, scanning from
+// *next. Up to BCACHE_BATCH of them go to the disk together; they stay
+// pinned meanwhile and are only marked clean if nobody touched them since.
+// A sync (age 0) also takes buffers already being written: the bio points
+// at the buffer itself, so whichever write lands last carries the newest
+// data. Returns the number of failed writes.
+static int bcache_writeback(uint32_t age, uint32_t *next) {
+    bcache_batch_t *batch = (bcache_batch_t*)memory_alloc(sizeof(bcache_batch_t));
+    if (!batch) {
+        *next = BCACHE_BUFFERS;
+        return 1;
+    }
+
+    uint32_t n = 0;
+    uint32_t now = pit_get_ticks();
+    uint32_t flags = spinlock_acquire_irqsave(&bcache_lock);
+    for (; *next < BCACHE_BUFFERS && n < BCACHE_BATCH; (*next)++) {
+        buffer_head_t *bh = &buffers[*next];
+        if (!bh->dirty || (age && bh->writeback) || (now - bh->dirty_tick) < age) continue;
+        bh->refcount++;
+        bh->writeback++;
+        batch->bh[n] = bh;
+        batch->seq[n] = bh->seq;
+        bio_t *bio = &batch->bios[n];
+        memset(bio, 0, sizeof(bio_t));
+        bio->lba = bh->lba;
+        bio->count = 1;
+        bio->buffer = bh->data;
+        bio->write = 1;
+        n++;
+    }
+    spinlock_release_irqrestore(&bcache_lock, flags);
+
+    int failed = 0;
+    if (n) {
+        disk_batch(batch->bios, n);
+
+        flags = spinlock_acquire_irqsave(&bcache_lock);
+        writeout_gen++;
+        for (uint32_t i = 0; i < n; i++) {
+            buffer_head_t *bh = batch->bh[i];
+            bh->refcount--;
+            bh->writeback--;
+            if (batch->bios[i].error) failed++;
+            else if (bh->dirty && bh->seq == batch->seq[i]) {
+                bh->dirty = 0;
+                dirty_count--;
+            }
+        }
+        spinlock_release_irqrestore(&bcache_lock, flags);
+    }
+    memory_free(batch);
+    return failed;
+}
+
+int bcache_sync(void) {
+    if (!bcache_ready) return 0;
+
+    int failed = 0;
+    uint32_t next = 0;
+    while (next < BCACHE_BUFFERS) failed += bcache_writeback(0, &next);
+    return failed;
+}
+
+// --- Write-back thread ---
+
+static void bcache_flusher(void) {
+    uint32_t age = pit_ms_to_ticks(BCACHE_DIRTY_AGE_MS);
+    while (1) {
+        process_block(pit_get_ticks() + pit_ms_to_ticks(BCACHE_FLUSH_MS));
+        if (!bcache_ready || dirty_count == 0) continue;
+
+        // Batch by batch, so readers are not stalled behind a long flush
+        uint32_t next = 0;
+        while (next < BCACHE_BUFFERS) bcache_writeback(age, &next);
+    }
+}
+
+void bcache_start_flusher(void) {
+    bcache_init();
+    process_create("bflush", bcache_flusher);
+}
@@ -0,0 +1,311 @@
+#include "blk.h"
+#include "process.h"
+#include "pit.h"
+#include "string.h"
+
+#define BLK_PHYS_LIMIT 0x08000000   // Frames above 128MB are not identity-mapped
+
+// Everything here runs with IRQs off: drivers complete from their IRQ
+// handler, which is the only other party touching a queue.
+static blk_request_t blk_pool[BLK_REQUESTS];
+static blk_request_t *blk_free = 0;
+static int blk_ready = 0;
+static blk_device_t *blk_devices = 0;
+
+extern process_t *current_process;
+
+static void blk_init(void) {
+    if (blk_ready) return;
+    blk_ready = 1;
+    for (int i = 0; i < BLK_REQUESTS; i++) {
+        blk_pool[i].next = blk_free;
+        blk_free = &blk_pool[i];
+    }
+}
+
+static void blk_free_request(blk_request_t *req) {
+    req->next = blk_free;
+    blk_free = req;
+}
+
+// --- Devices ---
+
+void blk_register(blk_device_t *dev) {
+    uint32_t flags = wait_irq_save();
+    blk_init();
+    dev->queue = 0;
+    dev->inflight = 0;
+    dev->position = 0;
+    dev->plugged = 0;
+    dev->dispatching = 0;
+    if (!dev->depth) dev->depth = 1;
+    if (!dev->max_bios) dev->max_bios = 1;
+    if (!dev->max_sectors) dev->max_sectors = 1;
+    wait_queue_init(&dev->wait);
+
+    // Registration order decides blk_default()
+    dev->next = 0;
+    blk_device_t **link = &blk_devices;
+    while (*link) link = &(*link)->next;
+    *link = dev;
+    wait_irq_restore(flags);
+}
+
+blk_device_t *blk_get(const char *name) {
+    for (blk_device_t *dev = blk_devices; dev; dev = dev->next) {
+        if (strcmp(dev->name, name) == 0) return dev;
+    }
+    return 0;
+}
+
+blk_device_t *blk_default(void) {
+    return blk_devices;
+}
+
+// --- Elevator ---
+
+// C-LOOK: the lowest LBA at or past the last dispatch, else wrap to the
+// lowest. A request past its deadline goes first, oldest first.
+static blk_request_t *blk_pick(blk_device_t *dev) {
+    uint32_t now = pit_get_ticks();
+    blk_request_t *expired = 0;
+    blk_request_t *ahead = 0;
+    for (blk_request_t *r = dev->queue; r; r = r->next) {
+        if ((int32_t)(now - r->deadline) >= 0 &&
+            (!expired || (int32_t)(r->deadline - expired->deadline) < 0)) expired = r;
+        if (!ahead && r->lba >= dev->position) ahead = r;
+    }
+    if (expired) return expired;
+    return ahead ? ahead : dev->queue;
+}
+
+static void blk_unlink(blk_device_t *dev, blk_request_t *req) {
+    blk_request_t **link = &dev->queue;
+    while (*link && *link != req) link = &(*link)->next;
+    if (*link) *link = req->next;
+    req->next = 0;
+}
+
+// Feed the driver while it has room. 'force' ignores a plug (someone is
+// waiting on a queued bio, or the request pool ran dry).
+static void blk_run(blk_device_t *dev, int force) {
+    if (dev->dispatching) return; // start() completing inline lands back here
+    dev->dispatching = 1;
+    int started = 0;
+    while ((force || !dev->plugged) && dev->queue && dev->inflight < dev->depth) {
+        blk_request_t *req = blk_pick(dev);
+        blk_unlink(dev, req);
+        dev->position = req->lba + req->count;
+        dev->inflight++;
+        if (dev->start(dev, req) != 0) blk_end_request(dev, req, 1);
+        else started = 1;
+    }
+    if (started && dev->commit) dev->commit(dev);
+    dev->dispatching = 0;
+}
+
+// Can requests 'a' then 'b' (adjacent, a first) become one?
+static int blk_can_join(blk_device_t *dev, blk_request_t *a, blk_request_t *b) {
+    return a->write == b->write && a->lba + a->count == b->lba &&
+           a->count + b->count <= dev->max_sectors && a->nbio + b->nbio <= dev->max_bios;
+}
+
+static void blk_join(blk_request_t *a, blk_request_t *b) {
+    a->bio_tail->next = b->bio;
+    a->bio_tail = b->bio_tail;
+    a->count += b->count;
+    a->nbio += b->nbio;
+    if ((int32_t)(b->deadline - a->deadline) < 0) a->deadline = b->deadline;
+    a->next = b->next;
+    blk_free_request(b);
+}
+
+// Add the bio to a queued request it extends; 0 if none fits
+static int blk_merge(blk_device_t *dev, bio_t *bio) {
+    blk_request_t *prev = 0;
+    for (blk_request_t *r = dev->queue; r; prev = r, r = r->next) {
+        if (r->write != bio->write || r->nbio >= dev->max_bios || r->count + bio->count > dev->max_sectors) continue;
+
+        if (r->lba + r->count == bio->lba) {
+            r->bio_tail->next = bio;
+            r->bio_tail = bio;
+            r->count += bio->count;
+            r->nbio++;
+            if (r->next && blk_can_join(dev, r, r->next)) blk_join(r, r->next); // Gap closed
+            return 1;
+        }
+        if (bio->lba + bio->count == r->lba) {
+            bio->next = r->bio;
+            r->bio = bio;
+            r->lba = bio->lba;
+            r->count += bio->count;
+            r->nbio++;
+            if (prev && blk_can_join(dev, prev, r)) blk_join(prev, r);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void blk_insert(blk_device_t *dev, blk_request_t *req) {
+    // After any request with the same LBA, so those keep their order
+    blk_request_t **link = &dev->queue;
+    while (*link && (*link)->lba <= req->lba) link = &(*link)->next;
+    req->next = *link;
+    *link = req;
+}
+
+static void blk_poll_all(void) {
+    for (blk_device_t *dev = blk_devices; dev; dev = dev->next) {
+        blk_run(dev, 1);
+        if (dev->poll) dev->poll(dev);
+    }
+}
+
+// --- Submission ---
+
+// Fault user buffers in before the device sees them: demand-paged memory
+// may not be present yet, and a read must not land in a copy-on-write
+// frame someone else still shares.
+static void blk_prefault(bio_t *bio) {
+    uint8_t *p = bio->buffer;
+    uint32_t len = bio->count * BLK_SECTOR_SIZE;
+    if (len == 0 || (uint32_t)p + len <= BLK_PHYS_LIMIT) return;
+
+    uint32_t first = (uint32_t)p & ~(PAGE_SIZE - 1);
+    for (uint32_t page = first; page - first < (uint32_t)p + len - first; page += PAGE_SIZE) {
+        volatile uint8_t *b = (uint8_t*)(page < (uint32_t)p ? (uint32_t)p : page);
+        if (bio->write) (void)*b;
+        else *b = *b;
+    }
+}
+
+void blk_submit(blk_device_t *dev, bio_t *bio) {
+    blk_prefault(bio);
+    uint32_t flags = wait_irq_save();
+    blk_init();
+    bio->pd = vmm_current_directory();
+    bio->done = 0;
+    bio->error = 0;
+    bio->next = 0;
+
+    if (bio->count == 0) {
+        bio->done = 1;
+        if (bio->end_io) bio->end_io(bio);
+        wait_irq_restore(flags);
+        return;
+    }
+
+    if (!blk_merge(dev, bio)) {
+        while (!blk_free) blk_poll_all(); // Every request is queued or in flight
+        blk_request_t *req = blk_free;
+        blk_free = req->next;
+
+        req->lba = bio->lba;
+        req->count = bio->count;
+        req->nbio = 1;
+        req->write = bio->write;
+        req->deadline = pit_get_ticks() + pit_ms_to_ticks(bio->write ? BLK_WRITE_EXPIRE_MS : BLK_READ_EXPIRE_MS);
+        req->bio = req->bio_tail = bio;
+        req->driver_data = 0;
+        blk_insert(dev, req);
+    }
+    blk_run(dev, 0);
+    wait_irq_restore(flags);
+}
+
+int blk_wait(blk_device_t *dev, bio_t *bio, int can_sleep) {
+    uint32_t flags = wait_irq_save();
+    can_sleep = can_sleep && current_process;
+    while (!bio->done) {
+        blk_run(dev, 1);
+        if (bio->done) break;
+        if (can_sleep && dev->polled) {
+            // Nothing will wake us; let the timer and input in between steps
+            asm volatile("sti; nop; cli");
+        } else if (can_sleep) {
+            wait_entry_t e = {0};
+            wait_queue_add(&dev->wait, &e);
+            process_block(pit_get_ticks() + BLK_POLL_TICKS);
+            wait_queue_remove(&e);
+        }
+        if (dev->poll) dev->poll(dev);
+    }
+    wait_irq_restore(flags);
+    return bio->error;
+}
+
+int blk_rw(blk_device_t *dev, uint32_t lba, uint32_t count, uint8_t *buffer, int write, int can_sleep) {
+    if (!dev) return 1;
+    bio_t bio;
+    memset(&bio, 0, sizeof(bio));
+    bio.lba = lba;
+    bio.count = count;
+    bio.buffer = buffer;
+    bio.write = write ? 1 : 0;
+    blk_submit(dev, &bio);
+    return blk_wait(dev, &bio, can_sleep);
+}
+
+void blk_plug(blk_device_t *dev) {
+    uint32_t flags = wait_irq_save();
+    dev->plugged++;
+    wait_irq_restore(flags);
+}
+
+void blk_unplug(blk_device_t *dev) {
+    uint32_t flags = wait_irq_save();
+    if (dev->plugged) dev->plugged--;
+    blk_run(dev, 0);
+    wait_irq_restore(flags);
+}
+
+// --- Completion ---
+
+void blk_end_request(blk_device_t *dev, blk_request_t *req, int error) {
+    uint32_t flags = wait_irq_save();
+    bio_t *bio = req->bio;
+    while (bio) {
+        bio_t *next = bio->next; // The owner may reuse it once done is set
+        bio->error = error ? 1 : 0;
+        bio->done = 1;
+        if (bio->end_io) bio->end_io(bio);
+        bio = next;
+    }
+    blk_free_request(req);
+    if (dev->inflight) dev->inflight--;
+    wait_queue_wake_all(&dev->wait);
+    blk_run(dev, 0);
+    wait_irq_restore(flags);
+}
+
+// --- Data access for drivers ---
+
+// Completion may run under another process's page directory. The low
+// 128MB (kernel heap, page tables) looks the same everywhere; anything
+// else is reached through its physical frame.
+uint8_t *blk_bio_map(bio_t *bio, uint32_t offset, uint32_t len) {
+    uint8_t *virt = bio->buffer + offset;
+    if (!bio->pd || bio->pd == vmm_current_directory() || (uint32_t)virt + len <= BLK_PHYS_LIMIT) return virt;
+
+    if (((uint32_t)virt & (PAGE_SIZE - 1)) + len > PAGE_SIZE) return 0;
+    uint32_t phys = vmm_virt_to_phys(bio->pd, virt);
+    if (!phys || phys + len > BLK_PHYS_LIMIT) return 0;
+    return (uint8_t*)phys;
+}
+
+int blk_bio_copy(bio_t *bio, uint32_t offset, uint8_t *data, uint32_t len, int to_bio) {
+    int ret = 0;
+    while (len > 0) {
+        uint32_t chunk = PAGE_SIZE - ((uint32_t)(bio->buffer + offset) & (PAGE_SIZE - 1));
+        if (chunk > len) chunk = len;
+        uint8_t *p = blk_bio_map(bio, offset, chunk);
+        if (!p) ret = -1;
+        else if (to_bio) memcpy(p, data, chunk);
+        else memcpy(data, p, chunk);
+        offset += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return ret;
+}
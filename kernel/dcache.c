@@ -0,0 +1,176 @@
+#include "dcache.h"
+#include "string.h"
+#include "spinlock.h"
+
+typedef struct dentry {
+    fs_node_t *parent;
+    fs_node_t *node;            // NULL = negative entry
+    uint32_t hash;
+    struct dentry *hnext;       // Bucket chain
+    struct dentry *lru_prev;    // LRU list (head = most recent)
+    struct dentry *lru_next;
+    uint8_t used;
+    char name[DCACHE_NAME_MAX];
+} dentry_t;
+
+static dentry_t pool[DCACHE_ENTRIES];
+static dentry_t *buckets[DCACHE_BUCKETS];
+static dentry_t *lru_head = NULL;
+static dentry_t *lru_tail = NULL;
+static lock_t dcache_lock;
+static int dcache_ready = 0;
+
+// FNV-1a over the parent pointer, then the name
+static uint32_t dcache_hash(fs_node_t *parent, const char *name) {
+    uint32_t h = 2166136261u;
+    uint32_t p = (uint32_t)parent;
+    for (int i = 0; i < 4; i++) {
+        h ^= (p >> (i * 8)) & 0xFF;
+        h *= 16777619u;
+    }
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void lru_unlink(dentry_t *d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+    else lru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+    else lru_tail = d->lru_prev;
+    d->lru_prev = d->lru_next = NULL;
+}
+
+static void lru_push_front(dentry_t *d) {
+    d->lru_prev = NULL;
+    d->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = d;
+    lru_head = d;
+    if (!lru_tail) lru_tail = d;
+}
+
+static void hash_unlink(dentry_t *d) {
+    dentry_t **link = &buckets[d->hash % DCACHE_BUCKETS];
+    while (*link) {
+        if (*link == d) {
+            *link = d->hnext;
+            break;
+        }
+        link = &(*link)->hnext;
+    }
+    d->hnext = NULL;
+}
+
+// Unhash an entry and move it to the LRU tail so it is reused first
+static void dentry_drop(dentry_t *d) {
+    hash_unlink(d);
+    d->used = 0;
+    d->parent = NULL;
+    d->node = NULL;
+    lru_unlink(d);
+    d->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = d;
+    lru_tail = d;
+    if (!lru_head) lru_head = d;
+}
+
+static dentry_t *dentry_find(fs_node_t *parent, const char *name, uint32_t hash) {
+    dentry_t *d = buckets[hash % DCACHE_BUCKETS];
+    while (d) {
+        if (d->hash == hash && d->parent == parent && strcmp(d->name, name) == 0)
+            return d;
+        d = d->hnext;
+    }
+    return NULL;
+}
+
+void dcache_init(void) {
+    spinlock_init(dcache_lock);
+    memset(pool, 0, sizeof(pool));
+    memset(buckets, 0, sizeof(buckets));
+    lru_head = lru_tail = NULL;
+    // Every slot starts free on the LRU list
+    for (int i = 0; i < DCACHE_ENTRIES; i++) lru_push_front(&pool[i]);
+    dcache_ready = 1;
+}
+
+int dcache_lookup(fs_node_t *parent, const char *name, fs_node_t **out) {
+    if (!dcache_ready) dcache_init();
+
+    uint32_t hash = dcache_hash(parent, name);
+    uint32_t flags = spinlock_acquire_irqsave(&dcache_lock);
+    dentry_t *d = dentry_find(parent, name, hash);
+    int result = DCACHE_MISS;
+    if (d) {
+        lru_unlink(d);
+        lru_push_front(d);
+        *out = d->node;
+        result = d->node ? DCACHE_HIT : DCACHE_NEGATIVE;
+    }
+    spinlock_release_irqrestore(&dcache_lock, flags);
+    return result;
+}
+
+void dcache_insert(fs_node_t *parent, const char *name, fs_node_t *node) {
+    if (!dcache_ready) dcache_init();
+    if (strlen(name) >= DCACHE_NAME_MAX) return; // Too long to key on, just don't cache
+
+    uint32_t hash = dcache_hash(parent, name);
+    uint32_t flags = spinlock_acquire_irqsave(&dcache_lock);
+
+    dentry_t *d = dentry_find(parent, name, hash);
+    if (!d) {
+        // Recycle the least recently used slot (free slots sit at the tail)
+        d = lru_tail;
+        if (d->used) hash_unlink(d);
+        d->parent = parent;
+        d->hash = hash;
+        strcpy(d->name, name);
+        d->used = 1;
+        d->hnext = buckets[hash % DCACHE_BUCKETS];
+        buckets[hash % DCACHE_BUCKETS] = d;
+    }
+    d->node = node;
+    lru_unlink(d);
+    lru_push_front(d);
+
+    spinlock_release_irqrestore(&dcache_lock, flags);
+}
+
+void dcache_invalidate(fs_node_t *parent, const char *name) {
+    if (!dcache_ready) return;
+
+    uint32_t hash = dcache_hash(parent, name);
+    uint32_t flags = spinlock_acquire_irqsave(&dcache_lock);
+    dentry_t *d = dentry_find(parent, name, hash);
+    if (d) dentry_drop(d);
+    spinlock_release_irqrestore(&dcache_lock, flags);
+}
+
+// The node is going away: forget it as a child and everything cached under it
+void dcache_invalidate_node(fs_node_t *node) {
+    if (!dcache_ready || !node) return;
+
+    uint32_t flags = spinlock_acquire_irqsave(&dcache_lock);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        dentry_t *d = &pool[i];
+        if (d->used && (d->node == node || d->parent == node)) dentry_drop(d);
+    }
+    spinlock_release_irqrestore(&dcache_lock, flags);
+}
+
+fs_node_t *dcache_finddir(fs_node_t *parent, char *name) {
+    fs_node_t *node = NULL;
+    int r = dcache_lookup(parent, name, &node);
+    if (r == DCACHE_HIT) return node;
+    if (r == DCACHE_NEGATIVE) return NULL;
+
+    // Only directories are cacheable parents; finddir_fs rejects the rest
+    if ((parent->flags & 0x7) != FS_DIRECTORY) return NULL;
+
+    node = finddir_fs(parent, name);
+    dcache_insert(parent, name, node);
+    return node;
+}
@@ -2,6 +2,8 @@
 #include "vfs.h"
 #include "mm/vmm.h"
 #include "mm/pmm.h"
+#include "mm/vma.h"
+#include "exec_cache.h"
 #include "string.h"
 #include "console.h"
 #include "memory.h"
@@ -24,19 +26,16 @@ static int is_valid_elf(Elf32_Ehdr *hdr) {
     return 1;
 }
 
-// Load an ELF executable from the filesystem
-// Returns the Entry Point address, or 0 on failure
-// Aux Vector capacity
+// Aux Vector of the last program loaded, for process_exec()
 #define MAX_AUX_ENTRIES 32
 static Elf32_auxv_t stored_auxv[MAX_AUX_ENTRIES];
 static int stored_auxc = 0;
 
-// Internal loader that doesn't reset auxv
-uint32_t elf_load_file_internal(const char *filename, uint32_t *out_base, int is_interpreter) {
-    console_log("[ELF] Loading: "); console_log(filename); console_log("\n");
 
-    fs_node_t *file = vfs_resolve_path((char*)filename);
-    if (!file) { console_log("[ELF] Error: File not found.\n"); return 0; }
+// Parse headers into 'img': segments, entry, interpreter and aux vector.
+// Only runs on an exec cache miss.
+static int elf_parse(fs_node_t *file, int is_interpreter, exec_image_t *img) {
+    console_log("[ELF] Loading: "); console_log(file->name); console_log("\n");
 
     Elf32_Ehdr hdr;
     if (read_fs(file, 0, sizeof(Elf32_Ehdr), (uint8_t*)&hdr) != sizeof(Elf32_Ehdr)) return 0;
@@ -48,124 +47,153 @@ uint32_t elf_load_file_internal(const char *filename, uint32_t *out_base, int is
         return 0;
     }
 
+    memset(img, 0, sizeof(*img));
+    img->node = file;
+    img->inode = file->inode;
+    img->length = file->length;
+
+    // ld.so is ET_DYN linked at 0; it relocates itself once running, we
+    // only pick where it goes (0x40000000). ET_EXEC addresses are absolute.
     uint32_t load_bias = 0;
-    // For DYN (Position Independent), we might need to pick a base address if it's not specified.
-    // Usually ld-linux.so is DYN but linked at 0. We map it to a high address (e.g. 0x40000000)?
-    // For simplicity, if DYN, let's keep it at 0 + offset if headers allow, or pick an address.
-    // Real ld.so is often pre-linked at 0, so we must relocate it.
-    // For this V1, we assume headers p_vaddr are absolute execution addresses for ET_EXEC,
-    // and for ET_DYN (like ld.so) we might need to add a base.
-    
-    if (is_interpreter && hdr.e_type == ET_DYN) {
-        // Load interpreter at 0x40000000 (standard-ish for some systems)
-        // Or just trust p_vaddr?
-        // ld-2.5.so p_vaddr might be 0.
-        // Let's check a typical p_vaddr.
-        // Assuming we need a bias.
-        load_bias = 0x40000000;
-    }
-    
-    if (out_base) *out_base = load_bias;
-
-    uint32_t ph_offset = hdr.e_phoff;
-    uint32_t ph_count = hdr.e_phnum;
-    uint32_t ph_size = hdr.e_phentsize;
-    
-    // Store PHDR info for the *Main Executable* (not interpreter)
-    if (!is_interpreter) {
-        // AT_PHDR = Base + ex_phdr execution address
-        // We need to find where PHDRs are loaded in memory.
-        // Often they are part of the first PT_LOAD loading the headers.
-        // We will calc this.
-        
-        // Scan for PT_PHDR
-        uint32_t phdr_vaddr = 0;
-        int found_phdr = 0;
-        
-        // We iterate efficiently
-        for (uint32_t i=0; i<ph_count; i++) {
-             Elf32_Phdr ph;
-             read_fs(file, ph_offset + i*ph_size, sizeof(ph), (uint8_t*)&ph);
-             if (ph.p_type == PT_PHDR) {
-                 phdr_vaddr = ph.p_vaddr + load_bias;
-                 found_phdr = 1;
-                 break;
-             }
-        }
-        
-        // Assuming headers are loaded:
-        if (found_phdr) {
-             stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_PHDR, .a_un.a_val = phdr_vaddr};
-        } else {
-             // Fallback: usually headers are at start of first load
-             // We can defer this till we load segments.
-             stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_PHDR, .a_un.a_val = hdr.e_phoff + load_bias}; // Wrong if not mapped
-        }
-        
-        stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_PHNUM, .a_un.a_val = ph_count};
-        stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_PHENT, .a_un.a_val = ph_size};
-        stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_ENTRY, .a_un.a_val = hdr.e_entry + load_bias};
-    }
+    if (is_interpreter && hdr.e_type == ET_DYN) load_bias = 0x40000000;
+    img->base = load_bias;
+    img->entry = hdr.e_entry + load_bias;
 
-    char interpreter_path[256];
-    interpreter_path[0] = 0;
+    uint32_t phdr_vaddr = 0;
 
-    for (uint32_t i = 0; i < ph_count; i++) {
+    for (uint32_t i = 0; i < hdr.e_phnum; i++) {
         Elf32_Phdr ph;
-        read_fs(file, ph_offset + (i * ph_size), sizeof(Elf32_Phdr), (uint8_t*)&ph);
-
-        if (ph.p_type == PT_INTERP) {
-             // Read interpreter path
-             if (ph.p_filesz < 255) {
-                read_fs(file, ph.p_offset, ph.p_filesz, (uint8_t*)interpreter_path);
-                interpreter_path[ph.p_filesz] = 0;
-             }
-        }
-        else if (ph.p_type == PT_LOAD) {
-            uint32_t start_addr = ph.p_vaddr + load_bias;
-            uint32_t end_addr = start_addr + ph.p_memsz;
-            uint32_t start_page = start_addr & 0xFFFFF000;
-            uint32_t end_page = (end_addr + 0xFFF) & 0xFFFFF000;
-
-            for (uint32_t addr = start_page; addr < end_page; addr += 4096) {
-                void *phys = pmm_alloc_block();
-                if (!phys) { return 0; } // OOM
-                vmm_map_page(0, phys, (void*)addr);
-            }
-
-            if (ph.p_filesz > 0) {
-                read_fs(file, ph.p_offset, ph.p_filesz, (uint8_t*)(start_addr));
+        if (read_fs(file, hdr.e_phoff + i * hdr.e_phentsize, sizeof(Elf32_Phdr), (uint8_t*)&ph) != sizeof(Elf32_Phdr))
+            return 0;
+
+        if (ph.p_type == PT_PHDR) {
+            phdr_vaddr = ph.p_vaddr + load_bias;
+        } else if (ph.p_type == PT_INTERP) {
+            // Read interpreter path
+            if (ph.p_filesz < EXEC_INTERP_MAX) {
+                read_fs(file, ph.p_offset, ph.p_filesz, (uint8_t*)img->interp);
+                img->interp[ph.p_filesz] = 0;
             }
-            if (ph.p_memsz > ph.p_filesz) {
-                memset((void*)(start_addr + ph.p_filesz), 0, ph.p_memsz - ph.p_filesz);
+        } else if (ph.p_type == PT_LOAD) {
+            if (img->nsegs == EXEC_MAX_SEGMENTS) {
+                console_log("[ELF] Error: Too many segments.\n");
+                return 0;
             }
+            exec_segment_t *seg = &img->segs[img->nsegs++];
+            seg->vaddr = ph.p_vaddr + load_bias;
+            seg->memsz = ph.p_memsz;
+            seg->offset = ph.p_offset;
+            seg->filesz = ph.p_filesz;
+            // No PT_PHDR: the headers are wherever the segment holding them lands
+            if (!phdr_vaddr && hdr.e_phoff >= ph.p_offset && hdr.e_phoff < ph.p_offset + ph.p_filesz)
+                phdr_vaddr = seg->vaddr + (hdr.e_phoff - ph.p_offset);
         }
     }
 
-    // If we have an interpreter and we are the main executable...
-    if (interpreter_path[0] && !is_interpreter) {
-         console_log("[ELF] Interpreter identified: ");
-         console_log(interpreter_path);
-         console_log("\n");
-         
-         // Load the interpreter!
-         uint32_t terp_base = 0;
-         uint32_t terp_entry = elf_load_file_internal(interpreter_path, &terp_base, 1);
-         if (!terp_entry) return 0; // Failed to load interpreter
-         
-         // Add AT_BASE
-         stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_BASE, .a_un.a_val = terp_base};
-         
-         return terp_entry;
+    // The interpreter gets no aux vector of its own
+    if (is_interpreter) return 1;
+
+    if (!phdr_vaddr) phdr_vaddr = hdr.e_phoff + load_bias; // Wrong if not mapped
+    img->auxv[img->auxc++] = (Elf32_auxv_t){AT_PHDR, .a_un.a_val = phdr_vaddr};
+    img->auxv[img->auxc++] = (Elf32_auxv_t){AT_PHNUM, .a_un.a_val = hdr.e_phnum};
+    img->auxv[img->auxc++] = (Elf32_auxv_t){AT_PHENT, .a_un.a_val = hdr.e_phentsize};
+    img->auxv[img->auxc++] = (Elf32_auxv_t){AT_ENTRY, .a_un.a_val = img->entry};
+
+    if (img->interp[0]) {
+        console_log("[ELF] Interpreter identified: ");
+        console_log(img->interp);
+        console_log("\n");
+    }
+    return 1;
+}
+
+// Image for 'file' from the exec cache, parsing it on a miss. Hand it back
+// with elf_image_done(). When every cache slot is busy the parsed copy on
+// the heap is used instead (kernel stacks are only 4KB).
+static exec_image_t *elf_image(fs_node_t *file, int is_interpreter) {
+    exec_image_t *img = exec_cache_get(file);
+    if (img) return img;
+
+    exec_image_t *parsed = (exec_image_t*)memory_alloc(sizeof(exec_image_t));
+    if (!parsed) return NULL;
+    if (!elf_parse(file, is_interpreter, parsed)) {
+        memory_free(parsed);
+        return NULL;
     }
+    img = exec_cache_put(parsed);
+    if (!img) return parsed;
+    memory_free(parsed);
+    return img;
+}
 
-    return hdr.e_entry + load_bias;
+static void elf_image_done(exec_image_t *img) {
+    if (!exec_cache_release(img)) memory_free(img);
 }
 
-// Wrapper to expose Aux Vector
+// Set up the mappings of every segment in the current address space
+static int elf_map_image(exec_image_t *img) {
+    for (uint32_t i = 0; i < img->nsegs; i++) {
+        exec_segment_t *seg = &img->segs[i];
+
+        // Demand-paged: pages come in from the page cache on first
+        // touch, text shared with everyone running this file
+        if (vma_map_file(0, img->node, seg->vaddr, seg->memsz, seg->offset, seg->filesz)) continue;
+
+        // Table full or odd alignment: copy it in now
+        uint32_t start_page = seg->vaddr & 0xFFFFF000;
+        uint32_t end_page = (seg->vaddr + seg->memsz + 0xFFF) & 0xFFFFF000;
+
+        for (uint32_t addr = start_page; addr < end_page; addr += 4096) {
+            void *phys = pmm_alloc_block();
+            if (!phys) { return 0; } // OOM
+            vmm_map_page(0, phys, (void*)addr);
+        }
+
+        if (seg->filesz > 0) {
+            read_fs(img->node, seg->offset, seg->filesz, (uint8_t*)(seg->vaddr));
+        }
+        if (seg->memsz > seg->filesz) {
+            memset((void*)(seg->vaddr + seg->filesz), 0, seg->memsz - seg->filesz);
+        }
+    }
+    return 1;
+}
+
+// Load an ELF executable (and its interpreter) into the current address space
+// Returns the Entry Point address, or 0 on failure
 uint32_t elf_load_file(const char *filename) {
     stored_auxc = 0; // Reset
-    return elf_load_file_internal(filename, NULL, 0);
+
+    fs_node_t *file = vfs_resolve_path((char*)filename);
+    if (!file) { console_log("[ELF] Error: File not found.\n"); return 0; }
+
+    exec_image_t *prog = elf_image(file, 0);
+    if (!prog) return 0;
+
+    // Looked up by path each time: the cache must not hold on to a node
+    // that may since have been unlinked or replaced
+    exec_image_t *terp = NULL;
+    if (prog->interp[0]) {
+        fs_node_t *terp_file = vfs_resolve_path(prog->interp);
+        if (!terp_file) console_log("[ELF] Error: Interpreter not found.\n");
+        else terp = elf_image(terp_file, 1);
+        if (!terp) {
+            elf_image_done(prog);
+            return 0;
+        }
+    }
+
+    uint32_t entry = 0;
+    if (elf_map_image(prog) && (!terp || elf_map_image(terp))) {
+        memcpy(stored_auxv, prog->auxv, prog->auxc * sizeof(Elf32_auxv_t));
+        stored_auxc = prog->auxc;
+        if (terp) stored_auxv[stored_auxc++] = (Elf32_auxv_t){AT_BASE, .a_un.a_val = terp->base};
+        entry = terp ? terp->entry : prog->entry;
+    }
+
+    if (terp) elf_image_done(terp);
+    elf_image_done(prog);
+    return entry;
 }
 
 // Accessor for Process Manager
@@ -0,0 +1,67 @@
+#include "exec_cache.h"
+#include "spinlock.h"
+
+static exec_image_t exec_cache[EXEC_CACHE_SLOTS];
+static uint32_t exec_clock = 0;
+static lock_t exec_lock;
+
+static int exec_matches(exec_image_t *img, fs_node_t *node) {
+    return img->valid && img->node == node &&
+           img->inode == node->inode && img->length == node->length;
+}
+
+exec_image_t *exec_cache_get(fs_node_t *node) {
+    uint32_t flags = spinlock_acquire_irqsave(&exec_lock);
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        exec_image_t *img = &exec_cache[i];
+        if (exec_matches(img, node)) {
+            img->users++;
+            img->stamp = ++exec_clock;
+            spinlock_release_irqrestore(&exec_lock, flags);
+            return img;
+        }
+    }
+    spinlock_release_irqrestore(&exec_lock, flags);
+    return NULL;
+}
+
+exec_image_t *exec_cache_put(const exec_image_t *img) {
+    uint32_t flags = spinlock_acquire_irqsave(&exec_lock);
+
+    // Empty or stale slots first, then the least recently used idle one
+    exec_image_t *victim = NULL;
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        exec_image_t *slot = &exec_cache[i];
+        if (slot->users) continue;
+        if (!slot->valid) {
+            victim = slot;
+            break;
+        }
+        if (!victim || slot->stamp < victim->stamp) victim = slot;
+    }
+    if (victim) {
+        *victim = *img;
+        victim->valid = 1;
+        victim->users = 1;
+        victim->stamp = ++exec_clock;
+    }
+
+    spinlock_release_irqrestore(&exec_lock, flags);
+    return victim;
+}
+
+int exec_cache_release(exec_image_t *img) {
+    if (img < &exec_cache[0] || img >= &exec_cache[EXEC_CACHE_SLOTS]) return 0;
+    uint32_t flags = spinlock_acquire_irqsave(&exec_lock);
+    if (img->users) img->users--;
+    spinlock_release_irqrestore(&exec_lock, flags);
+    return 1;
+}
+
+void exec_cache_invalidate(fs_node_t *node) {
+    uint32_t flags = spinlock_acquire_irqsave(&exec_lock);
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        if (exec_cache[i].node == node) exec_cache[i].valid = 0; // Pinned users keep their copy
+    }
+    spinlock_release_irqrestore(&exec_lock, flags);
+}
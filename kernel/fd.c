@@ -0,0 +1,295 @@
+#include "fd.h"
+#include "memory.h"
+#include "string.h"
+#include "input.h"
+#include "console.h"
+#include "wait_queue.h"
+#include "pipe.h"
+#include "bcache.h"
+
+extern process_t *current_process;
+
+struct file_descriptor *fd_get(int fd) {
+    if (!current_process || fd < 0 || fd >= FD_MAX) return NULL;
+    return current_process->fd_table[fd];
+}
+
+int fd_install(fs_node_t *node, int flags) {
+    if (!current_process || !node) return -1;
+    
+    for (int i = 3; i < FD_MAX; i++) { // Reserved 0,1,2
+        if (current_process->fd_table[i] == NULL) {
+            struct file_descriptor *desc = (struct file_descriptor*)memory_alloc(sizeof(struct file_descriptor));
+            if (!desc) return -1;
+            desc->node = node;
+            desc->offset = 0;
+            desc->flags = flags;
+            current_process->fd_table[i] = desc;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int fd_read(int fd, void *buf, uint32_t count, uint32_t offset) {
+    struct file_descriptor *desc = fd_get(fd);
+    
+    if (!desc && fd == 0) {
+        // STDIN (Keyboard)
+        // Note: Race condition with GUI input_poll, but suitable for single-tasking demo
+        // Simple Blocking Read (1 char). Key events live in a static ring, nothing to free.
+        if (count == 0) return 0;
+        while (1) {
+            if (keyboard_event_ready()) {
+                key_event_t *ke = receive_key_event();
+                if (ke && ke->action == KEY_PRESS && ke->ascii) {
+                    ((char*)buf)[0] = ke->ascii;
+                    return 1;
+                }
+                continue;
+            }
+            // Sleep until the next key arrives
+            uint32_t flags = wait_irq_save();
+            if (!keyboard_event_ready()) wait_queue_sleep(keyboard_wait_queue());
+            wait_irq_restore(flags);
+        }
+    }
+    
+    if (!desc || !desc->node) return -1; // Bad FD
+    
+    if (offset == FD_OFFSET_CUR) {
+        uint32_t read_bytes = read_fs(desc->node, desc->offset, count, (uint8_t*)buf);
+        desc->offset += read_bytes;
+        return read_bytes;
+    }
+    return read_fs(desc->node, offset, count, (uint8_t*)buf);
+}
+
+int fd_write(int fd, const void *buf, uint32_t count, uint32_t offset) {
+    struct file_descriptor *desc = fd_get(fd);
+    
+    if (!desc && (fd == 1 || fd == 2)) {
+        const char *s = (const char*)buf;
+        for (uint32_t i = 0; i < count; i++) {
+            console_putc(s[i]);
+        }
+        // Redirect to GUI Terminal if active
+        extern void terminal_active_write(const char *buf, uint32_t len);
+        terminal_active_write(s, count);
+        return count;
+    }
+    
+    if (!desc || !desc->node) return -1; // Bad FD
+    
+    if (offset == FD_OFFSET_CUR) {
+        uint32_t written = write_fs(desc->node, desc->offset, count, (uint8_t*)buf);
+        desc->offset += written;
+        return written;
+    }
+    return write_fs(desc->node, offset, count, (uint8_t*)buf);
+}
+
+// Create 'path' in its parent directory; returns the new node or NULL
+static fs_node_t *fd_create(const char *path) {
+    char buf[256];
+    if (strlen(path) >= sizeof(buf)) return NULL;
+    strcpy(buf, path);
+    
+    char *last_slash = NULL;
+    for (char *p = buf; *p; p++) if (*p == '/') last_slash = p;
+    
+    fs_node_t *parent = fs_root;
+    char *name = buf;
+    if (last_slash) {
+        *last_slash = 0;
+        name = last_slash + 1;
+        parent = vfs_resolve_path(buf[0] ? buf : "/");
+    }
+    if (!parent || !name[0]) return NULL;
+    
+    create_fs(parent, name, 0644);
+    return vfs_resolve_path(path);
+}
+
+int fd_open(const char *path, int flags) {
+    fs_node_t *node = vfs_resolve_path(path);
+    if (!node && (flags & FD_O_CREAT)) node = fd_create(path);
+    if (!node) return -1; // ENOENT
+    
+    if ((flags & FD_O_TRUNC) && (node->flags & 0x7) == FS_FILE && node->length > 0) {
+        truncate_fs(node, 0);
+    }
+    
+    int fd = fd_install(node, flags);
+    if (fd < 0) return -1; // EMFILE
+    
+    // Open VFS hook
+    open_fs(node, 1, 0);
+    return fd;
+}
+
+int fd_close(int fd) {
+    if (fd < 3) return -1; // stdio stays open
+    
+    struct file_descriptor *desc = fd_get(fd);
+    if (!desc) return -1;
+    
+    close_fs(desc->node);
+    memory_free(desc);
+    current_process->fd_table[fd] = NULL;
+    return 0;
+}
+
+// Dirty state only lives in the block buffer cache, so flush all of it
+int fd_fsync(int fd) {
+    struct file_descriptor *desc = fd_get(fd);
+    if (!desc && fd >= 0 && fd <= 2) return 0;
+    if (!desc) return -1;
+    return bcache_sync() == 0 ? 0 : -1;
+}
+
+int sys_fcntl(int fd, int cmd, uint32_t arg) {
+    struct file_descriptor *desc = fd_get(fd);
+    if (!desc || !desc->node) return -1;
+    int is_pipe = (desc->node->flags & 0x7) == FS_PIPE;
+    
+    switch (cmd) {
+        case F_GETPIPE_SZ:
+            return is_pipe ? (int)pipe_get_size(desc->node) : -1;
+        case F_SETPIPE_SZ:
+            return is_pipe ? pipe_set_size(desc->node, arg) : -1;
+        default:
+            return -1; // EINVAL
+    }
+}
+
+// --- Vectored I/O ---
+
+int sys_readv(int fd, const struct iovec *iov, int iovcnt) {
+    if (!iov || iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+        int n = fd_read(fd, iov[i].iov_base, iov[i].iov_len, FD_OFFSET_CUR);
+        if (n < 0) return total ? total : -1;
+        total += n;
+        if ((uint32_t)n < iov[i].iov_len) break; // Short read: stop like POSIX
+    }
+    return total;
+}
+
+int sys_writev(int fd, const struct iovec *iov, int iovcnt) {
+    if (!iov || iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+        int n = fd_write(fd, iov[i].iov_base, iov[i].iov_len, FD_OFFSET_CUR);
+        if (n < 0) return total ? total : -1;
+        total += n;
+        if ((uint32_t)n < iov[i].iov_len) break;
+    }
+    return total;
+}
+
+// --- In-kernel transfers ---
+
+#define FD_XFER_CHUNK (16 * 1024)
+
+static int fd_is_pipe_end(struct file_descriptor *desc, uint32_t end) {
+    return desc && desc->node && (desc->node->flags & 0x7) == FS_PIPE && desc->node->impl == end;
+}
+
+// Fallback: one kernel bounce buffer instead of two user/kernel crossings
+static int fd_copy(int out_fd, int in_fd, uint32_t *in_off, uint32_t *out_off, uint32_t count) {
+    uint8_t *buf = (uint8_t*)memory_alloc(count < FD_XFER_CHUNK ? count : FD_XFER_CHUNK);
+    if (!buf) return -1;
+    
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t chunk = count - done;
+        if (chunk > FD_XFER_CHUNK) chunk = FD_XFER_CHUNK;
+        
+        int n = fd_read(in_fd, buf, chunk, in_off ? *in_off : FD_OFFSET_CUR);
+        if (n <= 0) break;
+        if (in_off) *in_off += n;
+        
+        int w = fd_write(out_fd, buf, n, out_off ? *out_off : FD_OFFSET_CUR);
+        if (w <= 0) break;
+        if (out_off) *out_off += w;
+        
+        done += w;
+        if (w < n || (uint32_t)n < chunk) break;
+    }
+    
+    memory_free(buf);
+    return done;
+}
+
+// Position for a transfer: explicit offset, or the descriptor's own
+static uint32_t *fd_xfer_pos(struct file_descriptor *desc, uint32_t *explicit_off) {
+    if (explicit_off) return explicit_off;
+    return desc ? &desc->offset : NULL;
+}
+
+int sys_sendfile(int out_fd, int in_fd, uint32_t *offset, uint32_t count) {
+    struct file_descriptor *in = fd_get(in_fd);
+    struct file_descriptor *out = fd_get(out_fd);
+    if (!in || !in->node) return -1;
+    
+    // File -> pipe: read straight into the pipe ring
+    if (fd_is_pipe_end(out, 1) && !fd_is_pipe_end(in, 0)) {
+        uint32_t *pos = fd_xfer_pos(in, offset);
+        uint32_t done = 0;
+        while (done < count) {
+            int n = pipe_splice_in(out->node, in->node, pos, count - done);
+            if (n <= 0) return done ? (int)done : n;
+            done += n;
+        }
+        return done;
+    }
+    
+    return fd_copy(out_fd, in_fd, offset, NULL, count);
+}
+
+// One side must be a pipe. Offsets apply to the non-pipe side.
+int sys_splice(int fd_in, uint32_t *off_in, int fd_out, uint32_t *off_out, uint32_t len) {
+    struct file_descriptor *in = fd_get(fd_in);
+    struct file_descriptor *out = fd_get(fd_out);
+    
+    int in_pipe = fd_is_pipe_end(in, 0);
+    int out_pipe = fd_is_pipe_end(out, 1);
+    if (!in_pipe && !out_pipe) return -1; // EINVAL
+    
+    if (in_pipe && out && out->node && !out_pipe) {
+        // Pipe -> file: write straight out of the pipe ring
+        return pipe_splice_out(in->node, out->node, fd_xfer_pos(out, off_out), len);
+    }
+    if (out_pipe && in && in->node && !in_pipe) {
+        // File -> pipe
+        return pipe_splice_in(out->node, in->node, fd_xfer_pos(in, off_in), len);
+    }
+    
+    // Pipe <-> pipe, or implicit stdio on the other side
+    return fd_copy(fd_out, fd_in, in_pipe ? NULL : off_in, out_pipe ? NULL : off_out, len);
+}
+
+// User pages to/from a pipe, by reference where the flags allow it
+int sys_vmsplice(int fd, const struct iovec *iov, int iovcnt, uint32_t flags) {
+    struct file_descriptor *desc = fd_get(fd);
+    int writing = fd_is_pipe_end(desc, 1);
+    if (!writing && !fd_is_pipe_end(desc, 0)) return -1; // EBADF
+    if (!iov || iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+        int n = writing ? pipe_vmsplice_in(desc->node, (uint8_t*)iov[i].iov_base, iov[i].iov_len, flags & SPLICE_F_GIFT)
+                        : pipe_vmsplice_out(desc->node, (uint8_t*)iov[i].iov_base, iov[i].iov_len, flags & SPLICE_F_MOVE);
+        if (n < 0) return total ? total : n;
+        total += n;
+        if ((uint32_t)n < iov[i].iov_len) break;
+    }
+    return total;
+}
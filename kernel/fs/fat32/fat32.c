@@ -3,7 +3,7 @@
 #include "memory.h"
 #include "string.h"
 #include "console.h"
-#include "ata.h"
+#include "bcache.h"
 
 // Hardcoded for now: Partition starts at LBA 0 (Superfloppy)
 #define PARTITION_LBA_OFFSET 0
@@ -11,35 +11,391 @@
 static fat32_fs_t fat_fs;
 static uint32_t fat_lba_start = 0;
 
-// Wrapper for ATA
-// TODO: Replace with generic Block Device Interface
-// function decl removed
-
-// extern void ata_write_sector(uint32_t lba, uint8_t *buffer);
+// All disk access goes through the buffer cache, which submits to the
+// block layer (kernel/blk.c)
 
+// Metadata (boot sector, FAT, directories) goes through the buffer cache
 static void disk_read(uint32_t lba, uint8_t *buffer) {
-    ata_read_sector(fat_lba_start + lba, buffer);
+    bcache_read(fat_lba_start + lba, buffer);
+}
+
+static uint32_t cluster_lba(uint32_t cluster) {
+    return fat_fs.data_start_lba + ((cluster - 2) * fat_fs.sectors_per_cluster);
+}
+
+// Whole-sector runs of one read, submitted together so the block queue
+// can merge and sort runs that sit in different extents
+#define FAT32_READ_BATCH 16
+
+typedef struct {
+    bcache_span_t spans[FAT32_READ_BATCH];
+    uint32_t count;
+} fat32_read_batch_t;
+
+static void read_batch_flush(fat32_read_batch_t *batch) {
+    if (batch->count) bcache_read_spans(batch->spans, batch->count);
+    batch->count = 0;
+}
+
+// File data: the page cache above us keeps it, so don't evict metadata for it.
+// Reads 'len' bytes starting 'skip' bytes into sector 'lba'; whole sectors
+// land directly in the destination once the batch is flushed.
+static void read_data_span(uint32_t lba, uint32_t skip, uint32_t len, uint8_t *buffer, fat32_read_batch_t *batch) {
+    uint8_t sector[512];
+    while (len > 0) {
+        uint32_t chunk = 512 - skip;
+        if (chunk > len) chunk = len;
+        if (chunk == 512) {
+            // Every whole sector left in the span is one run
+            uint32_t whole = len / 512;
+            if (batch->count == FAT32_READ_BATCH) read_batch_flush(batch);
+            bcache_span_t *span = &batch->spans[batch->count++];
+            span->lba = fat_lba_start + lba;
+            span->count = whole;
+            span->buffer = buffer;
+            chunk = whole * 512;
+            lba += whole - 1;
+        } else {
+            bcache_read_bypass(fat_lba_start + lba, sector);
+            memcpy(buffer, sector + skip, chunk);
+        }
+        buffer += chunk;
+        len -= chunk;
+        skip = 0;
+        lba++;
+    }
 }
 
-// Helper: Read a cluster
-// Note: Only supports single sector clusters for simplicity in this V1, or requires loop
-static void read_cluster(uint32_t cluster, uint8_t *buffer) {
-    uint32_t lba = fat_fs.data_start_lba + ((cluster - 2) * fat_fs.sectors_per_cluster);
-    for (uint32_t i = 0; i < fat_fs.sectors_per_cluster; i++) {
-        ata_read_sector(fat_lba_start + lba + i, buffer + (i * 512));
+// Writes are deferred: whole sectors are handed to the buffer cache, partial
+// ones are patched in place. The flusher (or sync) puts them on disk.
+// A NULL buffer writes zeros.
+static void write_data_span(uint32_t lba, uint32_t skip, uint32_t len, const uint8_t *buffer) {
+    static const uint8_t zeros[512];
+    while (len > 0) {
+        uint32_t chunk = 512 - skip;
+        if (chunk > len) chunk = len;
+        const uint8_t *src = buffer ? buffer : zeros;
+        if (chunk == 512) {
+            bcache_write(fat_lba_start + lba, src);
+        } else {
+            buffer_head_t *bh = bcache_get(fat_lba_start + lba);
+            if (bh) {
+                memcpy(bh->data + skip, src, chunk);
+                bcache_mark_dirty(bh);
+                bcache_put(bh);
+            }
+        }
+        if (buffer) buffer += chunk;
+        len -= chunk;
+        skip = 0;
+        lba++;
     }
 }
 
+// Zero a freshly allocated cluster (directories must not inherit garbage)
+static void zero_cluster(uint32_t cluster) {
+    write_data_span(cluster_lba(cluster), 0, fat_fs.bytes_per_cluster, NULL);
+}
+
+// --- In-Memory FAT ---
+// The table is loaded on demand in chunks and kept for the life of the
+// mount, so following a chain is a memory lookup after the first touch.
+// A bitmap of used clusters is filled in alongside each chunk and drives
+// allocation; the search starts at the FSInfo next-free hint.
+
+#define FAT_CHUNK_SECTORS 8
+#define FAT_CHUNK_ENTRIES (FAT_CHUNK_SECTORS * 512 / 4)
+
+static uint32_t **fat_chunks = NULL;
+static uint32_t fat_chunk_count = 0;
+static uint32_t *fat_used_map = NULL;   // 1 bit per cluster, valid for loaded chunks
+
+static void map_set(uint32_t cluster, int used) {
+    if (!fat_used_map) return;
+    if (used) fat_used_map[cluster / 32] |= (1u << (cluster % 32));
+    else fat_used_map[cluster / 32] &= ~(1u << (cluster % 32));
+}
+
+static int map_test(uint32_t cluster) {
+    return (fat_used_map[cluster / 32] >> (cluster % 32)) & 1;
+}
+
+static uint32_t *fat_chunk(uint32_t cluster) {
+    uint32_t idx = cluster / FAT_CHUNK_ENTRIES;
+    if (!fat_chunks || idx >= fat_chunk_count) return NULL;
+
+    if (!fat_chunks[idx]) {
+        uint32_t *chunk = (uint32_t*)memory_alloc(FAT_CHUNK_SECTORS * 512);
+        if (!chunk) return NULL;
+        uint32_t first = idx * FAT_CHUNK_SECTORS;
+        uint32_t sectors = fat_fs.sectors_per_fat - first;
+        if (sectors > FAT_CHUNK_SECTORS) sectors = FAT_CHUNK_SECTORS;
+        bcache_read_span(fat_lba_start + fat_fs.fat_start_lba + first, sectors, (uint8_t*)chunk);
+        uint32_t base = idx * FAT_CHUNK_ENTRIES;
+        for (uint32_t i = 0; i < FAT_CHUNK_ENTRIES; i++) {
+            if (base + i < 2 + fat_fs.total_clusters) map_set(base + i, (chunk[i] & 0x0FFFFFFF) != 0);
+        }
+        fat_chunks[idx] = chunk;
+    }
+    return fat_chunks[idx];
+}
+
 // Get next cluster from FAT table
 static uint32_t get_next_cluster(uint32_t cluster) {
-    uint32_t fat_sector = fat_fs.fat_start_lba + ((cluster * 4) / 512);
-    uint32_t fat_offset = (cluster * 4) % 512;
-    
-    uint8_t buffer[512];
-    ata_read_sector(fat_lba_start + fat_sector, buffer);
-    
-    uint32_t next_cluster = *(uint32_t*)&buffer[fat_offset];
-    return next_cluster & 0x0FFFFFFF; // Mask top 4 bits
+    if (cluster < 2) return FAT32_EOC;
+    uint32_t *chunk = fat_chunk(cluster);
+    if (!chunk) return FAT32_EOC; // Treat unreadable FAT as end of chain
+    return chunk[cluster % FAT_CHUNK_ENTRIES] & 0x0FFFFFFF; // Mask top 4 bits
+}
+
+// Update one FAT entry in memory and queue its sector for every FAT copy
+static void fat_set(uint32_t cluster, uint32_t value) {
+    uint32_t *chunk = fat_chunk(cluster);
+    if (!chunk) return;
+
+    uint32_t *entry = &chunk[cluster % FAT_CHUNK_ENTRIES];
+    int was_free = (*entry & 0x0FFFFFFF) == 0;
+    *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF); // Top 4 bits are reserved
+
+    int now_free = (value & 0x0FFFFFFF) == 0;
+    map_set(cluster, !now_free);
+    if (fat_fs.free_count != 0xFFFFFFFF && was_free != now_free) {
+        if (now_free) fat_fs.free_count++;
+        else fat_fs.free_count--;
+    }
+
+    uint32_t sector = (cluster * 4) / 512;
+    const uint8_t *src = (const uint8_t*)chunk + (sector % FAT_CHUNK_SECTORS) * 512;
+    for (uint32_t f = 0; f < fat_fs.fat_count; f++) {
+        bcache_write(fat_lba_start + fat_fs.fat_start_lba + f * fat_fs.sectors_per_fat + sector, src);
+    }
+}
+
+static void fat32_fsinfo_sync(void) {
+    if (!fat_fs.fsinfo_sector) return;
+    buffer_head_t *bh = bcache_get(fat_lba_start + fat_fs.fsinfo_sector);
+    if (!bh) return;
+    fat32_fsinfo_t *info = (fat32_fsinfo_t*)bh->data;
+    info->free_count = fat_fs.free_count;
+    info->next_free = fat_fs.next_free;
+    bcache_mark_dirty(bh);
+    bcache_put(bh);
+}
+
+// Find 'count' free clusters in a row; 0 if there is no such run
+static uint32_t fat_find_run(uint32_t count) {
+    uint32_t last = fat_fs.total_clusters + 1;
+    uint32_t start = fat_fs.next_free;
+    if (start < 2 || start > last) start = 2;
+
+    uint32_t run = 0, run_start = 0;
+    for (uint32_t n = 0; n < fat_fs.total_clusters; n++) {
+        uint32_t c = start + n;
+        if (c > last) c -= fat_fs.total_clusters;
+        if (c == 2) run = 0; // Wrapped: runs don't continue across the end
+        if (!fat_chunk(c)) return 0;
+
+        // Skip fully used words
+        if ((c % 32) == 0 && c + 31 <= last && fat_used_map[c / 32] == 0xFFFFFFFF) {
+            run = 0;
+            n += 31;
+            continue;
+        }
+        if (map_test(c)) {
+            run = 0;
+            continue;
+        }
+        if (run == 0) run_start = c;
+        if (++run == count) return run_start;
+    }
+    return 0;
+}
+
+static void fat_free_chain(uint32_t cluster) {
+    uint32_t guard = 0;
+    while (cluster >= 2 && cluster < 0x0FFFFFF8 && guard++ <= fat_fs.total_clusters) {
+        uint32_t next = get_next_cluster(cluster);
+        fat_set(cluster, 0);
+        if (cluster < fat_fs.next_free) fat_fs.next_free = cluster;
+        cluster = next;
+    }
+}
+
+// --- Node Table ---
+// One fs_node_t per directory entry, so every open of a file shares the
+// same length, extent map and page cache state.
+
+#define FAT32_NODE_BUCKETS 64
+static fat32_file_t *node_table[FAT32_NODE_BUCKETS];
+
+static uint32_t node_hash(uint32_t lba, uint32_t off) {
+    return (lba * 16 + off / 32) % FAT32_NODE_BUCKETS;
+}
+
+static void node_table_remove(fat32_file_t *ff) {
+    fat32_file_t **link = &node_table[node_hash(ff->dirent_lba, ff->dirent_off)];
+    while (*link) {
+        if (*link == ff) {
+            *link = ff->hnext;
+            break;
+        }
+        link = &(*link)->hnext;
+    }
+    ff->hnext = NULL;
+}
+
+// --- Extent Maps ---
+
+// Add clusters to the end of the map, merging with the last run when contiguous
+static int fat32_extent_append(fat32_file_t *ff, uint32_t disk_cluster, uint32_t count) {
+    fat32_extent_t *tail = ff->count ? &ff->extents[ff->count - 1] : NULL;
+    if (tail && tail->disk_cluster + tail->count == disk_cluster) {
+        tail->count += count;
+        ff->clusters += count;
+        return 0;
+    }
+
+    if (ff->count == ff->capacity) {
+        uint32_t cap = ff->capacity ? ff->capacity * 2 : 8;
+        fat32_extent_t *grown = (fat32_extent_t*)memory_alloc(cap * sizeof(fat32_extent_t));
+        if (!grown) return -1;
+        if (ff->extents) {
+            memcpy(grown, ff->extents, ff->count * sizeof(fat32_extent_t));
+            memory_free(ff->extents);
+        }
+        ff->extents = grown;
+        ff->capacity = cap;
+    }
+    fat32_extent_t *e = &ff->extents[ff->count++];
+    e->file_cluster = ff->clusters;
+    e->disk_cluster = disk_cluster;
+    e->count = count;
+    ff->clusters += count;
+    return 0;
+}
+
+static void fat32_extent_drop(fat32_file_t *ff) {
+    if (ff->extents) memory_free(ff->extents);
+    ff->extents = NULL;
+    ff->count = ff->capacity = ff->last = ff->clusters = 0;
+    ff->mapped = 0;
+}
+
+// Walk the chain once and cache the runs on the node
+static fat32_file_t *fat32_file_map(fs_node_t *node) {
+    fat32_file_t *ff = (fat32_file_t*)node->impl;
+    if (!ff || ff->mapped) return ff;
+
+    uint32_t cluster = node->inode;
+    while (cluster >= 2 && cluster < 0x0FFFFFF8 && ff->clusters <= fat_fs.total_clusters) {
+        if (fat32_extent_append(ff, cluster, 1) < 0) break;
+        cluster = get_next_cluster(cluster);
+    }
+    ff->mapped = 1;
+    return ff;
+}
+
+static fat32_extent_t *fat32_find_extent(fat32_file_t *ff, uint32_t file_cluster) {
+    if (ff->count == 0) return NULL;
+
+    // Sequential readers stay in the same run or step to the next one
+    for (uint32_t i = ff->last; i < ff->count && i <= ff->last + 1; i++) {
+        fat32_extent_t *e = &ff->extents[i];
+        if (file_cluster >= e->file_cluster && file_cluster < e->file_cluster + e->count) {
+            ff->last = i;
+            return e;
+        }
+    }
+
+    uint32_t lo = 0, hi = ff->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        fat32_extent_t *e = &ff->extents[mid];
+        if (file_cluster < e->file_cluster) hi = mid;
+        else if (file_cluster >= e->file_cluster + e->count) lo = mid + 1;
+        else {
+            ff->last = mid;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Grow the chain to at least 'want' clusters, preferring one contiguous run.
+// Returns the number of clusters the file has afterwards.
+static uint32_t fat32_grow(fs_node_t *node, fat32_file_t *ff, uint32_t want) {
+    uint32_t last = ff->count ? ff->extents[ff->count - 1].disk_cluster +
+                                ff->extents[ff->count - 1].count - 1 : 0;
+
+    while (ff->clusters < want) {
+        uint32_t need = want - ff->clusters;
+        uint32_t start = fat_find_run(need);
+        while (!start && need > 1) {
+            need /= 2; // Fragmented volume: take smaller pieces
+            start = fat_find_run(need);
+        }
+        if (!start) break; // Disk full
+
+        for (uint32_t i = 0; i < need; i++) {
+            fat_set(start + i, i + 1 < need ? start + i + 1 : FAT32_EOC);
+        }
+        if (last) fat_set(last, start);
+        else node->inode = start;
+
+        if (fat32_extent_append(ff, start, need) < 0) {
+            ff->mapped = 0; // Map is incomplete; rebuild from the FAT next time
+            fat32_extent_drop(ff);
+            fat32_file_map(node);
+        }
+        last = start + need - 1;
+        fat_fs.next_free = last + 1;
+    }
+
+    fat32_fsinfo_sync();
+    return ff->clusters;
+}
+
+// Cut the chain down to 'keep' clusters
+static void fat32_shrink(fs_node_t *node, fat32_file_t *ff, uint32_t keep) {
+    if (ff->clusters <= keep) return;
+
+    if (keep == 0) {
+        fat_free_chain(node->inode);
+        node->inode = 0;
+    } else {
+        fat32_extent_t *e = fat32_find_extent(ff, keep - 1);
+        if (!e) return;
+        uint32_t tail = e->disk_cluster + (keep - 1 - e->file_cluster);
+        uint32_t rest = get_next_cluster(tail);
+        fat_set(tail, FAT32_EOC);
+        fat_free_chain(rest);
+    }
+
+    fat32_extent_drop(ff);
+    fat32_fsinfo_sync();
+}
+
+static void fat32_dir_index_drop(uint32_t dir_cluster);
+
+// Write size and first cluster back into our directory entry
+static void fat32_update_dirent(fs_node_t *node) {
+    fat32_file_t *ff = (fat32_file_t*)node->impl;
+    if (!ff || !ff->dirent_lba) return;
+
+    buffer_head_t *bh = bcache_get(fat_lba_start + ff->dirent_lba);
+    if (!bh) return;
+    fat_dir_entry_t *entry = (fat_dir_entry_t*)(bh->data + ff->dirent_off);
+    uint32_t old_cluster = ((uint32_t)entry->cluster_high << 16) | entry->cluster_low;
+    entry->size = ((node->flags & 0x7) == FS_DIRECTORY) ? 0 : node->length;
+    entry->cluster_high = (uint16_t)(node->inode >> 16);
+    entry->cluster_low = (uint16_t)(node->inode & 0xFFFF);
+    if ((node->flags & 0x7) == FS_FILE) entry->attr |= ATTR_ARCHIVE;
+    bcache_mark_dirty(bh);
+    bcache_put(bh);
+
+    // readdir reports the first cluster as ino; sizes in the index are only
+    // used to seed new nodes, and this node already exists
+    if (old_cluster != node->inode) fat32_dir_index_drop(ff->dir_cluster);
 }
 
 // VFS Hooks
@@ -49,36 +405,118 @@ static struct dirent dir_entry_ret; // Static buffer for return (from vfs.h dire
 fs_node_t *fat32_finddir(fs_node_t *node, char *name);
 struct dirent *fat32_readdir(fs_node_t *node, uint32_t index);
 uint32_t fat32_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+uint32_t fat32_read_pages(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t **pages);
+uint32_t fat32_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+void fat32_open(fs_node_t *node);
+void fat32_close(fs_node_t *node);
+int fat32_truncate(fs_node_t *node, uint32_t length);
+void fat32_create(fs_node_t *parent, char *name, uint16_t permission);
+void fat32_mkdir(fs_node_t *parent, char *name, uint16_t permission);
+void fat32_unlink(fs_node_t *parent, char *name);
 
 void fat32_init(uint32_t partition_lba) {
     fat_lba_start = partition_lba;
-    
+
     uint8_t *bpb_buffer = (uint8_t*)memory_alloc(512);
     disk_read(0, bpb_buffer); // Read Partition Boot Sector
-    
+
     fat32_bpb_t *bpb = (fat32_bpb_t*)bpb_buffer;
-    
+
     if (bpb->boot_signature != 0x29 && bpb->boot_signature != 0x28) {
         // Warning: Might be 0x00 on some formatted disks? FAT check usually looks for JMP or BytesPerSector
     }
-    
+
     fat_fs.partition_offset = partition_lba;
     fat_fs.sectors_per_cluster = bpb->sectors_per_cluster;
     fat_fs.bytes_per_cluster = bpb->sectors_per_cluster * 512;
     fat_fs.fat_start_lba = bpb->reserved_sectors;
     fat_fs.root_cluster = bpb->root_cluster;
-    
+
     // Calculate Data Start
     // DataStart = Reserved + (FatCount * SectorsPerFAT)
     uint32_t fat_size = bpb->sectors_per_fat_32;
     fat_fs.data_start_lba = bpb->reserved_sectors + (bpb->fat_count * fat_size);
-    
+    fat_fs.sectors_per_fat = fat_size;
+    fat_fs.fat_count = bpb->fat_count;
+    uint32_t total_sectors = bpb->total_sectors_32 ? bpb->total_sectors_32 : bpb->total_sectors_16;
+    fat_fs.total_clusters = bpb->sectors_per_cluster ?
+        (total_sectors - fat_fs.data_start_lba) / bpb->sectors_per_cluster : 0;
+
+    // FAT chunks are filled in on first use
+    fat_chunk_count = (fat_size + FAT_CHUNK_SECTORS - 1) / FAT_CHUNK_SECTORS;
+    fat_chunks = (uint32_t**)memory_alloc(fat_chunk_count * sizeof(uint32_t*));
+    fat_used_map = (uint32_t*)memory_alloc((fat_fs.total_clusters + 2 + 31) / 32 * 4);
+
+    // FSInfo: free count and where to start looking for free clusters
+    fat_fs.fsinfo_sector = 0;
+    fat_fs.free_count = 0xFFFFFFFF;
+    fat_fs.next_free = 2;
+    if (bpb->fs_info != 0 && bpb->fs_info != 0xFFFF) {
+        uint8_t info_buf[512];
+        disk_read(bpb->fs_info, info_buf);
+        fat32_fsinfo_t *info = (fat32_fsinfo_t*)info_buf;
+        if (info->lead_sig == FSINFO_LEAD_SIG && info->struct_sig == FSINFO_STRUCT_SIG) {
+            fat_fs.fsinfo_sector = bpb->fs_info;
+            if (info->free_count <= fat_fs.total_clusters) fat_fs.free_count = info->free_count;
+            if (info->next_free >= 2 && info->next_free < fat_fs.total_clusters + 2) fat_fs.next_free = info->next_free;
+        }
+    }
+
+    memory_free(bpb_buffer);
+
     serial_write("[FAT32] Initialized.\n");
     serial_write("  Sec/Clust: ");
     // print hex bpb->sectors_per_cluster
     serial_write("\n");
 }
 
+// Shared node setup for the root, finddir results and new entries
+static fs_node_t *fat32_make_node(const char *name, uint32_t cluster, uint32_t size, int is_dir,
+                                  uint32_t dir_cluster, uint32_t dirent_lba, uint32_t dirent_off) {
+    if (dirent_lba) {
+        fat32_file_t *ff = node_table[node_hash(dirent_lba, dirent_off)];
+        while (ff && !(ff->dirent_lba == dirent_lba && ff->dirent_off == dirent_off)) ff = ff->hnext;
+        if (ff) return ff->node;
+    }
+
+    fs_node_t *ret = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
+    fat32_file_t *ff = (fat32_file_t*)memory_alloc(sizeof(fat32_file_t));
+    if (!ret || !ff) return NULL;
+
+    strncpy(ret->name, name, sizeof(ret->name) - 1);
+    ret->inode = cluster;
+    ret->length = size;
+    ret->impl = (uint32_t)ff;
+    ff->node = ret;
+    ff->dirent_lba = dirent_lba;
+    ff->dirent_off = dirent_off;
+    ff->dir_cluster = dir_cluster;
+
+    if (is_dir) {
+        ret->flags = FS_DIRECTORY;
+        ret->readdir = fat32_readdir;
+        ret->finddir = fat32_finddir;
+        ret->create = fat32_create;
+        ret->mkdir = fat32_mkdir;
+        ret->unlink = fat32_unlink;
+    } else {
+        ret->flags = FS_FILE | FS_CACHED;
+        ret->read = fat32_read;
+        ret->read_pages = fat32_read_pages;
+        ret->write = fat32_write;
+        ret->open = fat32_open;
+        ret->close = fat32_close;
+        ret->truncate = fat32_truncate;
+    }
+
+    if (dirent_lba) {
+        uint32_t h = node_hash(dirent_lba, dirent_off);
+        ff->hnext = node_table[h];
+        node_table[h] = ff;
+    }
+    return ret;
+}
+
 // VFS 2.0 Mount Callback
 fs_node_t *fat32_mount_fs(const char *source, const char *target) {
     (void)target;
@@ -87,22 +525,15 @@ fs_node_t *fat32_mount_fs(const char *source, const char *target) {
     // fat32_init(0); // Assuming already initialized or init here?
     // Actually, mount usually initializes per instance.
     // We'll init strict LBA 0 for now.
-    
+
     // fat32_init(0); // If we call this, we re-read BPB.
     // It's safe.
     // But `fat32_init` is void.
-    
+
     // Existing fat32_mount returns the node.
-    fs_node_t *root = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
-    strcpy(root->name, "fat_root");
-    root->flags = FS_DIRECTORY;
-    root->inode = fat_fs.root_cluster; // Use Cluster as Inode
-    root->readdir = fat32_readdir;
-    root->finddir = fat32_finddir;
-    root->read = 0; 
-    root->write = 0;
-    root->open = 0;
-    root->close = 0;
+    // One root node per volume so every mount sees the same directory state
+    static fs_node_t *root = NULL;
+    if (!root) root = fat32_make_node("fat_root", fat_fs.root_cluster, 0, 1, 0, 0, 0); // Use Cluster as Inode
     return root;
 }
 
@@ -114,145 +545,627 @@ void fat32_register(void) {
     vfs_register_driver("fat32", fat32_mount_fs);
 }
 
+// --- Names ---
 
-// READ DIRECTORY
-struct dirent *fat32_readdir(fs_node_t *node, uint32_t index) {
-    // This is tricky. Index 0 = First Entry.
-    // We need to iterate clusters.
-    
-    uint32_t cluster = node->inode;
-    uint32_t entry_count = 0;
-    uint8_t *cluster_buf = (uint8_t*)memory_alloc(fat_fs.bytes_per_cluster);
-    
-    while (cluster < 0x0FFFFFF8) {
-        read_cluster(cluster, cluster_buf);
-        
-        uint32_t entries_per_cluster = fat_fs.bytes_per_cluster / 32;
-        
-        for (uint32_t i = 0; i < entries_per_cluster; i++) {
-             fat_dir_entry_t *entry = (fat_dir_entry_t*)(cluster_buf + (i * 32));
-             
-             if ((uint8_t)entry->name[0] == 0x00) break; // End of Dir
-             if ((uint8_t)entry->name[0] == 0xE5) continue; // Deleted
-             if (entry->attr & ATTR_LONG_NAME) continue; // Skip LFN for now
-             if (entry->attr & ATTR_VOLUME_ID) continue;
-             
-             if (entry_count == index) {
-                 // Found it
-                 // Format Name (8.3)
-                 int j=0;
-                 for (int k=0; k<8; k++) {
-                     if (entry->name[k] != ' ') dir_entry_ret.name[j++] = entry->name[k];
-                 }
-                 if (entry->ext[0] != ' ') {
-                     dir_entry_ret.name[j++] = '.';
-                     for (int k=0; k<3; k++) {
-                         if (entry->ext[k] != ' ') dir_entry_ret.name[j++] = entry->ext[k];
-                     }
-                 }
-                 dir_entry_ret.name[j] = 0;
-                 dir_entry_ret.ino = (entry->cluster_high << 16) | entry->cluster_low;
-                 
-                 memory_free(cluster_buf);
-                 return &dir_entry_ret;
-             }
-             entry_count++;
+static char fat_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - 32 : c;
+}
+
+// Case-insensitive, like FAT itself
+static int fat32_name_eq(const char *a, const char *b) {
+    while (*a && *b) {
+        if (fat_upper(*a) != fat_upper(*b)) return 0;
+        a++; b++;
+    }
+    return *a == *b;
+}
+
+static void fat32_format_name(fat_dir_entry_t *entry, char *out) {
+    int j=0;
+    for (int k=0; k<8; k++) {
+        if (entry->name[k] != ' ') out[j++] = entry->name[k];
+    }
+    if (entry->ext[0] != ' ' && entry->ext[0] != 0) {
+        out[j++] = '.';
+        for (int k=0; k<3; k++) {
+            if (entry->ext[k] != ' ') out[j++] = entry->ext[k];
+        }
+    }
+    out[j] = 0;
+}
+
+// "readme.txt" -> "README  TXT"; -1 if the name does not fit 8.3
+static int fat32_short_name(const char *name, char out[11]) {
+    memset(out, ' ', 11);
+    if (!name[0] || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return -1;
+
+    const char *dot = NULL;
+    for (const char *p = name; *p; p++) if (*p == '.') dot = p;
+    if (dot == name) return -1;
+
+    uint32_t base_len = dot ? (uint32_t)(dot - name) : strlen(name);
+    uint32_t ext_len = dot ? strlen(dot + 1) : 0;
+    if (base_len == 0 || base_len > 8 || ext_len > 3) return -1;
+
+    for (uint32_t i = 0; i < base_len + (dot ? ext_len + 1 : 0); i++) {
+        char c = name[i];
+        if (dot && name + i == dot) continue;
+        if (c <= ' ' || c == '.' || c == '"' || c == '*' || c == '/' || c == ':' || c == '<' ||
+            c == '>' || c == '?' || c == '\\' || c == '|' || c == '+' || c == ',' || c == ';' ||
+            c == '=' || c == '[' || c == ']') return -1;
+        if (name + i < (dot ? dot : name + base_len)) out[i] = fat_upper(c);
+        else out[8 + (name + i - dot - 1)] = fat_upper(c);
+    }
+    return 0;
+}
+
+// --- Directory Access ---
+
+// --- Directory Name Index ---
+
+static fat32_dir_index_t dir_indexes[FAT32_DIR_INDEX_SLOTS];
+static uint32_t dir_index_clock = 0;
+
+// FNV-1a over the case-folded name
+static uint32_t fat32_name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t)fat_upper(*name++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// ".." entries store 0 for the root directory
+static uint32_t fat32_dir_cluster(uint32_t cluster) {
+    return cluster ? cluster : fat_fs.root_cluster;
+}
+
+static void dir_index_free(fat32_dir_index_t *ix) {
+    for (uint32_t i = 0; i < ix->count; i++) {
+        if (ix->entries[i].name) memory_free(ix->entries[i].name);
+    }
+    if (ix->entries) memory_free(ix->entries);
+    if (ix->long_buckets) memory_free(ix->long_buckets);
+    if (ix->short_buckets) memory_free(ix->short_buckets);
+    memset(ix, 0, sizeof(fat32_dir_index_t));
+}
+
+// Directory changed on disk: forget what we know about it
+static void fat32_dir_index_drop(uint32_t dir_cluster) {
+    dir_cluster = fat32_dir_cluster(dir_cluster);
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        if (dir_indexes[i].dir_cluster == dir_cluster) dir_index_free(&dir_indexes[i]);
+    }
+}
+
+static uint8_t fat32_lfn_checksum(const fat_dir_entry_t *entry) {
+    const uint8_t *p = (const uint8_t*)entry->name; // name and ext are adjacent: 11 bytes
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) sum = ((sum & 1) << 7) + (sum >> 1) + p[i];
+    return sum;
+}
+
+// Long names are UCS-2; anything outside ASCII becomes '?'
+static void fat32_lfn_copy(const fat_lfn_entry_t *lfn, char *out) {
+    uint16_t chars[13];
+    for (int i = 0; i < 5; i++) chars[i] = lfn->name1[i];
+    for (int i = 0; i < 6; i++) chars[5 + i] = lfn->name2[i];
+    for (int i = 0; i < 2; i++) chars[11 + i] = lfn->name3[i];
+    for (int i = 0; i < 13; i++) {
+        uint16_t c = chars[i];
+        if (c == 0x0000 || c == 0xFFFF) out[i] = 0;
+        else out[i] = c < 0x80 ? (char)c : '?';
+    }
+}
+
+static int fat32_dir_index_push(fat32_dirent_info_t **entries, uint32_t *count, uint32_t *capacity) {
+    if (*count < *capacity) return 0;
+    uint32_t cap = *capacity ? *capacity * 2 : 16;
+    fat32_dirent_info_t *grown = (fat32_dirent_info_t*)memory_alloc(cap * sizeof(fat32_dirent_info_t));
+    if (!grown) return -1;
+    if (*entries) {
+        memcpy(grown, *entries, *count * sizeof(fat32_dirent_info_t));
+        memory_free(*entries);
+    }
+    *entries = grown;
+    *capacity = cap;
+    return 0;
+}
+
+// Read the whole directory once, pairing long-name slots with their short entry
+static int fat32_dir_scan(uint32_t dir_cluster, fat32_dir_index_t *ix) {
+    uint32_t capacity = 0;
+    char lfn[20 * 13 + 1];
+    uint32_t lfn_next = 0, lfn_slots = 0, lfn_lba = 0, lfn_off = 0;
+    uint8_t lfn_sum = 0;
+
+    uint32_t cluster = dir_cluster;
+    uint32_t guard = 0;
+    int done = 0;
+    while (!done && cluster >= 2 && cluster < 0x0FFFFFF8 && guard++ <= fat_fs.total_clusters) {
+        for (uint32_t s = 0; s < fat_fs.sectors_per_cluster && !done; s++) {
+            uint32_t lba = cluster_lba(cluster) + s;
+            buffer_head_t *bh = bcache_get(fat_lba_start + lba);
+            if (!bh) return -1;
+
+            for (uint32_t off = 0; off < 512; off += 32) {
+                fat_dir_entry_t *entry = (fat_dir_entry_t*)(bh->data + off);
+                if ((uint8_t)entry->name[0] == 0x00) { done = 1; break; } // End of Dir
+                if ((uint8_t)entry->name[0] == 0xE5) { lfn_slots = 0; continue; }
+
+                if (entry->attr == ATTR_LONG_NAME) {
+                    // Slots are stored last-first; the first one carries 0x40
+                    fat_lfn_entry_t *l = (fat_lfn_entry_t*)entry;
+                    uint8_t seq = l->order & 0x1F;
+                    if (l->order & 0x40) {
+                        lfn_next = seq;
+                        lfn_sum = l->checksum;
+                        lfn_slots = 0;
+                        lfn_lba = lba;
+                        lfn_off = off;
+                        memset(lfn, 0, sizeof(lfn));
+                    }
+                    if (seq == 0 || seq > 20 || seq != lfn_next || l->checksum != lfn_sum) {
+                        lfn_next = lfn_slots = 0; // Orphaned or corrupt: fall back to 8.3
+                        continue;
+                    }
+                    fat32_lfn_copy(l, lfn + (seq - 1) * 13);
+                    lfn_next--;
+                    lfn_slots++;
+                    continue;
+                }
+                if (entry->attr & ATTR_VOLUME_ID) { lfn_slots = 0; continue; }
+
+                if (fat32_dir_index_push(&ix->entries, &ix->count, &capacity) < 0) {
+                    bcache_put(bh);
+                    return -1;
+                }
+                fat32_dirent_info_t *info = &ix->entries[ix->count];
+                memset(info, 0, sizeof(fat32_dirent_info_t));
+                fat32_format_name(entry, info->short_name);
+                info->attr = entry->attr;
+                info->cluster = (entry->cluster_high << 16) | entry->cluster_low;
+                info->size = entry->size;
+                info->lba = lba;
+                info->off = off;
+
+                const char *name = info->short_name;
+                if (lfn_slots && lfn_next == 0 && lfn_sum == fat32_lfn_checksum(entry) && lfn[0]) {
+                    name = lfn;
+                    info->lfn_lba = lfn_lba;
+                    info->lfn_off = lfn_off;
+                    info->lfn_count = lfn_slots;
+                }
+                lfn_slots = 0;
+
+                info->name = (char*)memory_alloc(strlen(name) + 1);
+                if (!info->name) {
+                    bcache_put(bh);
+                    return -1;
+                }
+                strcpy(info->name, name);
+                ix->count++;
+            }
+            bcache_put(bh);
         }
-        
         cluster = get_next_cluster(cluster);
     }
-    
-    memory_free(cluster_buf);
     return 0;
 }
 
-fs_node_t *fat32_finddir(fs_node_t *node, char *name) {
-    // Iterate until name matches
-    uint32_t cluster = node->inode;
-    uint8_t *cluster_buf = (uint8_t*)memory_alloc(fat_fs.bytes_per_cluster);
-    
-    while (cluster < 0x0FFFFFF8) {
-        read_cluster(cluster, cluster_buf);
-        uint32_t entries_per_cluster = fat_fs.bytes_per_cluster / 32;
-        for (uint32_t i = 0; i < entries_per_cluster; i++) {
-             fat_dir_entry_t *entry = (fat_dir_entry_t*)(cluster_buf + (i * 32));
-             
-             if ((uint8_t)entry->name[0] == 0x00) break; 
-             if ((uint8_t)entry->name[0] == 0xE5) continue;
-             if (entry->attr == ATTR_LONG_NAME) continue;
-             
-             // Check Name Match
-             char filename[13];
-             int j=0;
-             for (int k=0; k<8; k++) {
-                 if (entry->name[k] != ' ') filename[j++] = entry->name[k];
-             }
-             if (entry->ext[0] != ' ' && entry->ext[0] != 0) {
-                 filename[j++] = '.';
-                 for (int k=0; k<3; k++) {
-                     if (entry->ext[k] != ' ') filename[j++] = entry->ext[k];
-                 }
-             }
-             filename[j] = 0;
-             
-             if (strcmp(name, filename) == 0) {
-                 // Found!
-                 fs_node_t *ret = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
-                 strcpy(ret->name, filename);
-                 ret->inode = (entry->cluster_high << 16) | entry->cluster_low;
-                 ret->length = entry->size;
-                 
-                 if (entry->attr & ATTR_DIRECTORY) {
-                     ret->flags = FS_DIRECTORY;
-                     ret->readdir = fat32_readdir;
-                     ret->finddir = fat32_finddir;
-                 } else {
-                     ret->flags = FS_FILE;
-                     ret->read = fat32_read;
-                 }
-                 memory_free(cluster_buf);
-                 return ret;
-             }
+static fat32_dir_index_t *fat32_dir_index(uint32_t dir_cluster) {
+    dir_cluster = fat32_dir_cluster(dir_cluster);
+
+    fat32_dir_index_t *victim = &dir_indexes[0];
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        fat32_dir_index_t *ix = &dir_indexes[i];
+        if (ix->dir_cluster == dir_cluster) {
+            ix->last_used = ++dir_index_clock;
+            return ix;
+        }
+        if (victim->dir_cluster && (!ix->dir_cluster || ix->last_used < victim->last_used)) victim = ix;
+    }
+
+    // Build into the least recently used slot
+    fat32_dir_index_t *ix = victim;
+    dir_index_free(ix);
+    if (fat32_dir_scan(dir_cluster, ix) != 0) {
+        dir_index_free(ix);
+        return NULL;
+    }
+
+    ix->nbuckets = 16;
+    while (ix->nbuckets < ix->count) ix->nbuckets *= 2;
+    ix->long_buckets = (fat32_dirent_info_t**)memory_alloc(ix->nbuckets * sizeof(fat32_dirent_info_t*));
+    ix->short_buckets = (fat32_dirent_info_t**)memory_alloc(ix->nbuckets * sizeof(fat32_dirent_info_t*));
+    if (!ix->long_buckets || !ix->short_buckets) {
+        dir_index_free(ix);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < ix->count; i++) {
+        fat32_dirent_info_t *info = &ix->entries[i];
+        uint32_t h = fat32_name_hash(info->name) & (ix->nbuckets - 1);
+        info->long_next = ix->long_buckets[h];
+        ix->long_buckets[h] = info;
+        h = fat32_name_hash(info->short_name) & (ix->nbuckets - 1);
+        info->short_next = ix->short_buckets[h];
+        ix->short_buckets[h] = info;
+    }
+
+    ix->dir_cluster = dir_cluster;
+    ix->last_used = ++dir_index_clock;
+    return ix;
+}
+
+// Find 'name' (long or 8.3) in a directory. The result lives in the index
+// and is only valid until the directory is next modified.
+static fat32_dirent_info_t *fat32_lookup(uint32_t dir_cluster, const char *name) {
+    fat32_dir_index_t *ix = fat32_dir_index(dir_cluster);
+    if (!ix) return NULL;
+
+    uint32_t h = fat32_name_hash(name) & (ix->nbuckets - 1);
+    for (fat32_dirent_info_t *info = ix->long_buckets[h]; info; info = info->long_next) {
+        if (fat32_name_eq(name, info->name)) return info;
+    }
+    for (fat32_dirent_info_t *info = ix->short_buckets[h]; info; info = info->short_next) {
+        if (fat32_name_eq(name, info->short_name)) return info;
+    }
+    return NULL;
+}
+
+// Step to the following 32-byte slot, crossing into the next cluster if needed
+static void fat32_next_slot(uint32_t *lba, uint32_t *off) {
+    *off += 32;
+    if (*off < 512) return;
+    *off = 0;
+
+    uint32_t rel = *lba - fat_fs.data_start_lba;
+    if ((rel + 1) % fat_fs.sectors_per_cluster) {
+        (*lba)++;
+        return;
+    }
+    *lba = cluster_lba(get_next_cluster(rel / fat_fs.sectors_per_cluster + 2));
+}
+
+// Find (or make, by extending the directory) a free 32-byte slot
+static int fat32_dir_slot(fs_node_t *dir, uint32_t *lba_out, uint32_t *off_out) {
+    uint32_t cluster = dir->inode;
+    uint32_t last = 0;
+    uint32_t guard = 0;
+    while (cluster >= 2 && cluster < 0x0FFFFFF8 && guard++ <= fat_fs.total_clusters) {
+        for (uint32_t s = 0; s < fat_fs.sectors_per_cluster; s++) {
+            uint32_t lba = cluster_lba(cluster) + s;
+            buffer_head_t *bh = bcache_get(fat_lba_start + lba);
+            if (!bh) return -1;
+            for (uint32_t off = 0; off < 512; off += 32) {
+                uint8_t first = bh->data[off];
+                if (first == 0x00 || first == 0xE5) {
+                    bcache_put(bh);
+                    *lba_out = lba;
+                    *off_out = off;
+                    return 0;
+                }
+            }
+            bcache_put(bh);
         }
+        last = cluster;
         cluster = get_next_cluster(cluster);
     }
-    memory_free(cluster_buf);
+
+    // Directory full: chain on a zeroed cluster
+    uint32_t fresh = fat_find_run(1);
+    if (!fresh || !last) return -1;
+    fat_set(fresh, FAT32_EOC);
+    fat_set(last, fresh);
+    fat_fs.next_free = fresh + 1;
+    fat32_fsinfo_sync();
+    zero_cluster(fresh);
+
+    *lba_out = cluster_lba(fresh);
+    *off_out = 0;
     return 0;
 }
 
-uint32_t fat32_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    // Read File
+static int fat32_write_entry(uint32_t lba, uint32_t off, const char short_name[11],
+                             uint8_t attr, uint32_t cluster) {
+    buffer_head_t *bh = bcache_get(fat_lba_start + lba);
+    if (!bh) return -1;
+    fat_dir_entry_t *entry = (fat_dir_entry_t*)(bh->data + off);
+    memset(entry, 0, sizeof(fat_dir_entry_t));
+    memcpy(entry->name, short_name, 8);
+    memcpy(entry->ext, short_name + 8, 3);
+    entry->attr = attr;
+    entry->cluster_high = (uint16_t)(cluster >> 16);
+    entry->cluster_low = (uint16_t)(cluster & 0xFFFF);
+    bcache_mark_dirty(bh);
+    bcache_put(bh);
+    return 0;
+}
+
+// READ DIRECTORY
+struct dirent *fat32_readdir(fs_node_t *node, uint32_t index) {
+    // Index 0 = First Entry, straight out of the name index
+    fat32_dir_index_t *ix = fat32_dir_index(node->inode);
+    if (!ix || index >= ix->count) return 0;
+
+    fat32_dirent_info_t *info = &ix->entries[index];
+    strncpy(dir_entry_ret.name, info->name, sizeof(dir_entry_ret.name) - 1);
+    dir_entry_ret.name[sizeof(dir_entry_ret.name) - 1] = 0;
+    dir_entry_ret.ino = info->cluster;
+    return &dir_entry_ret;
+}
+
+fs_node_t *fat32_finddir(fs_node_t *node, char *name) {
+    fat32_dirent_info_t *info = fat32_lookup(node->inode, name);
+    if (!info) return 0;
+
+    // Nodes outlive the index, so a size cached here only seeds a new node
+    int is_dir = (info->attr & ATTR_DIRECTORY) != 0;
+    uint32_t cluster = is_dir ? fat32_dir_cluster(info->cluster) : info->cluster;
+    return fat32_make_node(info->name, cluster, info->size, is_dir, node->inode, info->lba, info->off);
+}
+
+void fat32_create(fs_node_t *parent, char *name, uint16_t permission) {
+    (void)permission;
+    char short_name[11];
+    uint32_t lba, off;
+    if (fat32_short_name(name, short_name) != 0) return; // Long names need VFAT entries
+    if (fat32_lookup(parent->inode, name)) return; // Exists
+    if (fat32_dir_slot(parent, &lba, &off) != 0) return;
+
+    // Empty file: no clusters until the first write
+    fat32_write_entry(lba, off, short_name, ATTR_ARCHIVE, 0);
+    fat32_dir_index_drop(parent->inode);
+}
+
+void fat32_mkdir(fs_node_t *parent, char *name, uint16_t permission) {
+    (void)permission;
+    char short_name[11];
+    uint32_t lba, off;
+    if (fat32_short_name(name, short_name) != 0) return;
+    if (fat32_lookup(parent->inode, name)) return;
+
+    uint32_t cluster = fat_find_run(1);
+    if (!cluster) return;
+    fat_set(cluster, FAT32_EOC);
+    fat_fs.next_free = cluster + 1;
+    fat32_fsinfo_sync();
+    zero_cluster(cluster);
+
+    // "." and ".." (a parent that is the root is written as cluster 0)
+    uint32_t parent_cluster = parent->inode == fat_fs.root_cluster ? 0 : parent->inode;
+    fat32_write_entry(cluster_lba(cluster), 0, ".          ", ATTR_DIRECTORY, cluster);
+    fat32_write_entry(cluster_lba(cluster), 32, "..         ", ATTR_DIRECTORY, parent_cluster);
+
+    if (fat32_dir_slot(parent, &lba, &off) != 0) {
+        fat_free_chain(cluster);
+        return;
+    }
+    fat32_write_entry(lba, off, short_name, ATTR_DIRECTORY, cluster);
+    fat32_dir_index_drop(parent->inode);
+}
+
+// Only "." and ".." left?
+static int fat32_dir_empty(uint32_t dir_cluster) {
+    fat32_dir_index_t *ix = fat32_dir_index(dir_cluster);
+    if (!ix) return 0;
+    for (uint32_t i = 0; i < ix->count; i++) {
+        if (strcmp(ix->entries[i].short_name, ".") != 0 && strcmp(ix->entries[i].short_name, "..") != 0) return 0;
+    }
+    return 1;
+}
+
+// Give an unlinked file's clusters back. Open descriptors keep the node,
+// so it is emptied rather than freed.
+static void fat32_release(fs_node_t *node) {
+    fat32_file_t *ff = (fat32_file_t*)node->impl;
     uint32_t cluster = node->inode;
-    uint32_t read_bytes = 0;
-    
-    uint8_t *cluster_buf = (uint8_t*)memory_alloc(fat_fs.bytes_per_cluster);
-    
-    // Skip clusters until offset
+    if (ff) fat32_extent_drop(ff);
+    node->inode = 0;
+    node->length = 0;
+    node->read = 0;
+    node->read_pages = 0;
+    node->write = 0;
+    fat_free_chain(cluster);
+    fat32_fsinfo_sync();
+}
+
+void fat32_unlink(fs_node_t *parent, char *name) {
+    fat32_dirent_info_t *info = fat32_lookup(parent->inode, name);
+    if (!info) return;
+
+    // Copy out: checking for emptiness may recycle the parent's index slot
+    uint32_t lba = info->lba, off = info->off;
+    uint32_t slot_lba = info->lfn_lba, slot_off = info->lfn_off, slots = info->lfn_count;
+    uint32_t cluster = info->cluster;
+    int is_dir = (info->attr & ATTR_DIRECTORY) != 0;
+    if (is_dir && !fat32_dir_empty(cluster)) return;
+
+    // Detach a live node so open descriptors stop touching freed clusters.
+    // A running program may still page in from it: then the clusters stay
+    // allocated until the last mapping goes (fat32_release()).
+    fat32_file_t *ff = node_table[node_hash(lba, off)];
+    while (ff && !(ff->dirent_lba == lba && ff->dirent_off == off)) ff = ff->hnext;
+    if (ff) {
+        node_table_remove(ff);
+        ff->dirent_lba = 0;
+    }
+
+    if (is_dir) fat32_dir_index_drop(cluster);
+    if (!ff) {
+        fat_free_chain(cluster);
+        fat32_fsinfo_sync();
+    } else if (!vfs_orphan_node(ff->node, fat32_release)) {
+        fat32_release(ff->node);
+    }
+
+    // Long-name slots first, then the short entry they lead up to
+    if (!slots) {
+        slot_lba = lba;
+        slot_off = off;
+    }
+    for (uint32_t i = 0; i <= slots; i++) {
+        buffer_head_t *bh = bcache_get(fat_lba_start + slot_lba);
+        if (!bh) break;
+        bh->data[slot_off] = 0xE5;
+        bcache_mark_dirty(bh);
+        bcache_put(bh);
+        if (slot_lba == lba && slot_off == off) break;
+        fat32_next_slot(&slot_lba, &slot_off);
+    }
+    fat32_dir_index_drop(parent->inode);
+}
+
+// Queue the read of [offset, offset + size) into 'buffer' on 'batch'
+static uint32_t fat32_read_batched(fat32_file_t *ff, uint32_t offset, uint32_t size, uint8_t *buffer,
+                                   fat32_read_batch_t *batch) {
     uint32_t cluster_size = fat_fs.bytes_per_cluster;
-    while (offset >= cluster_size) {
-        cluster = get_next_cluster(cluster);
-        if (cluster >= 0x0FFFFFF8) { memory_free(cluster_buf); return 0; }
-        offset -= cluster_size;
-    }
-    
-    // Read Data
-    while (read_bytes < size && cluster < 0x0FFFFFF8) {
-        read_cluster(cluster, cluster_buf);
-        
-        uint32_t chunk = size - read_bytes;
-        uint32_t available = cluster_size - offset;
-        
-        if (chunk > available) chunk = available;
-        
-        // Copy
-        memcpy(buffer + read_bytes, cluster_buf + offset, chunk);
-        
+    uint32_t read_bytes = 0;
+
+    // Each pass reads as far as the current contiguous run allows
+    while (read_bytes < size) {
+        uint32_t pos = offset + read_bytes;
+        uint32_t file_cluster = pos / cluster_size;
+        fat32_extent_t *e = fat32_find_extent(ff, file_cluster);
+        if (!e) break; // Chain shorter than the directory entry claims
+
+        uint32_t chunk = (e->file_cluster + e->count) * cluster_size - pos;
+        if (chunk > size - read_bytes) chunk = size - read_bytes;
+
+        uint32_t disk_cluster = e->disk_cluster + (file_cluster - e->file_cluster);
+        uint32_t lba = cluster_lba(disk_cluster) + (pos % cluster_size) / 512;
+        read_data_span(lba, pos % 512, chunk, buffer + read_bytes, batch);
+
         read_bytes += chunk;
-        offset = 0; // Next cluster starts at 0
-        
-        cluster = get_next_cluster(cluster);
     }
-    
-    memory_free(cluster_buf);
     return read_bytes;
 }
+
+uint32_t fat32_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    if (offset >= node->length) return 0;
+    if (size > node->length - offset) size = node->length - offset;
+
+    fat32_file_t *ff = fat32_file_map(node);
+    if (!ff) return 0;
+
+    fat32_read_batch_t batch;
+    batch.count = 0;
+    uint32_t read_bytes = fat32_read_batched(ff, offset, size, buffer, &batch);
+    read_batch_flush(&batch);
+    return read_bytes;
+}
+
+// Page cache fill: every page is its own destination, but the sectors of
+// all of them go to the block layer together and merge there
+uint32_t fat32_read_pages(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t **pages) {
+    if (offset >= node->length) return 0;
+    if (size > node->length - offset) size = node->length - offset;
+
+    fat32_file_t *ff = fat32_file_map(node);
+    if (!ff) return 0;
+
+    fat32_read_batch_t batch;
+    batch.count = 0;
+    uint32_t read_bytes = 0;
+    for (uint32_t i = 0; read_bytes < size; i++) {
+        uint32_t chunk = size - read_bytes < 4096 ? size - read_bytes : 4096;
+        uint32_t got = fat32_read_batched(ff, offset + read_bytes, chunk, pages[i], &batch);
+        read_bytes += got;
+        if (got < chunk) break;
+    }
+    read_batch_flush(&batch);
+    return read_bytes;
+}
+
+// Write 'size' bytes (zeros when buffer is NULL) into clusters the file already owns
+static uint32_t fat32_write_mapped(fat32_file_t *ff, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    uint32_t cluster_size = fat_fs.bytes_per_cluster;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t file_cluster = pos / cluster_size;
+        fat32_extent_t *e = fat32_find_extent(ff, file_cluster);
+        if (!e) break;
+
+        uint32_t chunk = (e->file_cluster + e->count) * cluster_size - pos;
+        if (chunk > size - done) chunk = size - done;
+
+        uint32_t disk_cluster = e->disk_cluster + (file_cluster - e->file_cluster);
+        uint32_t lba = cluster_lba(disk_cluster) + (pos % cluster_size) / 512;
+        write_data_span(lba, pos % 512, chunk, buffer ? buffer + done : NULL);
+
+        done += chunk;
+    }
+    return done;
+}
+
+uint32_t fat32_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    fat32_file_t *ff = fat32_file_map(node);
+    if (!ff || size == 0) return 0;
+
+    uint32_t cluster_size = fat_fs.bytes_per_cluster;
+    uint32_t end = offset + size;
+    uint32_t need = (end + cluster_size - 1) / cluster_size;
+
+    if (need > ff->clusters) {
+        // Reserve ahead geometrically so a growing file stays contiguous
+        uint32_t want = need;
+        uint32_t ahead = ff->clusters < FAT32_PREALLOC_MIN ? FAT32_PREALLOC_MIN : ff->clusters;
+        if (ahead > FAT32_PREALLOC_MAX) ahead = FAT32_PREALLOC_MAX;
+        if (want < ff->clusters + ahead) want = ff->clusters + ahead;
+        if (fat32_grow(node, ff, want) < need) fat32_grow(node, ff, need); // Tight on space: exact fit
+    }
+
+    uint32_t capacity = ff->clusters * cluster_size;
+    if (offset >= capacity) return 0; // Disk full
+    if (end > capacity) {
+        end = capacity;
+        size = end - offset;
+    }
+
+    // A write past EOF leaves a hole that must read back as zeros
+    if (offset > node->length) fat32_write_mapped(ff, node->length, offset - node->length, NULL);
+
+    uint32_t written = fat32_write_mapped(ff, offset, size, buffer);
+    if (offset + written > node->length) node->length = offset + written;
+    fat32_update_dirent(node);
+    return written;
+}
+
+void fat32_open(fs_node_t *node) {
+    fat32_file_t *ff = (fat32_file_t*)node->impl;
+    if (ff) ff->opens++;
+}
+
+// Give back clusters preallocated past EOF once no one is writing. The
+// node is shared by every descriptor on the file.
+void fat32_close(fs_node_t *node) {
+    fat32_file_t *ff = (fat32_file_t*)node->impl;
+    if (!ff) return;
+    if (ff->opens && --ff->opens) return;
+    ff = fat32_file_map(node);
+    if (!ff->dirent_lba) return;
+
+    uint32_t keep = (node->length + fat_fs.bytes_per_cluster - 1) / fat_fs.bytes_per_cluster;
+    if (ff->clusters > keep) {
+        fat32_shrink(node, ff, keep);
+        fat32_update_dirent(node);
+    }
+}
+
+int fat32_truncate(fs_node_t *node, uint32_t length) {
+    fat32_file_t *ff = fat32_file_map(node);
+    if (!ff || !ff->dirent_lba) return -1;
+
+    if (length > node->length) {
+        // Extending: writing the last byte zero-fills the gap before it
+        fat32_write(node, length - 1, 1, (uint8_t*)"\0");
+        return node->length == length ? 0 : -1;
+    }
+
+    node->length = length;
+    fat32_shrink(node, ff, (length + fat_fs.bytes_per_cluster - 1) / fat_fs.bytes_per_cluster);
+    fat32_update_dirent(node);
+    return 0;
+}
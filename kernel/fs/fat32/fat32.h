@@ -83,10 +83,96 @@ typedef struct {
     uint32_t root_cluster;
     uint32_t sectors_per_cluster;
     uint32_t bytes_per_cluster;
+    uint32_t sectors_per_fat;
+    uint32_t fat_count;
+    uint32_t total_clusters;   // Valid cluster numbers are 2 .. total_clusters + 1
     
-    // Cache or other info
+    // Allocation state (seeded from FSInfo, written back through the cache)
+    uint32_t fsinfo_sector;    // 0 = volume has no FSInfo
+    uint32_t free_count;       // 0xFFFFFFFF = unknown
+    uint32_t next_free;        // Where the next allocation search starts
 } fat32_fs_t;
 
+// FSInfo Sector
+#define FSINFO_LEAD_SIG   0x41615252
+#define FSINFO_STRUCT_SIG 0x61417272
+#define FSINFO_TRAIL_SIG  0xAA550000
+
+typedef struct __attribute__((packed)) {
+    uint32_t lead_sig;
+    uint8_t  reserved1[480];
+    uint32_t struct_sig;
+    uint32_t free_count;
+    uint32_t next_free;
+    uint8_t  reserved2[12];
+    uint32_t trail_sig;
+} fat32_fsinfo_t;
+
+#define FAT32_EOC         0x0FFFFFFF
+#define FAT32_PREALLOC_MIN 8      // Clusters reserved ahead when a file first grows
+#define FAT32_PREALLOC_MAX 256    // Cap on the geometric preallocation
+
+// File Extent Map
+// A file's cluster chain flattened into runs of physically contiguous
+// clusters. Built once from the FAT and kept in node->impl, so seeking is a
+// lookup instead of a chain walk and a run is read with one sector loop.
+// Growing files get clusters preallocated past EOF; the surplus is trimmed
+// again when the last descriptor on the file is closed.
+typedef struct {
+    uint32_t file_cluster;     // Index of the run's first cluster within the file
+    uint32_t disk_cluster;     // Cluster number on disk where the run starts
+    uint32_t count;            // Clusters in the run
+} fat32_extent_t;
+
+typedef struct fat32_file {
+    fs_node_t *node;
+    uint32_t dirent_lba;       // Sector holding our directory entry (0 = root)
+    uint32_t dirent_off;       // Byte offset of the entry in that sector
+    struct fat32_file *hnext;  // Node table chain (one node per entry)
+    uint32_t dir_cluster;      // Directory holding the entry
+    
+    uint8_t mapped;            // Extent map built
+    fat32_extent_t *extents;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t last;             // Extent used by the previous lookup
+    uint32_t clusters;         // Clusters in the chain (preallocation included)
+    uint32_t opens;            // Descriptors open on the node
+} fat32_file_t;
+
+// Directory Name Index
+// One scan of a directory decodes its VFAT long names and records every
+// entry; lookups then hash the case-folded long or 8.3 name instead of
+// rereading clusters, and readdir indexes the array directly. An index is
+// thrown away whenever its directory is modified and rebuilt on next use.
+#define FAT32_DIR_INDEX_SLOTS 32  // Directories with a live index
+#define FAT32_LFN_MAX         255
+
+typedef struct fat32_dirent_info {
+    char *name;                // Long name, or the 8.3 name when there is none
+    char short_name[13];
+    uint8_t attr;
+    uint32_t cluster;
+    uint32_t size;
+    uint32_t lba;              // Short entry location
+    uint32_t off;
+    uint32_t lfn_lba;          // First long-name slot (lfn_count slots precede the short entry)
+    uint32_t lfn_off;
+    uint32_t lfn_count;
+    struct fat32_dirent_info *long_next;
+    struct fat32_dirent_info *short_next;
+} fat32_dirent_info_t;
+
+typedef struct {
+    uint32_t dir_cluster;      // 0 = slot unused
+    uint32_t last_used;
+    fat32_dirent_info_t *entries;  // On-disk order
+    uint32_t count;
+    uint32_t nbuckets;
+    fat32_dirent_info_t **long_buckets;
+    fat32_dirent_info_t **short_buckets;
+} fat32_dir_index_t;
+
 // Function Prototypes
 void fat32_init(uint32_t partition_lba);
 fs_node_t *fat32_mount(void);
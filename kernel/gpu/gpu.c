@@ -1,6 +1,7 @@
 #include "gpu.h"
 #include "graphics.h"
 #include "ports.h"
+#include "pci.h"
 #include "string.h"
 
 /* External console logging */
@@ -37,16 +38,34 @@ static int detect_bochs_vga(void) {
 /* VMware SVGA Detection */
 static int detect_vmware_svga(void) {
     // VMware SVGA II uses PCI device 15ad:0405
-    // For now, we'll skip PCI enumeration and just return 0
-    // TODO: Implement PCI device enumeration
-    return 0;
+    // BAR0: I/O index/value ports, BAR1: framebuffer, BAR2: command FIFO
+    pci_device_t *dev = pci_find_device(0x15AD, 0x0405);
+    if (!dev || !(dev->bars[0].flags & PCI_BAR_IO)) return 0;
+
+    pci_enable_device(dev, 0);
+    gpu.type = GPU_VMWARE_SVGA;
+    gpu.name = "VMware SVGA II";
+    gpu.ioport_index = (uint16_t)dev->bars[0].base;
+    gpu.ioport_data = (uint16_t)(dev->bars[0].base + 1);
+    gpu.vram_size = dev->bars[1].size;
+    gpu.mmio_base = (void*)dev->bars[2].base;
+    gpu.has_vsync = 1;
+    return 1;
 }
 
 /* VirtualBox VGA Detection */
 static int detect_virtualbox_vga(void) {
-    // VirtualBox uses PCI device 80ee:beef
-    // TODO: Implement PCI device enumeration
-    return 0;
+    // VirtualBox uses PCI device 80ee:beef, BAR0 is the framebuffer.
+    // It speaks the Bochs VBE interface, so that probe normally wins first.
+    pci_device_t *dev = pci_find_device(0x80EE, 0xBEEF);
+    if (!dev) return 0;
+
+    pci_enable_device(dev, 0);
+    gpu.type = GPU_VIRTUALBOX_VGA;
+    gpu.name = "VirtualBox VGA";
+    gpu.vram_size = dev->bars[0].size;
+    gpu.has_vsync = 1;
+    return 1;
 }
 
 /* GPU Detection */
@@ -542,6 +542,39 @@ void graphics_draw_image(int x, int y, int w, int h, const uint32_t* data) {
     }
 }    
 
+// Opaque blit (no alpha test) - used to composite client surfaces.
+// 'stride' is the source row length in pixels.
+void graphics_blit(int x, int y, int w, int h, const uint32_t* data, int stride) {
+    if (!data || !backbuffer) return;
+    
+    rect_t img_rect = {x, y, w, h};
+    rect_t draw_rect;
+    
+    if (clip_rect.width == 0) {
+        clip_rect.width = fb.width; clip_rect.height = fb.height;
+    }
+    
+    if (!rect_intersect(&img_rect, &clip_rect, &draw_rect)) return;
+    
+    uint32_t bytes_per_pixel = fb.bpp / 8;
+    uint32_t internal_pitch = fb.width * bytes_per_pixel;
+    
+    for (int dy = 0; dy < draw_rect.height; dy++) {
+        int screen_y = draw_rect.y + dy;
+        const uint32_t *src = data + (screen_y - y) * stride + (draw_rect.x - x);
+        
+        if (fb.bpp == 32) {
+            // Whole row in one copy
+            uint32_t *dst = (uint32_t*)(backbuffer + screen_y * internal_pitch) + draw_rect.x;
+            memcpy(dst, src, draw_rect.width * 4);
+        } else {
+            for (int dx = 0; dx < draw_rect.width; dx++) {
+                set_pixel(draw_rect.x + dx, screen_y, src[dx] | 0xFF000000);
+            }
+        }
+    }
+}
+
 // Helper to separate alpha blending logic
 static void blend_pixel(int x, int y, uint32_t color) {
     if (x < 0 || x >= (int)fb.width || y < 0 || y >= (int)fb.height) return;
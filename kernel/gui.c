@@ -6,6 +6,11 @@
 #include "wm.h"
 #include <theme.h>
 #include "process.h" // For current_process
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+#include "vfs.h"
+#include "poll.h"
+#include "wait_queue.h"
 
 extern process_t *current_process;
 
@@ -326,6 +331,7 @@ void gui_run(void)
                           // Critical Section: Protect list modification from Syscall preemption
                           asm volatile("cli");
                           list_append(win->incoming_events, copy);
+                          wait_queue_wake_all(win->event_wait);
                           asm volatile("sti");
                       }
                  }
@@ -601,7 +607,17 @@ void gui_draw_window(gui_renderer_t *renderer, gui_element_t *element)
         }
     }
     
-    // 6. Draw Children (Content) being clipped to window bounds? 
+    // 6. Composite client surface (pixels already live in shared memory),
+    // clipped to the content area: the window may have shrunk since attach
+    if (win->surface) {
+        int blit_w = win->surface_w < bounds.width ? win->surface_w : bounds.width;
+        int blit_h = bounds.y + bounds.height - content_y;
+        if (blit_h > win->surface_h) blit_h = win->surface_h;
+        if (blit_w > 0 && blit_h > 0)
+            graphics_blit(bounds.x, content_y, blit_w, blit_h, win->surface, win->surface_w);
+    }
+    
+    // 7. Draw Children (Content) being clipped to window bounds? 
     // For now simple recursion.
     if (element->children) {
         list_node_t *child_node = element->children->head;
@@ -761,6 +777,12 @@ gui_window_t *gui_create_window(const char *title, int x, int y, int width, int
 {
     gui_window_t *win = (gui_window_t *)memory_alloc(sizeof(gui_window_t));
     if (!win) return NULL;
+    win->event_wait = (wait_queue_t*)memory_alloc(sizeof(wait_queue_t));
+    if (!win->event_wait) {
+        memory_free(win);
+        return NULL;
+    }
+    wait_queue_init(win->event_wait);
     
     win->base.type = GUI_ELEMENT_WINDOW;
     win->base.state = GUI_STATE_NORMAL;
@@ -795,6 +817,7 @@ gui_window_t *gui_create_window(const char *title, int x, int y, int width, int
     } else {
         win->owner_pid = 0; // Kernel
     }
+    win->owner_handle = GUI_HANDLE_INVALID; // Exported later by SYS_MITHL_GUI_CREATE
     win->incoming_events = list_create();
 
     win->base.event_handler = gui_window_event_handler;
@@ -943,3 +966,272 @@ void gui_window_add_tab(gui_window_t *window, const char *title, gui_element_t *
     
     gui_mgr.needs_redraw = 1;
 }
+
+// Tear down a window: detach it from the GUI tree and WM, then free it.
+void gui_destroy_window(gui_window_t *win) {
+    if (!win) return;
+    
+    // Critical Section: Tree and focus pointers are walked by the GUI loop
+    asm volatile("cli");
+    gui_invalidate_rect(win->base.bounds);
+    gui_remove_element((gui_element_t*)win);
+    wm_unmanage_window(win);
+    
+    if (gui_mgr.focused_element == (gui_element_t*)win) gui_mgr.focused_element = NULL;
+    if (gui_mgr.hovered_element == (gui_element_t*)win) gui_mgr.hovered_element = NULL;
+    if (gui_mgr.captured_element == (gui_element_t*)win) gui_mgr.captured_element = NULL;
+    
+    // Pollers see the window vanish (POLLHUP)
+    wait_queue_destroy(win->event_wait);
+    asm volatile("sti");
+    
+    gui_window_release_surface(win);
+    
+    // Drop undelivered events
+    if (win->incoming_events) {
+        gui_event_t *ev;
+        while ((ev = (gui_event_t*)list_pop_front(win->incoming_events))) memory_free(ev);
+        list_destroy(win->incoming_events);
+    }
+    if (win->base.children) list_destroy(win->base.children);
+    if (win->tabs) list_destroy(win->tabs);
+    if (win->title) memory_free(win->title);
+    memory_free(win->event_wait);
+    memory_free(win);
+}
+
+// --- Userspace Window Handles ---
+
+int gui_handle_alloc(gui_window_t *win) {
+    if (!win || !current_process) return GUI_HANDLE_INVALID;
+    
+    for (int h = 0; h < PROCESS_MAX_WINDOWS; h++) {
+        if (!current_process->windows[h]) {
+            current_process->windows[h] = win;
+            win->owner_handle = h;
+            return h;
+        }
+    }
+    return GUI_HANDLE_INVALID; // Table full
+}
+
+gui_window_t *gui_handle_lookup(int handle) {
+    if (!current_process) return NULL;
+    if (handle < 0 || handle >= PROCESS_MAX_WINDOWS) return NULL;
+    return current_process->windows[handle];
+}
+
+// Legacy syscalls (no handle argument) target the process' first window.
+int gui_handle_default(void) {
+    if (!current_process) return GUI_HANDLE_INVALID;
+    for (int h = 0; h < PROCESS_MAX_WINDOWS; h++) {
+        if (current_process->windows[h]) return h;
+    }
+    return GUI_HANDLE_INVALID;
+}
+
+void gui_handle_close(int handle) {
+    gui_window_t *win = gui_handle_lookup(handle);
+    if (!win) return;
+    current_process->windows[handle] = NULL;
+    gui_destroy_window(win);
+}
+
+void gui_handle_close_all(void) {
+    if (!current_process) return;
+    for (int h = 0; h < PROCESS_MAX_WINDOWS; h++) {
+        if (current_process->windows[h]) gui_handle_close(h);
+    }
+}
+
+// Execute a client draw command. Coordinates are relative to the content area.
+int gui_window_draw(gui_window_t *win, const gui_draw_cmd_t *cmd) {
+    if (!win || !cmd) return -1;
+    
+    int title_h = 30;
+    int win_x = win->base.bounds.x;
+    int win_y = win->base.bounds.y + title_h;
+    int abs_x = win_x + cmd->x;
+    int abs_y = win_y + cmd->y;
+    
+    switch (cmd->op) {
+        case GUI_DRAW_RECT:
+            {
+                // Basic Clipping against window origin (not perfect, but safe)
+                if (abs_x < win_x) abs_x = win_x;
+                if (abs_y < win_y) abs_y = win_y;
+                
+                rect_t r = {abs_x, abs_y, cmd->w, cmd->h};
+                draw_rect_filled(r, cmd->color);
+                gui_invalidate_rect(r);
+            }
+            return 0;
+            
+        case GUI_DRAW_TEXT:
+            {
+                const char *msg = (const char*)cmd->data;
+                if (!msg) return -1;
+                draw_text(msg, abs_x, abs_y, cmd->color, 12); // Default size 12
+                // Invalidate text area (guesstimate)
+                gui_invalidate_rect((rect_t){abs_x, abs_y, strlen(msg)*10, 16});
+            }
+            return 0;
+            
+        case GUI_DRAW_IMAGE:
+            if (!cmd->data) return -1;
+            graphics_draw_image(abs_x, abs_y, cmd->w, cmd->h, (const uint32_t*)cmd->data);
+            gui_invalidate_rect((rect_t){abs_x, abs_y, cmd->w, cmd->h});
+            return 0;
+            
+        default:
+            return -1;
+    }
+}
+
+int gui_window_pop_event(gui_window_t *win, gui_event_t *out) {
+    if (!win || !win->incoming_events || !out) return 0;
+    
+    // Critical Section: GUI loop appends to this list
+    asm volatile("cli");
+    gui_event_t *ev = NULL;
+    if (win->incoming_events->head) {
+        ev = (gui_event_t*)list_pop_front(win->incoming_events);
+    }
+    asm volatile("sti");
+    
+    if (!ev) return 0;
+    *out = *ev;
+    memory_free(ev);
+    return 1;
+}
+
+// --- Shared Surfaces ---
+
+uint32_t gui_window_attach_surface(gui_window_t *win, int w, int h) {
+    if (!win || win->owner_handle < 0 || win->surface) return 0;
+    
+    // Clamp to content area so the blit never spills over the chrome
+    int title_h = 30;
+    if (w <= 0 || h <= 0) return 0;
+    if (w > win->base.bounds.width) w = win->base.bounds.width;
+    if (h > win->base.bounds.height - title_h) h = win->base.bounds.height - title_h;
+    if (h <= 0) return 0;
+    
+    uint32_t bytes = (uint32_t)w * h * 4;
+    if (bytes > GUI_SURFACE_SLOT) return 0;
+    uint32_t pages = (bytes + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    
+    void *phys = pmm_alloc_contiguous(pages);
+    if (!phys) return 0;
+    
+    // Compositor reads the frames through the 128MB identity map
+    if ((uint32_t)phys + pages * PMM_PAGE_SIZE > 0x08000000) {
+        pmm_free_contiguous(phys, pages);
+        return 0;
+    }
+    memset(phys, 0, pages * PMM_PAGE_SIZE);
+    
+    // Map into the caller (owner) address space
+    uint32_t user = GUI_SURFACE_BASE + win->owner_handle * GUI_SURFACE_SLOT;
+    for (uint32_t i = 0; i < pages; i++) {
+        vmm_map_page(0, (void*)((uint32_t)phys + i * PMM_PAGE_SIZE), (void*)(user + i * PMM_PAGE_SIZE));
+    }
+    
+    win->surface_w = w;
+    win->surface_h = h;
+    win->surface_pages = pages;
+    win->surface_user = user;
+    win->surface = (uint32_t*)phys; // Publish last: GUI loop checks this pointer
+    return user;
+}
+
+// Must run in the owner's address space (destroy / exit path)
+void gui_window_release_surface(gui_window_t *win) {
+    if (!win || !win->surface) return;
+    
+    uint32_t *phys = win->surface;
+    win->surface = NULL;
+    
+    for (uint32_t i = 0; i < win->surface_pages; i++) {
+        vmm_unmap_page(0, (void*)(win->surface_user + i * PMM_PAGE_SIZE));
+    }
+    pmm_free_contiguous(phys, win->surface_pages);
+    win->surface_pages = 0;
+    win->surface_user = 0;
+}
+
+// Client finished a frame: only the damaged part is recomposited
+int gui_window_commit(gui_window_t *win, rect_t damage) {
+    if (!win || !win->surface) return -1;
+    
+    // Empty damage = whole surface
+    if (damage.width <= 0 || damage.height <= 0) {
+        damage = (rect_t){0, 0, win->surface_w, win->surface_h};
+    }
+    
+    // Clip to surface
+    if (damage.x < 0) { damage.width += damage.x; damage.x = 0; }
+    if (damage.y < 0) { damage.height += damage.y; damage.y = 0; }
+    if (damage.x + damage.width > win->surface_w) damage.width = win->surface_w - damage.x;
+    if (damage.y + damage.height > win->surface_h) damage.height = win->surface_h - damage.y;
+    if (damage.width <= 0 || damage.height <= 0) return 0;
+    
+    int title_h = 30;
+    damage.x += win->base.bounds.x;
+    damage.y += win->base.bounds.y + title_h;
+    
+    asm volatile("cli");
+    gui_invalidate_rect(damage);
+    asm volatile("sti");
+    return 0;
+}
+
+// --- Window Event FDs ---
+// Lets a client wait on its window together with pipes/tty via poll/epoll.
+// The node remembers the handle, not the window, so a destroyed window
+// simply reads as hung up.
+
+static gui_window_t *gui_event_node_window(fs_node_t *node) {
+    return gui_handle_lookup((int)node->impl);
+}
+
+static uint32_t gui_event_node_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    (void)offset;
+    gui_window_t *win = gui_event_node_window(node);
+    uint32_t done = 0;
+    
+    // Whole events only; never blocks (poll first)
+    while (win && size - done >= sizeof(gui_event_t)) {
+        if (!gui_window_pop_event(win, (gui_event_t*)(buffer + done))) break;
+        done += sizeof(gui_event_t);
+    }
+    return done;
+}
+
+static uint32_t gui_event_node_poll(fs_node_t *node, struct wait_queue **wq) {
+    gui_window_t *win = gui_event_node_window(node);
+    if (!win) return POLLHUP;
+    
+    *wq = win->event_wait;
+    return (win->incoming_events && win->incoming_events->head) ? POLLIN : 0;
+}
+
+static void gui_event_node_close(fs_node_t *node) {
+    memory_free(node);
+}
+
+fs_node_t *gui_window_event_node(int handle) {
+    if (!gui_handle_lookup(handle)) return NULL;
+    
+    fs_node_t *node = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
+    if (!node) return NULL;
+    
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, "gui_events");
+    node->flags = FS_CHARDEVICE;
+    node->impl = (uint32_t)handle;
+    node->read = gui_event_node_read;
+    node->poll = gui_event_node_poll;
+    node->close = gui_event_node_close;
+    return node;
+}
@@ -2,6 +2,9 @@
 #include "string.h"
 #include "console.h"
 #include "ports.h"
+#include "pit.h"
+#include "lapic.h"
+#include "mm/vmm.h"
 
 idt_entry_t idt_entries[256];
 idt_ptr_t   idt_ptr;
@@ -18,6 +21,13 @@ extern void isr20(); extern void isr21(); extern void isr22(); extern void isr23
 extern void isr24(); extern void isr25(); extern void isr26(); extern void isr27();
 extern void isr28(); extern void isr29(); extern void isr30(); extern void isr31();
 extern void isr128(); // Syscall
+extern void irq1(); extern void irq2(); extern void irq3(); extern void irq4();
+extern void irq5(); extern void irq6(); extern void irq7(); extern void irq8();
+extern void irq9(); extern void irq10(); extern void irq11(); extern void irq12();
+extern void irq13(); extern void irq14(); extern void irq15();
+extern void irq16(); extern void irq17(); extern void irq18(); extern void irq19();
+extern void irq20(); extern void irq21(); extern void irq22(); extern void irq23();
+extern void irq_spurious();
 
 static void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags)
 {
@@ -103,6 +113,13 @@ static const char *exception_messages[] = {
 
 void isr_handler(registers_t *regs)
 {
+    // Copy-on-write faults are not errors
+    if (regs->int_no == 14) {
+        uint32_t cr2;
+        asm volatile("mov %%cr2, %0" : "=r"(cr2));
+        if (vmm_handle_fault(cr2, regs->err_code)) return;
+    }
+
     // LOG TO SERIAL FIRST (Reliable)
     serial_write("\n\n=== KERNEL PANIC ===\n");
     serial_write("Exception: ");
@@ -178,6 +195,38 @@ void isr_handler(registers_t *regs)
     for (;;) { __asm__ volatile("hlt"); }
 }
 
+// --- Hardware IRQs (1-15) and MSI vectors ---
+
+static irq_handler_t irq_handlers[IRQ_MSI_FIRST + IRQ_MSI_COUNT];
+
+void irq_install_handler(uint8_t irq, irq_handler_t handler)
+{
+    if (irq >= 16) return;
+    irq_handlers[irq] = handler;
+    pic_unmask(irq);
+}
+
+int irq_install_msi(irq_handler_t handler)
+{
+    for (int i = IRQ_MSI_FIRST; i < IRQ_MSI_FIRST + IRQ_MSI_COUNT; i++) {
+        if (!irq_handlers[i]) {
+            irq_handlers[i] = handler;
+            return 32 + i;
+        }
+    }
+    return -1;
+}
+
+void irq_handler(registers_t *regs)
+{
+    uint8_t irq = regs->int_no - 32;
+    
+    // Acknowledge first so an edge raised while the handler runs is not lost
+    if (irq >= IRQ_MSI_FIRST) lapic_eoi();
+    else pic_eoi(irq);
+    if (irq < IRQ_MSI_FIRST + IRQ_MSI_COUNT && irq_handlers[irq]) irq_handlers[irq](regs);
+}
+
 void idt_init(void)
 {
     idt_ptr.limit = sizeof(idt_entry_t) * 256 - 1;
@@ -222,6 +271,34 @@ void idt_init(void)
     extern void irq0();
     idt_set_gate(32, (uint32_t)irq0,  0x08, 0x8E);
     
+    // IRQ1-15 share one dispatcher; drivers attach with irq_install_handler()
+    idt_set_gate(33, (uint32_t)irq1,  0x08, 0x8E);
+    idt_set_gate(34, (uint32_t)irq2,  0x08, 0x8E);
+    idt_set_gate(35, (uint32_t)irq3,  0x08, 0x8E);
+    idt_set_gate(36, (uint32_t)irq4,  0x08, 0x8E);
+    idt_set_gate(37, (uint32_t)irq5,  0x08, 0x8E);
+    idt_set_gate(38, (uint32_t)irq6,  0x08, 0x8E);
+    idt_set_gate(39, (uint32_t)irq7,  0x08, 0x8E);
+    idt_set_gate(40, (uint32_t)irq8,  0x08, 0x8E);
+    idt_set_gate(41, (uint32_t)irq9,  0x08, 0x8E);
+    idt_set_gate(42, (uint32_t)irq10, 0x08, 0x8E);
+    idt_set_gate(43, (uint32_t)irq11, 0x08, 0x8E);
+    idt_set_gate(44, (uint32_t)irq12, 0x08, 0x8E);
+    idt_set_gate(45, (uint32_t)irq13, 0x08, 0x8E);
+    idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
+    idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
+
+    // MSI vectors (acknowledged at the local APIC) and its spurious vector
+    idt_set_gate(48, (uint32_t)irq16, 0x08, 0x8E);
+    idt_set_gate(49, (uint32_t)irq17, 0x08, 0x8E);
+    idt_set_gate(50, (uint32_t)irq18, 0x08, 0x8E);
+    idt_set_gate(51, (uint32_t)irq19, 0x08, 0x8E);
+    idt_set_gate(52, (uint32_t)irq20, 0x08, 0x8E);
+    idt_set_gate(53, (uint32_t)irq21, 0x08, 0x8E);
+    idt_set_gate(54, (uint32_t)irq22, 0x08, 0x8E);
+    idt_set_gate(55, (uint32_t)irq23, 0x08, 0x8E);
+    idt_set_gate(255, (uint32_t)irq_spurious, 0x08, 0x8E);
+    
     // Syscall Gate (0x80)
     // Flags: Present(0x80) | DPL3(0x60) | Interrupt Gate(0xE) = 0xEE
     idt_set_gate(128, (uint32_t)isr128, 0x08, 0xEE); 
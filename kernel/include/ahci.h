@@ -0,0 +1,22 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+// AHCI SATA
+// Every SATA disk on an AHCI controller becomes a block device ("sata0",
+// "sata1", ...). Each port has a 32-slot command list and a FIS receive
+// area; with native command queuing all slots can be in flight at once,
+// so the block queue's depth is the drive's queue depth. Completions come
+// in by MSI when the local APIC is usable, otherwise by the PCI INTx line.
+//
+// Devices register after the legacy IDE disk, so blk_default() still
+// picks that one when both exist.
+
+#define AHCI_MAX_PORTS      4           // Disks we drive per controller
+#define AHCI_MAX_SECTORS    1024        // Per command; fits any PRD table
+#define AHCI_MAX_BIOS       64
+
+void ahci_init(void);
+
+#endif
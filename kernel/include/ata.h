@@ -3,8 +3,19 @@
 
 #include <stdint.h>
 
+// Sectors per command: the count register wraps 0 to the maximum
+#define ATA_MAX_SECTORS_28  256
+#define ATA_MAX_SECTORS_48  65536
+
 int ata_read_sector(uint32_t lba, uint8_t *buffer);
 int ata_write_sector(uint32_t lba, const uint8_t *buffer);
+
+// Multi-sector PIO; split into as few commands as the drive allows.
+// Return 0 on success like the single-sector calls.
+int ata_read_sectors(uint32_t lba, uint32_t count, uint8_t *buffer);
+int ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buffer);
+
+// Identify the drive (LBA48, READ/WRITE MULTIPLE); runs on first use if not called
 void ata_init(void);
 
 #endif
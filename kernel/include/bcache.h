@@ -0,0 +1,73 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+
+// Block Buffer Cache
+// 512-byte disk sectors cached by LBA (hash + LRU). All filesystem metadata
+// (boot sector, FAT, directories) goes through here.
+// Writes are write-back: buffers are marked dirty and the "bflush" kernel
+// thread writes them out once they are old enough, or bcache_sync() forces
+// everything to disk. Both submit a batch of buffers to the block queue at
+// once so adjacent sectors are merged into one command.
+//
+// Bulk file data should use the *_bypass calls so it does not push metadata
+// out of the cache; they still see (and update) any cached copy.
+
+#define BCACHE_SECTOR_SIZE   512
+#define BCACHE_BUFFERS       512     // 256KB of cached sectors
+#define BCACHE_BUCKETS       128
+#define BCACHE_FLUSH_MS      1000    // Flusher wakeup interval
+#define BCACHE_DIRTY_AGE_MS  3000    // Dirty buffers older than this get written
+#define BCACHE_BATCH         64      // Bios submitted together by write-back and span reads
+
+typedef struct buffer_head {
+    uint32_t lba;
+    uint8_t valid;                   // data matches the disk (or is newer)
+    uint8_t dirty;                   // data newer than the disk
+    uint8_t writeback;               // Write-backs of it in flight
+    uint16_t refcount;               // Pinned while > 0, never evicted
+    uint32_t seq;                    // Bumped on every modification
+    uint32_t dirty_tick;             // When it first became dirty
+    struct buffer_head *hnext;
+    struct buffer_head *lru_prev;
+    struct buffer_head *lru_next;
+    uint8_t *data;
+} buffer_head_t;
+
+void bcache_init(void);
+
+// Pin a sector (reading it in if needed); NULL on I/O error
+buffer_head_t *bcache_get(uint32_t lba);
+void bcache_put(buffer_head_t *bh);
+void bcache_mark_dirty(buffer_head_t *bh);
+
+// Copying helpers built on get/put; return 0 on success like ata_*_sector
+int bcache_read(uint32_t lba, uint8_t *buffer);
+int bcache_write(uint32_t lba, const uint8_t *buffer);
+
+// Uncached transfers that stay coherent with the cache
+int bcache_read_bypass(uint32_t lba, uint8_t *buffer);
+int bcache_write_bypass(uint32_t lba, const uint8_t *buffer);
+
+// Multi-sector versions: one disk request per run instead of one per sector
+int bcache_read_span(uint32_t lba, uint32_t count, uint8_t *buffer);
+int bcache_write_span(uint32_t lba, uint32_t count, const uint8_t *buffer);
+
+// Several runs submitted together (the block queue merges neighbours);
+// returns once all have arrived
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+    uint8_t *buffer;
+} bcache_span_t;
+
+int bcache_read_spans(const bcache_span_t *spans, uint32_t n);
+
+// Write every dirty buffer now; returns number of failed writes
+int bcache_sync(void);
+
+// Spawn the write-back thread (needs the process manager)
+void bcache_start_flusher(void);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef BLK_H
+#define BLK_H
+
+#include <stdint.h>
+#include "wait_queue.h"
+#include "mm/vmm.h"
+
+// Block Layer
+// Filesystems describe I/O as bios (a sector range plus a buffer) and
+// submit them to a device. Each device keeps one request queue sorted by
+// LBA: a bio that continues (or precedes) a queued request in the same
+// direction is merged into it, so sequential I/O becomes one command.
+// Dispatch is C-LOOK (ascending from the last position, then wrap), with
+// a deadline so a far-away request is not starved by a busy region.
+// Drivers finish requests with blk_end_request(), normally from their
+// IRQ handler; submitters sleep on the device wait queue meanwhile.
+//
+// Batch submitters plug the queue, submit, unplug and then wait: nothing
+// is dispatched while plugged, which gives the merging a chance.
+// Overlapping requests are not ordered against each other; keeping them
+// apart is up to the caller (the buffer cache does).
+
+#define BLK_SECTOR_SIZE     512
+#define BLK_REQUESTS        128     // Request pool shared by all devices
+#define BLK_READ_EXPIRE_MS  500     // Deadline before a request jumps the C-LOOK order
+#define BLK_WRITE_EXPIRE_MS 5000
+#define BLK_POLL_TICKS      2       // Waiters re-poll the driver if an IRQ goes missing
+
+struct bio;
+struct blk_device;
+
+typedef void (*bio_end_t)(struct bio *bio);
+
+typedef struct bio {
+    uint32_t lba;
+    uint32_t count;             // Sectors
+    uint8_t *buffer;            // Virtual address in 'pd'
+    pd_entry_t *pd;             // Address space at submit (set by blk_submit)
+    uint8_t write;
+    volatile uint8_t done;
+    volatile int8_t error;
+    bio_end_t end_io;           // Optional, called with IRQs off when done
+    void *private;
+    struct bio *next;           // Next bio of the same request
+} bio_t;
+
+// Consecutive bios of one direction; the driver runs it as one command
+typedef struct blk_request {
+    uint32_t lba;
+    uint32_t count;
+    uint32_t nbio;
+    uint8_t write;
+    uint32_t deadline;          // Tick after which it is served first
+    bio_t *bio;
+    bio_t *bio_tail;
+    void *driver_data;          // Free for the driver while in flight
+    struct blk_request *next;
+} blk_request_t;
+
+typedef struct blk_device {
+    const char *name;
+    uint32_t sectors;           // Capacity, 0 if unknown
+    uint32_t max_sectors;       // Merging stops here; drivers split larger bios
+    uint32_t max_bios;          // Scatter-gather segments per request
+    uint32_t depth;             // Requests the driver accepts at once
+
+    // Begin a request; completion is reported through blk_end_request(),
+    // which may happen before start() returns. Non-zero fails it at once.
+    int (*start)(struct blk_device *dev, blk_request_t *req);
+    // Check for completions without an interrupt (may be NULL)
+    void (*poll)(struct blk_device *dev);
+    // End of a dispatch round that started requests (may be NULL): drivers
+    // that batch their doorbell ring it here once instead of per start()
+    void (*commit)(struct blk_device *dev);
+    void *driver_data;
+    // Set by the driver while its command in flight only advances from
+    // poll() (no IRQ to wait for): sleeping waiters poll it instead
+    volatile uint8_t polled;
+
+    // Owned by the block layer
+    blk_request_t *queue;       // Sorted by LBA
+    uint32_t inflight;
+    uint32_t position;          // LBA after the last dispatched request
+    uint32_t plugged;
+    int dispatching;
+    wait_queue_t wait;
+    struct blk_device *next;
+} blk_device_t;
+
+void blk_register(blk_device_t *dev);
+blk_device_t *blk_get(const char *name);
+// First registered device: the disk the buffer cache serves
+blk_device_t *blk_default(void);
+
+// Queue a bio; never sleeps. A full request pool is drained by polling.
+void blk_submit(blk_device_t *dev, bio_t *bio);
+// Returns the bio's error (0 on success). Waiters without a task to
+// switch to, or with can_sleep clear, poll the driver instead.
+int blk_wait(blk_device_t *dev, bio_t *bio, int can_sleep);
+// Synchronous convenience: one bio, submitted and waited for
+int blk_rw(blk_device_t *dev, uint32_t lba, uint32_t count, uint8_t *buffer, int write, int can_sleep);
+
+void blk_plug(blk_device_t *dev);
+void blk_unplug(blk_device_t *dev);
+
+// Drivers: finish a request started by start()
+void blk_end_request(blk_device_t *dev, blk_request_t *req, int error);
+
+// Drivers: reach bio data from any address space. blk_bio_map() returns a
+// pointer valid for 'len' bytes at 'offset', or NULL if the range is not
+// contiguous there; blk_bio_copy() goes page by page (-1 if unreachable).
+uint8_t *blk_bio_map(bio_t *bio, uint32_t offset, uint32_t len);
+int blk_bio_copy(bio_t *bio, uint32_t offset, uint8_t *data, uint32_t len, int to_bio);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "types.h"
+#include "vfs.h"
+
+// Dentry Cache
+// Remembers (parent node, component name) -> child node so path walks hit a
+// hash bucket instead of calling the filesystem's finddir per segment.
+// Misses are cached too (node == NULL) so probing $PATH for a binary that
+// does not exist in most directories stays cheap. Entries live in a fixed
+// pool and are recycled least-recently-used first.
+//
+// Anything that changes a directory's contents must invalidate:
+//   create/mkdir -> dcache_invalidate(parent, name)   (drop negative entry)
+//   unlink       -> dcache_invalidate(parent, name)   (drop positive entry)
+//   rename       -> both old and new names
+//   node freed   -> dcache_invalidate_node(node)      (as parent and child)
+
+#define DCACHE_BUCKETS  256
+#define DCACHE_ENTRIES  512
+#define DCACHE_NAME_MAX 128
+
+#define DCACHE_MISS     0   // Not cached, ask the filesystem
+#define DCACHE_HIT      1   // *out is the child
+#define DCACHE_NEGATIVE 2   // Cached "does not exist"
+
+void dcache_init(void);
+
+int  dcache_lookup(fs_node_t *parent, const char *name, fs_node_t **out);
+void dcache_insert(fs_node_t *parent, const char *name, fs_node_t *node);
+
+void dcache_invalidate(fs_node_t *parent, const char *name);
+void dcache_invalidate_node(fs_node_t *node);
+
+// finddir_fs() through the cache
+fs_node_t *dcache_finddir(fs_node_t *parent, char *name);
+
+#endif
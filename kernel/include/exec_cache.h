@@ -0,0 +1,62 @@
+#ifndef EXEC_CACHE_H
+#define EXEC_CACHE_H
+
+#include "types.h"
+#include "vfs.h"
+#include "elf.h"
+
+// Exec Cache
+// What exec needs from an ELF file, worked out once per binary: the
+// PT_LOAD segments at their final addresses (the mapping plan), the entry
+// point and the initial aux vector. A program with an interpreter keeps
+// the interpreter's path, resolved again on every exec (ld.so may have been
+// replaced since); its own image (biased to 0x40000000) is cached the same
+// way and shared by every program that names it.
+//
+// Nodes carry no mtime, so entries are keyed by node, inode and length,
+// and write_fs(), truncate_fs() and unlink_fs() drop them: a rebuilt or
+// replaced binary is parsed afresh on its next exec.
+
+#define EXEC_CACHE_SLOTS   16
+#define EXEC_MAX_SEGMENTS  8
+#define EXEC_MAX_AUXV      8
+#define EXEC_INTERP_MAX    256
+
+typedef struct exec_segment {
+    uint32_t vaddr;             // Load bias applied
+    uint32_t memsz;
+    uint32_t offset;
+    uint32_t filesz;
+} exec_segment_t;
+
+typedef struct exec_image {
+    fs_node_t *node;            // NULL: slot empty
+    uint32_t inode;
+    uint32_t length;
+    uint8_t valid;              // Cleared when the file changes
+    uint32_t users;             // Execs working from this entry right now
+    uint32_t stamp;             // Last use, for LRU replacement
+
+    uint32_t base;              // Load bias
+    uint32_t entry;             // This file's entry point (bias applied)
+    exec_segment_t segs[EXEC_MAX_SEGMENTS];
+    uint32_t nsegs;
+    char interp[EXEC_INTERP_MAX]; // PT_INTERP path, empty for static programs
+    Elf32_auxv_t auxv[EXEC_MAX_AUXV];
+    uint32_t auxc;              // AT_BASE is added at exec
+} exec_image_t;
+
+// Pinned entry for 'node', or NULL on a miss
+exec_image_t *exec_cache_get(fs_node_t *node);
+
+// Store a copy of a freshly parsed image and return it pinned. NULL when
+// every slot is in use; the caller then keeps working from its own copy.
+exec_image_t *exec_cache_put(const exec_image_t *img);
+
+// Unpin. Returns 0 (and does nothing) if 'img' is not a cache entry.
+int exec_cache_release(exec_image_t *img);
+
+// The file changed or went away
+void exec_cache_invalidate(fs_node_t *node);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef FD_H
+#define FD_H
+
+#include "process.h"
+#include "vfs.h"
+
+#define FD_MAX 256
+
+// Descriptor of the current process, or NULL if fd is not open
+struct file_descriptor *fd_get(int fd);
+
+// Install node in the lowest free slot >= 3; returns fd or -1 (EMFILE)
+int fd_install(fs_node_t *node, int flags);
+
+// Shared by the read/write/open/close syscalls and the submission ring.
+// Pass FD_OFFSET_CUR to use (and advance) the descriptor's own offset.
+#define FD_OFFSET_CUR 0xFFFFFFFF
+int fd_read(int fd, void *buf, uint32_t count, uint32_t offset);
+int fd_write(int fd, const void *buf, uint32_t count, uint32_t offset);
+// fd_open flags (Linux values, matching userspace fcntl.h)
+#define FD_O_CREAT 0x0040
+#define FD_O_TRUNC 0x0200
+int fd_open(const char *path, int flags);
+int fd_close(int fd);
+int fd_fsync(int fd);
+
+// fcntl commands (Linux values). F_SETPIPE_SZ sets how far a pipe may
+// grow and returns it; F_GETPIPE_SZ reads it back.
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+int sys_fcntl(int fd, int cmd, uint32_t arg);
+
+// Vectored and in-kernel transfers
+struct iovec {
+    void *iov_base;
+    uint32_t iov_len;
+};
+#define IOV_MAX 1024
+
+int sys_readv(int fd, const struct iovec *iov, int iovcnt);
+int sys_writev(int fd, const struct iovec *iov, int iovcnt);
+int sys_sendfile(int out_fd, int in_fd, uint32_t *offset, uint32_t count);
+int sys_splice(int fd_in, uint32_t *off_in, int fd_out, uint32_t *off_out, uint32_t len);
+
+// vmsplice flags (Linux values): GIFT on a write end, MOVE on a read end
+#define SPLICE_F_MOVE 0x01
+#define SPLICE_F_GIFT 0x08
+int sys_vmsplice(int fd, const struct iovec *iov, int iovcnt, uint32_t flags);
+
+#endif
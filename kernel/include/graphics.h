@@ -82,6 +82,7 @@ void draw_text_sf_mono(const char *text, int x, int y, uint32_t color);
 int get_text_width_sf(const char *text);
 void draw_text_centered(const char *text, rect_t rect, uint32_t color, uint32_t size);
 void graphics_draw_image(int x, int y, int w, int h, const uint32_t* data);
+void graphics_blit(int x, int y, int w, int h, const uint32_t* data, int stride);
 
 void draw_boot_logo(void);
 
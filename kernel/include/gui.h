@@ -139,7 +139,15 @@ typedef struct gui_window
 
     /* --- Userspace Integration --- */
     int owner_pid;                   // Process ID of the owner (0 = Kernel)
+    int owner_handle;                // Index in owner's window table (-1 = not exported)
     list_t *incoming_events;         // Queue of events pending delivery to Userspace
+    struct wait_queue *event_wait;   // Woken when incoming_events grows
+    
+    /* --- Shared Surface (client renders, compositor blits) --- */
+    uint32_t *surface;               // Kernel view of the pixels (identity-mapped frames)
+    int surface_w, surface_h;
+    uint32_t surface_pages;
+    uint32_t surface_user;           // Client virtual address of the same frames
 } gui_window_t;
 
 /* Button structure */
@@ -216,6 +224,46 @@ gui_button_t *gui_create_button(const char *text, int x, int y, int width, int h
 gui_label_t *gui_create_label(const char *text, int x, int y, int width, int height);
 gui_panel_t *gui_create_panel(int x, int y, int width, int height);
 
+void gui_destroy_window(gui_window_t *win);
+
+/* --- Userspace Window Handles --- */
+// Handles are small integers indexing the calling process' window table,
+// so syscalls resolve their target window in O(1) instead of walking the tree.
+#define GUI_HANDLE_INVALID (-1)
+
+int gui_handle_alloc(gui_window_t *win);     // Export window to current process
+gui_window_t *gui_handle_lookup(int handle); // Resolve handle of current process
+int gui_handle_default(void);                // Lowest live handle (legacy syscalls)
+void gui_handle_close(int handle);           // Destroy window and free handle
+void gui_handle_close_all(void);             // Process teardown
+
+/* Batched draw command (SYS_GUI_DRAW). Coordinates are client-area relative. */
+typedef enum {
+    GUI_DRAW_RECT,
+    GUI_DRAW_TEXT,
+    GUI_DRAW_IMAGE
+} gui_draw_op_t;
+
+typedef struct {
+    int op;             // gui_draw_op_t
+    int x, y, w, h;
+    uint32_t color;
+    const void *data;   // GUI_DRAW_TEXT: char*, GUI_DRAW_IMAGE: uint32_t* pixels
+} gui_draw_cmd_t;
+
+int gui_window_draw(gui_window_t *win, const gui_draw_cmd_t *cmd);
+int gui_window_pop_event(gui_window_t *win, gui_event_t *out); // 1 = event copied, 0 = empty
+
+// Shared-memory surfaces: one 4MB slot of client address space per handle
+#define GUI_SURFACE_BASE 0xA0000000
+#define GUI_SURFACE_SLOT 0x00400000  // Max 1024x1024 ARGB
+uint32_t gui_window_attach_surface(gui_window_t *win, int w, int h); // Returns client address, 0 on failure
+void gui_window_release_surface(gui_window_t *win);
+int gui_window_commit(gui_window_t *win, rect_t damage);
+
+// Pollable fd node delivering a window's events (SYS_GUI_EVENT_FD)
+struct fs_node *gui_window_event_node(int handle);
+
 /* Drawing functions (can be generic and theme-dependent) */
 void gui_draw_element_default(gui_renderer_t *renderer, gui_element_t *element);
 void gui_draw_recursive(gui_renderer_t *renderer, gui_element_t *element);
@@ -29,4 +29,16 @@ typedef struct {
 void idt_init(void);
 void isr_handler(registers_t *regs);
 
+// Hardware IRQs 1-15 (IRQ0 stays hardwired to the PIT). Installing a
+// handler unmasks the line; the PIC is acknowledged before it runs.
+typedef void (*irq_handler_t)(registers_t *regs);
+void irq_install_handler(uint8_t irq, irq_handler_t handler);
+void irq_handler(registers_t *regs);
+
+// MSI vectors 48-55 share the dispatcher but are acknowledged at the
+// local APIC. Returns the vector, or -1 when all are taken.
+#define IRQ_MSI_FIRST   16
+#define IRQ_MSI_COUNT   8
+int irq_install_msi(irq_handler_t handler);
+
 #endif
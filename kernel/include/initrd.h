@@ -0,0 +1,34 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+
+// Packed Initrd Archive (built by tools/mkinitrd.py)
+//
+//   [header][index: count entries, sorted by path][path strings][pad]
+//   [file data, each file starting on a 4KB boundary]
+//
+// Paths are relative ("bin/ls.elf"), '/'-separated, without NUL and
+// compared bytewise, so every directory's contents form one contiguous
+// run of the index. ramfs reads file data in place; nothing is copied.
+
+#define INITRD_MAGIC    0x4452494D      // "MIRD"
+#define INITRD_VERSION  1
+#define INITRD_ALIGN    4096
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;           // Index entries
+    uint32_t index_off;       // From the start of the archive
+    uint32_t total_size;
+} initrd_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t path_off;        // From the start of the archive
+    uint32_t path_len;
+    uint32_t data_off;        // INITRD_ALIGN-aligned
+    uint32_t size;
+} initrd_entry_t;
+
+#endif
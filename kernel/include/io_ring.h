@@ -0,0 +1,64 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "types.h"
+
+// Submission/Completion Rings (io_uring-style)
+// One physically contiguous region shared with the process:
+//   [io_ring_hdr_t][sqes: io_sqe_t * sq_entries][cqes: io_cqe_t * cq_entries]
+// Userspace fills SQEs and bumps sq_tail; the kernel consumes them in
+// SYS_IO_RING_ENTER, appends CQEs at cq_tail, and userspace reaps from cq_head.
+
+#define IO_RING_BASE      0xA4000000   // Mapped at IO_RING_BASE + fd * IO_RING_SLOT
+#define IO_RING_SLOT      0x00010000   // 64KB per ring
+#define IO_RING_MAX_SQ    256
+#define IO_RING_MAX_POLLS 32           // Outstanding IORING_OP_POLL requests per ring
+
+// Opcodes
+#define IORING_OP_NOP    0
+#define IORING_OP_READ   1   // fd, addr=buf, len, off
+#define IORING_OP_WRITE  2   // fd, addr=buf, len, off
+#define IORING_OP_OPEN   3   // addr=path, op_flags=flags -> res = fd
+#define IORING_OP_CLOSE  4   // fd
+#define IORING_OP_FSYNC  5   // fd
+#define IORING_OP_POLL   6   // fd, op_flags=POLL* mask -> res = revents (completes when ready)
+
+#define IORING_OFF_CUR   0xFFFFFFFF    // off: use/advance the fd's file position
+
+// io_ring_enter flags
+#define IORING_ENTER_GETEVENTS 0x1     // Wait for min_complete CQEs
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t fd;
+    uint32_t off;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t op_flags;
+    uint32_t user_data;
+    uint32_t pad;
+} io_sqe_t; // 32 bytes
+
+typedef struct {
+    uint32_t user_data;
+    int32_t res;
+} io_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head;  // Kernel advances
+    volatile uint32_t sq_tail;  // User advances
+    volatile uint32_t cq_head;  // User advances
+    volatile uint32_t cq_tail;  // Kernel advances
+    uint32_t sq_entries;        // Power of two
+    uint32_t cq_entries;        // 2 * sq_entries
+    uint32_t sqes_off;          // Byte offsets from the start of the region
+    uint32_t cqes_off;
+    volatile uint32_t cq_overflow; // CQEs dropped because the CQ was full
+} io_ring_hdr_t;
+
+int sys_io_ring_setup(uint32_t entries, uint32_t *out_addr);
+int sys_io_ring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+#endif
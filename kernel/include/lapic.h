@@ -0,0 +1,24 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdint.h>
+#include "idt.h"
+
+// Local APIC
+// Legacy devices still interrupt through the 8259 PIC (the LAPIC stays in
+// virtual-wire mode for them). The LAPIC is only brought up to take
+// message-signalled interrupts: PCI devices write the message straight
+// to it, and the handler acknowledges it instead of the PIC.
+
+#define LAPIC_MSI_ADDRESS   0xFEE00000  // Message address, destination ID in bits 19:12
+
+// Map and software-enable the LAPIC; 0 on success, -1 if there is none
+int lapic_init(void);
+void lapic_eoi(void);
+uint32_t lapic_id(void);
+
+// Allocate an MSI vector for 'handler' and return the message to program
+// with pci_enable_msi(). -1 if no LAPIC or no free vector.
+int lapic_msi_route(irq_handler_t handler, uint32_t *address, uint16_t *data);
+
+#endif
@@ -66,6 +66,7 @@ void input_init(void);
 int input_available(void);
 // Keyboard functions
 int keyboard_event_ready(void);
+struct wait_queue *keyboard_wait_queue(void); // Woken on every new key event
 key_event_t *receive_key_event(void);
 void free_key_event(key_event_t *event);
 // Mouse functions
@@ -17,6 +17,22 @@ void pmm_init(boot_info_t* boot_info);
 void* pmm_alloc_block();
 void pmm_free_block(void* p);
 
+// Shared frames: each extra holder takes a reference; the last
+// pmm_unref_block() frees the frame. pmm_block_refs() counts holders.
+void pmm_ref_block(void* p);
+void pmm_unref_block(void* p);
+uint32_t pmm_block_refs(void* p);
+
+// Physically contiguous runs of blocks
+void* pmm_alloc_contiguous(size_t count);
+void pmm_free_contiguous(void* p, size_t count);
+
+// Reclaim hook: called when an allocation finds no free frame. Should free
+// up to 'want' frames without touching the kernel heap (it may run from
+// inside heap expansion) and return how many it released.
+typedef size_t (*pmm_reclaim_t)(size_t want);
+void pmm_set_reclaim(pmm_reclaim_t fn);
+
 // Region management (initialize bitmap based on GRUB map)
 void pmm_init_region(uint32_t base, size_t size);
 void pmm_deinit_region(uint32_t base, size_t size);
@@ -0,0 +1,45 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include <stdint.h>
+#include "mm/vmm.h"
+
+struct fs_node;
+
+// File-backed areas (demand paging)
+// vma_map_file() records a program segment in a small table and leaves its
+// pages not present, each PTE tagged with the table slot (I86_PTE_FILE).
+// Nothing is read until a page is touched. The fault maps the page cache
+// frame for that file page copy-on-write (for any regular file, cached
+// reads or not), so every process running the same file shares one copy
+// of a page until someone writes to it. Pages
+// that hold the end of the file data or bss get a private, zeroed frame.
+//
+// A slot is recycled once none of its tagged PTEs are left (all faulted in,
+// mapped over, or dropped when the process is reaped). Until then it pins
+// the node (vfs_map_node()): the file can't be written, so the pages still
+// to come match the ones already in, and an unlink doesn't free it.
+
+#define VMA_MAX 128
+
+typedef struct vma {
+    struct fs_node *node;       // NULL: slot free; pinned otherwise
+    uint32_t start;             // First page
+    uint32_t end;               // Page-aligned end of the segment in memory
+    uint32_t offset;            // File offset of 'start'
+    uint32_t file_end;          // Address where file data stops (bss follows)
+    uint32_t pending;           // PTEs still tagged with this slot
+} vma_t;
+
+// Lay out 'memsz' bytes at 'vaddr' from 'filesz' bytes at 'offset' of 'node'.
+// Returns 0 when the segment can't be demand-paged (the caller loads it).
+int vma_map_file(pd_entry_t* pd, struct fs_node *node, uint32_t vaddr, uint32_t memsz,
+                 uint32_t offset, uint32_t filesz);
+
+// Called by vmm_handle_fault() for a tagged, not present 'entry'
+int vma_fault(uint32_t entry, uint32_t addr);
+
+// A tagged PTE of 'slot' went away
+void vma_put(uint32_t slot);
+
+#endif
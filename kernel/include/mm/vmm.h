@@ -14,6 +14,8 @@
 #define I86_PTE_DIRTY         0x40
 #define I86_PTE_PAT           0x80
 #define I86_PTE_GLOBAL        0x100
+#define I86_PTE_COW           0x200 // Available bit: read-only until written, then copied
+#define I86_PTE_FILE          0x400 // Not present: bits 12-31 name a file area (see mm/vma.h)
 #define I86_PTE_FRAME         0xFFFFF000
 
 #define I86_PDE_PRESENT       0x01
@@ -41,8 +43,32 @@ typedef uint32_t pd_entry_t;
 // Functions
 void vmm_init(boot_info_t* boot_info);
 int vmm_map_page(pd_entry_t* pd, void* phys, void* virt);
+void vmm_unmap_page(pd_entry_t* pd, void* virt);
+uint32_t vmm_virt_to_phys(pd_entry_t* pd, void* virt);
+pd_entry_t* vmm_current_directory(void);
+void* vmm_map_mmio(uint32_t phys, uint32_t size);
 void vmm_enable_paging();
 
+// Copy-on-write. vmm_share_page() write-protects a present page so the
+// frame can be handed to someone else (who takes a pmm reference);
+// vmm_map_shared() maps such a frame read-only at 'virt'. The first write
+// to either mapping faults into vmm_handle_fault(), which copies the
+// frame, or just re-enables writing if no one else holds it anymore.
+int vmm_share_page(pd_entry_t* pd, void* virt);
+int vmm_map_shared(pd_entry_t* pd, uint32_t frame, void* virt);
+int vmm_handle_fault(uint32_t addr, uint32_t err);
+// Demand paging. vmm_map_lazy() leaves 'virt' not present but tagged with
+// a file area; the first access faults the page in. vmm_get_entry() reads
+// the raw page table entry (0 without a table).
+int vmm_map_lazy(pd_entry_t* pd, uint32_t tag, void* virt);
+uint32_t vmm_get_entry(pd_entry_t* pd, void* virt);
+// Address space teardown: untag the file-area entries left in the page
+// table at 'pd_index', so their areas can be recycled
+void vmm_release_file_entries(pd_entry_t* pd, uint32_t pd_index);
+// Does 'virt' sit in a page table of this directory alone (user memory),
+// rather than one linked from the kernel directory?
+int vmm_page_is_private(pd_entry_t* pd, void* virt);
+
 pd_entry_t* vmm_clone_directory(pd_entry_t* src);
 void vmm_free_directory(pd_entry_t* pd);
 void vmm_switch_pd(pd_entry_t* pd);
@@ -0,0 +1,69 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "types.h"
+#include "vfs.h"
+
+// Page Cache
+// File data for FS_CACHED nodes is kept in 4KB frames indexed by
+// (node, offset / 4096). Each file owns a radix tree of pages; all pages
+// share one global LRU list. read_fs() serves from here and only calls the
+// driver on a miss, reading ahead when the access pattern is sequential.
+// Misses are read straight into their frames (node->read_pages() when the
+// filesystem has it), with no bounce copy.
+// Demand-paged programs take frames from here for any regular file, so
+// other filesystems' nodes can carry pages too (see mm/vma.h).
+//
+// Memory: resident pages are capped at a quarter of the RAM free when the
+// cache first starts, and the PMM calls pcache_shrink() when it runs dry.
+
+#define PCACHE_PAGE_SIZE   4096
+#define PCACHE_RADIX_SHIFT 6
+#define PCACHE_RADIX_SLOTS (1 << PCACHE_RADIX_SHIFT)
+#define PCACHE_RADIX_MAX   6                 // 64^6 pages covers a 4GB file
+
+#define PCACHE_RA_MIN      4                 // Pages read ahead when a stream starts
+#define PCACHE_RA_MAX      32                // Window cap (128KB)
+
+typedef struct pcache_page {
+    struct pcache_file *file;
+    uint32_t index;                          // Page number within the file
+    uint8_t *data;                           // Identity-mapped frame, NULL once reclaimed
+    uint32_t valid;                          // Bytes of real file data in the page
+    struct pcache_page *lru_prev;
+    struct pcache_page *lru_next;
+} pcache_page_t;
+
+typedef struct pcache_file {
+    fs_node_t *node;
+    void *root;                              // Radix node, or NULL when empty
+    uint32_t height;                         // Tree covers indices < 64^height
+    uint32_t nr_pages;
+    uint32_t ra_offset;                      // Where a sequential reader reads next
+    uint32_t ra_window;                      // Current readahead size (0 = random)
+} pcache_file_t;
+
+void pcache_init(void);
+
+// Cached read; misses fall through to node->read
+uint32_t pcache_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+
+// Frame holding page 'index', with a pmm reference taken for the caller
+// (who maps it; pmm_unref_block() when done). NULL if it can't be cached.
+// Shared frames are never written again: a write to the file detaches
+// them from the cache first.
+uint8_t *pcache_get_frame(fs_node_t *node, uint32_t index);
+
+// Keep cached copies coherent after node->write succeeded
+void pcache_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer);
+
+// Drop pages at or beyond 'length' (the partial last page included)
+void pcache_truncate(fs_node_t *node, uint32_t length);
+
+// Drop every page of a file (unlink, node going away)
+void pcache_invalidate(fs_node_t *node);
+
+// Release up to 'want' frames; safe to call from inside the heap allocator
+size_t pcache_shrink(size_t want);
+
+#endif
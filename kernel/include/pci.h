@@ -0,0 +1,123 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+// PCI Bus
+// Configuration space is reached through mechanism #1 (ports 0xCF8/0xCFC).
+// pci_init() walks every bus once and records each function in a device
+// table: IDs, class, sized BARs, the legacy interrupt line and where the
+// MSI/MSI-X capabilities sit. Drivers register an ID table; probe() runs
+// for every matching device, whether it was found before or after.
+
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION        0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19
+#define PCI_CAP_PTR         0x34
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+#define PCI_COMMAND_IO      0x0001
+#define PCI_COMMAND_MEMORY  0x0002
+#define PCI_COMMAND_MASTER  0x0004
+#define PCI_COMMAND_INTX_OFF 0x0400
+#define PCI_STATUS_CAP_LIST 0x0010
+
+#define PCI_CAP_ID_MSI      0x05
+#define PCI_CAP_ID_MSIX     0x11
+
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_CLASS_DISPLAY   0x03
+#define PCI_CLASS_BRIDGE    0x06
+#define PCI_SUBCLASS_IDE    0x01
+#define PCI_SUBCLASS_SATA   0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+#define PCI_MAX_DEVICES     64
+#define PCI_ANY_ID          0xFFFF
+#define PCI_ANY_CLASS       0xFF
+
+#define PCI_BAR_IO          0x01
+#define PCI_BAR_PREFETCH    0x02
+#define PCI_BAR_64          0x04
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+} pci_addr_t;
+
+typedef struct {
+    uint32_t base;              // Address (I/O port or physical memory), 0 if unused
+    uint32_t size;
+    uint32_t flags;             // PCI_BAR_*
+} pci_bar_t;
+
+struct pci_driver;
+
+typedef struct pci_device {
+    pci_addr_t addr;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t irq_line;           // Legacy INTx routing set up by the firmware
+    uint8_t irq_pin;            // 0 = none, 1-4 = INTA#-INTD#
+    uint8_t msi_cap;            // Config offsets, 0 = capability absent
+    uint8_t msix_cap;
+    pci_bar_t bars[6];
+    struct pci_driver *driver;  // Bound driver, if any
+    void *driver_data;
+} pci_device_t;
+
+typedef struct {
+    uint16_t vendor;            // PCI_ANY_ID matches all
+    uint16_t device;
+    uint8_t class_code;         // PCI_ANY_CLASS matches all
+    uint8_t subclass;
+} pci_device_id_t;
+
+// The ID table ends with an all-zero entry. probe() returns 0 to bind.
+typedef struct pci_driver {
+    const char *name;
+    const pci_device_id_t *ids;
+    int (*probe)(pci_device_t *dev, const pci_device_id_t *id);
+    struct pci_driver *next;
+} pci_driver_t;
+
+// Enumerate the bus (idempotent; the first lookup or registration runs it)
+void pci_init(void);
+
+void pci_register_driver(pci_driver_t *drv);
+
+uint32_t pci_device_count(void);
+pci_device_t *pci_get_device(uint32_t index);
+pci_device_t *pci_find_device(uint16_t vendor, uint16_t device);
+pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass);
+
+// Turn on I/O + memory decoding, and bus mastering when asked
+void pci_enable_device(pci_device_t *dev, int bus_master);
+
+// Program the MSI capability with a message address/data and enable it
+// (legacy INTx is masked). lapic_msi_route() hands out the message.
+int pci_enable_msi(pci_device_t *dev, uint32_t address, uint16_t data);
+void pci_disable_msi(pci_device_t *dev);
+
+// Raw config space access
+uint32_t pci_read32(pci_addr_t addr, uint8_t offset);
+uint16_t pci_read16(pci_addr_t addr, uint8_t offset);
+uint8_t pci_read8(pci_addr_t addr, uint8_t offset);
+void pci_write32(pci_addr_t addr, uint8_t offset, uint32_t value);
+void pci_write16(pci_addr_t addr, uint8_t offset, uint16_t value);
+
+#endif
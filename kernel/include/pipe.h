@@ -3,10 +3,38 @@
 
 #include "vfs.h"
 
+// The ring starts at PIPE_MIN_SIZE and doubles whenever a writer finds it
+// full, up to a per-pipe limit (PIPE_DEFAULT_MAX unless F_SETPIPE_SZ
+// changes it). Only then do writers block.
+#define PIPE_MIN_SIZE       4096
+#define PIPE_DEFAULT_MAX    65536
+#define PIPE_MAX_SIZE       (1024 * 1024)   // Ceiling for F_SETPIPE_SZ
+
 // Initialize pipe system (if needed)
 void pipe_init(void);
 
 // Create a pipe, returning two nodes (read and write)
 int make_pipe(fs_node_t **read_node, fs_node_t **write_node);
 
+// Zero-copy transfer between a pipe end and another node at *offset
+// (advanced). Block until the pipe has space/data. Return bytes moved,
+// 0 on EOF (splice_out), -1 if the pipe has no readers (splice_in).
+int pipe_splice_in(fs_node_t *pipe_w, fs_node_t *src, uint32_t *offset, uint32_t len);
+int pipe_splice_out(fs_node_t *pipe_r, fs_node_t *dst, uint32_t *offset, uint32_t len);
+
+// vmsplice(). On the write end with 'gift', whole pages of the buffer are
+// queued by reference instead of copied (the writer keeps them mapped
+// copy-on-write; kernel and identity-mapped memory is always copied). On
+// the read end with 'move', whole queued pages are mapped over a
+// page-aligned destination instead of copied. Same return values as
+// pipe write/read; pages count against the pipe's size limit.
+int pipe_vmsplice_in(fs_node_t *pipe_w, uint8_t *buffer, uint32_t len, int gift);
+int pipe_vmsplice_out(fs_node_t *pipe_r, uint8_t *buffer, uint32_t len, int move);
+
+// Growth limit of either end's pipe. pipe_set_size() rounds up to a page
+// and returns the new limit, or -1 if it is above PIPE_MAX_SIZE or below
+// what is currently queued.
+uint32_t pipe_get_size(fs_node_t *node);
+int pipe_set_size(fs_node_t *node, uint32_t size);
+
 #endif
@@ -6,4 +6,12 @@
 void pit_init(uint32_t frequency);
 void timer_handler(void);
 
+// 8259 PIC (remapped to vectors 32-47 by pit_init)
+void pic_unmask(uint8_t irq);
+void pic_eoi(uint8_t irq);
+
+// Tick counter (incremented by IRQ0)
+uint32_t pit_get_ticks(void);
+uint32_t pit_ms_to_ticks(uint32_t ms);
+
 #endif
@@ -0,0 +1,50 @@
+#ifndef POLL_H
+#define POLL_H
+
+#include "types.h"
+#include "wait_queue.h"
+
+// Readiness bits (Linux values)
+#define POLLIN   0x001
+#define POLLPRI  0x002
+#define POLLOUT  0x004
+#define POLLERR  0x008
+#define POLLHUP  0x010
+#define POLLNVAL 0x020
+
+struct pollfd {
+    int fd;
+    short events;
+    short revents;
+};
+
+#define POLL_MAX_FDS 256
+
+// epoll: persistent interest set. Level-triggered.
+#define EPOLLIN  POLLIN
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+struct epoll_event {
+    uint32_t events;
+    uint32_t data;     // Opaque cookie returned to the caller
+};
+
+// Readiness of an fd in the current process (+ queue to sleep on)
+uint32_t poll_fd(int fd, wait_queue_t **wq);
+
+// Timeout helpers: ms < 0 = forever, 0 = don't block
+uint32_t poll_deadline(int timeout_ms);
+int poll_expired(uint32_t deadline);
+
+int sys_poll(struct pollfd *fds, uint32_t nfds, int timeout_ms);
+int sys_epoll_create(void);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int sys_epoll_wait(int epfd, struct epoll_event *events, int max_events, int timeout_ms);
+
+#endif
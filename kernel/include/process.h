@@ -13,6 +13,10 @@ typedef enum {
 
 // Forward declaration
 struct fs_node;
+struct gui_window;
+
+// Per-process GUI window handle table size
+#define PROCESS_MAX_WINDOWS 16
 
 // Process Control Block (PCB)
 typedef struct process {
@@ -20,6 +24,7 @@ typedef struct process {
     char name[32];              // Process Name
     char cmdline[128];          // Command Line Arguments
     process_state_t state;      // Current State
+    uint32_t wake_tick;         // BLOCKED: PIT tick to wake at (0 = wait for wakeup only)
     
     uint32_t esp;               // Stack Pointer
     uint32_t ebp;               // Base Pointer
@@ -43,6 +48,10 @@ typedef struct process {
         int flags;
     } *fd_table[256];
     
+    // GUI Window Handle Table
+    // Handles returned by SYS_MITHL_GUI_CREATE index directly into this table.
+    struct gui_window *windows[PROCESS_MAX_WINDOWS];
+    
     struct process *next;       // Linked List
 } process_t;
 
@@ -56,6 +65,10 @@ void process_yield(void);
 void process_exit(void);
 void process_init_main_thread(void);
 
+// Blocking (see wait_queue.h). Caller must re-check its condition on return.
+void process_block(uint32_t wake_tick);
+void process_wake(process_t *proc);
+
 // Helper struct for Listing (must match userspace)
 typedef struct {
     int pid;
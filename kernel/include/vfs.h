@@ -10,9 +10,14 @@
 #define FS_BLOCKDEVICE 0x04
 #define FS_PIPE        0x05
 #define FS_SYMLINK     0x06
+#define FS_EPOLL       0x07
 #define FS_MOUNTPOINT  0x08
+#define FS_CACHED      0x10 // File data goes through the VFS page cache
+#define FS_ORPHAN      0x20 // Unlinked while mapped; freed by the last unmap
 
 struct fs_node;
+struct wait_queue;
+struct pcache_file;
 
 typedef uint32_t (*read_type_t)(struct fs_node*, uint32_t, uint32_t, uint8_t*);
 typedef uint32_t (*write_type_t)(struct fs_node*, uint32_t, uint32_t, uint8_t*);
@@ -23,6 +28,11 @@ typedef struct fs_node * (*finddir_type_t)(struct fs_node*, char *name);
 typedef void (*create_type_t)(struct fs_node*, char *name, uint16_t permission);
 typedef void (*mkdir_type_t)(struct fs_node*, char *name, uint16_t permission);
 typedef void (*unlink_type_t)(struct fs_node*, char *name);
+typedef uint32_t (*poll_type_t)(struct fs_node*, struct wait_queue **wq); // Ready mask (POLLIN...) + queue to sleep on
+typedef int (*rename_type_t)(struct fs_node*, char *old_name, char *new_name); // Same-directory rename
+typedef int (*truncate_type_t)(struct fs_node*, uint32_t length);
+typedef void (*release_type_t)(struct fs_node*); // Frees an orphaned node
+typedef uint32_t (*read_pages_type_t)(struct fs_node*, uint32_t offset, uint32_t size, uint8_t **pages); // 4KB each
 
 typedef struct fs_node {
     char name[128];
@@ -43,8 +53,15 @@ typedef struct fs_node {
     create_type_t create;
     mkdir_type_t mkdir;
     unlink_type_t unlink;
+    poll_type_t poll;
+    rename_type_t rename;
+    truncate_type_t truncate;
+    read_pages_type_t read_pages; // Optional: page cache fills, one call for scattered frames
     
     struct fs_node *ptr; // Used by mountpoints and symlinks
+    struct pcache_file *pcache; // Cached pages (FS_CACHED files, created on first read)
+    uint32_t maps;        // Program mappings (mm/vma.h) still reading the file
+    release_type_t release; // Set with FS_ORPHAN
 } fs_node_t;
 
 struct dirent {
@@ -66,6 +83,15 @@ fs_node_t *finddir_fs(fs_node_t *node, char *name);
 void create_fs(fs_node_t *parent, char *name, uint16_t permission);
 void mkdir_fs(fs_node_t *parent, char *name, uint16_t permission);
 void unlink_fs(fs_node_t *parent, char *name);
+uint32_t poll_fs(fs_node_t *node, struct wait_queue **wq);
+int truncate_fs(fs_node_t *node, uint32_t length);
+// Program mappings pin the node. Meanwhile writes and truncation fail
+// (ETXTBSY), and a filesystem unlinking it calls vfs_orphan_node(): if that
+// returns 1 the node stays allocated until the last vfs_unmap_node(), which
+// hands it to 'release'.
+void vfs_map_node(fs_node_t *node);
+void vfs_unmap_node(fs_node_t *node);
+int vfs_orphan_node(fs_node_t *node, release_type_t release);
 void create_fs(fs_node_t *parent, char *name, uint16_t permission);
 void mkdir_fs(fs_node_t *parent, char *name, uint16_t permission);
 
@@ -0,0 +1,24 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+// virtio-blk (legacy PCI transport)
+// Each disk gets one split virtqueue and registers with the block layer
+// as "vda", "vdb", ... A request occupies one slot: with indirect
+// descriptors a single ring entry points at the slot's own descriptor
+// table (header, data segments, status), otherwise the slot owns a fixed
+// run of ring descriptors. The doorbell is rung once per dispatch round,
+// and only when the device asks for it (event index); completions are
+// coalesced by asking for the interrupt only after several of them.
+
+#define VBLK_MAX_DISKS      4
+#define VBLK_DEPTH          32          // Requests in flight per disk
+#define VBLK_DIRECT_DESCS   16          // Ring descriptors per slot without indirect
+#define VBLK_COALESCE       4           // Completions per interrupt at most
+#define VBLK_MAX_SECTORS    1024
+#define VBLK_MAX_BIOS       64
+
+void virtio_blk_init(void);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef WAIT_QUEUE_H
+#define WAIT_QUEUE_H
+
+#include "types.h"
+#include "spinlock.h"
+
+// Wait Queues
+// Objects that can become ready (pipes, tty, window event lists) own a
+// wait_queue_t. Sleepers hang a wait_entry_t on it (usually on their stack)
+// and block; the producer calls wait_queue_wake_all() when state changes.
+//
+// Usage (IRQs must stay off between the condition check and the sleep):
+//     while (!condition) wait_queue_sleep(&obj->wait);
+
+struct process;
+struct wait_queue;
+
+typedef struct wait_entry {
+    struct process *proc;                 // Sleeper to wake
+    struct wait_queue *queue;             // Queue we are linked on (NULL = detached)
+    void (*func)(struct wait_entry *e);   // Optional: callback instead of waking proc
+    void *priv;                           // Callback data
+    struct wait_entry *next;
+} wait_entry_t;
+
+typedef struct wait_queue {
+    lock_t lock;
+    wait_entry_t *head;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t *wq);
+void wait_queue_add(wait_queue_t *wq, wait_entry_t *e);
+void wait_queue_remove(wait_entry_t *e);
+void wait_queue_wake_all(wait_queue_t *wq);
+void wait_queue_sleep(wait_queue_t *wq);
+
+// Object is going away: wake everyone and unlink all entries
+void wait_queue_destroy(wait_queue_t *wq);
+
+// IRQ helpers for the condition-check / sleep window
+static inline uint32_t wait_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushfl; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void wait_irq_restore(uint32_t flags) {
+    __asm__ volatile("push %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+#endif
@@ -21,4 +21,7 @@ void wm_handle_event(gui_window_t *node, gui_event_t *event);
 // Helper to wrap existing windows into the tree
 void wm_manage_window(gui_window_t *window);
 
+// Remove a window from the tree before it is freed
+void wm_unmanage_window(gui_window_t *window);
+
 #endif
@@ -126,6 +126,76 @@ irq_common_stub:
     sti
     iret
 
+; IRQ1-15 (vectors 33-47): dispatched through irq_handler in idt.c
+%macro IRQ 2
+    global irq%1
+    irq%1:
+        cli
+        push 0
+        push %2
+        jmp irq_dispatch_stub
+%endmacro
+
+IRQ 1, 33
+IRQ 2, 34
+IRQ 3, 35
+IRQ 4, 36
+IRQ 5, 37
+IRQ 6, 38
+IRQ 7, 39
+IRQ 8, 40
+IRQ 9, 41
+IRQ 10, 42
+IRQ 11, 43
+IRQ 12, 44
+IRQ 13, 45
+IRQ 14, 46
+IRQ 15, 47
+
+; MSI vectors 48-55, delivered by the local APIC
+IRQ 16, 48
+IRQ 17, 49
+IRQ 18, 50
+IRQ 19, 51
+IRQ 20, 52
+IRQ 21, 53
+IRQ 22, 54
+IRQ 23, 55
+
+; LAPIC spurious vector: no EOI, nothing to do
+global irq_spurious
+irq_spurious:
+    iret
+
+extern irq_handler
+
+irq_dispatch_stub:
+    pusha
+    
+    mov ax, ds
+    push eax
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    
+    push esp        ; registers_t*
+    call irq_handler
+    add esp, 4
+    
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    
+    popa
+    add esp, 8
+    sti
+    iret
+
 isr_common_stub:
     pusha           ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax
     mov ax, ds
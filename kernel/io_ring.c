@@ -0,0 +1,286 @@
+#include "io_ring.h"
+#include "fd.h"
+#include "poll.h"
+#include "vfs.h"
+#include "memory.h"
+#include "string.h"
+#include "process.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+
+extern process_t *current_process;
+
+struct io_ring;
+
+// IORING_OP_POLL waiting for readiness
+typedef struct {
+    int used;
+    int fd;
+    uint32_t events;
+    uint32_t user_data;
+    wait_entry_t wait;
+    struct io_ring *ring;
+} io_poll_req_t;
+
+typedef struct io_ring {
+    io_ring_hdr_t *hdr;         // Kernel view (identity-mapped frames)
+    io_sqe_t *sqes;
+    io_cqe_t *cqes;
+    uint32_t pages;
+    uint32_t user_addr;
+    // The shared header is writable by userspace: sizes and the kernel's own
+    // indices live here, and only these are used to address the rings
+    uint32_t sq_mask;
+    uint32_t cq_entries;
+    uint32_t sq_head;
+    uint32_t cq_tail;
+    wait_queue_t wait;          // Woken on new CQEs / poll readiness
+    io_poll_req_t polls[IO_RING_MAX_POLLS];
+} io_ring_t;
+
+static io_ring_t *io_ring_get(int fd);
+
+// --- Completion ---
+
+static void io_ring_post(io_ring_t *ring, uint32_t user_data, int32_t res) {
+    io_ring_hdr_t *hdr = ring->hdr;
+    
+    // A cq_head that is ahead of us or too far behind counts as full
+    if (ring->cq_tail - hdr->cq_head >= ring->cq_entries) {
+        hdr->cq_overflow++;
+        return;
+    }
+    
+    io_cqe_t *cqe = &ring->cqes[ring->cq_tail & (ring->cq_entries - 1)];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    ring->cq_tail++;
+    hdr->cq_tail = ring->cq_tail; // Publish after the entry is written
+    
+    wait_queue_wake_all(&ring->wait);
+}
+
+static void io_poll_wake(wait_entry_t *e) {
+    io_poll_req_t *req = (io_poll_req_t*)e->priv;
+    wait_queue_wake_all(&req->ring->wait);
+}
+
+// Complete any outstanding polls that became ready. IRQs off.
+static void io_ring_reap_polls(io_ring_t *ring) {
+    for (int i = 0; i < IO_RING_MAX_POLLS; i++) {
+        io_poll_req_t *req = &ring->polls[i];
+        if (!req->used) continue;
+        
+        wait_queue_t *wq;
+        uint32_t mask = poll_fd(req->fd, &wq) & (req->events | POLLERR | POLLHUP | POLLNVAL);
+        if (mask) {
+            wait_queue_remove(&req->wait);
+            req->used = 0;
+            io_ring_post(ring, req->user_data, mask);
+        } else if (wq && !req->wait.queue) {
+            wait_queue_add(wq, &req->wait);
+        }
+    }
+}
+
+static int io_ring_polls_pending(io_ring_t *ring) {
+    for (int i = 0; i < IO_RING_MAX_POLLS; i++) {
+        if (ring->polls[i].used) return 1;
+    }
+    return 0;
+}
+
+// --- Submission ---
+
+static int io_ring_queue_poll(io_ring_t *ring, io_sqe_t *sqe) {
+    for (int i = 0; i < IO_RING_MAX_POLLS; i++) {
+        io_poll_req_t *req = &ring->polls[i];
+        if (req->used) continue;
+        
+        memset(req, 0, sizeof(io_poll_req_t));
+        req->used = 1;
+        req->fd = sqe->fd;
+        req->events = sqe->op_flags;
+        req->user_data = sqe->user_data;
+        req->ring = ring;
+        req->wait.func = io_poll_wake;
+        req->wait.priv = req;
+        return 0;
+    }
+    return -1; // EBUSY: too many outstanding polls
+}
+
+static void io_ring_issue(io_ring_t *ring, io_sqe_t *sqe) {
+    int32_t res;
+    
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            res = 0;
+            break;
+        case IORING_OP_READ:
+            res = fd_read(sqe->fd, (void*)sqe->addr, sqe->len, sqe->off);
+            break;
+        case IORING_OP_WRITE:
+            res = fd_write(sqe->fd, (const void*)sqe->addr, sqe->len, sqe->off);
+            break;
+        case IORING_OP_OPEN:
+            res = fd_open((const char*)sqe->addr, (int)sqe->op_flags);
+            break;
+        case IORING_OP_CLOSE:
+            // Closing the ring itself would free it under sys_io_ring_enter
+            if (io_ring_get(sqe->fd) == ring) res = -1; // EBUSY
+            else res = fd_close(sqe->fd);
+            break;
+        case IORING_OP_FSYNC:
+            res = fd_fsync(sqe->fd);
+            break;
+        case IORING_OP_POLL:
+            // Completed later by io_ring_reap_polls
+            if (io_ring_queue_poll(ring, sqe) == 0) return;
+            res = -1;
+            break;
+        default:
+            res = -1; // EINVAL
+    }
+    
+    io_ring_post(ring, sqe->user_data, res);
+}
+
+// --- Ring fd ---
+
+static uint32_t io_ring_node_poll(fs_node_t *node, wait_queue_t **wq) {
+    io_ring_t *ring = (io_ring_t*)node->ptr;
+    *wq = &ring->wait;
+    return (ring->cq_tail != ring->hdr->cq_head) ? POLLIN : 0;
+}
+
+static void io_ring_node_close(fs_node_t *node) {
+    io_ring_t *ring = (io_ring_t*)node->ptr;
+    
+    uint32_t flags = wait_irq_save();
+    for (int i = 0; i < IO_RING_MAX_POLLS; i++) {
+        if (ring->polls[i].used) wait_queue_remove(&ring->polls[i].wait);
+    }
+    wait_queue_destroy(&ring->wait);
+    wait_irq_restore(flags);
+    
+    // Runs in the owner's address space (close / exit)
+    for (uint32_t i = 0; i < ring->pages; i++) {
+        vmm_unmap_page(0, (void*)(ring->user_addr + i * PMM_PAGE_SIZE));
+    }
+    pmm_free_contiguous(ring->hdr, ring->pages);
+    memory_free(ring);
+    memory_free(node);
+}
+
+static io_ring_t *io_ring_get(int fd) {
+    struct file_descriptor *desc = fd_get(fd);
+    if (!desc || !desc->node || desc->node->close != io_ring_node_close) return NULL;
+    return (io_ring_t*)desc->node->ptr;
+}
+
+// Returns the ring fd; *out_addr receives the user address of the region
+int sys_io_ring_setup(uint32_t entries, uint32_t *out_addr) {
+    if (!out_addr || entries == 0 || entries > IO_RING_MAX_SQ) return -1;
+    
+    // Round up to a power of two
+    uint32_t sq = 1;
+    while (sq < entries) sq <<= 1;
+    uint32_t cq = sq * 2;
+    
+    uint32_t sqes_off = (sizeof(io_ring_hdr_t) + 63) & ~63;
+    uint32_t cqes_off = sqes_off + sq * sizeof(io_sqe_t);
+    uint32_t bytes = cqes_off + cq * sizeof(io_cqe_t);
+    uint32_t pages = (bytes + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    if (pages * PMM_PAGE_SIZE > IO_RING_SLOT) return -1;
+    
+    io_ring_t *ring = (io_ring_t*)memory_alloc(sizeof(io_ring_t));
+    fs_node_t *node = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
+    void *phys = pmm_alloc_contiguous(pages);
+    
+    // Kernel reads the rings through the 128MB identity map
+    if (!ring || !node || !phys || (uint32_t)phys + pages * PMM_PAGE_SIZE > 0x08000000) {
+        if (ring) memory_free(ring);
+        if (node) memory_free(node);
+        if (phys) pmm_free_contiguous(phys, pages);
+        return -1;
+    }
+    memset(phys, 0, pages * PMM_PAGE_SIZE);
+    
+    ring->hdr = (io_ring_hdr_t*)phys;
+    ring->hdr->sq_entries = sq;
+    ring->hdr->cq_entries = cq;
+    ring->hdr->sqes_off = sqes_off;
+    ring->hdr->cqes_off = cqes_off;
+    ring->sqes = (io_sqe_t*)((uint8_t*)phys + sqes_off);
+    ring->cqes = (io_cqe_t*)((uint8_t*)phys + cqes_off);
+    ring->pages = pages;
+    ring->sq_mask = sq - 1;
+    ring->cq_entries = cq;
+    ring->sq_head = 0;
+    ring->cq_tail = 0;
+    wait_queue_init(&ring->wait);
+    
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, "io_ring");
+    node->flags = FS_CHARDEVICE;
+    node->poll = io_ring_node_poll;
+    node->close = io_ring_node_close;
+    node->ptr = (struct fs_node*)ring;
+    
+    int fd = fd_install(node, 0);
+    if (fd < 0) {
+        pmm_free_contiguous(phys, pages);
+        memory_free(ring);
+        memory_free(node);
+        return -1;
+    }
+    
+    // Map into the caller at a per-fd slot
+    ring->user_addr = IO_RING_BASE + fd * IO_RING_SLOT;
+    for (uint32_t i = 0; i < pages; i++) {
+        vmm_map_page(0, (void*)((uint32_t)phys + i * PMM_PAGE_SIZE), (void*)(ring->user_addr + i * PMM_PAGE_SIZE));
+    }
+    
+    *out_addr = ring->user_addr;
+    return fd;
+}
+
+// Consume up to to_submit SQEs, then optionally wait for min_complete CQEs.
+// Returns the number of SQEs consumed.
+int sys_io_ring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    io_ring_t *ring = io_ring_get(fd);
+    if (!ring) return -1;
+    
+    io_ring_hdr_t *hdr = ring->hdr;
+    uint32_t submitted = 0;
+    
+    // Never take more than one ring's worth, whatever sq_tail claims
+    uint32_t ready = hdr->sq_tail - ring->sq_head;
+    if (ready > ring->sq_mask + 1) ready = ring->sq_mask + 1;
+    if (to_submit > ready) to_submit = ready;
+    
+    while (submitted < to_submit) {
+        // Copy the SQE first: userspace may reuse the slot once sq_head moves
+        io_sqe_t sqe = ring->sqes[ring->sq_head & ring->sq_mask];
+        ring->sq_head++;
+        hdr->sq_head = ring->sq_head;
+        io_ring_issue(ring, &sqe);
+        submitted++;
+    }
+    
+    uint32_t irq = wait_irq_save();
+    io_ring_reap_polls(ring);
+    
+    if (flags & IORING_ENTER_GETEVENTS) {
+        if (min_complete > ring->cq_entries) min_complete = ring->cq_entries;
+        
+        while (ring->cq_tail - hdr->cq_head < min_complete && io_ring_polls_pending(ring)) {
+            wait_queue_sleep(&ring->wait);
+            io_ring_reap_polls(ring);
+        }
+    }
+    wait_irq_restore(irq);
+    
+    return submitted;
+}
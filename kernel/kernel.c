@@ -27,6 +27,7 @@
 #include "mm/pmm.h"
 #include "process.h"
 #include "vfs.h"
+#include "bcache.h"
 #include "apps/file_manager/file_manager.h"
 #include "fs/fat32/fat32.h"
 
@@ -175,6 +176,11 @@ void kmain(uint32_t magic, void* addr)
     rust_init(); 
     console_log("[INFO] Rust Initialized.\n");
 
+    // Enumerate PCI devices (GPU and disk drivers look them up)
+    void pci_init(void);
+    pci_init();
+    console_log("[INFO] PCI Bus Enumerated.\n");
+
     // Initialize Graphics
     if (boot_info.framebuffer.addr != 0) {
         console_log("[INFO] Multiboot Graphics Available. Initializing VESA...\n");
@@ -227,6 +233,14 @@ void kmain(uint32_t magic, void* addr)
     extern void ramfs_load_modules(boot_info_t *info);
     ramfs_load_modules(&boot_info);
     
+    // Disk controllers register their block devices
+    void ata_init(void);
+    ata_init();
+    void ahci_init(void);
+    ahci_init();
+    void virtio_blk_init(void);
+    virtio_blk_init();
+
     // Initialize FAT32 Hardware (Controller)
     serial_write("[KERNEL] Initializing FAT32 (Drive 0, LBA 0)...\n");
     fat32_init(0); 
@@ -287,6 +301,9 @@ void kmain(uint32_t magic, void* addr)
     // Initialize Process Manager
     process_init_main_thread();
     
+    // Disk write-back thread for the block buffer cache
+    bcache_start_flusher();
+    
     // Launch Userspace Hello App (The "Daily Driver" test)
     // Assumes ramfs loaded it at /hello.elf
     // process_create_elf("Hello", "/hello.elf", "");
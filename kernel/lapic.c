@@ -0,0 +1,72 @@
+#include "lapic.h"
+#include "mm/vmm.h"
+#include "console.h"
+
+#define IA32_APIC_BASE      0x1B
+#define APIC_BASE_ENABLE    (1 << 11)
+#define CPUID_EDX_APIC      (1 << 9)
+
+#define LAPIC_REG_ID        0x020
+#define LAPIC_REG_EOI       0x0B0
+#define LAPIC_REG_SVR       0x0F0
+#define LAPIC_REG_LINT0     0x350
+#define LAPIC_REG_LINT1     0x360
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_LVT_EXTINT    0x700
+#define LAPIC_LVT_NMI       0x400
+#define LAPIC_SPURIOUS      0xFF        // Gate installed by idt_init()
+
+static volatile uint32_t *lapic_regs = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_regs[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_regs[reg / 4] = value;
+}
+
+int lapic_init(void) {
+    if (lapic_regs) return 0;
+
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_EDX_APIC)) return -1;
+
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(IA32_APIC_BASE));
+    if (!(lo & APIC_BASE_ENABLE)) return -1; // Turning it on would reroute the PIC
+
+    volatile uint32_t *regs = (volatile uint32_t*)vmm_map_mmio(lo & 0xFFFFF000, 4096);
+    if (!regs) return -1;
+    lapic_regs = regs;
+
+    // Software-disabled LAPICs deliver nothing but INIT/NMI. Enabling it
+    // leaves the LVTs masked, so restore virtual-wire mode for the PIC.
+    if (!(lapic_read(LAPIC_REG_SVR) & LAPIC_SVR_ENABLE)) {
+        lapic_write(LAPIC_REG_LINT0, LAPIC_LVT_EXTINT);
+        lapic_write(LAPIC_REG_LINT1, LAPIC_LVT_NMI);
+        lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS);
+    }
+    serial_write("[LAPIC] Enabled for MSI.\n");
+    return 0;
+}
+
+void lapic_eoi(void) {
+    if (lapic_regs) lapic_write(LAPIC_REG_EOI, 0);
+}
+
+uint32_t lapic_id(void) {
+    return lapic_regs ? lapic_read(LAPIC_REG_ID) >> 24 : 0;
+}
+
+int lapic_msi_route(irq_handler_t handler, uint32_t *address, uint16_t *data) {
+    if (lapic_init() != 0) return -1;
+    int vector = irq_install_msi(handler);
+    if (vector < 0) return -1;
+
+    // Fixed delivery, edge triggered, physical destination: this CPU
+    *address = LAPIC_MSI_ADDRESS | (lapic_id() << 12);
+    *data = (uint16_t)vector;
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include "mm/vmm.h"
 #include "console.h"
 #include "string.h"
+#include "wait_queue.h"
 
 // Dynamic Heap Allocator Implementation (Paged)
 
@@ -243,6 +244,9 @@ int input_available(void) { return 0; }
 
 // Keyboard/Mouse Queue Implementation (Keep existing)
 static key_event_queue_t key_queue = {0};
+static wait_queue_t key_wait; // Zeroed .bss is a valid empty queue
+
+struct wait_queue *keyboard_wait_queue(void) { return &key_wait; }
 
 int keyboard_event_ready(void) { return key_queue.count > 0; }
 
@@ -264,6 +268,7 @@ void input_add_key_event(uint16_t keycode, char ascii, uint8_t modifiers, uint8_
     event->timestamp = 0;
     key_queue.head = (key_queue.head + 1) % MAX_KEY_EVENTS;
     key_queue.count++;
+    wait_queue_wake_all(&key_wait);
 }
 void free_key_event(key_event_t *event) { (void)event; }
 
@@ -16,9 +16,13 @@ typedef uint32_t uintptr_t;
 // We can allocate this statically in .bss
 #define PMM_MAX_FRAMES (1024 * 1024) 
 static uint32_t pmm_bitmap[PMM_MAX_FRAMES / 32];
+// Holders beyond the first, for frames mapped copy-on-write in several
+// places. Saturates: a frame stuck at 255 is never freed.
+static uint8_t pmm_shares[PMM_MAX_FRAMES];
 static size_t pmm_total_blocks = 0;
 static size_t pmm_used_blocks = 0;
 static lock_t pmm_lock;
+static pmm_reclaim_t pmm_reclaim = NULL;
 
 // Helper: Set bit
 static void pmm_set_frame(uint32_t frame_idx) {
@@ -139,10 +143,21 @@ void pmm_deinit_region(uint32_t base, size_t size) {
     }
 }
 
+void pmm_set_reclaim(pmm_reclaim_t fn) {
+    pmm_reclaim = fn;
+}
+
 void* pmm_alloc_block() {
     uint32_t flags = spinlock_acquire_irqsave(&pmm_lock);
     
     int frame = pmm_first_free_frame();
+    if (frame == -1 && pmm_reclaim) {
+        // Ask caches to give memory back, then retry once
+        spinlock_release_irqrestore(&pmm_lock, flags);
+        size_t freed = pmm_reclaim(1);
+        flags = spinlock_acquire_irqsave(&pmm_lock);
+        if (freed) frame = pmm_first_free_frame();
+    }
     if (frame == -1) {
         spinlock_release_irqrestore(&pmm_lock, flags);
         return NULL; // OOM
@@ -157,6 +172,51 @@ void* pmm_alloc_block() {
     return (void*)addr;
 }
 
+// Allocate 'count' physically contiguous blocks (DMA buffers, shared surfaces).
+// Low-first search, so results normally land in the identity-mapped region.
+static void* pmm_try_alloc_contiguous(size_t count) {
+    uint32_t flags = spinlock_acquire_irqsave(&pmm_lock);
+    
+    size_t run = 0;
+    uint32_t start = 0;
+    for (uint32_t frame = 0; frame < PMM_MAX_FRAMES; frame++) {
+        // Skip fully used words quickly
+        if ((frame % 32) == 0 && pmm_bitmap[frame / 32] == 0xFFFFFFFF) {
+            run = 0;
+            frame += 31;
+            continue;
+        }
+        if (pmm_test_frame(frame)) {
+            run = 0;
+            continue;
+        }
+        if (run == 0) start = frame;
+        if (++run == count) {
+            for (size_t i = 0; i < count; i++) pmm_set_frame(start + i);
+            pmm_used_blocks += count;
+            spinlock_release_irqrestore(&pmm_lock, flags);
+            return (void*)(start * PMM_BLOCK_SIZE);
+        }
+    }
+    
+    spinlock_release_irqrestore(&pmm_lock, flags);
+    return NULL;
+}
+
+void* pmm_alloc_contiguous(size_t count) {
+    if (count == 0) return NULL;
+    
+    void *p = pmm_try_alloc_contiguous(count);
+    if (!p && pmm_reclaim && pmm_reclaim(count)) p = pmm_try_alloc_contiguous(count);
+    return p;
+}
+
+void pmm_free_contiguous(void* p, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        pmm_free_block((void*)((uint32_t)p + i * PMM_BLOCK_SIZE));
+    }
+}
+
 void pmm_free_block(void* p) {
     if (!p) return;
     
@@ -169,10 +229,38 @@ void pmm_free_block(void* p) {
         pmm_unset_frame(frame);
         pmm_used_blocks--;
     }
+    pmm_shares[frame] = 0;
     
     spinlock_release_irqrestore(&pmm_lock, flags);
 }
 
+void pmm_ref_block(void* p) {
+    uint32_t flags = spinlock_acquire_irqsave(&pmm_lock);
+    uint32_t frame = (uint32_t)p / PMM_BLOCK_SIZE;
+    if (pmm_shares[frame] < 255) pmm_shares[frame]++;
+    spinlock_release_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_unref_block(void* p) {
+    uint32_t flags = spinlock_acquire_irqsave(&pmm_lock);
+    uint32_t frame = (uint32_t)p / PMM_BLOCK_SIZE;
+    if (pmm_shares[frame] == 255) {
+        spinlock_release_irqrestore(&pmm_lock, flags);
+        return;
+    }
+    if (pmm_shares[frame] > 0) {
+        pmm_shares[frame]--;
+        spinlock_release_irqrestore(&pmm_lock, flags);
+        return;
+    }
+    spinlock_release_irqrestore(&pmm_lock, flags);
+    pmm_free_block(p);
+}
+
+uint32_t pmm_block_refs(void* p) {
+    return pmm_shares[(uint32_t)p / PMM_BLOCK_SIZE] + 1;
+}
+
 size_t pmm_get_total_memory() {
     return pmm_total_blocks * PMM_BLOCK_SIZE; // Rough upper bound
 }
@@ -0,0 +1,121 @@
+#include "mm/vma.h"
+#include "mm/pmm.h"
+#include "page_cache.h"
+#include "vfs.h"
+#include "string.h"
+#include "spinlock.h"
+
+#define VMA_PHYS_LIMIT 0x08000000   // Frames above 128MB are not identity-mapped
+
+static vma_t vma_table[VMA_MAX];
+static lock_t vma_lock;
+
+int vma_map_file(pd_entry_t* pd, struct fs_node *node, uint32_t vaddr, uint32_t memsz,
+                 uint32_t offset, uint32_t filesz) {
+    if (!node || memsz == 0 || filesz > memsz) return 0;
+    // File pages must line up with memory pages to be mapped as they are
+    if ((vaddr & (PAGE_SIZE - 1)) != (offset & (PAGE_SIZE - 1))) return 0;
+
+    uint32_t flags = spinlock_acquire_irqsave(&vma_lock);
+    uint32_t slot = 0;
+    while (slot < VMA_MAX && vma_table[slot].node) slot++;
+    if (slot == VMA_MAX) {
+        spinlock_release_irqrestore(&vma_lock, flags);
+        return 0;
+    }
+    vma_t *a = &vma_table[slot];
+    a->node = node;
+    a->start = vaddr & ~(PAGE_SIZE - 1);
+    a->end = (vaddr + memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    a->offset = offset & ~(PAGE_SIZE - 1);
+    a->file_end = vaddr + filesz;
+    a->pending = 0;
+    spinlock_release_irqrestore(&vma_lock, flags);
+    vfs_map_node(node); // Released with the slot
+
+    for (uint32_t page = a->start; page < a->end; page += PAGE_SIZE) {
+        flags = spinlock_acquire_irqsave(&vma_lock);
+        a->pending++;
+        spinlock_release_irqrestore(&vma_lock, flags);
+        if (!vmm_map_lazy(pd, slot, (void*)page)) {
+            // Pages tagged so far are released as the caller maps over them
+            vma_put(slot);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void vma_put(uint32_t slot) {
+    if (slot >= VMA_MAX) return;
+    uint32_t flags = spinlock_acquire_irqsave(&vma_lock);
+    vma_t *a = &vma_table[slot];
+    struct fs_node *done = NULL;
+    if (a->node && a->pending && --a->pending == 0) {
+        done = a->node;
+        a->node = NULL;
+    }
+    spinlock_release_irqrestore(&vma_lock, flags);
+    if (done) vfs_unmap_node(done);
+}
+
+// Bring in the page at 'addr' of area 'a' (the node is pinned)
+static int vma_fault_page(const vma_t *a, uint32_t entry, uint32_t addr) {
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    uint32_t pos = a->offset + (page - a->start);
+    uint8_t *frame = NULL;
+    int shared = 0;
+
+    // A whole page of file data: map the page cache's frame copy-on-write.
+    // Files the page cache does not serve reads for (ramfs, the initrd)
+    // still get their pages cached here, so running them is shared too;
+    // write_fs() and truncate_fs() keep those pages current.
+    if (page + PAGE_SIZE <= a->file_end && (a->node->flags & 0x7) == FS_FILE) {
+        frame = pcache_get_frame(a->node, pos / PAGE_SIZE);
+        shared = (frame != NULL);
+    }
+    if (!frame) {
+        frame = (uint8_t*)pmm_alloc_block();
+        if (!frame) return 0;
+        if ((uint32_t)frame >= VMA_PHYS_LIMIT) { // Needs the identity map to fill
+            pmm_free_block(frame);
+            return 0;
+        }
+        memset(frame, 0, PAGE_SIZE);
+        if (page < a->file_end) {
+            uint32_t n = a->file_end - page;
+            if (n > PAGE_SIZE) n = PAGE_SIZE;
+            read_fs(a->node, pos, n, frame);
+        }
+    }
+
+    // Reading may have slept, and whoever shares this page table may have
+    // brought the page in meanwhile
+    if (vmm_get_entry(0, (void*)page) != entry) {
+        pmm_unref_block(frame);
+        return 1;
+    }
+    int ok = shared ? vmm_map_shared(0, (uint32_t)frame, (void*)page)
+                    : vmm_map_page(0, frame, (void*)page);
+    if (!ok) {
+        pmm_unref_block(frame);
+        return 0;
+    }
+    return 1;
+}
+
+int vma_fault(uint32_t entry, uint32_t addr) {
+    uint32_t slot = entry >> 12;
+    if (slot >= VMA_MAX) return 0;
+
+    uint32_t flags = spinlock_acquire_irqsave(&vma_lock);
+    vma_t a = vma_table[slot];
+    if (a.node && addr >= a.start && addr < a.end) vfs_map_node(a.node); // Held across the read
+    else a.node = NULL;
+    spinlock_release_irqrestore(&vma_lock, flags);
+    if (!a.node) return 0;
+
+    int ret = vma_fault_page(&a, entry, addr);
+    vfs_unmap_node(a.node);
+    return ret;
+}
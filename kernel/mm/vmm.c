@@ -6,6 +6,7 @@
 #include "ports.h"
 
 #include "spinlock.h"
+#include "mm/vma.h"
 
 // The Kernel's Page Directory
 pd_entry_t* kernel_page_directory = 0;
@@ -24,6 +25,7 @@ void vmm_enable_paging_asm() {
     uint32_t cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
     cr0 |= 0x80000000; // Bit 31: PG (Paging)
+    cr0 |= 0x00010000; // Bit 16: WP, so ring 0 writes fault on copy-on-write pages too
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
 }
 
@@ -39,20 +41,9 @@ static inline uint32_t vmm_get_cr3() {
 }
 
 // Map a single page
-int vmm_map_page(pd_entry_t* pd, void* phys, void* virt) {
-    uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
-
-    // If PD is provided, use it. Otherwise use current CR3.
-    pd_entry_t* page_directory = pd;
-    if (!page_directory) {
-        page_directory = (pd_entry_t*)vmm_get_cr3();
-        if (!page_directory) page_directory = kernel_page_directory;
-    }
-    if (!page_directory) {
-        spinlock_release_irqrestore(&vmm_lock, flags);
-        return 0; // Too early
-    }
-    
+// Page table entry for 'virt', allocating the table if 'create' is set.
+// Caller holds vmm_lock.
+static pt_entry_t* vmm_walk(pd_entry_t* page_directory, void* virt, int create) {
     uint32_t pd_index = (uint32_t)virt >> 22;
     uint32_t pt_index = ((uint32_t)virt >> 12) & 0x03FF;
     
@@ -60,15 +51,13 @@ int vmm_map_page(pd_entry_t* pd, void* phys, void* virt) {
     
     // Check if Page Table exists
     if ((*pd_entry & I86_PDE_PRESENT) != I86_PDE_PRESENT) {
+        if (!create) return 0;
         // Allocate new Page Table
         // Drop lock while calling PMM to allow interrupts? 
         // NO. PMM is fast and irq-safe. We keep VMM lock to prevent race on *pd_entry.
         
         void* new_pt_phys = pmm_alloc_block();
-        if (!new_pt_phys) {
-            spinlock_release_irqrestore(&vmm_lock, flags);
-            return 0; // OOM
-        }
+        if (!new_pt_phys) return 0; // OOM
         
         memset(new_pt_phys, 0, PMM_PAGE_SIZE); // Clear it
         
@@ -81,21 +70,209 @@ int vmm_map_page(pd_entry_t* pd, void* phys, void* virt) {
     // Note: This only works if new_pt_phys is IDENTITY MAPPED in Kernel space.
     // Since we identity map first 128MB, and PMM allocates from low mem first, this works.
     pt_entry_t* page_table = (pt_entry_t*)((*pd_entry) & ~0xFFF);
+    return &page_table[pt_index];
+}
+
+// A tagged entry going away: the file area it pointed at has one page less
+static inline void vmm_drop_entry(pt_entry_t old) {
+    if (!(old & I86_PTE_PRESENT) && (old & I86_PTE_FILE)) vma_put(old >> 12);
+}
+
+int vmm_map_page(pd_entry_t* pd, void* phys, void* virt) {
+    uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
+
+    // If PD is provided, use it. Otherwise use current CR3.
+    pd_entry_t* page_directory = pd;
+    if (!page_directory) {
+        page_directory = (pd_entry_t*)vmm_get_cr3();
+        if (!page_directory) page_directory = kernel_page_directory;
+    }
+    if (!page_directory) {
+        spinlock_release_irqrestore(&vmm_lock, flags);
+        return 0; // Too early
+    }
     
-    // Get entry
-    pt_entry_t* pt_entry = &page_table[pt_index];
+    pt_entry_t* pt_entry = vmm_walk(page_directory, virt, 1);
+    if (!pt_entry) {
+        spinlock_release_irqrestore(&vmm_lock, flags);
+        return 0; // OOM
+    }
     
     // Set Entry
+    pt_entry_t old = *pt_entry;
     *pt_entry = (uint32_t)phys | I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER;
     
     // FLUSH TLB to ensure CPU sees the new mapping!
     vmm_flush_tlb_entry(virt);
     
     spinlock_release_irqrestore(&vmm_lock, flags);
+    vmm_drop_entry(old);
+    return 1;
+}
+
+int vmm_map_lazy(pd_entry_t* pd, uint32_t tag, void* virt) {
+    uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
+    pd_entry_t* page_directory = pd ? pd : (pd_entry_t*)vmm_get_cr3();
+    pt_entry_t* pt_entry = page_directory ? vmm_walk(page_directory, virt, 1) : 0;
+    if (!pt_entry) {
+        spinlock_release_irqrestore(&vmm_lock, flags);
+        return 0;
+    }
+    pt_entry_t old = *pt_entry;
+    *pt_entry = (tag << 12) | I86_PTE_FILE;
+    vmm_flush_tlb_entry(virt);
+    spinlock_release_irqrestore(&vmm_lock, flags);
+    vmm_drop_entry(old);
     return 1;
 }
 
+// Unmap a single page. The backing frame is NOT freed.
+void vmm_unmap_page(pd_entry_t* pd, void* virt) {
+    uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
 
+    pd_entry_t* page_directory = pd;
+    if (!page_directory) {
+        page_directory = (pd_entry_t*)vmm_get_cr3();
+        if (!page_directory) page_directory = kernel_page_directory;
+    }
+    
+    uint32_t pd_index = (uint32_t)virt >> 22;
+    uint32_t pt_index = ((uint32_t)virt >> 12) & 0x03FF;
+    
+    pt_entry_t old = 0;
+    if (page_directory && (page_directory[pd_index] & I86_PDE_PRESENT)) {
+        pt_entry_t* page_table = (pt_entry_t*)(page_directory[pd_index] & ~0xFFF);
+        old = page_table[pt_index];
+        page_table[pt_index] = 0;
+        vmm_flush_tlb_entry(virt);
+    }
+    
+    spinlock_release_irqrestore(&vmm_lock, flags);
+    vmm_drop_entry(old);
+}
+
+// Identity-map device registers, uncached, in the kernel directory.
+// Directories cloned later link the same page tables.
+void* vmm_map_mmio(uint32_t phys, uint32_t size) {
+    uint32_t start = phys & ~(PAGE_SIZE - 1);
+    for (uint32_t addr = start; addr - start < (phys - start) + size; addr += PAGE_SIZE) {
+        if (!vmm_map_page(kernel_page_directory, (void*)addr, (void*)addr)) return 0;
+        pt_entry_t* page_table = (pt_entry_t*)(kernel_page_directory[addr >> 22] & ~0xFFF);
+        page_table[(addr >> 12) & 0x03FF] |= I86_PTE_NOT_CACHEABLE | I86_PTE_WRITETHROUGH;
+        vmm_flush_tlb_entry((void*)addr);
+    }
+    return (void*)phys;
+}
+
+// Directory loaded in CR3, for translating a buffer later from elsewhere
+pd_entry_t* vmm_current_directory(void) {
+    return (pd_entry_t*)vmm_get_cr3();
+}
+
+// Physical address behind 'virt' in the current (or given) directory;
+// 0 when unmapped. Used to hand buffers to bus-master DMA.
+uint32_t vmm_virt_to_phys(pd_entry_t* pd, void* virt) {
+    pd_entry_t* page_directory = pd;
+    if (!page_directory) {
+        page_directory = (pd_entry_t*)vmm_get_cr3();
+        if (!page_directory) page_directory = kernel_page_directory;
+    }
+    if (!page_directory) return (uint32_t)virt; // Paging not up yet: identity
+
+    uint32_t pd_index = (uint32_t)virt >> 22;
+    uint32_t pt_index = ((uint32_t)virt >> 12) & 0x03FF;
+    if (!(page_directory[pd_index] & I86_PDE_PRESENT)) return 0;
+
+    pt_entry_t* page_table = (pt_entry_t*)(page_directory[pd_index] & ~0xFFF);
+    if (!(page_table[pt_index] & I86_PTE_PRESENT)) return 0;
+    return (page_table[pt_index] & I86_PTE_FRAME) | ((uint32_t)virt & 0xFFF);
+}
+
+static pt_entry_t* vmm_get_pte(pd_entry_t* pd, void* virt) {
+    if (!pd) pd = (pd_entry_t*)vmm_get_cr3();
+    if (!pd) return 0;
+    uint32_t pd_index = (uint32_t)virt >> 22;
+    if (!(pd[pd_index] & I86_PDE_PRESENT)) return 0;
+    pt_entry_t* page_table = (pt_entry_t*)(pd[pd_index] & ~0xFFF);
+    return &page_table[((uint32_t)virt >> 12) & 0x03FF];
+}
+
+uint32_t vmm_get_entry(pd_entry_t* pd, void* virt) {
+    pt_entry_t* pte = vmm_get_pte(pd, virt);
+    return pte ? *pte : 0;
+}
+
+void vmm_release_file_entries(pd_entry_t* pd, uint32_t pd_index) {
+    if (!pd || pd_index >= 1024) return;
+    for (uint32_t i = 0; i < 1024; i++) {
+        uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
+        pt_entry_t old = 0;
+        if (pd[pd_index] & I86_PDE_PRESENT) {
+            pt_entry_t* page_table = (pt_entry_t*)(pd[pd_index] & ~0xFFF);
+            old = page_table[i];
+            if (!(old & I86_PTE_PRESENT) && (old & I86_PTE_FILE)) page_table[i] = 0;
+        }
+        spinlock_release_irqrestore(&vmm_lock, flags);
+        vmm_drop_entry(old);
+    }
+}
+
+int vmm_page_is_private(pd_entry_t* pd, void* virt) {
+    if (!pd) pd = (pd_entry_t*)vmm_get_cr3();
+    uint32_t pd_index = (uint32_t)virt >> 22;
+    if (!pd || pd == kernel_page_directory || !(pd[pd_index] & I86_PDE_PRESENT)) return 0;
+    return pd[pd_index] != kernel_page_directory[pd_index];
+}
+
+int vmm_share_page(pd_entry_t* pd, void* virt) {
+    uint32_t flags = spinlock_acquire_irqsave(&vmm_lock);
+    pt_entry_t* pte = vmm_get_pte(pd, virt);
+    if (!pte || !(*pte & I86_PTE_PRESENT)) {
+        spinlock_release_irqrestore(&vmm_lock, flags);
+        return 0;
+    }
+    *pte = (*pte & ~I86_PTE_WRITABLE) | I86_PTE_COW;
+    vmm_flush_tlb_entry(virt);
+    spinlock_release_irqrestore(&vmm_lock, flags);
+    return 1;
+}
+
+int vmm_map_shared(pd_entry_t* pd, uint32_t frame, void* virt) {
+    if (!vmm_map_page(pd, (void*)frame, virt)) return 0;
+    return vmm_share_page(pd, virt);
+}
+
+// Page fault hook: bring in a page of a file area, or resolve a write to a
+// copy-on-write page. Returns 1 if the access can be retried, 0 for a
+// genuine fault.
+int vmm_handle_fault(uint32_t addr, uint32_t err) {
+    void* page = (void*)(addr & ~(PAGE_SIZE - 1));
+    pt_entry_t* pte = vmm_get_pte(0, page);
+    if (!pte) return 0;
+    
+    if (!(err & 0x1)) { // Not present
+        if (!(*pte & I86_PTE_FILE)) return 0;
+        return vma_fault(*pte, addr);
+    }
+    if (!(err & 0x2) || !(*pte & I86_PTE_COW)) return 0; // Want: write access
+    
+    uint32_t frame = *pte & I86_PTE_FRAME;
+    if (pmm_block_refs((void*)frame) > 1) {
+        // Someone else still holds it: write to a private copy
+        void* copy = pmm_alloc_block();
+        if (!copy) return 0;
+        if ((uint32_t)copy >= 0x08000000) { // Needs the identity map to fill
+            pmm_free_block(copy);
+            return 0;
+        }
+        memcpy(copy, page, PAGE_SIZE);
+        pmm_unref_block((void*)frame);
+        frame = (uint32_t)copy;
+    }
+    *pte = frame | (*pte & 0xFFF & ~I86_PTE_COW) | I86_PTE_WRITABLE;
+    vmm_flush_tlb_entry(page);
+    return 1;
+}
 
 void vmm_map_framebuffer(boot_info_t* boot_info) {
     if (boot_info->framebuffer.addr != 0) {
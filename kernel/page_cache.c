@@ -0,0 +1,418 @@
+#include "page_cache.h"
+#include "memory.h"
+#include "string.h"
+#include "spinlock.h"
+#include "mm/pmm.h"
+
+#define PCACHE_PHYS_LIMIT 0x08000000      // Frames above 128MB are not identity-mapped
+#define PCACHE_LOW_WATER  (1024 * 1024)   // Start trimming when free RAM drops below this
+#define PCACHE_MIN_PAGES  64
+
+typedef struct pcache_radix {
+    void *slots[PCACHE_RADIX_SLOTS];
+    uint32_t count;
+} pcache_radix_t;
+
+static pcache_page_t *lru_head = NULL;   // Most recently used
+static pcache_page_t *lru_tail = NULL;
+static uint32_t nr_resident = 0;         // Pages holding a frame
+static uint32_t max_resident = 0;
+static lock_t pcache_lock;
+static int pcache_ready = 0;
+
+void pcache_init(void) {
+    spinlock_init(pcache_lock);
+    lru_head = lru_tail = NULL;
+    nr_resident = 0;
+    max_resident = pmm_get_free_memory() / PCACHE_PAGE_SIZE / 4;
+    if (max_resident < PCACHE_MIN_PAGES) max_resident = PCACHE_MIN_PAGES;
+    pmm_set_reclaim(pcache_shrink);
+    pcache_ready = 1;
+}
+
+// --- LRU ---
+
+static void lru_unlink(pcache_page_t *pg) {
+    if (pg->lru_prev) pg->lru_prev->lru_next = pg->lru_next;
+    else lru_head = pg->lru_next;
+    if (pg->lru_next) pg->lru_next->lru_prev = pg->lru_prev;
+    else lru_tail = pg->lru_prev;
+    pg->lru_prev = pg->lru_next = NULL;
+}
+
+static void lru_push_front(pcache_page_t *pg) {
+    pg->lru_prev = NULL;
+    pg->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = pg;
+    lru_head = pg;
+    if (!lru_tail) lru_tail = pg;
+}
+
+// --- Radix tree ---
+
+static int radix_fits(uint32_t height, uint32_t index) {
+    if (height >= PCACHE_RADIX_MAX) return 1;
+    return (index >> (height * PCACHE_RADIX_SHIFT)) == 0;
+}
+
+static uint32_t radix_slot(uint32_t index, uint32_t level) {
+    return (index >> ((level - 1) * PCACHE_RADIX_SHIFT)) & (PCACHE_RADIX_SLOTS - 1);
+}
+
+static pcache_page_t *radix_lookup(pcache_file_t *pf, uint32_t index) {
+    if (!pf->root || !radix_fits(pf->height, index)) return NULL;
+
+    void *slot = pf->root;
+    for (uint32_t level = pf->height; level > 0; level--) {
+        slot = ((pcache_radix_t*)slot)->slots[radix_slot(index, level)];
+        if (!slot) return NULL;
+    }
+    return (pcache_page_t*)slot;
+}
+
+static int radix_insert(pcache_file_t *pf, uint32_t index, pcache_page_t *page) {
+    if (!pf->root) {
+        pf->root = memory_alloc(sizeof(pcache_radix_t));
+        if (!pf->root) return -1;
+        pf->height = 1;
+    }
+    // Grow upwards until the index fits; the old root becomes slot 0
+    while (!radix_fits(pf->height, index)) {
+        pcache_radix_t *n = (pcache_radix_t*)memory_alloc(sizeof(pcache_radix_t));
+        if (!n) return -1;
+        n->slots[0] = pf->root;
+        n->count = 1;
+        pf->root = n;
+        pf->height++;
+    }
+
+    pcache_radix_t *n = (pcache_radix_t*)pf->root;
+    for (uint32_t level = pf->height; level > 1; level--) {
+        uint32_t i = radix_slot(index, level);
+        if (!n->slots[i]) {
+            n->slots[i] = memory_alloc(sizeof(pcache_radix_t));
+            if (!n->slots[i]) return -1;
+            n->count++;
+        }
+        n = (pcache_radix_t*)n->slots[i];
+    }
+
+    uint32_t i = radix_slot(index, 1);
+    if (!n->slots[i]) n->count++;
+    n->slots[i] = page;
+    return 0;
+}
+
+// Remove one leaf and free any interior nodes left empty
+static void radix_delete(pcache_file_t *pf, uint32_t index) {
+    if (!pf->root || !radix_fits(pf->height, index)) return;
+
+    pcache_radix_t *path[PCACHE_RADIX_MAX];
+    uint32_t slot[PCACHE_RADIX_MAX];
+    pcache_radix_t *n = (pcache_radix_t*)pf->root;
+    for (uint32_t level = pf->height; level > 0; level--) {
+        uint32_t depth = pf->height - level;
+        path[depth] = n;
+        slot[depth] = radix_slot(index, level);
+        if (level == 1) break;
+        n = (pcache_radix_t*)n->slots[slot[depth]];
+        if (!n) return;
+    }
+
+    for (int depth = pf->height - 1; depth >= 0; depth--) {
+        if (!path[depth]->slots[slot[depth]]) return;
+        path[depth]->slots[slot[depth]] = NULL;
+        if (--path[depth]->count > 0) return;
+        memory_free(path[depth]);
+    }
+    pf->root = NULL;
+    pf->height = 0;
+}
+
+// --- Pages ---
+
+static int page_ok(pcache_page_t *pg, fs_node_t *node) {
+    if (!pg || !pg->data) return 0;
+    uint32_t start = pg->index * PCACHE_PAGE_SIZE;
+    if (start >= node->length) return 1;
+    uint32_t need = node->length - start;
+    if (need > PCACHE_PAGE_SIZE) need = PCACHE_PAGE_SIZE;
+    return pg->valid >= need;
+}
+
+// Caller holds pcache_lock
+static void pcache_evict(pcache_page_t *pg) {
+    lru_unlink(pg);
+    radix_delete(pg->file, pg->index);
+    pg->file->nr_pages--;
+    if (pg->data) {
+        pmm_unref_block(pg->data); // Mapped frames live on in their processes
+        nr_resident--;
+    }
+    memory_free(pg);
+}
+
+// Trim from the cold end: over budget, low on RAM, or frames already reclaimed
+static void pcache_make_room(void) {
+    while (lru_tail && !lru_tail->data) pcache_evict(lru_tail);
+    while (lru_tail && (nr_resident >= max_resident || pmm_get_free_memory() < PCACHE_LOW_WATER))
+        pcache_evict(lru_tail);
+}
+
+static uint8_t *pcache_alloc_frame(void) {
+    void *frame = pmm_alloc_block();
+    if (frame && (uint32_t)frame >= PCACHE_PHYS_LIMIT) {
+        pmm_free_block(frame);
+        return NULL;
+    }
+    return (uint8_t*)frame;
+}
+
+// Called by the PMM when it is out of frames. This can run inside heap
+// expansion, so only frames are released here; the descriptors are cleaned
+// up by pcache_make_room() later. Never blocks on our own lock.
+size_t pcache_shrink(size_t want) {
+    if (!pcache_ready || !spinlock_acquire(&pcache_lock)) return 0;
+
+    size_t freed = 0;
+    for (pcache_page_t *pg = lru_tail; pg && freed < want; pg = pg->lru_prev) {
+        if (!pg->data || pmm_block_refs(pg->data) > 1) continue; // Mapped: frees nothing
+        pmm_free_block(pg->data);
+        pg->data = NULL;
+        nr_resident--;
+        freed++;
+    }
+
+    spinlock_drop(&pcache_lock);
+    return freed;
+}
+
+static pcache_file_t *pcache_file_get(fs_node_t *node) {
+    if (!node->pcache) {
+        pcache_file_t *pf = (pcache_file_t*)memory_alloc(sizeof(pcache_file_t));
+        if (!pf) return NULL;
+        pf->node = node;
+        node->pcache = pf;
+    }
+    return node->pcache;
+}
+
+// Driver reads straight into the frames: one read_pages() call when the
+// filesystem has it, else a read() per page
+static uint32_t pcache_read_frames(fs_node_t *node, uint32_t start, uint32_t want, uint8_t **frames) {
+    if (node->read_pages) return node->read_pages(node, start, want, frames);
+
+    uint32_t got = 0;
+    for (uint32_t i = 0; got < want; i++) {
+        uint32_t chunk = want - got < PCACHE_PAGE_SIZE ? want - got : PCACHE_PAGE_SIZE;
+        uint32_t n = node->read(node, start + got, chunk, frames[i]);
+        got += n;
+        if (n < chunk) break;
+    }
+    return got;
+}
+
+// Read pages [index, index + count) into fresh frames and insert them.
+// Stops short at the first page that is already resident.
+static void pcache_fill(pcache_file_t *pf, uint32_t index, uint32_t count) {
+    fs_node_t *node = pf->node;
+    uint32_t file_pages = (node->length + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE;
+    if (index >= file_pages) return;
+    if (count > file_pages - index) count = file_pages - index;
+    if (count > PCACHE_RA_MAX) count = PCACHE_RA_MAX;
+
+    uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+    for (uint32_t i = 1; i < count; i++) {
+        if (page_ok(radix_lookup(pf, index + i), node)) {
+            count = i;
+            break;
+        }
+    }
+    spinlock_release_irqrestore(&pcache_lock, flags);
+
+    // Take the frames before the lock so a PMM reclaim can still make progress
+    uint8_t *frames[PCACHE_RA_MAX];
+    uint32_t nframes = 0;
+    while (nframes < count && (frames[nframes] = pcache_alloc_frame()) != NULL) nframes++;
+    if (nframes == 0) return;
+
+    uint32_t start = index * PCACHE_PAGE_SIZE;
+    uint32_t want = nframes * PCACHE_PAGE_SIZE;
+    if (want > node->length - start) want = node->length - start;
+    uint32_t got = pcache_read_frames(node, start, want, frames);
+
+    uint32_t i = 0;
+    for (; i < nframes && i * PCACHE_PAGE_SIZE < got; i++) {
+        uint32_t bytes = got - i * PCACHE_PAGE_SIZE;
+        if (bytes > PCACHE_PAGE_SIZE) bytes = PCACHE_PAGE_SIZE;
+        uint8_t *frame = frames[i];
+        if (bytes < PCACHE_PAGE_SIZE) memset(frame + bytes, 0, PCACHE_PAGE_SIZE - bytes);
+
+        flags = spinlock_acquire_irqsave(&pcache_lock);
+        pcache_make_room();
+
+        pcache_page_t *pg = radix_lookup(pf, index + i);
+        if (!pg) {
+            pg = (pcache_page_t*)memory_alloc(sizeof(pcache_page_t));
+            if (!pg || radix_insert(pf, index + i, pg) < 0) {
+                if (pg) memory_free(pg);
+                spinlock_release_irqrestore(&pcache_lock, flags);
+                break;
+            }
+            pg->file = pf;
+            pg->index = index + i;
+            pf->nr_pages++;
+        } else {
+            lru_unlink(pg);
+            if (pg->data) {
+                pmm_unref_block(pg->data);
+                nr_resident--;
+            }
+        }
+        pg->data = frame;
+        pg->valid = bytes;
+        nr_resident++;
+        lru_push_front(pg);
+
+        spinlock_release_irqrestore(&pcache_lock, flags);
+    }
+    for (; i < nframes; i++) pmm_free_block(frames[i]); // Past the data read, or no room
+}
+
+uint32_t pcache_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    if (!pcache_ready) pcache_init();
+    if (offset >= node->length) return 0;
+    if (size > node->length - offset) size = node->length - offset;
+    if (size == 0) return 0;
+
+    pcache_file_t *pf = pcache_file_get(node);
+    if (!pf) return node->read(node, offset, size, buffer);
+
+    // Adaptive readahead: a read that starts where the last one ended keeps
+    // the stream going and doubles the window on each miss; anything else
+    // switches readahead off until the reader turns sequential again.
+    int sequential = (offset == pf->ra_offset);
+    pf->ra_offset = offset + size;
+    if (!sequential) pf->ra_window = 0;
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t index = pos / PCACHE_PAGE_SIZE;
+        uint32_t in_page = pos % PCACHE_PAGE_SIZE;
+
+        uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+        pcache_page_t *pg = radix_lookup(pf, index);
+        if (!page_ok(pg, node)) {
+            spinlock_release_irqrestore(&pcache_lock, flags);
+
+            uint32_t count = (offset + size - 1) / PCACHE_PAGE_SIZE - index + 1;
+            if (sequential) {
+                pf->ra_window = pf->ra_window ? pf->ra_window * 2 : PCACHE_RA_MIN;
+                if (pf->ra_window > PCACHE_RA_MAX) pf->ra_window = PCACHE_RA_MAX;
+                if (count < pf->ra_window) count = pf->ra_window;
+            }
+            pcache_fill(pf, index, count);
+
+            flags = spinlock_acquire_irqsave(&pcache_lock);
+            pg = radix_lookup(pf, index);
+            if (!page_ok(pg, node)) {
+                // No memory for the cache (or a short read): go straight to the driver
+                spinlock_release_irqrestore(&pcache_lock, flags);
+                return done + node->read(node, pos, size - done, buffer + done);
+            }
+        }
+
+        uint32_t chunk = PCACHE_PAGE_SIZE - in_page;
+        if (chunk > size - done) chunk = size - done;
+        memcpy(buffer + done, pg->data + in_page, chunk);
+        lru_unlink(pg);
+        lru_push_front(pg);
+        spinlock_release_irqrestore(&pcache_lock, flags);
+
+        done += chunk;
+    }
+    return done;
+}
+
+uint8_t *pcache_get_frame(fs_node_t *node, uint32_t index) {
+    if (!pcache_ready) pcache_init();
+    if (index >= (node->length + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE) return NULL;
+
+    pcache_file_t *pf = pcache_file_get(node);
+    if (!pf) return NULL;
+
+    for (int tries = 0; tries < 2; tries++) {
+        uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+        pcache_page_t *pg = radix_lookup(pf, index);
+        if (page_ok(pg, node)) {
+            pmm_ref_block(pg->data);
+            lru_unlink(pg);
+            lru_push_front(pg);
+            spinlock_release_irqrestore(&pcache_lock, flags);
+            return pg->data;
+        }
+        spinlock_release_irqrestore(&pcache_lock, flags);
+        if (tries == 0) pcache_fill(pf, index, PCACHE_RA_MIN); // Neighbours fault next
+    }
+    return NULL;
+}
+
+void pcache_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    pcache_file_t *pf = node->pcache;
+    if (!pf || size == 0) return;
+
+    uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t in_page = pos % PCACHE_PAGE_SIZE;
+        uint32_t chunk = PCACHE_PAGE_SIZE - in_page;
+        if (chunk > size - done) chunk = size - done;
+
+        pcache_page_t *pg = radix_lookup(pf, pos / PCACHE_PAGE_SIZE);
+        if (pg) {
+            // Frames mapped into processes keep the old bytes (private file mappings)
+            if (pg->data && in_page <= pg->valid && pmm_block_refs(pg->data) == 1) {
+                memcpy(pg->data + in_page, buffer + done, chunk);
+                if (in_page + chunk > pg->valid) pg->valid = in_page + chunk;
+            } else {
+                pcache_evict(pg); // Would leave a hole of unknown bytes
+            }
+        }
+        done += chunk;
+    }
+    spinlock_release_irqrestore(&pcache_lock, flags);
+}
+
+void pcache_truncate(fs_node_t *node, uint32_t length) {
+    pcache_file_t *pf = node->pcache;
+    if (!pf) return;
+
+    uint32_t first = length / PCACHE_PAGE_SIZE; // Partial page goes too: its tail may be stale
+    uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+    pcache_page_t *pg = lru_head;
+    while (pg) {
+        pcache_page_t *next = pg->lru_next;
+        if (pg->file == pf && pg->index >= first) pcache_evict(pg);
+        pg = next;
+    }
+    spinlock_release_irqrestore(&pcache_lock, flags);
+}
+
+void pcache_invalidate(fs_node_t *node) {
+    pcache_file_t *pf = node->pcache;
+    if (!pf) return;
+
+    uint32_t flags = spinlock_acquire_irqsave(&pcache_lock);
+    pcache_page_t *pg = lru_head;
+    while (pg && pf->nr_pages) {
+        pcache_page_t *next = pg->lru_next;
+        if (pg->file == pf) pcache_evict(pg);
+        pg = next;
+    }
+    node->pcache = NULL;
+    spinlock_release_irqrestore(&pcache_lock, flags);
+
+    memory_free(pf);
+}
@@ -0,0 +1,234 @@
+#include "pci.h"
+#include "ports.h"
+#include "console.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+#define PCI_MSI_CONTROL    0x02
+#define PCI_MSI_ADDR_LO    0x04
+#define PCI_MSI_ADDR_HI    0x08
+#define PCI_MSI_ENABLE     0x0001
+#define PCI_MSI_64BIT      0x0080
+#define PCI_MSI_MME_MASK   0x0070  // Multiple Message Enable: we use one vector
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static uint32_t pci_count = 0;
+static int pci_ready = 0;
+static pci_driver_t *pci_drivers = 0;
+
+// --- Config Space ---
+
+static uint32_t pci_address(pci_addr_t addr, uint8_t offset) {
+    return 0x80000000 | ((uint32_t)addr.bus << 16) | ((uint32_t)addr.slot << 11) |
+           ((uint32_t)addr.func << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_read32(pci_addr_t addr, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(addr, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read16(pci_addr_t addr, uint8_t offset) {
+    return (uint16_t)(pci_read32(addr, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_read8(pci_addr_t addr, uint8_t offset) {
+    return (uint8_t)(pci_read32(addr, offset) >> ((offset & 3) * 8));
+}
+
+void pci_write32(pci_addr_t addr, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(addr, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Read-modify-write of the containing dword
+void pci_write16(pci_addr_t addr, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t dword = pci_read32(addr, offset);
+    dword = (dword & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_write32(addr, offset, dword);
+}
+
+// --- Enumeration ---
+
+// Size each BAR by writing all ones and reading back the writable bits.
+// Decoding is off meanwhile so the probe value never claims real addresses.
+static void pci_size_bars(pci_device_t *dev) {
+    uint16_t command = pci_read16(dev->addr, PCI_COMMAND);
+    pci_write16(dev->addr, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int i = 0; i < 6; i++) {
+        uint8_t reg = PCI_BAR0 + i * 4;
+        uint32_t orig = pci_read32(dev->addr, reg);
+        pci_write32(dev->addr, reg, 0xFFFFFFFF);
+        uint32_t probe = pci_read32(dev->addr, reg);
+        pci_write32(dev->addr, reg, orig);
+        if (probe == 0 || probe == 0xFFFFFFFF) continue; // Unimplemented
+
+        pci_bar_t *bar = &dev->bars[i];
+        if (orig & 1) {
+            bar->flags = PCI_BAR_IO;
+            bar->base = orig & 0xFFFFFFFC;
+            bar->size = (~(probe & 0xFFFFFFFC) + 1) & 0xFFFF;
+            continue;
+        }
+
+        bar->base = orig & 0xFFFFFFF0;
+        bar->size = ~(probe & 0xFFFFFFF0) + 1;
+        if (orig & 0x08) bar->flags |= PCI_BAR_PREFETCH;
+        if (((orig >> 1) & 3) == 2 && i < 5) {
+            // 64-bit BAR: the next register holds the high half. We only
+            // reach the low 4GB, so a BAR placed above it is left unused.
+            bar->flags |= PCI_BAR_64;
+            uint32_t high = pci_read32(dev->addr, reg + 4);
+            if (high) bar->base = 0;
+            i++;
+        }
+    }
+
+    pci_write16(dev->addr, PCI_COMMAND, command);
+}
+
+static void pci_find_caps(pci_device_t *dev) {
+    if (!(pci_read16(dev->addr, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return;
+
+    uint8_t ptr = pci_read8(dev->addr, PCI_CAP_PTR) & 0xFC;
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        uint8_t id = pci_read8(dev->addr, ptr);
+        if (id == PCI_CAP_ID_MSI) dev->msi_cap = ptr;
+        else if (id == PCI_CAP_ID_MSIX) dev->msix_cap = ptr;
+        ptr = pci_read8(dev->addr, ptr + 1) & 0xFC;
+    }
+}
+
+static void pci_add_device(pci_addr_t addr) {
+    if (pci_count >= PCI_MAX_DEVICES) return;
+
+    pci_device_t *dev = &pci_devices[pci_count++];
+    dev->addr = addr;
+    dev->vendor = pci_read16(addr, PCI_VENDOR_ID);
+    dev->device = pci_read16(addr, PCI_DEVICE_ID);
+    dev->class_code = pci_read8(addr, PCI_CLASS);
+    dev->subclass = pci_read8(addr, PCI_SUBCLASS);
+    dev->prog_if = pci_read8(addr, PCI_PROG_IF);
+    dev->revision = pci_read8(addr, PCI_REVISION);
+
+    // Bridges (header type 1) have only two BARs and no INTx of interest
+    if ((pci_read8(addr, PCI_HEADER_TYPE) & 0x7F) == 0) {
+        dev->irq_line = pci_read8(addr, PCI_INTERRUPT_LINE);
+        dev->irq_pin = pci_read8(addr, PCI_INTERRUPT_PIN);
+        pci_size_bars(dev);
+    }
+    pci_find_caps(dev);
+}
+
+void pci_init(void) {
+    if (pci_ready) return;
+    pci_ready = 1;
+
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint32_t slot = 0; slot < 32; slot++) {
+            pci_addr_t addr = { (uint8_t)bus, (uint8_t)slot, 0 };
+            if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF) continue;
+
+            // Only multi-function devices have functions 1-7
+            uint32_t funcs = (pci_read8(addr, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (uint32_t func = 0; func < funcs; func++) {
+                addr.func = (uint8_t)func;
+                if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF) continue;
+                pci_add_device(addr);
+            }
+        }
+    }
+
+    serial_write("[PCI] Bus enumerated.\n");
+}
+
+// --- Drivers ---
+
+static const pci_device_id_t *pci_match(pci_driver_t *drv, pci_device_t *dev) {
+    for (const pci_device_id_t *id = drv->ids; id->vendor || id->device || id->class_code || id->subclass; id++) {
+        if (id->vendor != PCI_ANY_ID && id->vendor != dev->vendor) continue;
+        if (id->device != PCI_ANY_ID && id->device != dev->device) continue;
+        if (id->class_code != PCI_ANY_CLASS && id->class_code != dev->class_code) continue;
+        if (id->subclass != PCI_ANY_CLASS && id->subclass != dev->subclass) continue;
+        return id;
+    }
+    return 0;
+}
+
+static void pci_try_bind(pci_driver_t *drv, pci_device_t *dev) {
+    if (dev->driver) return;
+    const pci_device_id_t *id = pci_match(drv, dev);
+    if (id && drv->probe(dev, id) == 0) dev->driver = drv;
+}
+
+void pci_register_driver(pci_driver_t *drv) {
+    pci_init();
+    drv->next = pci_drivers;
+    pci_drivers = drv;
+    for (uint32_t i = 0; i < pci_count; i++) pci_try_bind(drv, &pci_devices[i]);
+}
+
+// --- Lookup ---
+
+uint32_t pci_device_count(void) {
+    pci_init();
+    return pci_count;
+}
+
+pci_device_t *pci_get_device(uint32_t index) {
+    pci_init();
+    return index < pci_count ? &pci_devices[index] : 0;
+}
+
+pci_device_t *pci_find_device(uint16_t vendor, uint16_t device) {
+    pci_init();
+    for (uint32_t i = 0; i < pci_count; i++) {
+        if (pci_devices[i].vendor == vendor && pci_devices[i].device == device) return &pci_devices[i];
+    }
+    return 0;
+}
+
+pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass) {
+    pci_init();
+    for (uint32_t i = 0; i < pci_count; i++) {
+        if (pci_devices[i].class_code == class_code && pci_devices[i].subclass == subclass) return &pci_devices[i];
+    }
+    return 0;
+}
+
+void pci_enable_device(pci_device_t *dev, int bus_master) {
+    uint16_t command = pci_read16(dev->addr, PCI_COMMAND) | PCI_COMMAND_IO | PCI_COMMAND_MEMORY;
+    if (bus_master) command |= PCI_COMMAND_MASTER;
+    pci_write16(dev->addr, PCI_COMMAND, command);
+}
+
+// --- MSI ---
+
+int pci_enable_msi(pci_device_t *dev, uint32_t address, uint16_t data) {
+    if (!dev->msi_cap) return -1;
+
+    uint8_t cap = dev->msi_cap;
+    uint16_t control = pci_read16(dev->addr, cap + PCI_MSI_CONTROL);
+    pci_write32(dev->addr, cap + PCI_MSI_ADDR_LO, address);
+    if (control & PCI_MSI_64BIT) {
+        pci_write32(dev->addr, cap + PCI_MSI_ADDR_HI, 0);
+        pci_write16(dev->addr, cap + 0x0C, data);
+    } else {
+        pci_write16(dev->addr, cap + 0x08, data);
+    }
+
+    control = (control & ~PCI_MSI_MME_MASK) | PCI_MSI_ENABLE;
+    pci_write16(dev->addr, cap + PCI_MSI_CONTROL, control);
+    pci_write16(dev->addr, PCI_COMMAND, pci_read16(dev->addr, PCI_COMMAND) | PCI_COMMAND_INTX_OFF);
+    return 0;
+}
+
+void pci_disable_msi(pci_device_t *dev) {
+    if (!dev->msi_cap) return;
+    uint8_t cap = dev->msi_cap;
+    pci_write16(dev->addr, cap + PCI_MSI_CONTROL, pci_read16(dev->addr, cap + PCI_MSI_CONTROL) & ~PCI_MSI_ENABLE);
+    pci_write16(dev->addr, PCI_COMMAND, pci_read16(dev->addr, PCI_COMMAND) & ~PCI_COMMAND_INTX_OFF);
+}
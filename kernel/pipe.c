@@ -2,35 +2,66 @@
 #include "memory.h"
 #include "string.h"
 #include "process.h"
+#include "poll.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
 
-#define PIPE_SIZE 4096
+#define PIPE_PHYS_LIMIT 0x08000000  // Gifted frames are read through the identity map
+
+// A page queued by reference (vmsplice gift), in order with the ring
+// bytes: ring_before ring bytes are read first
+typedef struct pipe_page {
+    uint32_t frame;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t ring_before;
+    struct pipe_page *next;
+} pipe_page_t;
 
 typedef struct {
-    uint8_t buffer[PIPE_SIZE];
+    uint8_t *buffer;
+    uint32_t size;              // Ring capacity, grows on demand
+    uint32_t max_size;          // Growth ceiling (F_SETPIPE_SZ)
     uint32_t read_ptr;
     uint32_t write_ptr;
     uint32_t bytes_available;
+    pipe_page_t *pages;         // Gifted pages, oldest first
+    pipe_page_t *pages_tail;
+    uint32_t npages;
+    uint32_t ring_after_tail;   // Ring bytes written after the newest page
     int readers;
     int writers;
-    // Simple verification lock mechanism
-    int lock; 
+    wait_queue_t read_wait;  // Readers waiting for data
+    wait_queue_t write_wait; // Writers waiting for space
 } pipe_context_t;
 
 static uint32_t pipe_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 static uint32_t pipe_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 static void pipe_close(fs_node_t *node);
 static void pipe_open(fs_node_t *node);
+static uint32_t pipe_poll(fs_node_t *node, wait_queue_t **wq);
 
 static pipe_context_t* pipe_create_context() {
     pipe_context_t *ctx = (pipe_context_t*)memory_alloc(sizeof(pipe_context_t));
+    if (!ctx) return NULL;
     memset(ctx, 0, sizeof(pipe_context_t));
+    ctx->buffer = (uint8_t*)memory_alloc(PIPE_MIN_SIZE);
+    if (!ctx->buffer) {
+        memory_free(ctx);
+        return NULL;
+    }
+    ctx->size = PIPE_MIN_SIZE;
+    ctx->max_size = PIPE_DEFAULT_MAX;
     ctx->readers = 0;
     ctx->writers = 0;
+    wait_queue_init(&ctx->read_wait);
+    wait_queue_init(&ctx->write_wait);
     return ctx;
 }
 
 int make_pipe(fs_node_t **read_node, fs_node_t **write_node) {
     pipe_context_t *ctx = pipe_create_context();
+    if (!ctx) return -1;
     
     // Read Node
     fs_node_t *r = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
@@ -41,6 +72,7 @@ int make_pipe(fs_node_t **read_node, fs_node_t **write_node) {
     r->write = NULL; // Read end cannot write
     r->open = pipe_open;
     r->close = pipe_close;
+    r->poll = pipe_poll;
     r->ptr = (struct fs_node*)ctx; // Store context
     r->impl = 0; // 0 for read end?
     
@@ -53,6 +85,7 @@ int make_pipe(fs_node_t **read_node, fs_node_t **write_node) {
     w->write = pipe_write;
     w->open = pipe_open;
     w->close = pipe_close;
+    w->poll = pipe_poll;
     w->ptr = (struct fs_node*)ctx;
     w->impl = 1; // 1 for write end?
     
@@ -77,8 +110,21 @@ static void pipe_close(fs_node_t *node) {
     if (node->impl == 0) ctx->readers--; // Read end
     else ctx->writers--; // Write end
     
+    // Peer sees EOF / broken pipe
+    wait_queue_wake_all(&ctx->read_wait);
+    wait_queue_wake_all(&ctx->write_wait);
+    
     // If no one left, free context (and buffer)
     if (ctx->readers == 0 && ctx->writers == 0) {
+        wait_queue_destroy(&ctx->read_wait);
+        wait_queue_destroy(&ctx->write_wait);
+        while (ctx->pages) {
+            pipe_page_t *pg = ctx->pages;
+            ctx->pages = pg->next;
+            pmm_unref_block((void*)pg->frame);
+            memory_free(pg);
+        }
+        memory_free(ctx->buffer);
         memory_free(ctx);
     }
     
@@ -87,34 +133,172 @@ static void pipe_close(fs_node_t *node) {
     memory_free(node);
 }
 
+// --- Ring ---
+// Data and free space may each wrap around the end of the buffer, so a
+// transfer is at most two memcpys.
+
+static void pipe_ring_put(pipe_context_t *ctx, const uint8_t *src, uint32_t n) {
+    uint32_t first = ctx->size - ctx->write_ptr;
+    if (first > n) first = n;
+    memcpy(ctx->buffer + ctx->write_ptr, src, first);
+    memcpy(ctx->buffer, src + first, n - first);
+    ctx->write_ptr = (ctx->write_ptr + n) % ctx->size;
+    ctx->bytes_available += n;
+    if (ctx->pages) ctx->ring_after_tail += n;
+}
+
+static void pipe_ring_get(pipe_context_t *ctx, uint8_t *dst, uint32_t n) {
+    uint32_t first = ctx->size - ctx->read_ptr;
+    if (first > n) first = n;
+    memcpy(dst, ctx->buffer + ctx->read_ptr, first);
+    memcpy(dst + first, ctx->buffer, n - first);
+    ctx->read_ptr = (ctx->read_ptr + n) % ctx->size;
+    ctx->bytes_available -= n;
+}
+
+// Move the contents into a new 'size'-byte ring, starting at offset 0
+static int pipe_resize(pipe_context_t *ctx, uint32_t size) {
+    uint32_t n = ctx->bytes_available;
+    if (size < n) return -1;
+    uint8_t *buffer = (uint8_t*)memory_alloc(size);
+    if (!buffer) return -1;
+    
+    pipe_ring_get(ctx, buffer, n);
+    memory_free(ctx->buffer);
+    ctx->buffer = buffer;
+    ctx->size = size;
+    ctx->read_ptr = 0;
+    ctx->write_ptr = n % size;
+    ctx->bytes_available = n;
+    wait_queue_wake_all(&ctx->write_wait); // No longer full
+    return 0;
+}
+
+// The ring is full: a producer outrunning its reader gets a bigger ring
+// (doubling up to max_size); past that it sleeps until a reader drains.
+static void pipe_wait_space(pipe_context_t *ctx) {
+    if (ctx->size < ctx->max_size) {
+        uint32_t size = ctx->size * 2;
+        if (size > ctx->max_size) size = ctx->max_size;
+        if (pipe_resize(ctx, size) == 0) return;
+    }
+    uint32_t flags = wait_irq_save();
+    if (ctx->bytes_available == ctx->size && ctx->readers > 0) {
+        wait_queue_sleep(&ctx->write_wait);
+    }
+    wait_irq_restore(flags);
+}
+
+static int pipe_empty(pipe_context_t *ctx) {
+    return ctx->bytes_available == 0 && !ctx->pages;
+}
+
+// Gifted pages count against the same limit the ring grows to
+static int pipe_pages_full(pipe_context_t *ctx) {
+    return ctx->npages * PAGE_SIZE >= ctx->max_size;
+}
+
+static int pipe_full(pipe_context_t *ctx) {
+    return ctx->bytes_available == ctx->size || pipe_pages_full(ctx);
+}
+
+// Readers only sleep on an empty pipe and writers on a full one, so only
+// those transitions wake anybody
+static void pipe_added(pipe_context_t *ctx, int was_empty) {
+    if (was_empty) wait_queue_wake_all(&ctx->read_wait);
+}
+
+static void pipe_removed(pipe_context_t *ctx, int was_full) {
+    if (was_full) wait_queue_wake_all(&ctx->write_wait);
+}
+
+// Ring bytes readable before the next gifted page
+static uint32_t pipe_ring_readable(pipe_context_t *ctx) {
+    return ctx->pages ? ctx->pages->ring_before : ctx->bytes_available;
+}
+
+static void pipe_ring_consumed(pipe_context_t *ctx, uint32_t n) {
+    if (ctx->pages) ctx->pages->ring_before -= n;
+}
+
+// Drop the head page; the caller decides what happens to its frame
+static void pipe_page_pop(pipe_context_t *ctx) {
+    pipe_page_t *pg = ctx->pages;
+    ctx->pages = pg->next;
+    if (!ctx->pages) ctx->pages_tail = NULL;
+    ctx->npages--;
+    memory_free(pg);
+}
+
+// Hand the reader a whole gifted page by remapping it over 'dst' instead
+// of copying. Only for page-aligned destinations in the caller's own
+// (non-kernel) page tables; the frame it replaces is released.
+static int pipe_page_move(pipe_context_t *ctx, uint8_t *dst) {
+    pipe_page_t *pg = ctx->pages;
+    if (pg->offset != 0 || pg->len != PAGE_SIZE || ((uint32_t)dst & (PAGE_SIZE - 1))) return 0;
+    if (!vmm_page_is_private(NULL, dst)) return 0;
+    uint32_t old = vmm_virt_to_phys(NULL, dst);
+    if (!old) return 0;
+    
+    uint32_t frame = pg->frame;
+    if (!vmm_map_shared(NULL, frame, dst)) return 0;
+    pipe_page_pop(ctx);             // The mapping inherits the pipe's reference
+    pmm_unref_block((void*)(old & I86_PTE_FRAME));
+    return 1;
+}
+
+// Take data out in FIFO order (ring bytes and gifted pages interleaved)
+static uint32_t pipe_take(pipe_context_t *ctx, uint8_t *buffer, uint32_t size, int move) {
+    int was_full = pipe_full(ctx);
+    uint32_t copied = 0;
+    
+    while (copied < size && !pipe_empty(ctx)) {
+        uint32_t ring = pipe_ring_readable(ctx);
+        if (ring > 0) {
+            uint32_t n = size - copied < ring ? size - copied : ring;
+            pipe_ring_get(ctx, buffer + copied, n);
+            pipe_ring_consumed(ctx, n);
+            copied += n;
+            continue;
+        }
+        
+        pipe_page_t *pg = ctx->pages;
+        if (move && size - copied >= PAGE_SIZE && pipe_page_move(ctx, buffer + copied)) {
+            copied += PAGE_SIZE;
+            continue;
+        }
+        uint32_t n = size - copied < pg->len ? size - copied : pg->len;
+        memcpy(buffer + copied, (uint8_t*)pg->frame + pg->offset, n);
+        pg->offset += n;
+        pg->len -= n;
+        copied += n;
+        if (pg->len == 0) {
+            uint32_t frame = pg->frame;
+            pipe_page_pop(ctx);
+            pmm_unref_block((void*)frame);
+        }
+    }
+    pipe_removed(ctx, was_full);
+    return copied;
+}
+
+// Returns whatever is there (up to size) as soon as the pipe is non-empty
 static uint32_t pipe_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
     (void)offset;
     pipe_context_t *ctx = (pipe_context_t*)node->ptr;
+    if (size == 0) return 0;
     
-    uint32_t collected = 0;
-    
-    while (collected < size) {
-        if (ctx->bytes_available > 0) {
-            // Read byte
-            buffer[collected] = ctx->buffer[ctx->read_ptr];
-            ctx->read_ptr = (ctx->read_ptr + 1) % PIPE_SIZE;
-            ctx->bytes_available--;
-            collected++;
-        } else {
-             // Empty
-             if (ctx->writers == 0) {
-                 // EOF
-                 return collected;
-             }
-             
-             // Block/Yield
-             // Ideally: event_wait(&ctx->wait_queue);
-             // For now: yield
-             extern void switch_task(void);
-             switch_task();
+    while (pipe_empty(ctx)) {
+        if (ctx->writers == 0) return 0; // EOF
+        
+        // Block until a writer adds data (or goes away)
+        uint32_t flags = wait_irq_save();
+        if (pipe_empty(ctx) && ctx->writers > 0) {
+            wait_queue_sleep(&ctx->read_wait);
         }
+        wait_irq_restore(flags);
     }
-    return collected;
+    return pipe_take(ctx, buffer, size, 0);
 }
 
 static uint32_t pipe_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
@@ -124,24 +308,222 @@ static uint32_t pipe_write(fs_node_t *node, uint32_t offset, uint32_t size, uint
     uint32_t written = 0;
     
     while (written < size) {
-        if (ctx->bytes_available < PIPE_SIZE) {
-            ctx->buffer[ctx->write_ptr] = buffer[written];
-            ctx->write_ptr = (ctx->write_ptr + 1) % PIPE_SIZE;
-            ctx->bytes_available++;
-            written++;
+        uint32_t space = ctx->size - ctx->bytes_available;
+        if (space > 0) {
+            int was_empty = pipe_empty(ctx);
+            uint32_t n = size - written < space ? size - written : space;
+            pipe_ring_put(ctx, buffer + written, n);
+            written += n;
+            pipe_added(ctx, was_empty);
         } else {
             // Full
             if (ctx->readers == 0) {
                 // Broken pipe
                 return written; // Or signal SIGPIPE
             }
-            extern void switch_task(void);
-            switch_task();
+            pipe_wait_space(ctx);
         }
     }
     return written;
 }
 
+static uint32_t pipe_poll(fs_node_t *node, wait_queue_t **wq) {
+    pipe_context_t *ctx = (pipe_context_t*)node->ptr;
+    uint32_t mask = 0;
+    
+    if (node->impl == 0) {
+        // Read end
+        *wq = &ctx->read_wait;
+        if (!pipe_empty(ctx)) mask |= POLLIN;
+        if (ctx->writers == 0) mask |= POLLHUP;
+    } else {
+        // Write end
+        *wq = &ctx->write_wait;
+        if (ctx->bytes_available < ctx->size) mask |= POLLOUT;
+        if (ctx->readers == 0) mask |= POLLERR;
+    }
+    return mask;
+}
+
+// --- Splice ---
+// Move data between the pipe ring and another node without a bounce
+// buffer: the other side reads/writes directly into/out of the ring.
+
+int pipe_splice_in(fs_node_t *pipe_w, fs_node_t *src, uint32_t *offset, uint32_t len) {
+    pipe_context_t *ctx = (pipe_context_t*)pipe_w->ptr;
+    uint32_t moved = 0;
+    
+    // Wait for space
+    while (ctx->bytes_available == ctx->size && ctx->readers > 0) {
+        pipe_wait_space(ctx);
+    }
+    if (ctx->readers == 0) return -1; // EPIPE
+    int was_empty = pipe_empty(ctx);
+    
+    while (moved < len && ctx->bytes_available < ctx->size) {
+        // Contiguous free span starting at write_ptr
+        uint32_t span = ctx->size - ctx->write_ptr;
+        uint32_t space = ctx->size - ctx->bytes_available;
+        if (span > space) span = space;
+        if (span > len - moved) span = len - moved;
+        
+        uint32_t got = read_fs(src, *offset, span, ctx->buffer + ctx->write_ptr);
+        if (got == 0) break; // EOF
+        
+        ctx->write_ptr = (ctx->write_ptr + got) % ctx->size;
+        ctx->bytes_available += got;
+        if (ctx->pages) ctx->ring_after_tail += got;
+        *offset += got;
+        moved += got;
+        if (got < span) break;
+    }
+    
+    if (moved) pipe_added(ctx, was_empty);
+    return moved;
+}
+
+int pipe_splice_out(fs_node_t *pipe_r, fs_node_t *dst, uint32_t *offset, uint32_t len) {
+    pipe_context_t *ctx = (pipe_context_t*)pipe_r->ptr;
+    uint32_t moved = 0;
+    
+    // Wait for data
+    uint32_t flags = wait_irq_save();
+    while (pipe_empty(ctx) && ctx->writers > 0) {
+        wait_queue_sleep(&ctx->read_wait);
+    }
+    wait_irq_restore(flags);
+    int was_full = pipe_full(ctx);
+    
+    while (moved < len && !pipe_empty(ctx)) {
+        uint32_t ring = pipe_ring_readable(ctx);
+        pipe_page_t *pg = ring ? NULL : ctx->pages;
+        
+        // Contiguous data span: from read_ptr, or the head gifted page
+        uint8_t *src = pg ? (uint8_t*)pg->frame + pg->offset : ctx->buffer + ctx->read_ptr;
+        uint32_t span = pg ? pg->len : ctx->size - ctx->read_ptr;
+        if (!pg && span > ring) span = ring;
+        if (span > len - moved) span = len - moved;
+        
+        uint32_t put = write_fs(dst, *offset, span, src);
+        if (put == 0) break;
+        
+        if (pg) {
+            pg->offset += put;
+            pg->len -= put;
+            if (pg->len == 0) {
+                uint32_t frame = pg->frame;
+                pipe_page_pop(ctx);
+                pmm_unref_block((void*)frame);
+            }
+        } else {
+            ctx->read_ptr = (ctx->read_ptr + put) % ctx->size;
+            ctx->bytes_available -= put;
+            pipe_ring_consumed(ctx, put);
+        }
+        *offset += put;
+        moved += put;
+        if (put < span) break;
+    }
+    
+    if (moved) pipe_removed(ctx, was_full);
+    return moved; // 0 = EOF
+}
+
+// --- vmsplice ---
+
+// Queue the writer's page at 'page' by reference. The writer keeps it
+// mapped copy-on-write, so later writes on its side do not show up here.
+static int pipe_gift_page(pipe_context_t *ctx, uint8_t *page) {
+    uint32_t phys = vmm_virt_to_phys(NULL, page);
+    if (!phys || phys >= PIPE_PHYS_LIMIT || !vmm_page_is_private(NULL, page)) return 0;
+    
+    pipe_page_t *pg = (pipe_page_t*)memory_alloc(sizeof(pipe_page_t));
+    if (!pg) return 0;
+    if (!vmm_share_page(NULL, page)) {
+        memory_free(pg);
+        return 0;
+    }
+    pg->frame = phys & I86_PTE_FRAME;
+    pmm_ref_block((void*)pg->frame);
+    pg->offset = 0;
+    pg->len = PAGE_SIZE;
+    pg->ring_before = ctx->pages ? ctx->ring_after_tail : ctx->bytes_available;
+    pg->next = NULL;
+    
+    int was_empty = pipe_empty(ctx);
+    if (ctx->pages_tail) ctx->pages_tail->next = pg;
+    else ctx->pages = pg;
+    ctx->pages_tail = pg;
+    ctx->npages++;
+    ctx->ring_after_tail = 0;
+    pipe_added(ctx, was_empty);
+    return 1;
+}
+
+int pipe_vmsplice_in(fs_node_t *pipe_w, uint8_t *buffer, uint32_t len, int gift) {
+    pipe_context_t *ctx = (pipe_context_t*)pipe_w->ptr;
+    uint32_t done = 0;
+    
+    while (done < len) {
+        uint8_t *p = buffer + done;
+        uint32_t head = (PAGE_SIZE - ((uint32_t)p & (PAGE_SIZE - 1))) & (PAGE_SIZE - 1);
+        
+        if (gift && head == 0 && len - done >= PAGE_SIZE) {
+            // Whole page: wait for room in the page queue, then gift it
+            uint32_t flags = wait_irq_save();
+            while (pipe_pages_full(ctx) && ctx->readers > 0) {
+                wait_queue_sleep(&ctx->write_wait);
+            }
+            wait_irq_restore(flags);
+            if (ctx->readers == 0) return done ? (int)done : -1; // EPIPE
+            
+            if (pipe_gift_page(ctx, p)) {
+                done += PAGE_SIZE;
+                continue;
+            }
+            head = PAGE_SIZE; // Not giftable: copy it
+        }
+        
+        // Copy up to the next page boundary (or everything, without gift)
+        uint32_t n = gift && head ? head : len - done;
+        if (n > len - done) n = len - done;
+        uint32_t w = pipe_write(pipe_w, 0, n, p);
+        done += w;
+        if (w < n) return done ? (int)done : -1;
+    }
+    return done;
+}
+
+int pipe_vmsplice_out(fs_node_t *pipe_r, uint8_t *buffer, uint32_t len, int move) {
+    pipe_context_t *ctx = (pipe_context_t*)pipe_r->ptr;
+    if (len == 0) return 0;
+    
+    uint32_t flags = wait_irq_save();
+    while (pipe_empty(ctx) && ctx->writers > 0) {
+        wait_queue_sleep(&ctx->read_wait);
+    }
+    wait_irq_restore(flags);
+    return pipe_take(ctx, buffer, len, move);
+}
+
+// --- Capacity ---
+
+uint32_t pipe_get_size(fs_node_t *node) {
+    return ((pipe_context_t*)node->ptr)->max_size;
+}
+
+int pipe_set_size(fs_node_t *node, uint32_t size) {
+    pipe_context_t *ctx = (pipe_context_t*)node->ptr;
+    if (size > PIPE_MAX_SIZE) return -1; // EPERM
+    if (size < PIPE_MIN_SIZE) size = PIPE_MIN_SIZE;
+    size = (size + PIPE_MIN_SIZE - 1) & ~(PIPE_MIN_SIZE - 1);
+    
+    // Shrinking below what is queued fails (EBUSY)
+    if (ctx->size > size && pipe_resize(ctx, size) != 0) return -1;
+    ctx->max_size = size;
+    return (int)size;
+}
+
 void pipe_init(void) {
     // Nothing to do globally
 }
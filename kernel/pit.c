@@ -17,6 +17,12 @@
 #define ICW1_ICW4 0x01
 #define ICW4_8086 0x01
 
+// Lines enabled so far: bit set = masked. Only the timer until a driver asks.
+static uint16_t pic_mask = 0xFFFE;
+
+static volatile uint32_t pit_ticks = 0;
+static uint32_t pit_frequency = 100;
+
 static void io_wait(void) {
     outb(0x80, 0);
 }
@@ -59,14 +65,28 @@ void pic_remap(void) {
     // But if we mask IRQ1, the controller buffers it?
     // Let's Unmask Timer(0) and maybe Keyboard(1) eventually.
     // For now, just Timer. 0xFE = 11111110 (Bit 0 clear)
-    outb(PIC1_DATA, 0xFE); 
-    outb(PIC2_DATA, 0xFF);
+    // plus whatever irq_install_handler() has asked for already
+    outb(PIC1_DATA, pic_mask & 0xFF); 
+    outb(PIC2_DATA, pic_mask >> 8);
+}
+
+void pic_unmask(uint8_t irq) {
+    pic_mask &= ~(1 << irq);
+    if (irq >= 8) pic_mask &= ~(1 << 2); // Slave cascade
+    outb(PIC1_DATA, pic_mask & 0xFF);
+    outb(PIC2_DATA, pic_mask >> 8);
+}
+
+void pic_eoi(uint8_t irq) {
+    if (irq >= 8) outb(PIC2_CMD, 0x20);
+    outb(PIC1_CMD, 0x20);
 }
 
 void pit_init(uint32_t frequency) {
     pic_remap();
     
     // Set frequency
+    pit_frequency = frequency;
     uint32_t divisor = 1193180 / frequency;
     
     outb(PIT_CMD_PORT, 0x36); // Mode 3 (Square Wave)
@@ -80,6 +100,17 @@ void timer_handler(void) {
     // Acknowledge PIC (Master)
     outb(PIC1_CMD, 0x20);
     
+    pit_ticks++;
+    
     // Switch Task
     process_schedule();
 }
+
+uint32_t pit_get_ticks(void) {
+    return pit_ticks;
+}
+
+// Rounds up so short timeouts still sleep at least one tick
+uint32_t pit_ms_to_ticks(uint32_t ms) {
+    return (ms * pit_frequency + 999) / 1000;
+}
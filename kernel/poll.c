@@ -0,0 +1,303 @@
+#include "poll.h"
+#include "fd.h"
+#include "vfs.h"
+#include "memory.h"
+#include "string.h"
+#include "pit.h"
+#include "process.h"
+
+extern process_t *current_process;
+
+// --- Readiness ---
+
+uint32_t poll_fd(int fd, wait_queue_t **wq) {
+    *wq = NULL;
+    
+    struct file_descriptor *desc = fd_get(fd);
+    if (desc && desc->node) return poll_fs(desc->node, wq);
+    
+    // Implicit stdio (no fd_table entry)
+    if (fd == 0) {
+        *wq = keyboard_wait_queue();
+        return keyboard_event_ready() ? POLLIN : 0;
+    }
+    if (fd == 1 || fd == 2) return POLLOUT;
+    
+    return POLLNVAL;
+}
+
+uint32_t poll_deadline(int timeout_ms) {
+    if (timeout_ms <= 0) return 0;
+    uint32_t deadline = pit_get_ticks() + pit_ms_to_ticks((uint32_t)timeout_ms);
+    return deadline ? deadline : 1; // 0 means "no deadline"
+}
+
+int poll_expired(uint32_t deadline) {
+    return deadline && (int32_t)(pit_get_ticks() - deadline) >= 0;
+}
+
+// --- poll() ---
+
+int sys_poll(struct pollfd *fds, uint32_t nfds, int timeout_ms) {
+    if (nfds > POLL_MAX_FDS || (nfds && !fds)) return -1;
+    
+    // One wait entry per fd, registered lazily on the first not-ready scan
+    wait_entry_t *entries = NULL;
+    if (nfds) {
+        entries = (wait_entry_t*)memory_alloc(nfds * sizeof(wait_entry_t));
+        if (!entries) return -1;
+    }
+    
+    uint32_t deadline = poll_deadline(timeout_ms);
+    uint32_t flags = wait_irq_save();
+    int ready;
+    
+    while (1) {
+        ready = 0;
+        for (uint32_t i = 0; i < nfds; i++) {
+            fds[i].revents = 0;
+            if (fds[i].fd < 0) continue; // Ignored slot
+            
+            wait_queue_t *wq;
+            uint32_t mask = poll_fd(fds[i].fd, &wq);
+            fds[i].revents = mask & (fds[i].events | POLLERR | POLLHUP | POLLNVAL);
+            
+            if (fds[i].revents) ready++;
+            else if (wq && !entries[i].queue) wait_queue_add(wq, &entries[i]);
+        }
+        
+        if (ready || timeout_ms == 0 || poll_expired(deadline)) break;
+        process_block(deadline);
+    }
+    
+    for (uint32_t i = 0; i < nfds; i++) wait_queue_remove(&entries[i]);
+    wait_irq_restore(flags);
+    
+    if (entries) memory_free(entries);
+    return ready;
+}
+
+// --- epoll ---
+// Each interest item keeps a wait entry on its object's queue for as long
+// as it is registered. The wakeup callback moves the item onto the set's
+// ready list, so epoll_wait only looks at fds that changed.
+
+struct epoll_set;
+
+typedef struct epoll_item {
+    int fd;
+    uint32_t events;
+    uint32_t data;
+    int on_ready;
+    struct epoll_item *ready_next;
+    wait_entry_t wait;          // Persistent registration
+    struct epoll_set *set;
+} epoll_item_t;
+
+typedef struct epoll_set {
+    epoll_item_t *by_fd[FD_MAX]; // O(1) ctl lookup
+    epoll_item_t *ready_head;
+    epoll_item_t *ready_tail;
+    wait_queue_t wait;           // epoll_wait sleepers (and pollers of the epoll fd)
+} epoll_set_t;
+
+// IRQs off
+static void epoll_ready_push(epoll_set_t *set, epoll_item_t *item) {
+    if (item->on_ready) return;
+    item->on_ready = 1;
+    item->ready_next = NULL;
+    if (set->ready_tail) set->ready_tail->ready_next = item;
+    else set->ready_head = item;
+    set->ready_tail = item;
+}
+
+// IRQs off
+static void epoll_ready_unlink(epoll_set_t *set, epoll_item_t *item) {
+    if (!item->on_ready) return;
+    epoll_item_t **link = &set->ready_head;
+    epoll_item_t *prev = NULL;
+    while (*link) {
+        if (*link == item) {
+            *link = item->ready_next;
+            if (set->ready_tail == item) set->ready_tail = prev;
+            break;
+        }
+        prev = *link;
+        link = &(*link)->ready_next;
+    }
+    item->on_ready = 0;
+    item->ready_next = NULL;
+}
+
+// Wakeup callback (runs with the source queue locked, IRQs off)
+static void epoll_item_wake(wait_entry_t *e) {
+    epoll_item_t *item = (epoll_item_t*)e->priv;
+    epoll_ready_push(item->set, item);
+    wait_queue_wake_all(&item->set->wait);
+}
+
+static uint32_t epoll_poll(fs_node_t *node, wait_queue_t **wq) {
+    epoll_set_t *set = (epoll_set_t*)node->ptr;
+    *wq = &set->wait;
+    return set->ready_head ? POLLIN : 0;
+}
+
+static void epoll_close(fs_node_t *node) {
+    epoll_set_t *set = (epoll_set_t*)node->ptr;
+    
+    uint32_t flags = wait_irq_save();
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        epoll_item_t *item = set->by_fd[fd];
+        if (!item) continue;
+        wait_queue_remove(&item->wait);
+        memory_free(item);
+    }
+    wait_queue_destroy(&set->wait);
+    wait_irq_restore(flags);
+    
+    memory_free(set);
+    memory_free(node);
+}
+
+static epoll_set_t *epoll_get(int epfd) {
+    struct file_descriptor *desc = fd_get(epfd);
+    if (!desc || !desc->node || (desc->node->flags & 0x7) != FS_EPOLL) return NULL;
+    return (epoll_set_t*)desc->node->ptr;
+}
+
+int sys_epoll_create(void) {
+    epoll_set_t *set = (epoll_set_t*)memory_alloc(sizeof(epoll_set_t));
+    fs_node_t *node = (fs_node_t*)memory_alloc(sizeof(fs_node_t));
+    if (!set || !node) {
+        if (set) memory_free(set);
+        if (node) memory_free(node);
+        return -1;
+    }
+    
+    wait_queue_init(&set->wait);
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, "epoll");
+    node->flags = FS_EPOLL;
+    node->close = epoll_close;
+    node->poll = epoll_poll;
+    node->ptr = (struct fs_node*)set;
+    
+    int fd = fd_install(node, 0);
+    if (fd < 0) epoll_close(node);
+    return fd;
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    epoll_set_t *set = epoll_get(epfd);
+    if (!set || fd < 0 || fd >= FD_MAX || fd == epfd) return -1;
+    if (op != EPOLL_CTL_DEL && !event) return -1;
+    
+    int ret = 0;
+    uint32_t flags = wait_irq_save();
+    epoll_item_t *item = set->by_fd[fd];
+    
+    switch (op) {
+        case EPOLL_CTL_ADD:
+            {
+                if (item) { ret = -1; break; } // EEXIST
+                
+                wait_queue_t *wq;
+                uint32_t mask = poll_fd(fd, &wq);
+                if (mask & POLLNVAL) { ret = -1; break; } // EBADF
+                
+                item = (epoll_item_t*)memory_alloc(sizeof(epoll_item_t));
+                if (!item) { ret = -1; break; }
+                item->fd = fd;
+                item->events = event->events;
+                item->data = event->data;
+                item->set = set;
+                item->wait.func = epoll_item_wake;
+                item->wait.priv = item;
+                if (wq) wait_queue_add(wq, &item->wait);
+                set->by_fd[fd] = item;
+                
+                if (mask & (item->events | POLLERR | POLLHUP)) epoll_ready_push(set, item);
+            }
+            break;
+            
+        case EPOLL_CTL_MOD:
+            {
+                if (!item) { ret = -1; break; } // ENOENT
+                item->events = event->events;
+                item->data = event->data;
+                
+                wait_queue_t *wq;
+                if (poll_fd(fd, &wq) & (item->events | POLLERR | POLLHUP)) epoll_ready_push(set, item);
+            }
+            break;
+            
+        case EPOLL_CTL_DEL:
+            if (!item) { ret = -1; break; }
+            wait_queue_remove(&item->wait);
+            epoll_ready_unlink(set, item);
+            set->by_fd[fd] = NULL;
+            memory_free(item);
+            break;
+            
+        default:
+            ret = -1;
+    }
+    
+    wait_irq_restore(flags);
+    return ret;
+}
+
+int sys_epoll_wait(int epfd, struct epoll_event *events, int max_events, int timeout_ms) {
+    epoll_set_t *set = epoll_get(epfd);
+    if (!set || !events || max_events <= 0) return -1;
+    
+    uint32_t deadline = poll_deadline(timeout_ms);
+    uint32_t flags = wait_irq_save();
+    int n;
+    
+    while (1) {
+        n = 0;
+        
+        // Re-check only the items that were signalled. Still-ready items go
+        // back on the tail (level-triggered, round robin across calls).
+        epoll_item_t *list = set->ready_head;
+        set->ready_head = set->ready_tail = NULL;
+        
+        while (list) {
+            epoll_item_t *item = list;
+            list = item->ready_next;
+            item->on_ready = 0;
+            item->ready_next = NULL;
+            
+            if (n >= max_events) {
+                epoll_ready_push(set, item); // Unexamined: keep for next call
+                continue;
+            }
+            
+            wait_queue_t *wq;
+            uint32_t mask = poll_fd(item->fd, &wq);
+            if (mask & POLLNVAL) continue; // fd closed underneath us
+            
+            // Object may have been recreated behind the same fd
+            if (wq && !item->wait.queue) wait_queue_add(wq, &item->wait);
+            
+            uint32_t rev = mask & (item->events | POLLERR | POLLHUP);
+            if (rev) {
+                events[n].events = rev;
+                events[n].data = item->data;
+                n++;
+                epoll_ready_push(set, item);
+            }
+        }
+        
+        if (n || timeout_ms == 0 || poll_expired(deadline)) break;
+        
+        wait_entry_t self = {0};
+        wait_queue_add(&set->wait, &self);
+        process_block(deadline);
+        wait_queue_remove(&self);
+    }
+    
+    wait_irq_restore(flags);
+    return n;
+}
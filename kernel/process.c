@@ -5,6 +5,7 @@
 #include "mm/vmm.h"
 #include "mm/pmm.h"
 #include "idt.h" // registers_t
+#include "pit.h"
 
 static process_t *process_list = NULL;
 process_t *current_process = NULL;
@@ -70,6 +71,7 @@ process_t *process_create(const char *name, void (*entry_point)(void)) {
     proc->heap_end = 0x10000000; // Start Heap at 256MB mark (Temporary safe zone)
     strcpy(proc->cwd, "/");      // Default to Root
     for(int i=0; i<256; i++) proc->fd_table[i] = NULL;
+    for(int i=0; i<PROCESS_MAX_WINDOWS; i++) proc->windows[i] = NULL;
     
     // VMM: Clone Kernel Directory
     // Each process gets its own Address Space (initially copy of kernel)
@@ -134,12 +136,26 @@ void process_schedule(void) {
         // Or we are switching FROM init.
     }
     
-    process_t *next = current_process->next;
-    if (!next) next = process_list; // Loop Loop
+    // Round robin over runnable tasks; blocked sleepers whose timeout
+    // expired are made ready on the way past.
+    uint32_t now = pit_get_ticks();
+    process_t *start = current_process->next ? current_process->next : process_list;
+    process_t *next = start;
+    while (1) {
+        if (next->state == PROCESS_STATE_BLOCKED && next->wake_tick &&
+            (int32_t)(now - next->wake_tick) >= 0) {
+            next->state = PROCESS_STATE_READY;
+        }
+        if (next->state == PROCESS_STATE_READY || next->state == PROCESS_STATE_RUNNING) break;
+        
+        next = next->next ? next->next : process_list;
+        if (next == start) return; // Nothing runnable: keep current (caller re-checks)
+    }
     
     if (next == current_process) return; // Only 1 task
     
     process_t *prev = current_process;
+    if (prev->state == PROCESS_STATE_RUNNING) prev->state = PROCESS_STATE_READY;
     current_process = next;
     
     current_process->state = PROCESS_STATE_RUNNING;
@@ -159,6 +175,25 @@ void process_yield(void) {
     process_schedule();
 }
 
+void process_block(uint32_t wake_tick) {
+    if (!current_process) return;
+    
+    current_process->wake_tick = wake_tick;
+    current_process->state = PROCESS_STATE_BLOCKED;
+    process_schedule();
+    
+    // Woken (or nothing else was runnable)
+    current_process->state = PROCESS_STATE_RUNNING;
+    current_process->wake_tick = 0;
+}
+
+void process_wake(process_t *proc) {
+    if (proc && proc->state == PROCESS_STATE_BLOCKED) {
+        proc->state = PROCESS_STATE_READY;
+        proc->wake_tick = 0;
+    }
+}
+
 // Exec: Replace current process image
 int process_exec(const char *filename, char *const argv[], char *const envp[]) {
     // 1. Load ELF (This maps segments into CURRENT address space)
@@ -292,6 +327,10 @@ void process_exit(void) {
     // Deschedule self
     if (!current_process) return;
     
+    // Release GUI windows still held in the handle table
+    extern void gui_handle_close_all(void);
+    gui_handle_close_all();
+    
     current_process->state = PROCESS_STATE_TERMINATED;
     
     console_log("[INFO] Process Exited\n");
@@ -455,6 +494,25 @@ int process_fork(registers_t *regs) {
     return child->pid; // Parent sees PID
 }
 
+// A reaped process's user page tables still hold the tags of file areas
+// it never touched. Untag the tables no one else links (fork shares them),
+// or the area table fills up.
+static void process_release_files(process_t *proc) {
+    extern pd_entry_t* kernel_page_directory;
+    pd_entry_t *pd = (pd_entry_t*)proc->page_directory;
+    if (!pd || pd == kernel_page_directory) return;
+
+    for (uint32_t i = 0; i < 1024; i++) {
+        if (!(pd[i] & I86_PDE_PRESENT) || pd[i] == kernel_page_directory[i]) continue;
+        int linked = 0;
+        for (process_t *p = process_list; p && !linked; p = p->next) {
+            pd_entry_t *other = (pd_entry_t*)p->page_directory;
+            linked = p != proc && other && other[i] == pd[i];
+        }
+        if (!linked) vmm_release_file_entries(pd, i);
+    }
+}
+
 int process_waitpid(int pid, int *status, int options) {
     (void)options; // Unused for now
     
@@ -490,6 +548,7 @@ int process_waitpid(int pid, int *status, int options) {
             }
             
             // Free Resources
+            process_release_files(child);
             if (child->kernel_stack) memory_free(child->kernel_stack);
             // vmm_free_directory handled in exit (implicit)?
             // Wait, process_exit frees PD immediately unless shared.
@@ -2,28 +2,51 @@
 #include "string.h"
 #include "console.h"
 #include "memory.h"
-#include "list.h" 
+#include "dcache.h"
+#include "initrd.h"
 
 // --- RamFS Structures ---
 
-// Since we lack a complex allocator or strict struct, we'll implement a simple tree
-// Any "fs_node_t" of type DIRECTORY will rely on `impl` to point to a list of children.
-// RAMFS specific node extension
-typedef struct ramfs_node {
-    const char *name;
-    void *data; // For file: content buffer. For dir: list_t* of children
-    uint32_t size;
-    uint32_t flags;
-    struct ramfs_node *parent;
-} ramfs_node_t;
+// Directories keep their children twice: an open-addressed hash table for
+// finddir and an array in creation order for readdir, so both are O(1).
+// File data lives in page-sized chunks reached through a chunk index;
+// growing a file only allocates new chunks and never copies old data.
+// Boot modules are not copied at all: their files read straight from the
+// module memory (reserved by the PMM) and a chunk is copied out only when
+// it is first written. A packed initrd archive is attached to a directory
+// unexpanded; each directory materialises its children from the archive
+// index the first time it is touched.
+
+#define RAMFS_CHUNK_SIZE   4096
+#define RAMFS_HASH_MIN     16
+#define RAMFS_TOMBSTONE    ((fs_node_t*)1)
+#define RAMFS_PHYS_LIMIT   0x08000000       // Modules above 128MB are not identity-mapped
+
+typedef struct ramfs_dir {
+    fs_node_t **children;   // Creation order
+    uint32_t count;
+    uint32_t capacity;
+    fs_node_t **table;      // Hash slots: NULL, RAMFS_TOMBSTONE or a child
+    uint32_t table_size;    // Power of two
+    uint32_t table_used;    // Live entries + tombstones
+    
+    // Pending initrd contents: index entries [first, last) all start with
+    // a prefix_len-byte path prefix naming this directory
+    const uint8_t *archive;
+    uint32_t first;
+    uint32_t last;
+    uint32_t prefix_len;
+} ramfs_dir_t;
 
-// We need to map generic fs_node_t back to our ramfs_node_t to access data.
-// For this simple impl, we can misuse the 'impl' field of fs_node_t to store the pointer to our internal ramfs structure?
-// Or just keep it simple: fs_node_t IS the structure we use, with some custom internal management.
-// Actually, generic vfs uses fs_node_t which is allocated by the fs driver.
-// So we can allocate fs_node_t + extra data, or just use fs_node_t and 'ptr' or 'impl'.
+typedef struct ramfs_file {
+    uint8_t **chunks;       // NULL chunk = hole, reads as zeros
+    uint32_t nchunks;       // Slots in the chunk index
+    const uint8_t *backing; // Read-only data under missing chunks (boot module)
+    uint32_t backing_len;
+    struct ramfs_snap *snap; // Where each chunk sits in the snapshot log
+} ramfs_file_t;
 
-// Let's use strict fs_node_t creation.
+// Directories hang their ramfs_dir_t off 'ptr', files their ramfs_file_t off 'impl'
 
 struct dirent dir_entry;
 
@@ -32,119 +55,292 @@ fs_node_t *ramfs_create_file(const char *name, const char *content);
 fs_node_t *ramfs_create_dir(const char *name);
 void ramfs_add_child(fs_node_t *dir, fs_node_t *child);
 
+// Snapshot change tracking (see Persistence Logic)
+static uint8_t snap_pending = 0;
+static uint32_t ramfs_tree_seq = 0;    // Bumped when a node may be freed or renamed
+static void ramfs_snap_touch(ramfs_file_t *file, uint32_t first, uint32_t last);
+static void ramfs_snap_free(ramfs_file_t *file);
+
+// -- Directory Table --
+
+static uint32_t ramfs_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void ramfs_dir_expand(fs_node_t *node, ramfs_dir_t *dir);
+
+static ramfs_dir_t *ramfs_dir(fs_node_t *node) {
+    if ((node->flags & FS_DIRECTORY) != FS_DIRECTORY) return 0;
+    if (node->flags & FS_MOUNTPOINT) return 0; // 'ptr' now links to the mounted root
+    ramfs_dir_t *dir = (ramfs_dir_t*)node->ptr;
+    if (dir && dir->archive) ramfs_dir_expand(node, dir);
+    return dir;
+}
+
+// Slot holding 'name', or NULL
+static fs_node_t **ramfs_dir_slot(ramfs_dir_t *dir, const char *name) {
+    if (!dir->table) return 0;
+    uint32_t mask = dir->table_size - 1;
+    for (uint32_t i = ramfs_hash(name) & mask, n = 0; n < dir->table_size; i = (i + 1) & mask, n++) {
+        fs_node_t *entry = dir->table[i];
+        if (!entry) return 0;
+        if (entry != RAMFS_TOMBSTONE && strcmp(entry->name, name) == 0) return &dir->table[i];
+    }
+    return 0;
+}
+
+static void ramfs_dir_hash_insert(ramfs_dir_t *dir, fs_node_t *child) {
+    uint32_t mask = dir->table_size - 1;
+    uint32_t i = ramfs_hash(child->name) & mask;
+    while (dir->table[i] && dir->table[i] != RAMFS_TOMBSTONE) i = (i + 1) & mask;
+    if (!dir->table[i]) dir->table_used++;
+    dir->table[i] = child;
+}
+
+// Keep the table at most 3/4 full (tombstones count); rebuilding drops them
+static int ramfs_dir_rehash(ramfs_dir_t *dir) {
+    if (dir->table && (dir->table_used + 1) * 4 <= dir->table_size * 3) return 0;
+
+    uint32_t size = RAMFS_HASH_MIN;
+    while (size * 3 < (dir->count + 1) * 4 * 2) size *= 2; // Live entries at most 3/8 after a rebuild
+    fs_node_t **table = (fs_node_t**)memory_alloc(size * sizeof(fs_node_t*));
+    if (!table) return -1;
+
+    if (dir->table) memory_free(dir->table);
+    dir->table = table;
+    dir->table_size = size;
+    dir->table_used = 0;
+    for (uint32_t i = 0; i < dir->count; i++) ramfs_dir_hash_insert(dir, dir->children[i]);
+    return 0;
+}
+
+static int ramfs_dir_insert(ramfs_dir_t *dir, fs_node_t *child) {
+    if (dir->count == dir->capacity) {
+        uint32_t cap = dir->capacity ? dir->capacity * 2 : 8;
+        fs_node_t **grown = (fs_node_t**)memory_alloc(cap * sizeof(fs_node_t*));
+        if (!grown) return -1;
+        if (dir->children) {
+            memcpy(grown, dir->children, dir->count * sizeof(fs_node_t*));
+            memory_free(dir->children);
+        }
+        dir->children = grown;
+        dir->capacity = cap;
+    }
+    if (ramfs_dir_rehash(dir) != 0) return -1;
+
+    dir->children[dir->count++] = child;
+    ramfs_dir_hash_insert(dir, child);
+    return 0;
+}
+
+static void ramfs_dir_remove(ramfs_dir_t *dir, fs_node_t *child) {
+    fs_node_t **slot = ramfs_dir_slot(dir, child->name);
+    if (slot) *slot = RAMFS_TOMBSTONE;
+
+    // Keep creation order for readdir
+    for (uint32_t i = 0; i < dir->count; i++) {
+        if (dir->children[i] == child) {
+            memmove(&dir->children[i], &dir->children[i + 1], (dir->count - i - 1) * sizeof(fs_node_t*));
+            dir->count--;
+            break;
+        }
+    }
+}
+
+// -- File Chunks --
+
+static ramfs_file_t *ramfs_file(fs_node_t *node) {
+    if ((node->flags & FS_FILE) != FS_FILE) return 0;
+    return (ramfs_file_t*)node->impl;
+}
+
+// Make room in the chunk index for 'count' chunks (doubling, pointers only)
+static int ramfs_file_reserve(ramfs_file_t *file, uint32_t count) {
+    if (count <= file->nchunks) return 0;
+    uint32_t slots = file->nchunks ? file->nchunks : 4;
+    while (slots < count) slots *= 2;
+    uint8_t **grown = (uint8_t**)memory_alloc(slots * sizeof(uint8_t*));
+    if (!grown) return -1;
+    if (file->chunks) {
+        memcpy(grown, file->chunks, file->nchunks * sizeof(uint8_t*));
+        memory_free(file->chunks);
+    }
+    file->chunks = grown;
+    file->nchunks = slots;
+    return 0;
+}
+
+// Copy of the backing bytes for chunk 'idx' (zero-filled past them)
+static void ramfs_file_fill(ramfs_file_t *file, uint32_t idx, uint32_t skip, uint32_t len, uint8_t *out) {
+    uint32_t pos = idx * RAMFS_CHUNK_SIZE + skip;
+    uint32_t have = pos < file->backing_len ? file->backing_len - pos : 0;
+    if (have > len) have = len;
+    if (have) memcpy(out, file->backing + pos, have);
+    if (have < len) memset(out + have, 0, len - have);
+}
+
+// Free every chunk from 'first' on
+static void ramfs_file_release(ramfs_file_t *file, uint32_t first) {
+    for (uint32_t i = first; i < file->nchunks; i++) {
+        if (file->chunks[i]) {
+            memory_free(file->chunks[i]);
+            file->chunks[i] = 0;
+        }
+    }
+}
+
 // -- Handlers --
 
 uint32_t ramfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if ((node->flags & FS_FILE) != FS_FILE) return 0;
+    ramfs_file_t *file = ramfs_file(node);
+    if (!file) return 0;
     
-    // Node->impl is pointer to data buffer for files in this simple FS
-    char *data = (char*)node->impl;
     if (offset > node->length) return 0;
-    if (offset + size > node->length) size = node->length - offset;
+    if (size > node->length - offset) size = node->length - offset;
     
-    memcpy(buffer, data + offset, size);
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t idx = pos / RAMFS_CHUNK_SIZE;
+        uint32_t skip = pos % RAMFS_CHUNK_SIZE;
+        uint32_t chunk = RAMFS_CHUNK_SIZE - skip;
+        if (chunk > size - done) chunk = size - done;
+        
+        uint8_t *data = idx < file->nchunks ? file->chunks[idx] : 0;
+        if (data) memcpy(buffer + done, data + skip, chunk);
+        else ramfs_file_fill(file, idx, skip, chunk, buffer + done);
+        done += chunk;
+    }
     return size;
 }
 
 struct dirent *ramfs_readdir(fs_node_t *node, uint32_t index) {
-    if ((node->flags & FS_DIRECTORY) != FS_DIRECTORY) return 0;
-    
-    // Node->ptr is pointer to list_t of children
-    list_t *children = (list_t*)node->ptr;
-    if (!children) return 0;
+    ramfs_dir_t *dir = ramfs_dir(node);
+    if (!dir || index >= dir->count) return 0;
     
-    list_node_t *item = children->head;
-    uint32_t i = 0;
-    while (item) {
-        if (i == index) {
-            fs_node_t *child = (fs_node_t*)item->data;
-            strcpy(dir_entry.name, child->name);
-            dir_entry.ino = child->inode;
-            return &dir_entry;
-        }
-        item = item->next;
-        i++;
-    }
-    return 0;
+    fs_node_t *child = dir->children[index];
+    strcpy(dir_entry.name, child->name);
+    dir_entry.ino = child->inode;
+    return &dir_entry;
 }
 
 fs_node_t *ramfs_finddir(fs_node_t *node, char *name) {
-    if ((node->flags & FS_DIRECTORY) != FS_DIRECTORY) return 0;
+    ramfs_dir_t *dir = ramfs_dir(node);
+    if (!dir) return 0;
     
-    list_t *children = (list_t*)node->ptr;
-    if (!children) return 0;
-    
-    list_node_t *item = children->head;
-    while (item) {
-        fs_node_t *child = (fs_node_t*)item->data;
-        if (strcmp(child->name, name) == 0) {
-            return child;
-        }
-        item = item->next;
-    }
-    return 0;
+    fs_node_t **slot = ramfs_dir_slot(dir, name);
+    return slot ? *slot : 0;
 }
 
-// -- Creation --
-
 // NEW: Write support
 uint32_t ramfs_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if ((node->flags & FS_FILE) != FS_FILE) return 0;
+    ramfs_file_t *file = ramfs_file(node);
+    if (!file || size == 0) return 0;
+    
+    uint32_t last = (offset + size - 1) / RAMFS_CHUNK_SIZE;
+    if (ramfs_file_reserve(file, last + 1) != 0) return 0;
+    ramfs_snap_touch(file, offset / RAMFS_CHUNK_SIZE, last);
     
-    // Check if we need to expand
-    uint32_t new_end = offset + size;
-    if (new_end > node->length) {
-        // Simple realloc: Alloc new, Copy old, Free old
-        // Note: memory_realloc would be nice
-        char *new_buf = (char*)memory_alloc(new_end + 1);
-        char *old_buf = (char*)node->impl;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t idx = pos / RAMFS_CHUNK_SIZE;
+        uint32_t skip = pos % RAMFS_CHUNK_SIZE;
+        uint32_t chunk = RAMFS_CHUNK_SIZE - skip;
+        if (chunk > size - done) chunk = size - done;
         
-        if (old_buf) {
-            if (node->length > 0) memcpy(new_buf, old_buf, node->length);
-            memory_free(old_buf);
+        if (!file->chunks[idx]) {
+            file->chunks[idx] = (uint8_t*)memory_alloc(RAMFS_CHUNK_SIZE); // Zeroed
+            if (!file->chunks[idx]) break;
+            // Copy-on-write: the chunk starts as the module bytes it replaces
+            if (file->backing) ramfs_file_fill(file, idx, 0, RAMFS_CHUNK_SIZE, file->chunks[idx]);
         }
-        node->impl = (uint32_t)new_buf;
-        node->length = new_end;
+        memcpy(file->chunks[idx] + skip, buffer + done, chunk);
+        done += chunk;
     }
     
-    char *data = (char*)node->impl;
-    memcpy(data + offset, buffer, size);
-    data[node->length] = 0; // Null terminate for safety (text files)
+    if (offset + done > node->length) node->length = offset + done;
+    return done;
+}
+
+int ramfs_truncate(fs_node_t *node, uint32_t length) {
+    ramfs_file_t *file = ramfs_file(node);
+    if (!file) return -1;
     
-    return size;
+    if (length < node->length) {
+        uint32_t keep = (length + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE;
+        ramfs_file_release(file, keep);
+        // Stale bytes past the new end must read back as zeros if the file regrows
+        uint32_t tail = length % RAMFS_CHUNK_SIZE;
+        if (tail && keep - 1 < file->nchunks && file->chunks[keep - 1]) memset(file->chunks[keep - 1] + tail, 0, RAMFS_CHUNK_SIZE - tail);
+        if (file->backing_len > length) file->backing_len = length;
+        ramfs_snap_touch(file, tail ? keep - 1 : keep, 0xFFFFFFFF);
+    }
+    node->length = length; // Growing just exposes holes
+    return 0;
+}
+
+// Free an unlinked node and its data
+static void ramfs_node_free(fs_node_t *child) {
+    ramfs_file_t *file = ramfs_file(child);
+    if (file) {
+        // Module memory stays reserved: boot code still reads modules directly
+        ramfs_file_release(file, 0);
+        ramfs_snap_free(file);
+        if (file->chunks) memory_free(file->chunks);
+        memory_free(file);
+    }
+    // If dir, we should recursively delete? For now, we allow leaking or assume empty.
+    // In a real OS, we'd fail if Dir not empty.
+    ramfs_dir_t *sub = ramfs_dir(child);
+    if (sub) {
+        if (sub->children) memory_free(sub->children);
+        if (sub->table) memory_free(sub->table);
+        memory_free(sub);
+    }
+    memory_free(child);
 }
 
 // NEW: Unlink (Delete)
 void ramfs_vfs_unlink(fs_node_t *parent, char *name) {
-    if ((parent->flags & FS_DIRECTORY) != FS_DIRECTORY) return;
+    ramfs_dir_t *dir = ramfs_dir(parent);
+    if (!dir) return;
     
-    list_t *children = (list_t*)parent->ptr;
-    if (!children) return;
+    fs_node_t *child = ramfs_finddir(parent, name);
+    if (!child) return;
+    ramfs_dir_remove(dir, child);
+    snap_pending = 1;
+    dcache_invalidate_node(child);
+    ramfs_tree_seq++;
     
-    // Find child node
-    list_node_t *item = children->head;
-    int index = 0;
-    while (item) {
-        fs_node_t *child = (fs_node_t*)item->data;
-        if (strcmp(child->name, name) == 0) {
-            // Found it. Remove from list.
-            list_remove_node(children, item);
-            
-            // Clean up child resources (simple version)
-            // If file, free buffer
-            if ((child->flags & FS_FILE) == FS_FILE) {
-                if (child->impl) memory_free((void*)child->impl);
-            }
-            // If dir, we should recursively delete? For now, we allow leaking or assume empty.
-            // In a real OS, we'd fail if Dir not empty. 
-            // We'll just free the node struct.
-            
-            memory_free(child);
-            return;
-        }
-        item = item->next;
-        index++;
-    }
+    // A running program may still page in from it
+    if (vfs_orphan_node(child, ramfs_node_free)) return;
+    ramfs_node_free(child);
+}
+
+// Rename within one directory; the entry name lives in the node itself
+int ramfs_vfs_rename(fs_node_t *parent, char *old_name, char *new_name) {
+    ramfs_dir_t *dir = ramfs_dir(parent);
+    if (!dir) return -1;
+    if (strlen(new_name) >= sizeof(parent->name)) return -1;
+    if (ramfs_finddir(parent, new_name)) return -1; // Target exists
+
+    fs_node_t **slot = ramfs_dir_slot(dir, old_name);
+    if (!slot) return -1;
+    fs_node_t *child = *slot;
+
+    // The hash position depends on the name
+    *slot = RAMFS_TOMBSTONE;
+    strcpy(child->name, new_name);
+    ramfs_dir_hash_insert(dir, child);
+    ramfs_tree_seq++;
+    snap_pending = 1;
+    return 0;
 }
 
 // -- Creation --
@@ -167,15 +363,24 @@ fs_node_t *allocate_node(const char *name, uint32_t flags) {
 // Fixed: Supports binary data with explicit length
 fs_node_t *ramfs_create_file_ex(const char *name, const char *data, uint32_t len) {
     fs_node_t *node = allocate_node(name, FS_FILE);
-    char *buf = (char*)memory_alloc(len + 1); // +1 safety
+    node->impl = (uint32_t)memory_alloc(sizeof(ramfs_file_t));
+    node->truncate = ramfs_truncate;
     
-    if (data && len > 0) {
-        memcpy(buf, data, len);
-    }
-    buf[len] = 0; // Null term just in case text
+    if (data && len > 0) ramfs_write(node, 0, len, (uint8_t*)data);
+    return node;
+}
+
+// Zero-copy: the node reads 'data' in place until written. 'data' must stay
+// valid and unchanged for the life of the node.
+fs_node_t *ramfs_create_file_ref(const char *name, const uint8_t *data, uint32_t len) {
+    fs_node_t *node = allocate_node(name, FS_FILE);
+    ramfs_file_t *file = (ramfs_file_t*)memory_alloc(sizeof(ramfs_file_t));
+    node->impl = (uint32_t)file;
+    node->truncate = ramfs_truncate;
     
+    file->backing = data;
+    file->backing_len = len;
     node->length = len;
-    node->impl = (uint32_t)buf;
     return node;
 }
 
@@ -189,23 +394,26 @@ void ramfs_vfs_mkdir(fs_node_t *parent, char *name, uint16_t permission);
 
 fs_node_t *ramfs_create_dir(const char *name) {
     fs_node_t *node = allocate_node(name, FS_DIRECTORY);
-    node->ptr = (struct fs_node*)list_create();
+    node->ptr = (struct fs_node*)memory_alloc(sizeof(ramfs_dir_t));
     node->create = ramfs_vfs_create;
     node->mkdir = ramfs_vfs_mkdir;
     node->unlink = ramfs_vfs_unlink; // Bind unlink
+    node->rename = ramfs_vfs_rename;
     return node;
 }
 
 void ramfs_add_child(fs_node_t *dir, fs_node_t *child) {
-    list_t *l = (list_t*)dir->ptr;
-    list_append(l, child);
+    ramfs_dir_t *d = ramfs_dir(dir);
+    if (!d || ramfs_dir_insert(d, child) != 0) return;
     // generic fs_node doesn't have parent
+    dcache_invalidate(dir, child->name); // May have been cached as missing
 }
 
 void ramfs_vfs_create(fs_node_t *parent, char *name, uint16_t permission) {
     (void)permission;
     fs_node_t *file = ramfs_create_file(name, "");
     ramfs_add_child(parent, file);
+    snap_pending = 1;
 }
 
 void ramfs_vfs_mkdir(fs_node_t *parent, char *name, uint16_t permission) {
@@ -214,6 +422,107 @@ void ramfs_vfs_mkdir(fs_node_t *parent, char *name, uint16_t permission) {
     ramfs_add_child(parent, dir);
 }
 
+// -- Initrd --
+
+static const initrd_entry_t *initrd_entry(const uint8_t *archive, uint32_t i) {
+    const initrd_header_t *hdr = (const initrd_header_t*)archive;
+    return (const initrd_entry_t*)(archive + hdr->index_off) + i;
+}
+
+static int initrd_has_prefix(const uint8_t *archive, uint32_t i, const char *prefix, uint32_t len) {
+    const initrd_entry_t *e = initrd_entry(archive, i);
+    return e->path_len >= len && memcmp(archive + e->path_off, prefix, len) == 0;
+}
+
+// Entries sharing a prefix are contiguous: binary search for where the run
+// starting at 'lo' ends
+static uint32_t initrd_prefix_end(const uint8_t *archive, uint32_t lo, uint32_t hi, const char *prefix, uint32_t len) {
+    lo++;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (initrd_has_prefix(archive, mid, prefix, len)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Create this directory's direct children from its index run. Files map the
+// archive in place; subdirectories get their own (still unexpanded) run.
+static void ramfs_dir_expand(fs_node_t *node, ramfs_dir_t *dir) {
+    const uint8_t *archive = dir->archive;
+    dir->archive = 0;
+
+    uint32_t i = dir->first;
+    while (i < dir->last) {
+        const initrd_entry_t *e = initrd_entry(archive, i);
+        const char *path = (const char*)archive + e->path_off;
+        const char *rest = path + dir->prefix_len;
+        uint32_t rest_len = e->path_len - dir->prefix_len;
+
+        uint32_t name_len = 0;
+        while (name_len < rest_len && rest[name_len] != '/') name_len++;
+
+        char name[128];
+        if (name_len == 0 || name_len >= sizeof(name)) { // "a//b" or too long
+            i++;
+            continue;
+        }
+        memcpy(name, rest, name_len);
+        name[name_len] = 0;
+        fs_node_t **slot = ramfs_dir_slot(dir, name);
+
+        if (name_len == rest_len) {
+            // File; anything already in the directory wins
+            if (!slot && ramfs_dir_insert(dir, ramfs_create_file_ref(name, archive + e->data_off, e->size)) == 0) {
+                dcache_invalidate(node, name); // May have been cached as missing
+            }
+            i++;
+            continue;
+        }
+
+        uint32_t sub_prefix = dir->prefix_len + name_len + 1;
+        uint32_t end = initrd_prefix_end(archive, i, dir->last, path, sub_prefix);
+
+        fs_node_t *child = slot ? *slot : 0;
+        if (!child) {
+            child = ramfs_create_dir(name);
+            if (ramfs_dir_insert(dir, child) != 0) break;
+            dcache_invalidate(node, name);
+        }
+        ramfs_dir_t *sub = (child->flags & FS_MOUNTPOINT) ? 0 : ramfs_dir(child);
+        if (sub) {
+            // Merges into an existing directory too
+            sub->archive = archive;
+            sub->first = i;
+            sub->last = end;
+            sub->prefix_len = sub_prefix;
+        }
+        i = end;
+    }
+}
+
+// Overlay an archive onto 'dir'; costs nothing until the tree is walked
+int ramfs_attach_initrd(fs_node_t *dir, const uint8_t *archive, uint32_t size) {
+    const initrd_header_t *hdr = (const initrd_header_t*)archive;
+    if (size < sizeof(initrd_header_t) || hdr->magic != INITRD_MAGIC || hdr->version != INITRD_VERSION) return -1;
+    if (hdr->total_size > size || hdr->index_off > size ||
+        hdr->count > (size - hdr->index_off) / sizeof(initrd_entry_t)) return -1;
+
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        const initrd_entry_t *e = initrd_entry(archive, i);
+        if (e->path_off > size || e->path_len > size - e->path_off ||
+            e->data_off > size || e->size > size - e->data_off) return -1;
+    }
+
+    ramfs_dir_t *d = ramfs_dir(dir);
+    if (!d) return -1;
+    d->archive = archive;
+    d->first = 0;
+    d->last = hdr->count;
+    d->prefix_len = 0;
+    return 0;
+}
+
 // -- Init --
 
 // -- Init --
@@ -303,21 +612,7 @@ fs_node_t *ramfs_ensure_dir(const char *path) {
         if (*p == '/') p++;
         
         // Check if segment exists in curr
-        fs_node_t *next = 0; // ramfs_finddir(curr, segment); // finddir not exposed?
-        // Use vfs finddir logic manually or expose ramfs_finddir
-        // ramfs uses a list.
-        list_t *children = (list_t*)curr->ptr;
-        if (children) {
-            list_node_t *item = children->head;
-            while(item) {
-                fs_node_t *child = (fs_node_t*)item->data;
-                if (strcmp(child->name, segment) == 0) {
-                    next = child;
-                    break;
-                }
-                item = item->next;
-            }
-        }
+        fs_node_t *next = ramfs_finddir(curr, segment);
         
         if (!next) {
             // Create directory
@@ -377,9 +672,21 @@ void ramfs_load_modules(boot_info_t *info) {
         
         fs_node_t *parent_node = ramfs_ensure_dir(parent_path);
         
-        // Create file
+        // Create file; modules are already reserved in the PMM, so use them in place
         uint32_t size = mod->mod_end - mod->mod_start;
-        fs_node_t *node = ramfs_create_file_ex(filename, (const char*)mod->mod_start, size);
+        if (mod->mod_end <= RAMFS_PHYS_LIMIT && size >= sizeof(initrd_header_t) &&
+            ((initrd_header_t*)mod->mod_start)->magic == INITRD_MAGIC) {
+            if (ramfs_attach_initrd(fs_root, (const uint8_t*)mod->mod_start, size) == 0) {
+                console_write("  Initrd: ");
+                console_write(path);
+                console_write("\n");
+                continue;
+            }
+            console_write("  Bad initrd, loading as a file\n");
+        }
+        fs_node_t *node;
+        if (mod->mod_end <= RAMFS_PHYS_LIMIT) node = ramfs_create_file_ref(filename, (const uint8_t*)mod->mod_start, size);
+        else node = ramfs_create_file_ex(filename, (const char*)mod->mod_start, size);
         
         ramfs_add_child(parent_node, node);
         
@@ -390,110 +697,647 @@ void ramfs_load_modules(boot_info_t *info) {
 }
 
 // --- Persistence Logic ---
+//
+// Log-structured snapshot of /home/aakash. The disk region starts with two
+// superblock sectors followed by an append-only log. A commit appends the
+// chunks that changed, a new extent list for each changed file and a fresh
+// inode table, then points the older superblock at it (the higher seq
+// wins). Unchanged files keep referring to extents logged earlier, so a
+// save costs time proportional to what changed. When the log runs out the
+// next commit starts over at the front and rewrites everything; that
+// commit overwrites the data the current superblock points at, so it is the
+// one window in which a crash loses the previous snapshot.
+//
+//   [SNAP_LBA + 0, + 1]   superblocks, written alternately
+//   [SNAP_LBA + 2 ...]    log: 4KB chunks, extent lists, inode tables
+//
+// Everything carries a CRC32. Commits are made by the "snapd" kernel thread;
+// ramfs_backup() only asks for one. ramfs has no lock of its own (syscalls
+// run with IF=0), so the capture keeps interrupts off only in short steps:
+// one walk that sizes the commit and lists the files, then one chunk copy
+// at a time into the bounce buffer. A write in between clears the chunk's
+// log position again, so each file's extent list is only built once all
+// its chunks are logged; an unlink or rename restarts that file. If the
+// capture can't finish (no memory, log space used up by rewrites) the
+// positions it handed out are taken back and the commit is retried later.
 
-#define BACKUP_MAGIC 0x424B5550 // "BKUP"
 #define SECTOR_SIZE 512
 
-// ATA Externs
-extern int ata_read_sector(uint32_t lba, uint8_t *buffer);
-extern int ata_write_sector(uint32_t lba, const uint8_t *buffer);
+// Log sectors bypass the buffer cache, superblocks too: ordering matters
+#include "bcache.h"
+#include "process.h"
+#include "pit.h"
+#include "wait_queue.h"
+
+#define SNAP_MAGIC         0x50414E53 // "SNAP"
+#define SNAP_VERSION       1
+#define SNAP_LBA           0          // Same disk area the old backup used
+#define SNAP_SECTORS       32768      // 16MB region
+#define SNAP_LOG_START     2
+#define SNAP_HOLE          0xFFFFFFFF
+#define SNAP_PATH_MAX      104
+#define SNAP_MAX_FILES     1024
+#define SNAP_INTERVAL_MS   30000      // Autosave check once the thread runs
+#define SNAP_CHUNK_SECTORS (RAMFS_CHUNK_SIZE / SECTOR_SIZE)
+#define SNAP_ROOT          "/home/aakash"
 
 typedef struct {
     uint32_t magic;
-    uint32_t count;
-} backup_header_t;
+    uint32_t version;
+    uint32_t seq;               // Newest valid superblock wins
+    uint32_t gen;               // Bumped whenever every file is rewritten
+    uint32_t log_head;          // Next free log sector (relative)
+    uint32_t table_lba;         // Inode table (relative)
+    uint32_t table_count;
+    uint32_t table_crc;
+    uint32_t crc;               // Over the fields above
+} snap_super_t;
 
 typedef struct {
-    char path[64];
+    char path[SNAP_PATH_MAX];   // Absolute
     uint32_t size;
-    uint32_t sector_offset; 
-} backup_entry_t;
+    uint32_t extents_lba;       // Relative
+    uint32_t extent_count;
+    uint32_t extents_crc;
+    uint32_t reserved[2];
+} snap_inode_t;                 // 128 bytes
 
-// Helper to traverse and collect files
-void collect_files(fs_node_t *node, char *path_prefix, backup_entry_t *entries, uint32_t *count, uint32_t *data_sector_ptr) {
-    if (!node) return;
-    
-    // Construct full path
-    char full_path[128];
-    if (strcmp(path_prefix, "/") == 0) strcpy(full_path, "/");
-    else {
-        strcpy(full_path, path_prefix);
-        if (full_path[strlen(full_path)-1] != '/') strcat(full_path, "/");
-    }
-    strcat(full_path, node->name);
-    
-    // If file, add to list
-    if ((node->flags & 0x01) == 0x01) { // FS_FILE
-        if (*count >= 100) return; // Limit 100 files for demo
-        
-        backup_entry_t *ent = &entries[*count];
-        strcpy(ent->path, full_path);
-        ent->size = node->length;
-        ent->sector_offset = *data_sector_ptr;
-        
-        // Write Data immediately
-        uint32_t sectors_needed = (node->length + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        char *file_data = (char*)node->impl; // Direct access
-        if (file_data) {
-             for (uint32_t s = 0; s < sectors_needed; s++) {
-                 uint8_t sec_buf[SECTOR_SIZE];
-                 memset(sec_buf, 0, SECTOR_SIZE);
-                 
-                 uint32_t chunk = node->length - (s * SECTOR_SIZE);
-                 if (chunk > SECTOR_SIZE) chunk = SECTOR_SIZE;
-                 
-                 memcpy(sec_buf, file_data + (s * SECTOR_SIZE), chunk);
-                 ata_write_sector(*data_sector_ptr + s, sec_buf);
-             }
+typedef struct {
+    uint32_t chunk;             // First file chunk of the run
+    uint32_t lba;               // Relative; chunks follow each other
+    uint32_t count;
+    uint32_t crc;               // CRC32 of the chunks' own CRC32s
+} snap_extent_t;
+
+typedef struct {
+    uint32_t lba;               // 0 = not logged yet, SNAP_HOLE = never written
+    uint32_t crc;
+} snap_chunk_t;
+
+typedef struct ramfs_snap {
+    snap_chunk_t *chunks;
+    uint32_t slots;
+    uint32_t gen;               // chunks[] only valid for this generation
+    uint8_t dirty;              // Extent list must be rewritten
+    uint32_t ext_lba;           // Extent list from the last commit
+    uint32_t ext_count;
+    uint32_t ext_crc;
+} ramfs_snap_t;
+
+static snap_super_t snap_sb;
+static int snap_loaded = 0;
+static uint8_t snap_force_full = 0;
+static uint8_t snap_requested = 0;
+static process_t *snap_proc = 0;
+
+static uint32_t crc_table[256];
+
+static uint32_t snap_crc32(uint32_t crc, const void *data, uint32_t len) {
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
         }
-        *data_sector_ptr += sectors_needed;
-        (*count)++;
     }
-    
-    // If dir, recurse
-    if ((node->flags & 0x02) == 0x02) { // FS_DIRECTORY
-        list_t *children = (list_t*)node->ptr;
-        if (children) {
-            list_node_t *item = children->head;
-            while (item) {
-                collect_files((fs_node_t*)item->data, full_path, entries, count, data_sector_ptr);
-                item = item->next;
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void ramfs_snap_touch(ramfs_file_t *file, uint32_t first, uint32_t last) {
+    snap_pending = 1;
+    ramfs_snap_t *snap = file->snap;
+    if (!snap) return; // Never logged: the next commit writes it whole
+    for (uint32_t i = first; i <= last && i < snap->slots; i++) snap->chunks[i].lba = 0;
+    snap->dirty = 1;
+}
+
+static void ramfs_snap_free(ramfs_file_t *file) {
+    if (!file->snap) return;
+    if (file->snap->chunks) memory_free(file->snap->chunks);
+    memory_free(file->snap);
+    file->snap = 0;
+}
+
+static int ramfs_snap_reserve(ramfs_snap_t *snap, uint32_t count) {
+    if (count <= snap->slots) return 0;
+    uint32_t slots = snap->slots ? snap->slots : 4;
+    while (slots < count) slots *= 2;
+    snap_chunk_t *grown = (snap_chunk_t*)memory_alloc(slots * sizeof(snap_chunk_t));
+    if (!grown) return -1;
+    if (snap->chunks) {
+        memcpy(grown, snap->chunks, snap->slots * sizeof(snap_chunk_t));
+        memory_free(snap->chunks);
+    }
+    snap->chunks = grown;     // New slots are zero: not logged
+    snap->slots = slots;
+    return 0;
+}
+
+static int ramfs_chunk_is_hole(ramfs_file_t *file, uint32_t idx) {
+    if (idx < file->nchunks && file->chunks[idx]) return 0;
+    return idx * RAMFS_CHUNK_SIZE >= file->backing_len;
+}
+
+static uint32_t snap_sector_align(uint32_t bytes) {
+    return (bytes + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+}
+
+// -- Disk I/O --
+
+static int snap_write(uint32_t lba, const uint8_t *buf, uint32_t sectors) {
+    return bcache_write_span(SNAP_LBA + lba, sectors, buf);
+}
+
+static int snap_read(uint32_t lba, uint8_t *buf, uint32_t sectors) {
+    return bcache_read_span(SNAP_LBA + lba, sectors, buf);
+}
+
+static uint32_t snap_super_crc(const snap_super_t *sb) {
+    return snap_crc32(0, sb, sizeof(snap_super_t) - sizeof(uint32_t));
+}
+
+// Newest valid superblock, or -1
+static int snap_read_super(snap_super_t *out) {
+    int found = -1;
+    uint8_t sec[SECTOR_SIZE];
+    for (uint32_t i = 0; i < SNAP_LOG_START; i++) {
+        if (snap_read(i, sec, 1) != 0) continue;
+        snap_super_t *sb = (snap_super_t*)sec;
+        if (sb->magic != SNAP_MAGIC || sb->version != SNAP_VERSION || sb->crc != snap_super_crc(sb)) continue;
+        if (found < 0 || sb->seq > out->seq) {
+            memcpy(out, sb, sizeof(snap_super_t));
+            found = 0;
+        }
+    }
+    return found;
+}
+
+// -- Commit --
+
+#define SNAP_SLACK_BYTES   (8 * RAMFS_CHUNK_SIZE) // Room for chunks dirtied while capturing
+#define SNAP_SLACK_FILES   16
+#define SNAP_RETRIES       4                      // Rounds before giving up on a busy file
+
+typedef struct {
+    uint32_t gen;
+    uint32_t base;              // Log sector of buf[0]
+    uint32_t files;             // Files counted (sizing) / listed in table
+    uint32_t max_files;         // Table slots (0 while sizing)
+    uint32_t bytes;             // Log bytes needed (sizing) / used (emit)
+    uint32_t cap;               // Data bytes buf has room for
+    uint8_t *buf;
+    snap_inode_t *table;        // Paths listed up front, the rest filled per file
+} snap_commit_t;
+
+static uint32_t snap_file_bytes(fs_node_t *node, uint32_t gen) {
+    ramfs_file_t *file = ramfs_file(node);
+    ramfs_snap_t *snap = file->snap;
+    int full = !snap || snap->gen != gen;
+    if (!full && !snap->dirty) return 0;
+
+    uint32_t nchunks = (node->length + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE;
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < nchunks; i++) {
+        int logged = !full && i < snap->slots && snap->chunks[i].lba != 0;
+        if (!logged && !ramfs_chunk_is_hole(file, i)) bytes += RAMFS_CHUNK_SIZE;
+    }
+    return bytes + snap_sector_align(nchunks * sizeof(snap_extent_t)); // Worst case
+}
+
+// Size the commit, or list the paths once a table exists. IRQs off.
+static void snap_walk(fs_node_t *node, char *path, snap_commit_t *c) {
+    ramfs_dir_t *dir = ramfs_dir(node);
+    uint32_t len = strlen(path);
+    for (uint32_t i = 0; dir && i < dir->count; i++) {
+        fs_node_t *child = dir->children[i];
+        if (len + 1 + strlen(child->name) >= 256) continue;
+        path[len] = '/';
+        strcpy(path + len + 1, child->name);
+        if ((child->flags & FS_FILE) != FS_FILE) {
+            snap_walk(child, path, c);
+        } else if (ramfs_file(child) && strlen(path) < SNAP_PATH_MAX && c->files < SNAP_MAX_FILES) {
+            if (!c->table) {
+                c->bytes += snap_file_bytes(child, c->gen);
+                c->files++;
+            } else if (c->files < c->max_files) {
+                strcpy(c->table[c->files++].path, path);
+            } else {
+                snap_pending = 1; // Created since sizing: next commit
             }
         }
+        path[len] = 0;
     }
 }
 
+static void snap_list(snap_commit_t *c) {
+    char path[256];
+    strcpy(path, SNAP_ROOT);
+    fs_node_t *root = vfs_resolve_path(SNAP_ROOT);
+    if (root) snap_walk(root, path, c);
+}
+
+static fs_node_t *snap_lookup(const char *path, uint32_t *seq) {
+    *seq = ramfs_tree_seq;
+    fs_node_t *node = vfs_resolve_path(path);
+    if (!node || node->read != ramfs_read || !ramfs_file(node)) return 0;
+    return node;
+}
+
+static uint32_t snap_log_lba(snap_commit_t *c) {
+    return c->base + c->bytes / SECTOR_SIZE;
+}
+
+// Log one file's changed chunks and fill in its inode. Runs with IRQs on
+// and turns them off for each step. Returns 0 when captured, 1 when the
+// file is gone, -1 to abort the commit.
+static int snap_emit_file(snap_commit_t *c, snap_inode_t *ino) {
+    for (int round = 0; round < SNAP_RETRIES; round++) {
+        uint32_t seq;
+        uint32_t flags = wait_irq_save();
+        fs_node_t *node = snap_lookup(ino->path, &seq);
+        if (!node) {
+            wait_irq_restore(flags);
+            return 1;
+        }
+        ramfs_file_t *file = ramfs_file(node);
+        if (!file->snap) file->snap = (ramfs_snap_t*)memory_alloc(sizeof(ramfs_snap_t));
+        ramfs_snap_t *snap = file->snap;
+        if (!snap) {
+            wait_irq_restore(flags);
+            return -1;
+        }
+        if (snap->gen != c->gen) {
+            if (snap->chunks) memset(snap->chunks, 0, snap->slots * sizeof(snap_chunk_t));
+            snap->gen = c->gen;
+            snap->dirty = 1;
+        }
+        wait_irq_restore(flags);
+
+        // Changed chunks, back to back so runs stay contiguous
+        for (uint32_t i = 0; ; i++) {
+            flags = wait_irq_save();
+            if (seq != ramfs_tree_seq) break; // IRQs stay off; checked below
+            uint32_t nchunks = (node->length + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE;
+            if (i >= nchunks || !snap->dirty) break;
+            if (ramfs_snap_reserve(snap, nchunks) != 0) {
+                wait_irq_restore(flags);
+                return -1;
+            }
+            snap_chunk_t *sc = &snap->chunks[i];
+            if (sc->lba == 0 && ramfs_chunk_is_hole(file, i)) {
+                sc->lba = SNAP_HOLE;
+                sc->crc = 0;
+            } else if (sc->lba == 0) {
+                if (c->bytes + RAMFS_CHUNK_SIZE > c->cap) {
+                    wait_irq_restore(flags);
+                    return -1;
+                }
+                uint8_t *dst = c->buf + c->bytes;
+                ramfs_read(node, i * RAMFS_CHUNK_SIZE, RAMFS_CHUNK_SIZE, dst); // Tail stays zero
+                sc->crc = snap_crc32(0, dst, RAMFS_CHUNK_SIZE);
+                sc->lba = snap_log_lba(c);
+                c->bytes += RAMFS_CHUNK_SIZE;
+            }
+            wait_irq_restore(flags);
+        }
+
+        // Still IRQs off from the loop: the extent list and size are taken
+        // together, and only if no chunk was dirtied again meanwhile
+        if (seq != ramfs_tree_seq) {
+            wait_irq_restore(flags);
+            continue;
+        }
+        uint32_t nchunks = (node->length + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE;
+        if (snap->dirty) {
+            if (ramfs_snap_reserve(snap, nchunks) != 0) {
+                wait_irq_restore(flags);
+                return -1;
+            }
+            int redo = 0;
+            for (uint32_t i = 0; i < nchunks && !redo; i++) redo = (snap->chunks[i].lba == 0);
+            if (redo) {
+                wait_irq_restore(flags);
+                continue;
+            }
+            if (c->bytes + snap_sector_align(nchunks * sizeof(snap_extent_t)) > c->cap) {
+                wait_irq_restore(flags);
+                return -1;
+            }
+
+            // Extent list over where every chunk now lives
+            snap_extent_t *ext = (snap_extent_t*)(c->buf + c->bytes);
+            uint32_t count = 0;
+            for (uint32_t i = 0; i < nchunks; i++) {
+                snap_chunk_t *sc = &snap->chunks[i];
+                if (sc->lba == SNAP_HOLE) continue;
+                snap_extent_t *prev = count ? &ext[count - 1] : 0;
+                if (!prev || prev->chunk + prev->count != i || prev->lba + prev->count * SNAP_CHUNK_SECTORS != sc->lba) {
+                    prev = &ext[count++];
+                    prev->chunk = i;
+                    prev->lba = sc->lba;
+                    prev->count = 0;
+                    prev->crc = 0;
+                }
+                prev->count++;
+                prev->crc = snap_crc32(prev->crc, &sc->crc, sizeof(uint32_t));
+            }
+            snap->ext_lba = snap_log_lba(c);
+            snap->ext_count = count;
+            snap->ext_crc = snap_crc32(0, ext, count * sizeof(snap_extent_t));
+            c->bytes += snap_sector_align(count * sizeof(snap_extent_t));
+            snap->dirty = 0;
+        }
+
+        ino->size = node->length;
+        ino->extents_lba = snap->ext_lba;
+        ino->extent_count = snap->ext_count;
+        ino->extents_crc = snap->ext_crc;
+        wait_irq_restore(flags);
+        return 0;
+    }
+    return -1; // Rewritten faster than we can log it
+}
+
+// Abort: forget every log position this commit handed out
+static void snap_unwind(snap_commit_t *c) {
+    uint32_t first = c->base;
+    uint32_t end = c->base + c->cap / SECTOR_SIZE;
+    for (uint32_t f = 0; f < c->files; f++) {
+        uint32_t seq;
+        uint32_t flags = wait_irq_save();
+        fs_node_t *node = snap_lookup(c->table[f].path, &seq);
+        ramfs_snap_t *snap = node ? ramfs_file(node)->snap : 0;
+        for (uint32_t i = 0; snap && i < snap->slots; i++) {
+            uint32_t lba = snap->chunks[i].lba;
+            if (lba != SNAP_HOLE && lba >= first && lba < end) snap->chunks[i].lba = 0;
+        }
+        if (snap) snap->dirty = 1;
+        wait_irq_restore(flags);
+    }
+    snap_pending = 1;
+}
+
+static int ramfs_snapshot_commit(void) {
+    if (!snap_loaded) {
+        // Continue an existing log; our in-memory state knows nothing of it
+        if (snap_read_super(&snap_sb) != 0) {
+            memset(&snap_sb, 0, sizeof(snap_sb));
+            snap_sb.log_head = SNAP_LOG_START;
+        }
+        snap_force_full = 1;
+        snap_loaded = 1;
+    }
+
+    snap_commit_t c;
+    memset(&c, 0, sizeof(c));
+
+    // Size it: a walk over the chunk maps, nothing copied
+    uint32_t flags = wait_irq_save();
+    snap_pending = 0;
+    c.gen = snap_sb.gen + (snap_force_full ? 1 : 0);
+    c.base = snap_sb.log_head;
+    snap_list(&c);
+    wait_irq_restore(flags);
+
+    uint32_t max_files = c.files + SNAP_SLACK_FILES;
+    if (max_files > SNAP_MAX_FILES) max_files = SNAP_MAX_FILES;
+    uint32_t table_bytes = snap_sector_align(max_files * sizeof(snap_inode_t));
+    uint32_t cap = c.bytes + SNAP_SLACK_BYTES;
+
+    if (c.base + (cap + table_bytes) / SECTOR_SIZE > SNAP_SECTORS) {
+        // Log full: start a new generation at the front
+        flags = wait_irq_save();
+        c.gen = snap_sb.gen + 1;
+        c.base = SNAP_LOG_START;
+        c.files = 0;
+        c.bytes = 0;
+        snap_list(&c);
+        wait_irq_restore(flags);
+
+        max_files = c.files + SNAP_SLACK_FILES;
+        if (max_files > SNAP_MAX_FILES) max_files = SNAP_MAX_FILES;
+        table_bytes = snap_sector_align(max_files * sizeof(snap_inode_t));
+        cap = c.bytes + SNAP_SLACK_BYTES;
+        if (c.base + (cap + table_bytes) / SECTOR_SIZE > SNAP_SECTORS) {
+            cap = (SNAP_SECTORS - c.base) * SECTOR_SIZE - table_bytes;
+            if (c.bytes > cap) {
+                console_write("[SNAPSHOT] Error: region too small.\n");
+                snap_pending = 1;
+                return -1;
+            }
+        }
+    }
+
+    c.buf = (uint8_t*)memory_alloc(cap + table_bytes);
+    c.table = (snap_inode_t*)memory_alloc(max_files * sizeof(snap_inode_t));
+    if (!c.buf || !c.table) {
+        if (c.buf) memory_free(c.buf);
+        if (c.table) memory_free(c.table);
+        snap_pending = 1;
+        return -1;
+    }
+    c.cap = cap;
+    c.max_files = max_files;
+
+    flags = wait_irq_save();
+    c.files = 0;
+    c.bytes = 0;
+    snap_list(&c);
+    wait_irq_restore(flags);
+
+    // Copy with interrupts on; vanished files drop out of the table
+    uint32_t kept = 0;
+    for (uint32_t f = 0; f < c.files; f++) {
+        int r = snap_emit_file(&c, &c.table[f]);
+        if (r < 0) {
+            snap_unwind(&c);
+            memory_free(c.buf);
+            memory_free(c.table);
+            console_write("[SNAPSHOT] Capture aborted, will retry.\n");
+            return -1;
+        }
+        if (r == 0) {
+            if (kept != f) c.table[kept] = c.table[f];
+            kept++;
+        }
+    }
+    c.files = kept;
+    snap_force_full = 0;
+
+    // Inode table goes right after the data
+    snap_super_t sb = snap_sb;
+    sb.magic = SNAP_MAGIC;
+    sb.version = SNAP_VERSION;
+    sb.seq++;
+    sb.gen = c.gen;
+    sb.table_lba = snap_log_lba(&c);
+    sb.table_count = c.files;
+    sb.table_crc = snap_crc32(0, c.table, c.files * sizeof(snap_inode_t));
+    memcpy(c.buf + c.bytes, c.table, c.files * sizeof(snap_inode_t));
+    uint32_t sectors = (c.bytes + snap_sector_align(c.files * sizeof(snap_inode_t))) / SECTOR_SIZE;
+    sb.log_head = c.base + sectors;
+    sb.crc = snap_super_crc(&sb);
+
+    uint8_t sec[SECTOR_SIZE];
+    memset(sec, 0, SECTOR_SIZE);
+    memcpy(sec, &sb, sizeof(sb));
+
+    // Log first, superblock last: a crash leaves the previous snapshot intact
+    int ret = snap_write(c.base, c.buf, sectors);
+    if (ret == 0) ret = snap_write(sb.seq % SNAP_LOG_START, sec, 1);
+    memory_free(c.buf);
+    memory_free(c.table);
+
+    if (ret != 0) {
+        // Chunk locations recorded above may not be on disk: rewrite
+        // everything under a generation no file has seen yet
+        snap_force_full = 1;
+        snap_sb.gen = c.gen;
+        snap_sb.log_head = sb.log_head;
+        console_write("[SNAPSHOT] Error: write failed.\n");
+        return -1;
+    }
+    snap_sb = sb;
+    return 0;
+}
+
+static void ramfs_snapshot_thread(void) {
+    while (1) {
+        uint32_t flags = wait_irq_save();
+        if (!snap_requested) process_block(pit_get_ticks() + pit_ms_to_ticks(SNAP_INTERVAL_MS));
+        snap_requested = 0;
+        wait_irq_restore(flags);
+
+        if (snap_pending && ramfs_snapshot_commit() == 0) {
+            serial_write("[SNAPSHOT] Committed.\n");
+        }
+    }
+}
+
+// Ask for a snapshot; returns at once, the "snapd" thread does the work
 void ramfs_backup(void) {
-    console_write("[BACKUP] Starting Backup to Disk (ZFS Snapshot)...\n");
-    
-    backup_entry_t entries[100];
-    uint32_t file_count = 0;
-    
-    // Data starts after Header (Sec 0) + Metadata (Sec 1..15)
-    uint32_t data_start_sector = 16;
-    
-    // Traverse /home/aakash (User data only)
-    fs_node_t *home = vfs_resolve_path("/home/aakash");
-    collect_files(home, "/home/aakash", entries, &file_count, &data_start_sector);
-    
-    // Write Header
-    backup_header_t header;
-    header.magic = BACKUP_MAGIC;
-    header.count = file_count;
-    
-    uint8_t sec0[SECTOR_SIZE];
-    memset(sec0, 0, SECTOR_SIZE);
-    memcpy(sec0, &header, sizeof(header));
-    ata_write_sector(0, sec0);
-    
-    // Write Metadata
-    uint8_t *entry_bytes = (uint8_t*)entries;
-    for (int i = 0; i < 15; i++) {
-        uint8_t buf[SECTOR_SIZE];
-        memcpy(buf, entry_bytes + (i * SECTOR_SIZE), SECTOR_SIZE);
-        ata_write_sector(1 + i, buf);
+    uint32_t flags = wait_irq_save();
+    snap_pending = 1;
+    snap_requested = 1;
+    if (!snap_proc) snap_proc = process_create("snapd", ramfs_snapshot_thread);
+    else process_wake(snap_proc);
+    wait_irq_restore(flags);
+}
+
+// -- Restore --
+
+// Rebuild one file from the log; the chunk map it leaves is the on-disk one
+static int snap_restore_file(const snap_inode_t *ino, uint32_t gen, uint8_t *chunk_buf) {
+    char parent[SNAP_PATH_MAX];
+    strcpy(parent, ino->path);
+    char *slash = 0;
+    for (char *p = parent; *p; p++) if (*p == '/') slash = p;
+    if (!slash || !slash[1]) return -1;
+    *slash = 0;
+
+    fs_node_t *dir = ramfs_ensure_dir(parent);
+    fs_node_t *node = ramfs_finddir(dir, slash + 1);
+    if (!node) {
+        node = ramfs_create_file(slash + 1, "");
+        ramfs_add_child(dir, node);
     }
-    
-    console_write("[BACKUP] Completed successfully.\n");
+    ramfs_file_t *file = ramfs_file(node);
+    if (!file) return -1;
+    ramfs_truncate(node, 0);
+
+    uint32_t ext_bytes = snap_sector_align(ino->extent_count * sizeof(snap_extent_t));
+    snap_extent_t *ext = (snap_extent_t*)memory_alloc(ext_bytes ? ext_bytes : SECTOR_SIZE);
+    if (!ext) return -1;
+    if (snap_read(ino->extents_lba, (uint8_t*)ext, ext_bytes / SECTOR_SIZE) != 0 ||
+        snap_crc32(0, ext, ino->extent_count * sizeof(snap_extent_t)) != ino->extents_crc) {
+        memory_free(ext);
+        return -1;
+    }
+
+    ramfs_snap_t *snap = file->snap;
+    if (!snap) snap = file->snap = (ramfs_snap_t*)memory_alloc(sizeof(ramfs_snap_t));
+    uint32_t nchunks = (ino->size + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE;
+    if (!snap || ramfs_snap_reserve(snap, nchunks) != 0) {
+        memory_free(ext);
+        return -1;
+    }
+    for (uint32_t i = 0; i < snap->slots; i++) {
+        snap->chunks[i].lba = SNAP_HOLE;
+        snap->chunks[i].crc = 0;
+    }
+
+    int ret = 0;
+    for (uint32_t e = 0; e < ino->extent_count && ret == 0; e++) {
+        uint32_t run_crc = 0;
+        for (uint32_t k = 0; k < ext[e].count; k++) {
+            uint32_t idx = ext[e].chunk + k;
+            uint32_t lba = ext[e].lba + k * SNAP_CHUNK_SECTORS;
+            if (idx >= nchunks || snap_read(lba, chunk_buf, SNAP_CHUNK_SECTORS) != 0) {
+                ret = -1;
+                break;
+            }
+            uint32_t crc = snap_crc32(0, chunk_buf, RAMFS_CHUNK_SIZE);
+            run_crc = snap_crc32(run_crc, &crc, sizeof(uint32_t));
+
+            uint32_t len = ino->size - idx * RAMFS_CHUNK_SIZE;
+            if (len > RAMFS_CHUNK_SIZE) len = RAMFS_CHUNK_SIZE;
+            ramfs_write(node, idx * RAMFS_CHUNK_SIZE, len, chunk_buf);
+            snap->chunks[idx].lba = lba;
+            snap->chunks[idx].crc = crc;
+        }
+        if (ret == 0 && run_crc != ext[e].crc) ret = -1;
+    }
+    memory_free(ext);
+
+    if (ret != 0) {
+        ramfs_truncate(node, 0);
+        snap->gen = 0; // Not what the log holds
+        return -1;
+    }
+    ramfs_truncate(node, ino->size);
+    snap->gen = gen;
+    snap->dirty = 0;
+    snap->ext_lba = ino->extents_lba;
+    snap->ext_count = ino->extent_count;
+    snap->ext_crc = ino->extents_crc;
+    return 0;
+}
+
+// Load the newest snapshot into ramfs; returns files restored or -1
+int ramfs_restore(void) {
+    snap_super_t sb;
+    if (snap_read_super(&sb) != 0) return -1;
+
+    uint32_t table_bytes = snap_sector_align(sb.table_count * sizeof(snap_inode_t));
+    snap_inode_t *table = (snap_inode_t*)memory_alloc(table_bytes ? table_bytes : SECTOR_SIZE);
+    uint8_t *chunk_buf = (uint8_t*)memory_alloc(RAMFS_CHUNK_SIZE);
+    if (!table || !chunk_buf ||
+        snap_read(sb.table_lba, (uint8_t*)table, table_bytes / SECTOR_SIZE) != 0 ||
+        snap_crc32(0, table, sb.table_count * sizeof(snap_inode_t)) != sb.table_crc) {
+        if (table) memory_free(table);
+        if (chunk_buf) memory_free(chunk_buf);
+        console_write("[SNAPSHOT] Error: inode table unreadable.\n");
+        return -1;
+    }
+
+    int restored = 0;
+    int damaged = 0;
+    for (uint32_t i = 0; i < sb.table_count; i++) {
+        table[i].path[SNAP_PATH_MAX - 1] = 0;
+        if (snap_restore_file(&table[i], sb.gen, chunk_buf) == 0) restored++;
+        else damaged++;
+    }
+    memory_free(table);
+    memory_free(chunk_buf);
+
+    // Keep appending to this log; damaged files get rewritten whole
+    snap_sb = sb;
+    snap_loaded = 1;
+    snap_force_full = 0;
+    snap_pending = damaged != 0;
+    if (damaged) console_write("[SNAPSHOT] Warning: some files failed their checksums.\n");
+    return restored;
 }
@@ -9,6 +9,10 @@
 #include "input.h"
 #include "mm/pmm.h"
 #include "mm/vmm.h"
+#include "fd.h"
+#include "poll.h"
+#include "io_ring.h"
+#include "bcache.h"
 
 extern process_t *current_process;
 #include <semantic.h>
@@ -33,16 +37,19 @@ extern process_t *current_process;
 #define SYS_LCHOWN    16
 #define SYS_GETPID    20
 #define SYS_MOUNT     21
+#define SYS_SYNC      36
 #define SYS_KILL      37
 #define SYS_RENAME    38
 #define SYS_LSEEK     19
 #define SYS_BRK       45
 #define SYS_IOCTL     54
 #define SYS_IOCTL     54
+#define SYS_FCNTL     55
 #define SYS_MMAP      90
 #define SYS_MUNMAP    91
 #define SYS_FUTEX     240
 #define SYS_UNAME     122
+#define SYS_FSYNC     118
 
 // mmap constants
 #define PROT_READ  0x1
@@ -69,6 +76,23 @@ struct mmap_args {
 #define SYS_MITHL_GUI_BUTTON  101
 #define SYS_MITHL_LOG         102
 #define SYS_AGENT_OP          110
+#define SYS_GUI_GET_EVENT_H   111
+#define SYS_GUI_DRAW          112
+#define SYS_GUI_DESTROY       113
+#define SYS_GUI_SURFACE       114
+#define SYS_GUI_COMMIT        115
+#define SYS_GUI_EVENT_FD      116
+#define SYS_READV             145
+#define SYS_WRITEV            146
+#define SYS_POLL              168
+#define SYS_SENDFILE          187
+#define SYS_EPOLL_CREATE      254
+#define SYS_EPOLL_CTL         255
+#define SYS_EPOLL_WAIT        256
+#define SYS_SPLICE            313
+#define SYS_VMSPLICE          316
+#define SYS_IO_RING_SETUP     425
+#define SYS_IO_RING_ENTER     426
 
 void syscall_handler(registers_t *regs) {
     console_write("[DEBUG] SYSCALL ENTERED. AX=");
@@ -282,37 +306,11 @@ void syscall_handler(registers_t *regs) {
 
         case SYS_WRITE:
             {
-                // int fd = regs->ebx;
-                // char *buf = (char*)regs->ecx;
-                // uint32_t count = regs->edx;
-                
                 int fd = regs->ebx;
                 char *buf = (char*)regs->ecx;
                 uint32_t count = regs->edx;
                 
-                // If STDOUT/STDERR (1 or 2), verify logic?
-                // For now, hardcode FD 1/2 to console if not in table?
-                // Or checking table.
-                
-                if (fd == 1 || fd == 2) {
-                     for (uint32_t i = 0; i < count; i++) {
-                        console_putc(buf[i]);
-                     }
-                     // Redirect to GUI Terminal if active
-                     extern void terminal_active_write(const char *buf, uint32_t len);
-                     terminal_active_write(buf, count);
-                     
-                     ret = count;
-                } else if (current_process && fd >= 0 && fd < 256 && current_process->fd_table[fd]) {
-                     // Read from FILE? SYS_WRITE to FILE?
-                     // Ah, this is WRITE. 
-                     struct file_descriptor *desc = current_process->fd_table[fd];
-                     (void)desc; // Silence unused warning
-                     // TODO: Implement write_fs logic tracking offset
-                     // TODO: Implement write_fs logic tracking offset
-                     // For now, support stdout only.
-                     ret = 0; 
-                } 
+                ret = fd_write(fd, buf, count, FD_OFFSET_CUR);
             }
             break;
 
@@ -322,95 +320,21 @@ void syscall_handler(registers_t *regs) {
                 char *buf = (char*)regs->ecx;
                 uint32_t count = regs->edx;
                 
-                if (fd == 0) {
-                     // STDIN (Keyboard)
-                     // Poll for key
-                     // Note: Race condition with GUI input_poll, but suitable for single-tasking demo
-                     
-                     // Simple Blocking Read (1 char)
-                     if (count > 0) {
-                         while(1) {
-                             if (keyboard_event_ready()) {
-                                  key_event_t *ke = receive_key_event();
-                                  if (ke && ke->action == KEY_PRESS && ke->ascii) {
-                                      buf[0] = ke->ascii;
-                                      ret = 1; 
-                                      memory_free(ke);
-                                      break;
-                                  }
-                                  if (ke) { memory_free(ke); }
-                             }
-                             // Yield
-                             extern void switch_task(void);
-                             switch_task();
-                         }
-                     } else { ret = 0; }
-                }
-                else if (current_process && fd >= 0 && fd < 256 && current_process->fd_table[fd]) {
-                    struct file_descriptor *desc = current_process->fd_table[fd];
-                    if (desc->node) {
-                        uint32_t read_bytes = read_fs(desc->node, desc->offset, count, (uint8_t*)buf);
-                        desc->offset += read_bytes;
-                        ret = read_bytes;
-                    } else {
-                        ret = -1;
-                    }
-                } else {
-                    ret = -1; // Bad FD
-                }
+                ret = fd_read(fd, buf, count, FD_OFFSET_CUR);
             }
             break;
 
         case SYS_OPEN:
             {
                 char *path = (char*)regs->ebx;
-                // int flags = regs->ecx;
+                int flags = regs->ecx;
                 
-                fs_node_t *node = vfs_resolve_path(path);
-                if (!node) {
-                    ret = -1; // ENOENT
-                } else {
-                    // Find free FD
-                    int fd = -1;
-                    for(int i=3; i<256; i++) { // Reserved 0,1,2
-                         if (current_process->fd_table[i] == NULL) {
-                             fd = i;
-                             break;
-                         }
-                    }
-                    
-                    if (fd != -1) {
-                        // Allocate descriptor
-                        struct file_descriptor *desc = (struct file_descriptor*)memory_alloc(sizeof(struct file_descriptor));
-                        desc->node = node;
-                        desc->offset = 0;
-                        desc->flags = 0;
-                        current_process->fd_table[fd] = desc;
-                        
-                        // Open VFS hook
-                        open_fs(node, 1, 0); 
-                        
-                        ret = fd;
-                    } else {
-                        ret = -1; // EMFILE
-                    }
-                }
+                ret = fd_open(path, flags);
             }
             break;
             
         case SYS_CLOSE:
-            {
-                int fd = regs->ebx;
-                if (current_process && fd >= 3 && fd < 256 && current_process->fd_table[fd]) {
-                     struct file_descriptor *desc = current_process->fd_table[fd];
-                     close_fs(desc->node);
-                     memory_free(desc);
-                     current_process->fd_table[fd] = NULL;
-                     ret = 0;
-                } else {
-                     ret = -1;
-                }
-            }
+            ret = fd_close(regs->ebx);
             break;
 
         case SYS_EXECVE:
@@ -508,130 +432,40 @@ void syscall_handler(registers_t *regs) {
                 console_write(title);
                 console_write("\n");
                 
-                // Create the window
-                // Ensure we cast/convert types correctly if needed
                 gui_window_t *win = gui_create_window(title, regs->ecx, regs->edx, regs->esi, regs->edi);
+                if (!win) { ret = -1; break; }
                 
-                // We shouldn't return a pointer to userspace directly if it's right kernel memory, 
-                // but for now let's just return 1 or the handle. 
-                // In a real OS we'd return a handle ID. Use the pointer as ID for now.
-                ret = (int)win; 
+                // Hand out a slot in the per-process window table instead of a kernel pointer
+                ret = gui_handle_alloc(win);
+                if (ret == GUI_HANDLE_INVALID) {
+                    gui_destroy_window(win);
+                    break;
+                }
+                
+                // CRITICAL: Tree is walked by the GUI loop
+                asm volatile("cli");
+                gui_add_element(gui_mgr.root, (gui_element_t*)win);
+                asm volatile("sti");
             }
             break;
 
-        case 103: // SYS_GET_EVENT
+        case 103: // SYS_GET_EVENT (buf) - legacy, targets default window
             {
                 gui_event_t *user_buf = (gui_event_t*)regs->ebx;
                 if (!user_buf) { ret = -1; break; }
-
-                // Find window owned by current process (Simple Linear Search for now)
-                // In future, pass window handle ID
-                gui_window_t *found = NULL;
                 
-                // CRITICAL: Protect Tree Traversal from Preemption (gui_bring_to_front modifies list)
-                asm volatile("cli");
-                
-                // Assuming root->children contains windows (Layout Manager dependent)
-                if (gui_mgr.root && gui_mgr.root->children) {
-                    list_node_t *node = gui_mgr.root->children->head;
-                    while (node) {
-                        gui_element_t *el = (gui_element_t*)node->data;
-                        if (el->type == GUI_ELEMENT_WINDOW) {
-                             gui_window_t *w = (gui_window_t*)el;
-                             if (w->owner_pid == current_process->pid) {
-                                 found = w;
-                                 break;
-                             }
-                        }
-                        node = node->next;
-                    }
-                }
+                gui_window_t *win = gui_handle_lookup(gui_handle_default());
+                if (!win) { ret = -1; break; }
                 
-                if (!found) {
-                    asm volatile("sti");
-                    ret = -1;
-                    break;
-                }
-                
-                // Found window, now pop event (Already protected list access locally below, but we can keep CLI held for efficiency?)
-                // Actually, I already protected the POP below.
-                // But found->incoming_events pointer itself is stable (window struct).
-                // I will release lock here, then re-acquire for POP.
-                asm volatile("sti");
-                
-                if (found && found->incoming_events) {
-                    // Critical Section: Protect list access
-                    asm volatile("cli");
-                    gui_event_t *ev = NULL;
-                    if (found->incoming_events->head) {
-                         ev = (gui_event_t*)list_pop_front(found->incoming_events);
-                    }
-                    asm volatile("sti");
-
-                    if (ev) {
-                        // Copy to user buffer
-                        // Note: Be careful with direct pointer deref if user address is bad (kernel checks needed normally)
-                        *user_buf = *ev; 
-                        memory_free(ev);
-                        ret = 1; // Event retrieved
-                    } else {
-                        ret = 0;
-                    }
-                } else {
-                    ret = 0; // No event
-                }
+                ret = gui_window_pop_event(win, user_buf);
             }
             break;
 
-        case 104: // SYS_DRAW_RECT (x, y, w, h, color)
-            {
-                 // We need 5 args. regs->ebx, ecx, edx, esi, edi
-                 // ebx=x, ecx=y, edx=w, esi=h, edi=color
-                 int x = regs->ebx;
-                 int y = regs->ecx;
-                 int w = regs->edx;
-                 int h = regs->esi;
-                 uint32_t color = regs->edi;
-
-                 // Find Window (Refactor this later)
-                 gui_window_t *found = NULL;
-                 if (gui_mgr.root && gui_mgr.root->children) {
-                    list_node_t *node = gui_mgr.root->children->head;
-                    while (node) {
-                        gui_element_t *el = (gui_element_t*)node->data;
-                        if (el->type == GUI_ELEMENT_WINDOW) {
-                             gui_window_t *win = (gui_window_t*)el;
-                             if (win->owner_pid == current_process->pid) {
-                                 found = win;
-                                 break;
-                             }
-                        }
-                        node = node->next;
-                    }
-                 }
-                 
-                 if (found) {
-                     // Clip and Offset
-                     int title_h = 30;
-                     int win_x = found->base.bounds.x;
-                     int win_y = found->base.bounds.y + title_h;
-                     
-                     // Absolute coords
-                     int abs_x = win_x + x;
-                     int abs_y = win_y + y;
-                     
-                     // Basic Clipping against window bounds (not perfect, but safe)
-                     if (abs_x < win_x) abs_x = win_x;
-                     if (abs_y < win_y) abs_y = win_y;
-                     // width/height clipping todo
-                     
-                     rect_t r = {abs_x, abs_y, w, h};
-                     draw_rect_filled(r, color);
-                     gui_invalidate_rect(r); // Mark dirty
-                     ret = 0;
-                 } else {
-                     ret = -1;
-                 }
+        case 104: // SYS_DRAW_RECT (x, y, w, h, color) - legacy, targets default window
+            {
+                 gui_draw_cmd_t cmd = { GUI_DRAW_RECT, (int)regs->ebx, (int)regs->ecx,
+                                        (int)regs->edx, (int)regs->esi, regs->edi, NULL };
+                 ret = gui_window_draw(gui_handle_lookup(gui_handle_default()), &cmd);
             }
             break;
             
@@ -897,83 +731,130 @@ void syscall_handler(registers_t *regs) {
             }
             break;
 
-        case 105: // SYS_DRAW_TEXT (msg, x, y, color)
-            {
-                 char *msg = (char*)regs->ebx;
-                 int x = regs->ecx;
-                 int y = regs->edx;
-                 uint32_t color = regs->esi;
-                 
-                 gui_window_t *found = NULL;
-                 if (gui_mgr.root && gui_mgr.root->children) {
-                    list_node_t *node = gui_mgr.root->children->head;
-                    while (node) {
-                        gui_element_t *el = (gui_element_t*)node->data;
-                        if (el->type == GUI_ELEMENT_WINDOW) {
-                             gui_window_t *win = (gui_window_t*)el;
-                             if (win->owner_pid == current_process->pid) {
-                                 found = win;
-                                 break;
-                             }
-                        }
-                        node = node->next;
-                    }
-                 }
-                 
-                 if (found) {
-                     int title_h = 30;
-                     int abs_x = found->base.bounds.x + x;
-                     int abs_y = found->base.bounds.y + title_h + y;
-                     
-                     draw_text(msg, abs_x, abs_y, color, 12); // Default size 12
-                     // Invalidate text area (guesstimate)
-                     gui_invalidate_rect((rect_t){abs_x, abs_y, strlen(msg)*10, 16});
-                     ret = 0;
-                 } else {
-                     ret = -1;
-                 }
-            }
-            break;
-
-        case 109: // SYS_DRAW_IMAGE (data, x, y, w, h)
-            {
-                // ebx = data*, ecx = x, edx = y, esi = w, edi = h
-                 uint32_t *img_data = (uint32_t*)regs->ebx;
-                 int x = regs->ecx;
-                 int y = regs->edx;
-                 int w = regs->esi;
-                 int h = regs->edi;
-
-                 gui_window_t *found = NULL;
-                 if (gui_mgr.root && gui_mgr.root->children) {
-                    list_node_t *node = gui_mgr.root->children->head;
-                    while (node) {
-                        gui_element_t *el = (gui_element_t*)node->data;
-                        if (el->type == GUI_ELEMENT_WINDOW) {
-                             gui_window_t *win = (gui_window_t*)el;
-                             if (win->owner_pid == current_process->pid) {
-                                 found = win;
-                                 break;
-                             }
-                        }
-                        node = node->next;
-                    }
-                 }
-                 
-                 if (found) {
-                     int title_h = 30;
-                     int abs_x = found->base.bounds.x + x;
-                     int abs_y = found->base.bounds.y + title_h + y;
-                     
-                     // Direct draw (Insecure but functional for V1)
-                     extern void graphics_draw_image(int x, int y, int w, int h, const uint32_t* data);
-                     graphics_draw_image(abs_x, abs_y, w, h, img_data);
-                     
-                     gui_invalidate_rect((rect_t){abs_x, abs_y, w, h});
-                     ret = 0;
-                 } else {
-                     ret = -1;
-                 }
+        case 105: // SYS_DRAW_TEXT (msg, x, y, color) - legacy, targets default window
+            {
+                 gui_draw_cmd_t cmd = { GUI_DRAW_TEXT, (int)regs->ecx, (int)regs->edx,
+                                        0, 0, regs->esi, (const void*)regs->ebx };
+                 ret = gui_window_draw(gui_handle_lookup(gui_handle_default()), &cmd);
+            }
+            break;
+
+        case 109: // SYS_DRAW_IMAGE (data, x, y, w, h) - legacy, targets default window
+            {
+                 gui_draw_cmd_t cmd = { GUI_DRAW_IMAGE, (int)regs->ecx, (int)regs->edx,
+                                        (int)regs->esi, (int)regs->edi, 0, (const void*)regs->ebx };
+                 ret = gui_window_draw(gui_handle_lookup(gui_handle_default()), &cmd);
+            }
+            break;
+
+        case SYS_GUI_GET_EVENT_H: // (handle, buf)
+            {
+                gui_event_t *user_buf = (gui_event_t*)regs->ecx;
+                gui_window_t *win = gui_handle_lookup((int)regs->ebx);
+                if (!win || !user_buf) { ret = -1; break; }
+                
+                ret = gui_window_pop_event(win, user_buf);
+            }
+            break;
+
+        case SYS_GUI_DRAW: // (handle, cmds, count) - batched, returns commands executed
+            {
+                gui_window_t *win = gui_handle_lookup((int)regs->ebx);
+                const gui_draw_cmd_t *cmds = (const gui_draw_cmd_t*)regs->ecx;
+                int count = (int)regs->edx;
+                if (!win || !cmds || count < 0) { ret = -1; break; }
+                
+                int done = 0;
+                while (done < count && gui_window_draw(win, &cmds[done]) == 0) done++;
+                ret = done;
+            }
+            break;
+
+        case SYS_GUI_DESTROY: // (handle)
+            {
+                if (!gui_handle_lookup((int)regs->ebx)) { ret = -1; break; }
+                gui_handle_close((int)regs->ebx);
+                ret = 0;
+            }
+            break;
+
+        case SYS_GUI_SURFACE: // (handle, w, h) - returns client pixel address, 0 on failure
+            {
+                gui_window_t *win = gui_handle_lookup((int)regs->ebx);
+                ret = (int)gui_window_attach_surface(win, (int)regs->ecx, (int)regs->edx);
+            }
+            break;
+
+        case SYS_GUI_EVENT_FD: // (handle) - pollable fd that reads gui_event_t records
+            {
+                fs_node_t *node = gui_window_event_node((int)regs->ebx);
+                if (!node) { ret = -1; break; }
+                ret = fd_install(node, 0);
+                if (ret < 0) close_fs(node);
+            }
+            break;
+
+        case SYS_POLL: // (fds, nfds, timeout_ms)
+            ret = sys_poll((struct pollfd*)regs->ebx, regs->ecx, (int)regs->edx);
+            break;
+
+        case SYS_EPOLL_CREATE: // (size - ignored)
+            ret = sys_epoll_create();
+            break;
+
+        case SYS_EPOLL_CTL: // (epfd, op, fd, event)
+            ret = sys_epoll_ctl((int)regs->ebx, (int)regs->ecx, (int)regs->edx, (struct epoll_event*)regs->esi);
+            break;
+
+        case SYS_EPOLL_WAIT: // (epfd, events, max, timeout_ms)
+            ret = sys_epoll_wait((int)regs->ebx, (struct epoll_event*)regs->ecx, (int)regs->edx, (int)regs->esi);
+            break;
+
+        case SYS_READV: // (fd, iov, iovcnt)
+            ret = sys_readv((int)regs->ebx, (const struct iovec*)regs->ecx, (int)regs->edx);
+            break;
+
+        case SYS_WRITEV: // (fd, iov, iovcnt)
+            ret = sys_writev((int)regs->ebx, (const struct iovec*)regs->ecx, (int)regs->edx);
+            break;
+
+        case SYS_SYNC: // Flush every dirty disk buffer
+            ret = bcache_sync() == 0 ? 0 : -1;
+            break;
+
+        case SYS_FSYNC: // (fd)
+            ret = fd_fsync((int)regs->ebx);
+            break;
+
+        case SYS_FCNTL: // (fd, cmd, arg) - only the pipe size commands
+            ret = sys_fcntl((int)regs->ebx, (int)regs->ecx, regs->edx);
+            break;
+
+        case SYS_SENDFILE: // (out_fd, in_fd, uint32_t *offset, count)
+            ret = sys_sendfile((int)regs->ebx, (int)regs->ecx, (uint32_t*)regs->edx, regs->esi);
+            break;
+
+        case SYS_SPLICE: // (fd_in, off_in*, fd_out, off_out*, len) - no flags argument
+            ret = sys_splice((int)regs->ebx, (uint32_t*)regs->ecx, (int)regs->edx, (uint32_t*)regs->esi, regs->edi);
+            break;
+
+        case SYS_VMSPLICE: // (fd, iov, iovcnt, flags)
+            ret = sys_vmsplice((int)regs->ebx, (const struct iovec*)regs->ecx, (int)regs->edx, regs->esi);
+            break;
+
+        case SYS_IO_RING_SETUP: // (entries, uint32_t *out_addr) - returns ring fd
+            ret = sys_io_ring_setup(regs->ebx, (uint32_t*)regs->ecx);
+            break;
+
+        case SYS_IO_RING_ENTER: // (fd, to_submit, min_complete, flags)
+            ret = sys_io_ring_enter((int)regs->ebx, regs->ecx, regs->edx, regs->esi);
+            break;
+
+        case SYS_GUI_COMMIT: // (handle, x, y, w, h) - damage in surface coords, w/h 0 = all
+            {
+                gui_window_t *win = gui_handle_lookup((int)regs->ebx);
+                rect_t damage = { (int)regs->ecx, (int)regs->edx, (int)regs->esi, (int)regs->edi };
+                ret = gui_window_commit(win, damage);
             }
             break;
 
@@ -2,23 +2,34 @@
 #include "string.h"
 #include "console.h"
 #include "memory.h"
+#include "poll.h"
+#include "dcache.h"
+#include "page_cache.h"
+#include "exec_cache.h"
+#include "spinlock.h"
 
 fs_node_t *fs_root = 0;
+static lock_t vfs_map_lock;
 
 uint32_t read_fs(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer)
 {
-    if (node->read != 0)
-        return node->read(node, offset, size, buffer);
-    else
+    if (node->read == 0)
         return 0;
+    if (node->flags & FS_CACHED)
+        return pcache_read(node, offset, size, buffer);
+    return node->read(node, offset, size, buffer);
 }
 
 uint32_t write_fs(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer)
 {
-    if (node->write != 0)
-        return node->write(node, offset, size, buffer);
-    else
-        return 0;
+    if (node->write == 0 || node->maps)
+        return 0; // Busy: a running program pages its text in from here
+    uint32_t written = node->write(node, offset, size, buffer);
+    if (node->pcache)
+        pcache_write(node, offset, written, buffer);
+    if (written)
+        exec_cache_invalidate(node);
+    return written;
 }
 
 void open_fs(fs_node_t *node, uint8_t read, uint8_t write)
@@ -33,6 +44,60 @@ void close_fs(fs_node_t *node)
         node->close(node);
 }
 
+// Nodes without a poll hook (regular files) never block
+uint32_t poll_fs(fs_node_t *node, struct wait_queue **wq)
+{
+    *wq = 0;
+    if (node->poll != 0)
+        return node->poll(node, wq);
+    else
+        return POLLIN | POLLOUT;
+}
+
+int truncate_fs(fs_node_t *node, uint32_t length)
+{
+    if (node->truncate == 0 || node->maps)
+        return -1;
+    int ret = node->truncate(node, length);
+    if (ret == 0 && node->pcache)
+        pcache_truncate(node, length);
+    if (ret == 0)
+        exec_cache_invalidate(node);
+    return ret;
+}
+
+void vfs_map_node(fs_node_t *node)
+{
+    uint32_t flags = spinlock_acquire_irqsave(&vfs_map_lock);
+    node->maps++;
+    spinlock_release_irqrestore(&vfs_map_lock, flags);
+}
+
+void vfs_unmap_node(fs_node_t *node)
+{
+    uint32_t flags = spinlock_acquire_irqsave(&vfs_map_lock);
+    int last = node->maps && --node->maps == 0 && (node->flags & FS_ORPHAN);
+    spinlock_release_irqrestore(&vfs_map_lock, flags);
+    if (!last)
+        return;
+    if (node->pcache)
+        pcache_invalidate(node); // Faults since the unlink cached pages again
+    if (node->release)
+        node->release(node);
+}
+
+int vfs_orphan_node(fs_node_t *node, release_type_t release)
+{
+    uint32_t flags = spinlock_acquire_irqsave(&vfs_map_lock);
+    int busy = node->maps != 0;
+    if (busy) {
+        node->flags |= FS_ORPHAN;
+        node->release = release;
+    }
+    spinlock_release_irqrestore(&vfs_map_lock, flags);
+    return busy;
+}
+
 struct dirent *readdir_fs(fs_node_t *node, uint32_t index)
 {
     if ((node->flags & 0x7) == FS_DIRECTORY && node->readdir != 0)
@@ -41,19 +106,29 @@ struct dirent *readdir_fs(fs_node_t *node, uint32_t index)
         return 0;
 }
 
+// Directory mutations drop the affected dentry (negative or positive)
 void create_fs(fs_node_t *parent, char *name, uint16_t permission) {
-    if (parent->create != 0)
+    if (parent->create != 0) {
         parent->create(parent, name, permission);
+        dcache_invalidate(parent, name);
+    }
 }
 
 void mkdir_fs(fs_node_t *parent, char *name, uint16_t permission) {
-    if (parent->mkdir != 0)
+    if (parent->mkdir != 0) {
         parent->mkdir(parent, name, permission);
+        dcache_invalidate(parent, name);
+    }
 }
 
 void unlink_fs(fs_node_t *parent, char *name) {
-    if (parent->unlink != 0)
+    if (parent->unlink != 0) {
+        fs_node_t *victim = dcache_finddir(parent, name);
+        if (victim && victim->pcache) pcache_invalidate(victim);
+        if (victim) exec_cache_invalidate(victim);
+        dcache_invalidate(parent, name);
         parent->unlink(parent, name);
+    }
 }
 
 fs_node_t *finddir_fs(fs_node_t *node, char *name)
@@ -165,7 +240,7 @@ fs_node_t *vfs_resolve_path(const char *path) {
                 // If we are AT a mountpoint, 'current' is the underlying node.
                 // But we should have swapped 'current' with the mounted root already if we traversed.
                 
-                fs_node_t *next = finddir_fs(current, segment);
+                fs_node_t *next = dcache_finddir(current, segment);
                 
                 // Mount Point Traversal (Down)
                 if (next && (next->flags & FS_MOUNTPOINT)) {
@@ -183,7 +258,7 @@ fs_node_t *vfs_resolve_path(const char *path) {
     
     // Last segment
     if (strlen(segment) > 0) {
-        fs_node_t *next = finddir_fs(current, segment);
+        fs_node_t *next = dcache_finddir(current, segment);
          if (next && (next->flags & FS_MOUNTPOINT)) {
             if (next->ptr) next = next->ptr;
         }
@@ -196,16 +271,51 @@ fs_node_t *vfs_resolve_path(const char *path) {
 
 // Stubs for Linker Satisfaction
 
+// Split "/a/b/c" into directory "/a/b" and leaf "c" (leaf points into buf)
+static fs_node_t *vfs_resolve_parent(const char *path, char *buf, char **leaf) {
+    if (!path || strlen(path) >= 256) return NULL;
+    strcpy(buf, path);
+
+    char *last_slash = NULL;
+    for (char *p = buf; *p; p++) if (*p == '/') last_slash = p;
+
+    if (!last_slash) {
+        *leaf = buf;
+        return fs_root;
+    }
+    *last_slash = 0;
+    *leaf = last_slash + 1;
+    return vfs_resolve_path(buf[0] ? buf : "/");
+}
+
 int vfs_move(const char *src, const char *dest) {
-    (void)src; (void)dest;
-    console_write("[VFS] Warning: vfs_move not implemented.\n");
-    return -1;
+    char src_buf[256], dest_buf[256];
+    char *src_name, *dest_name;
+    fs_node_t *src_dir = vfs_resolve_parent(src, src_buf, &src_name);
+    fs_node_t *dest_dir = vfs_resolve_parent(dest, dest_buf, &dest_name);
+    if (!src_dir || !dest_dir || !src_name[0] || !dest_name[0]) return -1;
+
+    if (src_dir != dest_dir) {
+        console_write("[VFS] Warning: vfs_move across directories not implemented.\n");
+        return -1;
+    }
+    return vfs_rename(src_dir, src_name, dest_name);
 }
 
 int vfs_rename(fs_node_t *parent, const char *oldpath, const char *newpath) {
-    (void)parent; (void)oldpath; (void)newpath;
-    console_write("[VFS] Warning: vfs_rename not implemented.\n");
-    return -1;
+    if (!parent || !parent->rename) return -1;
+
+    char old_name[128], new_name[128];
+    if (strlen(oldpath) >= 128 || strlen(newpath) >= 128) return -1;
+    strcpy(old_name, oldpath);
+    strcpy(new_name, newpath);
+
+    int ret = parent->rename(parent, old_name, new_name);
+    if (ret == 0) {
+        dcache_invalidate(parent, old_name);
+        dcache_invalidate(parent, new_name);
+    }
+    return ret;
 }
 
 int vfs_copy(const char *src, const char *dest) {
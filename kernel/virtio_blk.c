@@ -0,0 +1,469 @@
+#include "virtio_blk.h"
+#include "blk.h"
+#include "pci.h"
+#include "idt.h"
+#include "ports.h"
+#include "string.h"
+#include "console.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+
+#define VIRTIO_VENDOR           0x1AF4
+#define VIRTIO_DEV_BLK_LEGACY   0x1001
+
+/* Legacy PCI registers (I/O BAR0, no MSI-X) */
+#define VIRTIO_HOST_FEATURES    0x00
+#define VIRTIO_GUEST_FEATURES   0x04
+#define VIRTIO_QUEUE_PFN        0x08
+#define VIRTIO_QUEUE_SIZE       0x0C
+#define VIRTIO_QUEUE_SELECT     0x0E
+#define VIRTIO_QUEUE_NOTIFY     0x10
+#define VIRTIO_STATUS           0x12
+#define VIRTIO_ISR              0x13
+#define VIRTIO_CONFIG           0x14
+
+#define VIRTIO_STATUS_ACK       0x01
+#define VIRTIO_STATUS_DRIVER    0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED    0x80
+#define VIRTIO_ISR_QUEUE        0x01
+
+/* Features */
+#define VIRTIO_BLK_F_SIZE_MAX   (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX    (1u << 2)
+#define VIRTIO_BLK_F_RO         (1u << 5)
+#define VIRTIO_F_INDIRECT_DESC  (1u << 28)
+#define VIRTIO_F_EVENT_IDX      (1u << 29)
+#define VBLK_FEATURES           (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | \
+                                 VIRTIO_F_INDIRECT_DESC | VIRTIO_F_EVENT_IDX)
+
+/* Device config */
+#define VBLK_CFG_CAPACITY       0x00    // 64-bit, in 512-byte sectors
+#define VBLK_CFG_SIZE_MAX       0x08
+#define VBLK_CFG_SEG_MAX        0x0C
+
+#define VRING_DESC_F_NEXT       1
+#define VRING_DESC_F_WRITE      2       // Device writes this buffer
+#define VRING_DESC_F_INDIRECT   4
+#define VRING_USED_F_NO_NOTIFY  1
+
+#define VBLK_T_IN               0
+#define VBLK_T_OUT              1
+#define VBLK_S_OK               0
+
+#define VBLK_SLOT_STATUS        16      // Offsets in a slot page
+#define VBLK_SLOT_TABLE         64
+#define VBLK_INDIRECT           ((PMM_PAGE_SIZE - VBLK_SLOT_TABLE) / 16)
+#define VBLK_PHYS_LIMIT         0x08000000  // Frames above 128MB are not identity-mapped
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    volatile uint16_t idx;
+    uint16_t ring[];            // Followed by used_event
+} vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct {
+    volatile uint16_t flags;
+    volatile uint16_t idx;
+    vring_used_elem_t ring[];   // Followed by avail_event
+} vring_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) vblk_header_t;
+
+// Like an AHCI slot: a request too big for one command is issued again
+// from the same slot until it is done
+typedef struct {
+    blk_request_t *req;
+    bio_t *bio;                 // Cursor: where the next command starts
+    uint32_t bio_off;
+    uint32_t done;              // Sectors of req finished
+    uint32_t sectors;           // Size of the command in flight
+    uint8_t *page;              // Header, status and indirect table
+} vblk_slot_t;
+
+typedef struct {
+    uint16_t io;
+    uint16_t size;              // Ring entries
+    vring_desc_t *desc;
+    vring_avail_t *avail;
+    vring_used_t *used;
+    uint16_t avail_idx;         // Shadow of avail->idx
+    uint16_t kicked_idx;        // avail_idx at the last notify
+    uint16_t used_idx;          // Next used entry to look at
+    uint32_t features;
+    uint32_t seg_max;           // Data segments per command
+    uint32_t size_max;          // Bytes per segment
+    uint32_t per_slot;          // Ring descriptors per slot (1 with indirect)
+    uint32_t slots;
+    uint32_t pending;           // Commands at the device
+    vblk_slot_t slot[VBLK_DEPTH];
+    blk_device_t blk;
+    char name[4];
+} vblk_t;
+
+static vblk_t vblk_disks[VBLK_MAX_DISKS];
+static uint32_t vblk_count = 0;
+
+static inline void vblk_mb(void) {
+    __sync_synchronize();
+}
+
+static inline uint16_t *vblk_used_event(vblk_t *vb) {
+    return &vb->avail->ring[vb->size];
+}
+
+static inline volatile uint16_t *vblk_avail_event(vblk_t *vb) {
+    return (volatile uint16_t*)&vb->used->ring[vb->size];
+}
+
+// Describe data from the slot's cursor into d[], at most 'limit' entries.
+// Stops on a sector boundary; returns the entry count, -1 if unmapped.
+static int vblk_map(vblk_t *vb, vblk_slot_t *s, vring_desc_t *d, uint32_t limit, uint32_t *sectors) {
+    bio_t *bio = s->bio;
+    uint32_t off = s->bio_off * BLK_SECTOR_SIZE;
+    uint32_t want = (s->req->count - s->done) * BLK_SECTOR_SIZE;
+    uint32_t bytes = 0;
+    uint32_t n = 0;
+
+    while (bytes < want && bio) {
+        uint32_t phys = vmm_virt_to_phys(bio->pd, bio->buffer + off);
+        if (!phys) return -1;
+
+        uint32_t len = PMM_PAGE_SIZE - (phys & (PMM_PAGE_SIZE - 1));
+        if (len > bio->count * BLK_SECTOR_SIZE - off) len = bio->count * BLK_SECTOR_SIZE - off;
+        if (len > want - bytes) len = want - bytes;
+        if (len > vb->size_max) len = vb->size_max;
+
+        if (n && d[n - 1].addr + d[n - 1].len == phys && d[n - 1].len + len <= vb->size_max) {
+            d[n - 1].len += len;
+        } else {
+            if (n == limit) break;
+            d[n].addr = phys;
+            d[n].len = len;
+            n++;
+        }
+        bytes += len;
+        off += len;
+        if (off == bio->count * BLK_SECTOR_SIZE) {
+            bio = bio->next;
+            off = 0;
+        }
+    }
+
+    // Out of entries mid-sector: give the partial sector back
+    uint32_t excess = bytes % BLK_SECTOR_SIZE;
+    while (excess) {
+        if (d[n - 1].len <= excess) {
+            excess -= d[n - 1].len;
+            bytes -= d[n - 1].len;
+            n--;
+        } else {
+            d[n - 1].len -= excess;
+            bytes -= excess;
+            excess = 0;
+        }
+    }
+    *sectors = bytes / BLK_SECTOR_SIZE;
+    return (int)n;
+}
+
+// Build the slot's next command and publish it in the avail ring. The
+// device is not told; vblk_kick() does that for the whole batch.
+static int vblk_issue(vblk_t *vb, uint32_t index) {
+    vblk_slot_t *s = &vb->slot[index];
+    blk_request_t *req = s->req;
+    uint32_t head = index * vb->per_slot;
+    int indirect = vb->per_slot == 1;
+
+    // Chain: header, data..., status; 'next' indexes this chain's table
+    vring_desc_t *d = indirect ? (vring_desc_t*)(s->page + VBLK_SLOT_TABLE) : &vb->desc[head];
+    uint32_t base = indirect ? 0 : head;
+    uint32_t limit = (indirect ? VBLK_INDIRECT : vb->per_slot) - 2;
+    if (limit > vb->seg_max) limit = vb->seg_max;
+
+    uint32_t sectors;
+    int n = vblk_map(vb, s, &d[1], limit, &sectors);
+    if (n <= 0 || sectors == 0) return -1;
+
+    vblk_header_t *hdr = (vblk_header_t*)s->page;
+    hdr->type = req->write ? VBLK_T_OUT : VBLK_T_IN;
+    hdr->reserved = 0;
+    hdr->sector = req->lba + s->done;
+    s->page[VBLK_SLOT_STATUS] = 0xFF;
+
+    d[0].addr = (uint32_t)hdr;
+    d[0].len = sizeof(vblk_header_t);
+    d[0].flags = VRING_DESC_F_NEXT;
+    d[0].next = (uint16_t)(base + 1);
+    for (int i = 1; i <= n; i++) {
+        d[i].flags = VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE);
+        d[i].next = (uint16_t)(base + i + 1);
+    }
+    d[n + 1].addr = (uint32_t)(s->page + VBLK_SLOT_STATUS);
+    d[n + 1].len = 1;
+    d[n + 1].flags = VRING_DESC_F_WRITE;
+    d[n + 1].next = 0;
+
+    if (indirect) {
+        vb->desc[head].addr = (uint32_t)d;
+        vb->desc[head].len = (n + 2) * sizeof(vring_desc_t);
+        vb->desc[head].flags = VRING_DESC_F_INDIRECT;
+        vb->desc[head].next = 0;
+    }
+
+    s->sectors = sectors;
+    vb->avail->ring[vb->avail_idx % vb->size] = (uint16_t)head;
+    vb->avail_idx++;
+    vblk_mb();
+    vb->avail->idx = vb->avail_idx;
+    vb->pending++;
+    return 0;
+}
+
+// Notify the device of everything published since the last kick, unless
+// it said it does not need it (it is still working through the ring)
+static void vblk_kick(vblk_t *vb) {
+    if (vb->avail_idx == vb->kicked_idx) return;
+    vblk_mb();
+
+    int notify;
+    if (vb->features & VIRTIO_F_EVENT_IDX) {
+        uint16_t event = *vblk_avail_event(vb);
+        notify = (uint16_t)(vb->avail_idx - event - 1) < (uint16_t)(vb->avail_idx - vb->kicked_idx);
+    } else {
+        notify = !(vb->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    vb->kicked_idx = vb->avail_idx;
+    if (notify) outw(vb->io + VIRTIO_QUEUE_NOTIFY, 0);
+}
+
+static void vblk_advance(vblk_slot_t *s, uint32_t sectors) {
+    s->done += sectors;
+    while (sectors > 0 && s->bio) {
+        uint32_t take = s->bio->count - s->bio_off;
+        if (take > sectors) take = sectors;
+        s->bio_off += take;
+        sectors -= take;
+        if (s->bio_off == s->bio->count) {
+            s->bio = s->bio->next;
+            s->bio_off = 0;
+        }
+    }
+}
+
+static void vblk_finish(vblk_t *vb, vblk_slot_t *s, int error) {
+    blk_request_t *req = s->req;
+    s->req = 0;
+    blk_end_request(&vb->blk, req, error);
+}
+
+// Drain the used ring, then ask for the next interrupt only after
+// min(pending, VBLK_COALESCE) more completions
+static void vblk_complete(vblk_t *vb) {
+    for (;;) {
+        while (vb->used_idx != vb->used->idx) {
+            vblk_mb();
+            uint32_t id = vb->used->ring[vb->used_idx % vb->size].id;
+            vb->used_idx++;
+            vb->pending--;
+
+            vblk_slot_t *s = &vb->slot[id / vb->per_slot];
+            if (!s->req) continue;
+            if (s->page[VBLK_SLOT_STATUS] != VBLK_S_OK) {
+                vblk_finish(vb, s, 1);
+                continue;
+            }
+            vblk_advance(s, s->sectors);
+            if (s->done < s->req->count) {
+                if (vblk_issue(vb, id / vb->per_slot) != 0) vblk_finish(vb, s, 1);
+            } else {
+                vblk_finish(vb, s, 0);
+            }
+        }
+        vblk_kick(vb); // Follow-up commands of split requests
+
+        if (!(vb->features & VIRTIO_F_EVENT_IDX)) break;
+        uint32_t batch = vb->pending < VBLK_COALESCE ? vb->pending : VBLK_COALESCE;
+        *vblk_used_event(vb) = (uint16_t)(vb->used_idx + (batch ? batch - 1 : 0));
+        vblk_mb();
+        if (vb->used_idx == vb->used->idx) break; // Nothing slipped in meanwhile
+    }
+}
+
+static void vblk_irq(registers_t *regs) {
+    (void)regs;
+    for (uint32_t i = 0; i < vblk_count; i++) {
+        // Reading the ISR acknowledges it; zero means the shared line was not us
+        if (inb(vblk_disks[i].io + VIRTIO_ISR) & VIRTIO_ISR_QUEUE) vblk_complete(&vblk_disks[i]);
+    }
+}
+
+static void vblk_poll(blk_device_t *dev) {
+    vblk_complete((vblk_t*)dev->driver_data);
+}
+
+static void vblk_commit(blk_device_t *dev) {
+    vblk_kick((vblk_t*)dev->driver_data);
+}
+
+static int vblk_start(blk_device_t *dev, blk_request_t *req) {
+    vblk_t *vb = (vblk_t*)dev->driver_data;
+    if (req->write && (vb->features & VIRTIO_BLK_F_RO)) return 1;
+
+    uint32_t index = 0;
+    while (index < vb->slots && vb->slot[index].req) index++;
+    if (index == vb->slots) return 1; // Queue depth keeps us below this
+
+    vblk_slot_t *s = &vb->slot[index];
+    s->req = req;
+    s->bio = req->bio;
+    s->bio_off = 0;
+    s->done = 0;
+    if (vblk_issue(vb, index) != 0) {
+        s->req = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// --- Setup ---
+
+static void *vblk_alloc(uint32_t pages) {
+    void *p = pmm_alloc_contiguous(pages);
+    if (!p) return 0;
+    if ((uint32_t)p + pages * PMM_PAGE_SIZE > VBLK_PHYS_LIMIT) {
+        pmm_free_contiguous(p, pages);
+        return 0;
+    }
+    memset(p, 0, pages * PMM_PAGE_SIZE);
+    return p;
+}
+
+// Legacy layout: descriptors and avail ring, then the used ring on the
+// next page boundary, all physically contiguous
+static int vblk_setup_queue(vblk_t *vb) {
+    outw(vb->io + VIRTIO_QUEUE_SELECT, 0);
+    uint16_t size = inw(vb->io + VIRTIO_QUEUE_SIZE);
+    if (size == 0 || (size & (size - 1))) return -1;
+
+    uint32_t used_off = (16 * size + 6 + 2 * size + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+    uint32_t pages = (used_off + 6 + 8 * size + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    uint8_t *ring = (uint8_t*)vblk_alloc(pages);
+    if (!ring) return -1;
+
+    vb->size = size;
+    vb->desc = (vring_desc_t*)ring;
+    vb->avail = (vring_avail_t*)(ring + 16 * size);
+    vb->used = (vring_used_t*)(ring + used_off);
+    outl(vb->io + VIRTIO_QUEUE_PFN, (uint32_t)ring / PMM_PAGE_SIZE);
+    return 0;
+}
+
+static int vblk_probe(pci_device_t *dev, const pci_device_id_t *id) {
+    (void)id;
+    if (vblk_count == VBLK_MAX_DISKS || !(dev->bars[0].flags & PCI_BAR_IO)) return -1;
+    vblk_t *vb = &vblk_disks[vblk_count];
+    memset(vb, 0, sizeof(vblk_t));
+    vb->io = (uint16_t)dev->bars[0].base;
+    pci_enable_device(dev, 1);
+
+    outb(vb->io + VIRTIO_STATUS, 0); // Reset
+    outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+    outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+    vb->features = inl(vb->io + VIRTIO_HOST_FEATURES) & VBLK_FEATURES;
+    outl(vb->io + VIRTIO_GUEST_FEATURES, vb->features);
+
+    if (vblk_setup_queue(vb) != 0) {
+        outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+        serial_write("[VIRTIO] Block queue setup failed.\n");
+        return -1;
+    }
+
+    vb->seg_max = 0xFFFFFFFF;
+    vb->size_max = 0xFFFFFFFF;
+    if (vb->features & VIRTIO_BLK_F_SEG_MAX) vb->seg_max = inl(vb->io + VIRTIO_CONFIG + VBLK_CFG_SEG_MAX);
+    if (vb->features & VIRTIO_BLK_F_SIZE_MAX) vb->size_max = inl(vb->io + VIRTIO_CONFIG + VBLK_CFG_SIZE_MAX);
+    if (vb->seg_max == 0) vb->seg_max = 1;
+    if (vb->size_max < BLK_SECTOR_SIZE) vb->size_max = BLK_SECTOR_SIZE;
+
+    // Indirect: one ring entry per request. Direct: split the ring into
+    // fixed chains, one per slot.
+    if (vb->features & VIRTIO_F_INDIRECT_DESC) {
+        vb->slots = vb->size < VBLK_DEPTH ? vb->size : VBLK_DEPTH;
+        vb->per_slot = 1;
+    } else {
+        vb->slots = vb->size / VBLK_DIRECT_DESCS;
+        if (vb->slots == 0) vb->slots = 1;
+        if (vb->slots > VBLK_DEPTH) vb->slots = VBLK_DEPTH;
+        vb->per_slot = vb->size / vb->slots;
+        if (vb->per_slot < 3) {
+            outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < vb->slots; i++) {
+        vb->slot[i].page = (uint8_t*)vblk_alloc(1);
+        if (!vb->slot[i].page) {
+            vb->slots = i;
+            break;
+        }
+    }
+    if (!vb->slots) {
+        outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+        return -1;
+    }
+
+    uint32_t cap_lo = inl(vb->io + VIRTIO_CONFIG + VBLK_CFG_CAPACITY);
+    uint32_t cap_hi = inl(vb->io + VIRTIO_CONFIG + VBLK_CFG_CAPACITY + 4);
+
+    vb->name[0] = 'v';
+    vb->name[1] = 'd';
+    vb->name[2] = (char)('a' + vblk_count);
+    vb->blk.name = vb->name;
+    vb->blk.sectors = cap_hi ? 0xFFFFFFFF : cap_lo;
+    vb->blk.max_sectors = VBLK_MAX_SECTORS;
+    vb->blk.max_bios = VBLK_MAX_BIOS;
+    vb->blk.depth = vb->slots;
+    vb->blk.start = vblk_start;
+    vb->blk.poll = vblk_poll;
+    vb->blk.commit = vblk_commit;
+    vb->blk.driver_data = vb;
+
+    // Virtio only offers MSI-X, which we do not program: use INTx. One
+    // handler serves every disk, so sharing a line between them is fine.
+    if (dev->irq_line < 16) irq_install_handler(dev->irq_line, vblk_irq);
+
+    vblk_count++;
+    outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    blk_register(&vb->blk);
+    serial_write((vb->features & VIRTIO_F_INDIRECT_DESC) ? "[VIRTIO] Block device online (indirect).\n"
+                                                         : "[VIRTIO] Block device online.\n");
+    return 0;
+}
+
+static const pci_device_id_t vblk_pci_ids[] = {
+    { VIRTIO_VENDOR, VIRTIO_DEV_BLK_LEGACY, PCI_ANY_CLASS, PCI_ANY_CLASS },
+    { 0, 0, 0, 0 }
+};
+
+static pci_driver_t vblk_pci_driver = { "virtio-blk", vblk_pci_ids, vblk_probe, 0 };
+
+void virtio_blk_init(void) {
+    pci_register_driver(&vblk_pci_driver);
+}
@@ -0,0 +1,71 @@
+#include "wait_queue.h"
+#include "process.h"
+
+extern process_t *current_process;
+
+void wait_queue_init(wait_queue_t *wq) {
+    spinlock_init(wq->lock);
+    wq->head = NULL;
+}
+
+void wait_queue_add(wait_queue_t *wq, wait_entry_t *e) {
+    uint32_t flags = spinlock_acquire_irqsave(&wq->lock);
+    e->proc = current_process;
+    e->queue = wq;
+    e->next = wq->head;
+    wq->head = e;
+    spinlock_release_irqrestore(&wq->lock, flags);
+}
+
+void wait_queue_remove(wait_entry_t *e) {
+    wait_queue_t *wq = e->queue;
+    if (!wq) return; // Never added, or queue already destroyed
+    
+    uint32_t flags = spinlock_acquire_irqsave(&wq->lock);
+    wait_entry_t **link = &wq->head;
+    while (*link) {
+        if (*link == e) {
+            *link = e->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    e->queue = NULL;
+    e->next = NULL;
+    spinlock_release_irqrestore(&wq->lock, flags);
+}
+
+void wait_queue_wake_all(wait_queue_t *wq) {
+    uint32_t flags = spinlock_acquire_irqsave(&wq->lock);
+    wait_entry_t *e = wq->head;
+    while (e) {
+        wait_entry_t *next = e->next; // Callback may not touch e->next, but be safe
+        if (e->func) e->func(e);
+        else if (e->proc) process_wake(e->proc);
+        e = next;
+    }
+    spinlock_release_irqrestore(&wq->lock, flags);
+}
+
+// Caller checked its condition with IRQs off; we sleep until any wakeup.
+void wait_queue_sleep(wait_queue_t *wq) {
+    wait_entry_t e = {0};
+    wait_queue_add(wq, &e);
+    process_block(0);
+    wait_queue_remove(&e);
+}
+
+void wait_queue_destroy(wait_queue_t *wq) {
+    uint32_t flags = spinlock_acquire_irqsave(&wq->lock);
+    wait_entry_t *e = wq->head;
+    wq->head = NULL;
+    while (e) {
+        wait_entry_t *next = e->next;
+        e->queue = NULL;
+        e->next = NULL;
+        if (e->func) e->func(e);
+        else if (e->proc) process_wake(e->proc);
+        e = next;
+    }
+    spinlock_release_irqrestore(&wq->lock, flags);
+}
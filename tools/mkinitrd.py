@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Build a packed initrd archive (format: kernel/include/initrd.h)
+#
+# usage: mkinitrd.py OUTPUT ARCHIVE_PATH=HOST_FILE [...]
+#   e.g. mkinitrd.py initrd.img bin/ls.elf=userspace/apps/ls/ls.elf
+
+import struct
+import sys
+
+MAGIC = 0x4452494D
+VERSION = 1
+ALIGN = 4096
+HEADER = struct.Struct('<IIIII')
+ENTRY = struct.Struct('<IIII')
+
+
+def align(n):
+    return (n + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: mkinitrd.py OUTPUT PATH=FILE ...")
+        return 1
+
+    files = {}
+    for arg in sys.argv[2:]:
+        path, _, host = arg.partition('=')
+        path = path.strip('/')
+        if not path or not host:
+            print("bad entry: " + arg)
+            return 1
+        with open(host, 'rb') as f:
+            files[path.encode()] = f.read()
+
+    # Bytewise order keeps each directory in one contiguous run
+    paths = sorted(files)
+
+    index_off = HEADER.size
+    strtab_off = index_off + ENTRY.size * len(paths)
+    strtab = b''.join(paths)
+    data_off = align(strtab_off + len(strtab))
+
+    entries = []
+    str_pos = strtab_off
+    pos = data_off
+    for p in paths:
+        entries.append(ENTRY.pack(str_pos, len(p), pos, len(files[p])))
+        str_pos += len(p)
+        pos = align(pos + len(files[p]))
+
+    out = bytearray(HEADER.pack(MAGIC, VERSION, len(paths), index_off, pos))
+    out += b''.join(entries)
+    out += strtab
+    for p in paths:
+        out += b'\0' * (align(len(out)) - len(out))
+        out += files[p]
+    out += b'\0' * (pos - len(out))
+
+    with open(sys.argv[1], 'wb') as f:
+        f.write(out)
+    print("initrd: %d files, %d bytes" % (len(paths), len(out)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -168,12 +168,16 @@ void handle_logic(int btn_idx) {
 }
 
 int main() {
-    create_window("Calculator", 100, 100, 240, 260);
+    int win = create_window("Calculator", 100, 100, 240, 260);
     init_buttons();
     draw_ui();
     
+    // Sleep until the window has input instead of spinning on get_event
+    struct pollfd pfd = { win_event_fd(win), POLLIN, 0 };
+    
     gui_event_t event;
     while(1) {
+        if (pfd.fd >= 0) poll(&pfd, 1, -1);
         if (get_event(&event)) {
             if (event.type == GUI_EVENT_MOUSE_DOWN) {
                 // Adjust for title bar (handled by kernel offset in SYS_DRAW_RECT but NOT key events?)
@@ -12,6 +12,11 @@
 #define O_NONBLOCK  0x0800
 #define O_BINARY    0x0000 // No effect on our OS usually
 
+// Pipe capacity limit (the ring grows on demand up to it)
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+
 int open(const char *pathname, int flags, ...);
+int fcntl(int fd, int cmd, int arg);
 
 #endif
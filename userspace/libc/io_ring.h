@@ -0,0 +1,102 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stdint.h>
+#include "syscall.h"
+
+// Submission/completion rings shared with the kernel.
+// Layout and opcodes must match kernel/include/io_ring.h.
+
+#define IORING_OP_NOP    0
+#define IORING_OP_READ   1
+#define IORING_OP_WRITE  2
+#define IORING_OP_OPEN   3
+#define IORING_OP_CLOSE  4
+#define IORING_OP_FSYNC  5
+#define IORING_OP_POLL   6
+
+#define IORING_OFF_CUR   0xFFFFFFFF
+#define IORING_ENTER_GETEVENTS 0x1
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t fd;
+    uint32_t off;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t op_flags;
+    uint32_t user_data;
+    uint32_t pad;
+} io_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    int32_t res;
+} io_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t sqes_off;
+    uint32_t cqes_off;
+    volatile uint32_t cq_overflow;
+} io_ring_hdr_t;
+
+typedef struct {
+    int fd;
+    io_ring_hdr_t *hdr;
+    io_sqe_t *sqes;
+    io_cqe_t *cqes;
+    uint32_t pending;   // SQEs queued since the last submit
+} io_ring_t;
+
+static inline int io_ring_init(io_ring_t *ring, uint32_t entries) {
+    uint32_t addr = 0;
+    ring->fd = syscall_2(SYS_IO_RING_SETUP, entries, (int)&addr);
+    if (ring->fd < 0) return -1;
+    
+    ring->hdr = (io_ring_hdr_t*)addr;
+    ring->sqes = (io_sqe_t*)(addr + ring->hdr->sqes_off);
+    ring->cqes = (io_cqe_t*)(addr + ring->hdr->cqes_off);
+    ring->pending = 0;
+    return 0;
+}
+
+// Next free SQE, or 0 if the submission ring is full
+static inline io_sqe_t *io_ring_get_sqe(io_ring_t *ring) {
+    io_ring_hdr_t *h = ring->hdr;
+    if (h->sq_tail - h->sq_head >= h->sq_entries) return 0;
+    
+    io_sqe_t *sqe = &ring->sqes[h->sq_tail & (h->sq_entries - 1)];
+    for (uint32_t i = 0; i < sizeof(io_sqe_t) / 4; i++) ((uint32_t*)sqe)[i] = 0;
+    h->sq_tail++;
+    ring->pending++;
+    return sqe;
+}
+
+// Hand queued SQEs to the kernel; optionally wait for wait_nr completions
+static inline int io_ring_submit(io_ring_t *ring, uint32_t wait_nr) {
+    int n = syscall_5(SYS_IO_RING_ENTER, ring->fd, ring->pending, wait_nr,
+                      wait_nr ? IORING_ENTER_GETEVENTS : 0, 0);
+    if (n > 0) ring->pending -= n;
+    return n;
+}
+
+// Oldest completion, or 0 if none; release it with io_ring_cqe_seen
+static inline io_cqe_t *io_ring_peek_cqe(io_ring_t *ring) {
+    io_ring_hdr_t *h = ring->hdr;
+    if (h->cq_head == h->cq_tail) return 0;
+    return &ring->cqes[h->cq_head & (h->cq_entries - 1)];
+}
+
+static inline void io_ring_cqe_seen(io_ring_t *ring) {
+    ring->hdr->cq_head++;
+}
+
+#endif
@@ -128,6 +128,60 @@ void draw_image(const uint32_t *data, int x, int y, int w, int h) {
     syscall_5(SYS_DRAW_IMAGE, (int)data, x, y, w, h);
 }
 
+#define SYS_GUI_GET_EVENT_H 111
+int win_get_event(int win, gui_event_t *event) {
+    return syscall_2(SYS_GUI_GET_EVENT_H, win, (int)event);
+}
+
+#define SYS_GUI_DRAW 112
+int win_draw(int win, const gui_draw_cmd_t *cmds, int count) {
+    return syscall_3(SYS_GUI_DRAW, win, (int)cmds, count);
+}
+
+#define SYS_GUI_DESTROY 113
+int destroy_window(int win) {
+    return syscall_1(SYS_GUI_DESTROY, win);
+}
+
+#define SYS_GUI_SURFACE 114
+uint32_t *win_surface(int win, int w, int h) {
+    return (uint32_t*)syscall_3(SYS_GUI_SURFACE, win, w, h);
+}
+
+#define SYS_GUI_COMMIT 115
+int win_commit(int win, int x, int y, int w, int h) {
+    extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
+    return syscall_5(SYS_GUI_COMMIT, win, x, y, w, h);
+}
+
+#define SYS_GUI_EVENT_FD 116
+int win_event_fd(int win) {
+    return syscall_1(SYS_GUI_EVENT_FD, win);
+}
+
+#define SYS_POLL 168
+int poll(struct pollfd *fds, unsigned int nfds, int timeout_ms) {
+    return syscall_3(SYS_POLL, (int)fds, nfds, timeout_ms);
+}
+
+#define SYS_EPOLL_CREATE 254
+#define SYS_EPOLL_CTL    255
+#define SYS_EPOLL_WAIT   256
+int epoll_create(int size) {
+    return syscall_1(SYS_EPOLL_CREATE, size);
+}
+
+// 4-argument calls go through syscall_5 with a zero 5th argument
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
+    return syscall_5(SYS_EPOLL_CTL, epfd, op, fd, (int)event, 0);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int max_events, int timeout_ms) {
+    extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
+    return syscall_5(SYS_EPOLL_WAIT, epfd, (int)events, max_events, timeout_ms, 0);
+}
+
 // File System
 #define SYS_READ      3
 #define SYS_OPEN      5
@@ -144,6 +198,11 @@ int close(int fd) {
     return syscall_1(SYS_CLOSE, fd);
 }
 
+#define SYS_FCNTL     55
+int fcntl(int fd, int cmd, int arg) {
+    return syscall_3(SYS_FCNTL, fd, cmd, arg);
+}
+
 int write(int fd, const void *buf, uint32_t count) {
     return syscall_3(SYS_WRITE, fd, (int)buf, count);
 }
@@ -157,6 +216,33 @@ int read(int fd, void *buf, uint32_t count) {
     return syscall_3(SYS_READ, fd, (int)buf, count);
 }
 
+#define SYS_READV    145
+#define SYS_WRITEV   146
+#define SYS_SENDFILE 187
+#define SYS_SPLICE   313
+#define SYS_VMSPLICE 316
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall_3(SYS_READV, fd, (int)iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall_3(SYS_WRITEV, fd, (int)iov, iovcnt);
+}
+
+int sendfile(int out_fd, int in_fd, uint32_t *offset, uint32_t count) {
+    extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
+    return syscall_5(SYS_SENDFILE, out_fd, in_fd, (int)offset, count, 0);
+}
+
+int splice(int fd_in, uint32_t *off_in, int fd_out, uint32_t *off_out, uint32_t len) {
+    extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
+    return syscall_5(SYS_SPLICE, fd_in, (int)off_in, fd_out, (int)off_out, len);
+}
+
+int vmsplice(int fd, const struct iovec *iov, int iovcnt, uint32_t flags) {
+    return syscall_4(SYS_VMSPLICE, fd, (int)iov, iovcnt, flags);
+}
+
 char getchar() {
     char c = 0;
     read(0, &c, 1);
@@ -251,6 +337,14 @@ int execve(const char *filename, char *const argv[], char *const envp[]) {
     return syscall_3(SYS_EXECVE, (uint32_t)filename, (uint32_t)argv, (uint32_t)envp);
 }
 
+int fsync(int fd) {
+    return syscall_2(SYS_FSYNC, fd, 0);
+}
+
+void sync(void) {
+    syscall_0(SYS_SYNC);
+}
+
 int pipe(int pipefd[2]) {
     return syscall_1(SYS_PIPE, (uint32_t)pipefd);
 }
@@ -60,6 +60,48 @@ void draw_rect(int x, int y, int w, int h, uint32_t color);
 void draw_text(const char *msg, int x, int y, uint32_t color);
 void draw_image(const uint32_t *data, int x, int y, int w, int h);
 
+// Handle-based GUI (handle = return value of create_window)
+typedef enum { GUI_DRAW_RECT, GUI_DRAW_TEXT, GUI_DRAW_IMAGE } gui_draw_op_t;
+typedef struct {
+    int op;             // gui_draw_op_t
+    int x, y, w, h;     // Relative to window content area
+    uint32_t color;
+    const void *data;   // Text string or ARGB pixels
+} gui_draw_cmd_t;
+
+int win_get_event(int win, gui_event_t *event);
+int win_draw(int win, const gui_draw_cmd_t *cmds, int count); // Returns commands executed
+int destroy_window(int win);
+
+// Shared surface: render straight into the returned buffer (w*h ARGB,
+// stride = w), then commit the damaged region. w/h of 0 commits everything.
+uint32_t *win_surface(int win, int w, int h);
+int win_commit(int win, int x, int y, int w, int h);
+
+// Window events as a pollable fd (read() returns whole gui_event_t records)
+int win_event_fd(int win);
+
+// Readiness multiplexing
+#define POLLIN   0x001
+#define POLLOUT  0x004
+#define POLLERR  0x008
+#define POLLHUP  0x010
+#define POLLNVAL 0x020
+struct pollfd { int fd; short events; short revents; };
+int poll(struct pollfd *fds, unsigned int nfds, int timeout_ms); // timeout < 0 = forever
+
+#define EPOLLIN  POLLIN
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+struct epoll_event { uint32_t events; uint32_t data; };
+int epoll_create(int size);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int epoll_wait(int epfd, struct epoll_event *events, int max_events, int timeout_ms);
+
 // File System
 typedef struct {
     char name[128];
@@ -80,6 +122,18 @@ int read(int fd, void *buf, uint32_t count);
 int write(int fd, const void *buf, uint32_t count);
 int pipe(int pipefd[2]);
 int dup2(int oldfd, int newfd);
+
+// Vectored / in-kernel transfers
+struct iovec { void *iov_base; uint32_t iov_len; };
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int sendfile(int out_fd, int in_fd, uint32_t *offset, uint32_t count);      // offset 0 = use file position
+int splice(int fd_in, uint32_t *off_in, int fd_out, uint32_t *off_out, uint32_t len); // One side must be a pipe
+#define SPLICE_F_MOVE 0x01  // vmsplice read end: map whole pages instead of copying
+#define SPLICE_F_GIFT 0x08  // vmsplice write end: queue whole pages by reference (copy-on-write)
+int vmsplice(int fd, const struct iovec *iov, int iovcnt, uint32_t flags);
+int fsync(int fd);
+void sync(void);
 dirent_t *readdir(int fd);
 int mkdir(const char *path, uint32_t mode);
 int unlink(const char *pathname);
@@ -30,9 +30,27 @@ extern int syscall_5(int num, int arg1, int arg2, int arg3, int arg4, int arg5);
 #define SYS_MKDIR            108
 #define SYS_DRAW_IMAGE       109
 #define SYS_CHDIR            14
+#define SYS_SYNC             36
+#define SYS_FSYNC            118
 #define SYS_PIPE 42
 #define SYS_DUP2 63
 #define SYS_AGENT_OP 110
+#define SYS_GUI_GET_EVENT_H  111
+#define SYS_GUI_DRAW         112
+#define SYS_GUI_DESTROY      113
+#define SYS_GUI_SURFACE      114
+#define SYS_GUI_COMMIT       115
+#define SYS_GUI_EVENT_FD     116
+#define SYS_READV            145
+#define SYS_WRITEV           146
+#define SYS_POLL             168
+#define SYS_SENDFILE         187
+#define SYS_EPOLL_CREATE     254
+#define SYS_EPOLL_CTL        255
+#define SYS_EPOLL_WAIT       256
+#define SYS_SPLICE           313
+#define SYS_IO_RING_SETUP    425
+#define SYS_IO_RING_ENTER    426
 
 // Helpers
 static inline void sys_exit(int code) {
@@ -148,6 +148,27 @@ void wm_add_child(gui_window_t *parent, gui_window_t *child) {
     }
 }
 
+/* Unlink a window from its WM parent (window is being destroyed) */
+void wm_unmanage_window(gui_window_t *window) {
+    if (!window || !window->wm_parent) return;
+    
+    gui_window_t **link = &window->wm_parent->wm_children;
+    while (*link) {
+        if (*link == window) {
+            *link = window->wm_next;
+            break;
+        }
+        link = &(*link)->wm_next;
+    }
+    window->wm_parent = NULL;
+    window->wm_next = NULL;
+    
+    // Reflow remaining windows
+    if (wm_root) {
+        wm_render_tree(wm_root, wm_root->base.bounds);
+    }
+}
+
 /* Handle events through the WM tree (placeholder for future enhancements) */
 void wm_handle_event(gui_window_t *node, gui_event_t *event) {
     if (!node || !event) return;